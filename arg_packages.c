@@ -233,6 +233,26 @@ int arg_packages_size(struct arg_packages *aps)
 //        n_hash_size(aps->resolved_caps);
 }
 
+/* masks if all of arguments are plain names (no wildcards), NULL otherwise */
+tn_array *arg_packages__get_names(struct arg_packages *aps)
+{
+    int i;
+
+    if (n_array_size(aps->package_masks) == 0 ||
+        n_array_size(aps->packages) || n_array_size(aps->package_lists) ||
+        n_array_size(aps->package_files) || aps->pset_virtuals)
+        return NULL;
+
+    for (i=0; i < n_array_size(aps->package_masks); i++) {
+        const char *mask = n_array_nth(aps->package_masks, i);
+
+        if (strpbrk(mask, "*?[") || *mask == '/')
+            return NULL;
+    }
+
+    return arg_packages_get_masks(aps, 0);
+}
+
 tn_array *arg_packages_get_masks(struct arg_packages *aps, int hashed)
 {
     tn_array *masks;
@@ -54,6 +54,7 @@ EXPORT int arg_packages_setup(struct arg_packages *aps, struct pm_ctx *ctx);
 int arg_packages__validate_with_stubs(struct arg_packages *aps, tn_array *stubpkgs,
                                       tn_array **resolved, int quiet);
 void arg_packages__clean_masks(struct arg_packages *aps);
+tn_array *arg_packages__get_names(struct arg_packages *aps);
 
 EXPORT int arg_packages_resolve(struct arg_packages *aps, tn_array *avpkgs,
                                 struct pkgset *ps, unsigned flags);
@@ -0,0 +1,85 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+
+#include "bloom.h"
+
+#define BLOOM_BITS_PER_ITEM  10
+#define BLOOM_NHASHES        4     /* ~1.2% false positives at 10 bits/item */
+
+struct bloom {
+    uint64_t  nbits;               /* power of 2 */
+    uint64_t  *bits;
+};
+
+struct bloom *bloom_new(size_t nitems)
+{
+    struct bloom *bf;
+    uint64_t nbits = 1024;
+
+    while (nbits < (uint64_t)nitems * BLOOM_BITS_PER_ITEM)
+        nbits <<= 1;
+
+    bf = n_malloc(sizeof(*bf));
+    bf->nbits = nbits;
+    bf->bits = n_calloc(nbits / 64, sizeof(*bf->bits));
+
+    return bf;
+}
+
+void bloom_free(struct bloom *bf)
+{
+    free(bf->bits);
+    free(bf);
+}
+
+/* FNV-1a, halves are used as double hashing's pair */
+static uint64_t hash(const char *key, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+void bloom_add(struct bloom *bf, const char *key, size_t len)
+{
+    uint64_t h = hash(key, len), h1 = h, h2 = (h >> 32) | 1;
+    int i;
+
+    for (i = 0; i < BLOOM_NHASHES; i++) {
+        uint64_t bit = (h1 + i * h2) & (bf->nbits - 1);
+        bf->bits[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+}
+
+int bloom_maybe(const struct bloom *bf, const char *key, size_t len)
+{
+    uint64_t h = hash(key, len), h1 = h, h2 = (h >> 32) | 1;
+    int i;
+
+    for (i = 0; i < BLOOM_NHASHES; i++) {
+        uint64_t bit = (h1 + i * h2) & (bf->nbits - 1);
+        if ((bf->bits[bit / 64] & ((uint64_t)1 << (bit % 64))) == 0)
+            return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,23 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifndef POLDEK_BLOOM_H
+#define POLDEK_BLOOM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* set membership with false positives only; items are never removed */
+struct bloom;
+
+struct bloom *bloom_new(size_t nitems);
+void bloom_free(struct bloom *bf);
+
+void bloom_add(struct bloom *bf, const char *key, size_t len);
+/* RET: 0 if key is surely not in, 1 if it may be */
+int bloom_maybe(const struct bloom *bf, const char *key, size_t len);
+
+#endif
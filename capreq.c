@@ -15,6 +15,7 @@
 #endif
 
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -34,7 +35,8 @@
 #define __SPLITTED   (1 << 7) /* same as __NAALLOC (runtime only flag) */
 #define __PART       (1 << 6)
 #define __NAALLOC    (1 << 7)
-#define REL_RT_FLAGS __NAALLOC
+#define __SHARED     (1 << 5) /* capreq_shared() instance (runtime only) */
+#define REL_RT_FLAGS (__NAALLOC | __SHARED)
 
 // pure rel flags
 #define capreq_relflags(c) (c->cr_relflags & REL_ALL)
@@ -45,7 +47,8 @@ static struct capreq *capreq_restore(tn_alloc *na, tn_buf_it *nbufi, int *splitt
 void capreq_free_na(tn_alloc *na, struct capreq *cr)
 {
     n_assert(cr->cr_relflags & __NAALLOC);
-    na->na_free(na, cr);
+    if ((cr->cr_relflags & __SHARED) == 0)
+        na->na_free(na, cr);
 }
 
 void capreq_free(struct capreq *cr)
@@ -106,6 +109,9 @@ int capreq_cmp_name_evr(const struct capreq *cr1, const struct capreq *cr2)
 {
     register int rc;
 
+    if (cr1 == cr2)             /* shared instances */
+        return 0;
+
     if ((rc = strcmp(capreq_name(cr1), capreq_name(cr2))))
         return rc;
 
@@ -133,6 +139,9 @@ int capreq_strcmp_evr(const struct capreq *cr1, const struct capreq *cr2)
 __inline__
 int capreq_strcmp_name_evr(const struct capreq *cr1, const struct capreq *cr2)
 {
+    if (cr1 == cr2)
+        return 0;
+
     if (cr1->name != cr2->name) {
         register int rc;
         register int maxlen = cr1->namelen;
@@ -268,9 +277,32 @@ char *capreq_str(char *str, size_t size, const struct capreq *cr)
     return NULL;
 }
 
-struct capreq *capreq_new(tn_alloc *na, const char *name, int32_t epoch,
-                          const char *version, const char *release,
-                          int32_t relflags, int32_t flags)
+/* "[E:]V[-R]" part only */
+int capreq_snprintf_evr(char *str, size_t size, const struct capreq *cr)
+{
+    int n = 0;
+
+    n_assert(size > 0);
+    *str = '\0';
+
+    if (capreq_has_epoch(cr))
+        n += n_snprintf(&str[n], size - n, "%d:", capreq_epoch(cr));
+
+    if (capreq_has_ver(cr))
+        n += n_snprintf(&str[n], size - n, "%s", capreq_ver(cr));
+
+    if (capreq_has_rel(cr)) {
+        n_assert(capreq_has_ver(cr));
+        n += n_snprintf(&str[n], size - n, "-%s", capreq_rel(cr));
+    }
+
+    return n;
+}
+
+static
+struct capreq *do_capreq_new(tn_alloc *na, const char *name, int32_t epoch,
+                             const char *version, const char *release,
+                             int32_t relflags, int32_t flags)
 {
     int name_len = 0, version_len = 0, release_len = 0;
     struct capreq *cr;
@@ -393,6 +425,222 @@ struct capreq *capreq_new(tn_alloc *na, const char *name, int32_t epoch,
     return cr;
 }
 
+/*
+  Capreqs constructed by loaders (i.e. with allocator) are hash-consed:
+  equal ones are the same, immutable instance, allocated once per process
+  in the table's own allocator. Identical requirements (/bin/sh,
+  rpmlib(...), libc.so.6(GLIBC_2.x)...) repeated across packages and
+  sources cost one object and compare equal by pointer. Runtime flags are
+  part of the identity, they are only set on construction.
+
+  Every package holds a reference to the table current at its creation;
+  capreq_shared_reset() (on reload) starts a new one, the old one is freed
+  along with the last package using it.
+*/
+struct capreq_table {
+    tn_alloc        *na;
+    struct capreq   **slots;
+    unsigned        size;       /* power of 2 */
+    unsigned        n;
+    int             nusers;     /* packages */
+};
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct capreq_table *shared_tab = NULL; /* current one */
+
+static unsigned capreq_hash(const struct capreq *cr, int bufsize)
+{
+    register unsigned h = 2166136261u; /* FNV-1a */
+    register int i;
+
+    h = (h ^ cr->cr_flags) * 16777619u;
+    h = (h ^ (cr->cr_relflags & ~REL_RT_FLAGS)) * 16777619u;
+
+    for (i=0; i < cr->namelen; i++)
+        h = (h ^ (unsigned char)cr->name[i]) * 16777619u;
+
+    for (i=0; i < bufsize; i++)
+        h = (h ^ (unsigned char)cr->_buff[i]) * 16777619u;
+
+    return h;
+}
+
+static int capreq_eq(const struct capreq *cr1, const struct capreq *cr2,
+                     int bufsize)
+{
+    return cr1->cr_flags == cr2->cr_flags &&
+        (cr1->cr_relflags & ~REL_RT_FLAGS) == (cr2->cr_relflags & ~REL_RT_FLAGS) &&
+        cr1->cr_ep_ofs == cr2->cr_ep_ofs &&
+        cr1->cr_ver_ofs == cr2->cr_ver_ofs &&
+        cr1->cr_rel_ofs == cr2->cr_rel_ofs &&
+        cr1->namelen == cr2->namelen &&
+        memcmp(cr1->name, cr2->name, cr1->namelen) == 0 &&
+        memcmp(cr1->_buff, cr2->_buff, bufsize) == 0;
+}
+
+static struct capreq_table *shared_tab_new(void)
+{
+    struct capreq_table *tab = n_calloc(1, sizeof(*tab));
+
+    tab->na = n_alloc_new(64, TN_ALLOC_OBSTACK);
+    return tab;
+}
+
+static void shared_tab_free(struct capreq_table *tab)
+{
+    n_alloc_free(tab->na);
+    free(tab->slots);
+    free(tab);
+}
+
+static void shared_tab_grow(struct capreq_table *tab)
+{
+    struct capreq **slots;
+    unsigned size, i;
+
+    size = tab->size ? tab->size * 2 : 16 * 1024;
+    slots = n_calloc(size, sizeof(*slots));
+
+    for (i=0; i < tab->size; i++) {
+        struct capreq *cr = tab->slots[i];
+        unsigned j;
+
+        if (cr == NULL)
+            continue;
+
+        j = capreq_hash(cr, capreq_bufsize(cr)) & (size - 1);
+        while (slots[j])
+            j = (j + 1) & (size - 1);
+        slots[j] = cr;
+    }
+
+    free(tab->slots);
+    tab->slots = slots;
+    tab->size = size;
+}
+
+/* RET: shared instance equal to cr, cr itself is left untouched */
+static struct capreq *capreq_shared(const struct capreq *cr)
+{
+    struct capreq_table *tab;
+    struct capreq *scr;
+    int bufsize;
+    unsigned h, i;
+
+    bufsize = capreq_bufsize(cr);
+    h = capreq_hash(cr, bufsize);
+
+    pthread_mutex_lock(&shared_lock);
+
+    if (shared_tab == NULL)
+        shared_tab = shared_tab_new();
+    tab = shared_tab;
+
+    if (tab->n * 10 >= tab->size * 7)
+        shared_tab_grow(tab);
+
+    i = h & (tab->size - 1);
+    while ((scr = tab->slots[i])) {
+        if (capreq_eq(scr, cr, bufsize))
+            goto l_end;
+
+        i = (i + 1) & (tab->size - 1);
+    }
+
+    scr = tab->na->na_malloc(tab->na, sizeof(*scr) + bufsize);
+    memcpy(scr, cr, sizeof(*scr));
+    memcpy(scr->_buff, cr->_buff, bufsize);
+    scr->cr_relflags |= __NAALLOC | __SHARED;
+
+    if (cr->namelen > UINT8_MAX) {
+        const tn_str16 *ent = tab->na->na_alloc_str16(tab->na, cr->name, cr->namelen);
+        scr->name = ent->str;
+    } else {
+        const tn_str8 *ent = tab->na->na_alloc_str8(tab->na, cr->name, cr->namelen);
+        scr->name = ent->str;
+    }
+
+    tab->slots[i] = scr;
+    tab->n++;
+
+l_end:
+    pthread_mutex_unlock(&shared_lock);
+    return scr;
+}
+
+struct capreq_table *capreq_shared_tab_ref(void)
+{
+    struct capreq_table *tab;
+
+    pthread_mutex_lock(&shared_lock);
+
+    if (shared_tab == NULL)
+        shared_tab = shared_tab_new();
+
+    tab = shared_tab;
+    tab->nusers++;
+
+    pthread_mutex_unlock(&shared_lock);
+    return tab;
+}
+
+void capreq_shared_tab_unref(struct capreq_table *tab)
+{
+    int release = 0;
+
+    if (tab == NULL)
+        return;
+
+    pthread_mutex_lock(&shared_lock);
+    n_assert(tab->nusers > 0);
+
+    if (--tab->nusers == 0 && tab != shared_tab)
+        release = 1;            /* replaced by capreq_shared_reset() */
+
+    pthread_mutex_unlock(&shared_lock);
+
+    if (release)
+        shared_tab_free(tab);
+}
+
+void capreq_shared_reset(void)
+{
+    struct capreq_table *tab;
+
+    pthread_mutex_lock(&shared_lock);
+
+    tab = shared_tab;
+    shared_tab = NULL;
+
+    if (tab && tab->nusers > 0) /* freed by its last package */
+        tab = NULL;
+
+    pthread_mutex_unlock(&shared_lock);
+
+    if (tab)
+        shared_tab_free(tab);
+}
+
+struct capreq *capreq_new(tn_alloc *na, const char *name, int32_t epoch,
+                          const char *version, const char *release,
+                          int32_t relflags, int32_t flags)
+{
+    struct capreq *cr, *scr;
+
+    if (na == NULL)
+        return do_capreq_new(NULL, name, epoch, version, release, relflags, flags);
+
+    /* built aside and shared */
+    cr = do_capreq_new(NULL, name, epoch, version, release, relflags, flags);
+    if (cr == NULL)
+        return NULL;
+
+    scr = capreq_shared(cr);
+    free(cr);
+
+    return scr;
+}
+
 struct capreq *capreq_new_evr(tn_alloc *na, const char *name, char *evr,
                               int32_t relflags, int32_t flags)
 {
@@ -551,22 +799,11 @@ static int capreq_store(struct capreq *cr, tn_buf *nbuf)
     uint32_t size;
     uint8_t bufsize;
     uint8_t cr_buf[5];
-    uint8_t cr_flags = 0, cr_relflags = 0;
     tn_array *parts = NULL;
 
-    /* do not store runtime flags */
-    if (cr->cr_flags & CAPREQ_RT_FLAGS) {
-        cr_flags = cr->cr_flags;
-        cr->cr_flags &= ~CAPREQ_RT_FLAGS;
-    }
-
-    if (cr->cr_relflags & REL_RT_FLAGS) {
-        cr_relflags = cr->cr_relflags;
-        cr->cr_relflags &= ~REL_RT_FLAGS;
-    }
-
-    cr_buf[0] = cr->cr_relflags;
-    cr_buf[1] = cr->cr_flags;
+    /* do not store runtime flags; cr is not modified, it may be shared */
+    cr_buf[0] = cr->cr_relflags & ~REL_RT_FLAGS;
+    cr_buf[1] = cr->cr_flags & ~CAPREQ_RT_FLAGS;
     cr_buf[2] = cr->cr_ep_ofs;
     cr_buf[3] = cr->cr_ver_ofs;
     cr_buf[4] = cr->cr_rel_ofs;
@@ -605,26 +842,19 @@ static int capreq_store(struct capreq *cr, tn_buf *nbuf)
     n_buf_add(nbuf, cr_name, cr_namelen);
 
     if (bufsize) {          /* versioned? */
-        int32_t epoch = 0;
-
-        if (cr->cr_ep_ofs) {
-            epoch = capreq_epoch(cr);
-            int32_t nepoch = n_hton32(epoch);
-            memcpy(&cr->_buff[cr->cr_ep_ofs], &nepoch, sizeof(nepoch));
-        }
+        if (cr->cr_ep_ofs == 0) {
+            n_buf_add(nbuf, cr->_buff, bufsize);
 
-        n_buf_add(nbuf, cr->_buff, bufsize);
+        } else {                /* epoch in network byte order */
+            int32_t nepoch = n_hton32(capreq_epoch(cr));
+            int ofs = cr->cr_ep_ofs + sizeof(nepoch);
 
-        if (cr->cr_ep_ofs)      /* restore epoch */
-            memcpy(&cr->_buff[cr->cr_ep_ofs], &epoch, sizeof(epoch));
+            n_buf_add(nbuf, cr->_buff, cr->cr_ep_ofs);
+            n_buf_add(nbuf, &nepoch, sizeof(nepoch));
+            n_buf_add(nbuf, &cr->_buff[ofs], bufsize - ofs);
+        }
     }
 
-    if (cr_flags)
-        cr->cr_flags = cr_flags;
-
-    if (cr_relflags)
-        cr->cr_relflags = cr_relflags;
-
     if (parts) {
         for (i = 0; i < n_array_size(parts); i++) {
             struct capreq *cap = n_array_nth(parts, i);
@@ -645,6 +875,7 @@ static struct capreq *capreq_restore_na(tn_alloc *na, tn_buf_it *nbufi, int *spl
     uint8_t phcr_buf[5];          /* placeholder,  for sizeof */
     unsigned char *p, *name = NULL;
     size_t name_len = 0;
+    int shared;
 
     n_buf_it_get_int8(nbufi, &size);
 
@@ -672,7 +903,12 @@ static struct capreq *capreq_restore_na(tn_alloc *na, tn_buf_it *nbufi, int *spl
         size = 0;
     }
 
-    cr = na->na_malloc(na, sizeof(*cr) + size + 1);
+    /* names of splitted ones are completed by restore_parts() */
+    shared = (cr_buf[0] & (__SPLITTED | __PART)) == 0;
+    if (shared)
+        cr = alloca(sizeof(*cr) + size + 1);
+    else
+        cr = na->na_malloc(na, sizeof(*cr) + size + 1);
 
     cr->cr_relflags = cr_buf[0];
 
@@ -698,7 +934,11 @@ static struct capreq *capreq_restore_na(tn_alloc *na, tn_buf_it *nbufi, int *spl
     cr->cr_ver_ofs  = cr_buf[3];
     cr->cr_rel_ofs  = cr_buf[4];
 
-    if (name_len > UINT8_MAX) {
+    if (shared) {
+        cr->name = (const char *)name;
+        cr->namelen = name_len;
+
+    } else if (name_len > UINT8_MAX) {
         const tn_str16 *ent = na->na_alloc_str16(na, (const char *)name, name_len);
         n_assert(name_len == ent->len);
         cr->name = ent->str;
@@ -722,6 +962,9 @@ static struct capreq *capreq_restore_na(tn_alloc *na, tn_buf_it *nbufi, int *spl
     }
     DBGF("cr %s\n", capreq_snprintf_s(cr));
 
+    if (shared)
+        return capreq_shared(cr);
+
 	//printf("cr %s: %d, %d, %d, %d, %d\n", capreq_snprintf_s(cr),
 	//cr_bufp[0], cr_bufp[1], cr_bufp[2], cr_bufp[3], cr_bufp[4]);
     //printf("REST* %s %d -> %d\n", capreq_snprintf_s(cr),
@@ -132,6 +132,14 @@ EXPORT struct capreq *capreq_new(tn_alloc *na, const char *name, int32_t epoch,
 EXPORT void capreq_free_na(tn_alloc *na, struct capreq *cr);
 EXPORT void capreq_free(struct capreq *cr);
 
+/* table of shared capreqs (see capreq.c), referenced by packages */
+struct capreq_table;
+struct capreq_table *capreq_shared_tab_ref(void);
+void capreq_shared_tab_unref(struct capreq_table *tab);
+/* next capreqs go to a new table, the current one is freed with its
+   last package */
+void capreq_shared_reset(void);
+
 EXPORT struct capreq *capreq_clone(tn_alloc *na, const struct capreq *cr);
 
 EXPORT int capreq_strcmp_evr(const struct capreq *pr1, const struct capreq *pr2);
@@ -156,6 +164,7 @@ EXPORT int capreq_arr_restore_skip_st(tn_stream *st);
 
 EXPORT int capreq_snprintf(char *str, size_t size, const struct capreq *cr);
 EXPORT char *capreq_str(char *str, size_t size, const struct capreq *cr);
+EXPORT int capreq_snprintf_evr(char *str, size_t size, const struct capreq *cr);
 
 /* const char *capreq_stra(struct capreq *) */
 #define __CAPREQ_BUF_SIZE 512
@@ -345,3 +345,19 @@ struct capreq_idx_ent *capreq_idx_lookup(struct capreq_idx *idx,
 
     return ent;
 }
+
+int capreq_idx_get(const struct capreq_idx *idx, const char *capname,
+                   int capname_len, struct pkg *const **pkgs)
+{
+    struct capreq_idx_ent *ent;
+    unsigned hash = n_oash_compute_hash(idx->ht, capname, capname_len);
+
+    if ((ent = n_oash_hget(idx->ht, capname, capname_len, hash)) == NULL)
+        return 0;
+
+    if (ent->items == 0)
+        return 0;
+
+    *pkgs = ent->_size == 1 ? &ent->pkg : ent->pkgs;
+    return ent->items;
+}
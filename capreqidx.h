@@ -49,4 +49,9 @@ void capreq_idx_remove(struct capreq_idx *idx, const char *capname,
 const struct capreq_idx_ent *capreq_idx_lookup(struct capreq_idx *idx,
                                                const char *capname, int capname_len);
 
+/* as above, but does not touch the entry, i.e. is safe for concurrent
+   readers; RET: number of packages pointed by *pkgs */
+int capreq_idx_get(const struct capreq_idx *idx, const char *capname,
+                   int capname_len, struct pkg *const **pkgs);
+
 #endif /* POLDEK_CAPREQIDX_H */
@@ -692,6 +692,32 @@ struct pkg_dent *load_available(struct poclidek_ctx *cctx)
     return dir;
 }
 
+/* replaces available packages if underlying indexes were changed */
+int poclidek__reload_available(struct poclidek_ctx *cctx)
+{
+    tn_array *pkgs;
+    int rc;
+
+    if ((cctx->_flags & POLDEKCLI_LOADED_AVAILABLE) == 0)
+        return 0;
+
+    if ((rc = poldek_reload_sources(cctx->ctx, 0)) <= 0)
+        return rc;
+
+    if ((pkgs = poldek_get_avail_packages(cctx->ctx)) == NULL)
+        return -1;
+
+    n_array_ctl_set_cmpfn(pkgs, (tn_fn_cmp)pkg_nvr_strcmp);
+    poclidek_dent_setup(cctx, POCLIDEK_AVAILDIR, pkgs, 1);
+    n_array_sort(pkgs);
+
+    if (cctx->pkgs_available)
+        n_array_free((tn_array*)cctx->pkgs_available);
+    cctx->pkgs_available = pkgs;
+
+    return 1;
+}
+
 static int load_installed(struct poclidek_ctx *cctx, int flags)
 {
 
@@ -796,14 +822,17 @@ static char **a_argv_to_argv(tn_array *a_argv, char **argv)
     return argv;
 }
 
-/* executes command chain (a pipeline) */
+/* runs ent's command once, with pipe_left content as its arguments;
+   *runit is cleared if there was nothing to run it on */
 static
-int poclidek_exec_cmd_ent(struct poclidek_ctx *cctx, struct poldek_ts *ts,
-                          struct cmd_chain_ent *ent, struct cmd_pipe *cmd_pipe)
+int exec_cmd_ent(struct poclidek_ctx *cctx, struct poldek_ts *ts,
+                 struct cmd_chain_ent *ent, struct cmd_pipe *pipe_left,
+                 int *runit)
 {
     struct cmdctx  cmdctx;
+    tn_array *pipe_args = NULL;
     char **argv;
-    int rc = 0, runit = 1;
+    int rc = 0, argc, i;
 
     DBGF("ent %s, %d, %p\n", ent->cmd->name, n_array_size(ent->a_argv),
          ent->next_piped);
@@ -816,60 +845,139 @@ int poclidek_exec_cmd_ent(struct poclidek_ctx *cctx, struct poldek_ts *ts,
     memset(&cmdctx, 0, sizeof(cmdctx));
     cmdctx.cmd = ent->cmd;
     cmdctx.cctx = cctx;
+    cmdctx.pipe_left = pipe_left;     /* | cmd */
+    cmdctx.pipe_right = ent->pipe_right;
 
     if ((cmdctx.ts = ts) == NULL)
         cmdctx.ts = poldek_ts_new(cctx->ctx, 0);
 
-    if (ent->next_piped) {
-        ent->pipe_right = cmd_pipe_new();
-        cmdctx.pipe_right = ent->pipe_right;
+    if (pipe_left && (ent->cmd->flags & COMMAND_PIPE_XARGS)) {
+        if (ent->cmd->flags & COMMAND_PIPE_PACKAGES)
+            pipe_args = cmd_pipe_xargs(pipe_left, CMD_PIPE_CTX_PACKAGES);
+        else
+            pipe_args = cmd_pipe_xargs(pipe_left, CMD_PIPE_CTX_ASCII);
 
-    } else if (cmd_pipe) {
-        DBGF("piped %s\n", ent->cmd->name);
-        ent->pipe_right = cmd_pipe_link(cmd_pipe);
-        cmdctx.pipe_right = ent->pipe_right;
+        if (pipe_args == NULL) {
+            *runit = 0;      /* do not execute command if pipe is empty */
+            rc = 0;
+            goto l_end;
+        }
     }
 
-    if (ent->prev_piped) {      /* | cmd */
-        struct cmd_pipe *pipe;
-        tn_array *pipe_args = NULL;
+    /* ent may be run several times (streaming), so its argv stays intact */
+    argc = n_array_size(ent->a_argv);
+    if (pipe_args)
+        argc += n_array_size(pipe_args);
 
-        pipe = ent->prev_piped->pipe_right;
-        ent->prev_piped->pipe_right = NULL;
+    argv = n_malloc((argc + 1) * sizeof(*argv));
+    a_argv_to_argv(ent->a_argv, argv);
 
-        cmdctx.pipe_left = pipe;
+    for (i = 0; pipe_args && i < n_array_size(pipe_args); i++)
+        argv[n_array_size(ent->a_argv) + i] = n_array_nth(pipe_args, i);
+    argv[argc] = NULL;
 
-        if (ent->cmd->flags & COMMAND_PIPE_XARGS) {
-            if (ent->cmd->flags & COMMAND_PIPE_PACKAGES)
-                pipe_args = cmd_pipe_xargs(pipe, CMD_PIPE_CTX_PACKAGES);
-            else
-                pipe_args = cmd_pipe_xargs(pipe, CMD_PIPE_CTX_ASCII);
+    rc = do_exec_cmd_ent(&cmdctx, argc, argv);
+    free(argv);
 
-            if (pipe_args == NULL) {
-                runit = 0;      /* do not execute command if pipe is empty */
-                rc = 0;
-                goto l_end;
+ l_end:
+    n_array_cfree(&pipe_args);
 
-            } else {
-                while (n_array_size(pipe_args))
-                    n_array_push(ent->a_argv, n_array_shift(pipe_args));
-                n_array_free(pipe_args);
-            }
+    if (ts == NULL)
+        poldek_ts_free(cmdctx.ts);
+
+    return rc;
+}
+
+#define PIPE_STREAM_BATCH 128   /* packages passed to streamed cmd at once */
+
+struct pipe_stage {
+    struct poclidek_ctx  *cctx;
+    struct poldek_ts     *ts;
+    struct cmd_chain_ent *ent;
+    int                  nruns;
+    int                  rc;
+};
+
+/* is ent run on chunks of its left pipe, while left side produces them? */
+static int is_streamed(const struct cmd_chain_ent *ent)
+{
+    unsigned flags = COMMAND_PIPE_STREAM | COMMAND_PIPE_XARGS;
+
+    return ent->prev_piped && (ent->cmd->flags & flags) == flags;
+}
+
+static int stream_consumer(struct cmd_pipe *pipe, void *arg)
+{
+    struct pipe_stage *st = arg;
+    int rc, runit = 1;
+
+    rc = exec_cmd_ent(st->cctx, st->ts, st->ent, pipe, &runit);
+    if (runit) {
+        st->rc = st->nruns ? (st->rc && rc) : rc;
+        st->nruns++;
+    }
+
+    return rc;
+}
+
+/* executes command chain (a pipeline) */
+static
+int poclidek_exec_cmd_ent(struct poclidek_ctx *cctx, struct poldek_ts *ts,
+                          struct cmd_chain_ent *ent, struct cmd_pipe *cmd_pipe)
+{
+    struct pipe_stage *stages;
+    struct cmd_chain_ent *e;
+    int rc = 0, n = 0, i;
+
+    for (e = ent; e; e = e->next_piped)
+        n++;
+
+    stages = alloca(n * sizeof(*stages));
+    memset(stages, 0, n * sizeof(*stages));
+
+    /* pipes are set up first, streamed stages are run by their producers */
+    for (i = 0, e = ent; e; e = e->next_piped, i++) {
+        stages[i].cctx = cctx;
+        stages[i].ts = ts;
+        stages[i].ent = e;
+
+        if (e->next_piped) {
+            e->pipe_right = cmd_pipe_new();
+
+            if (is_streamed(e->next_piped))
+                cmd_pipe_set_consumer(e->pipe_right, stream_consumer,
+                                      &stages[i + 1], PIPE_STREAM_BATCH);
+
+        } else if (cmd_pipe) {
+            DBGF("piped %s\n", e->cmd->name);
+            e->pipe_right = cmd_pipe_link(cmd_pipe);
         }
     }
 
+    for (i = 0, e = ent; e; e = e->next_piped, i++) {
+        if (!is_streamed(e)) {
+            int runit = 1;
 
-    argv = alloca((n_array_size(ent->a_argv) + 1) * sizeof(*argv));
-    a_argv_to_argv(ent->a_argv, argv);
+            rc = exec_cmd_ent(cctx, ts, e, e->prev_piped ? e->prev_piped->pipe_right : NULL,
+                              &runit);
+            if (!runit)
+                break;
 
-    rc = do_exec_cmd_ent(&cmdctx, n_array_size(ent->a_argv), argv);
+        } else {                /* fed by left side already */
+            if (stages[i].nruns == 0) {
+                rc = 0;
+                break;
+            }
+            rc = stages[i].rc;
+        }
 
- l_end:
-    if (ts == NULL)
-        poldek_ts_free(cmdctx.ts);
+        /* the rest of its output to streamed right side */
+        if (e->next_piped && is_streamed(e->next_piped))
+            cmd_pipe_flush(e->pipe_right);
 
-    if (runit && ent->next_piped)
-        return poclidek_exec_cmd_ent(cctx, ts, ent->next_piped, cmd_pipe);
+        if (sigint_reached())
+            break;
+    }
 
     return rc;
 }
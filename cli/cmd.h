@@ -77,6 +77,8 @@ EXPORT int cmdctx_printf_c(struct cmdctx *cmdctx, int color, const char *fmt, ..
 
 #define COMMAND_PIPE_XARGS     (1 << 22) /* cmd treats pipe content as arguments */
 #define COMMAND_PIPE_PACKAGES  (1 << 23) /* cmd treats pipe content as packages */
+#define COMMAND_PIPE_STREAM    (1 << 24) /* cmd may be run on pipe content in
+                                            chunks, while left side produces */
 
 #define COMMAND_PIPE_DEFAULTS  COMMAND_PIPEABLE | COMMAND_PIPE_XARGS | \
                                COMMAND_PIPE_PACKAGES
@@ -63,9 +63,61 @@ struct cmd_pipe *cmd_pipe_link(struct cmd_pipe *p)
 
 
 
+static void cmd_pipe_reset(struct cmd_pipe *p)
+{
+    n_array_clean(p->pkgs);
+    p->nread_pkgs = 0;
+
+    n_buf_clean(p->nbuf);
+    n_buf_it_init(&p->nbuf_it, p->nbuf);
+    p->nwritten = 0;
+}
+
+void cmd_pipe_set_consumer(struct cmd_pipe *p,
+                           int (*consumer)(struct cmd_pipe *p, void *arg),
+                           void *arg, int batch_size)
+{
+    n_assert(batch_size > 0);
+
+    p->consumer = consumer;
+    p->consumer_arg = arg;
+    p->batch_size = batch_size;
+}
+
+int cmd_pipe_flush(struct cmd_pipe *p)
+{
+    int npkgs, rc = 1;
+
+    if (p->consumer == NULL || p->in_consumer)
+        return 1;
+
+    npkgs = n_array_size(p->pkgs);
+
+    /* text is used only if there are no packages at all (cmd_pipe_xargs()),
+       so it is gone if some were passed already */
+    if (npkgs == 0 && (p->npkgs_passed > 0 || n_buf_size(p->nbuf) == 0))
+        goto l_end;
+
+    if (sigint_reached())       /* stop feeding consumer */
+        goto l_end;
+
+    p->in_consumer = 1;
+    rc = p->consumer(p, p->consumer_arg);
+    p->in_consumer = 0;
+    p->npkgs_passed += npkgs;
+
+ l_end:
+    cmd_pipe_reset(p);
+    return rc;
+}
+
 int cmd_pipe_writepkg(struct cmd_pipe *p, struct pkg *pkg)
 {
     n_array_push(p->pkgs, pkg_link(pkg));
+
+    if (p->consumer && n_array_size(p->pkgs) >= p->batch_size)
+        return cmd_pipe_flush(p);
+
     return 1;
 }
 
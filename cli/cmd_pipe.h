@@ -23,6 +23,13 @@ struct cmd_pipe {
     tn_buf   *nbuf;
     tn_buf_it nbuf_it;
     int       nwritten;
+
+    /* streaming, see cmd_pipe_set_consumer() */
+    int       (*consumer)(struct cmd_pipe *p, void *arg);
+    void      *consumer_arg;
+    int       batch_size;
+    int       npkgs_passed;     /* packages already given to consumer */
+    int       in_consumer;
 };
 
 
@@ -44,6 +51,16 @@ tn_array *cmd_pipe_xargs(struct cmd_pipe *p, int pctx);
 
 int cmd_pipe_writeout_fd(struct cmd_pipe *p, int fd);
 
+/*
+  Streaming: consumer is run on pipe content every time batch_size packages
+  are queued (and by cmd_pipe_flush() on the rest), then pipe is emptied;
+  so the right side of pipe works while the left one still produces.
+*/
+void cmd_pipe_set_consumer(struct cmd_pipe *p,
+                           int (*consumer)(struct cmd_pipe *p, void *arg),
+                           void *arg, int batch_size);
+int cmd_pipe_flush(struct cmd_pipe *p);
+
 int cmd_pipe_printf(struct cmd_pipe *p, const char *fmt, ...);
 int cmd_pipe_vprintf(struct cmd_pipe *p, const char *fmt, va_list args);
 
@@ -0,0 +1,312 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+/*
+  Resident mode: packages are loaded once and commands are executed on
+  behalf of thin clients connected via local (unix) socket.
+
+  Protocol is trivial: client sends command arguments, each terminated
+  by '\0' (so they are passed as is, without re-splitting), and shuts down
+  its writing side; server replies with "<rc>\n" followed by command output
+  and closes connection.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <trurl/trurl.h>
+#include <sigint/sigint.h>
+
+#include "compiler.h"
+#include "i18n.h"
+#include "log.h"
+#include "cli.h"
+
+#define DAEMON_MAX_REQUEST (64 * 1024)
+#define DAEMON_POLL_TIMEOUT 1000  /* ms, to check for ^C while idle */
+#define DAEMON_IO_TIMEOUT  10   /* seconds, client's I/O is not waited longer */
+
+static int mkaddr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        logn(LOGERR, _("%s: socket path too long"), path);
+        return 0;
+    }
+
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+static int write_all(int fd, const char *buf, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, buf, size);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n <= 0)
+            return 0;
+
+        buf += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+/* RET: request's arguments, NULL on error or timeout */
+static tn_array *read_request(int fd)
+{
+    tn_buf *nbuf = n_buf_new(256);
+    tn_array *args = NULL;
+    char buf[4096];
+    const char *p, *end;
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                logn(LOGERR, _("daemon: request timed out"));
+            goto l_end;
+        }
+
+        n_buf_write(nbuf, buf, n);
+        if (n_buf_size(nbuf) > DAEMON_MAX_REQUEST) {
+            logn(LOGERR, _("daemon: request too long"));
+            goto l_end;
+        }
+    }
+
+    if (n_buf_size(nbuf) == 0)
+        goto l_end;
+
+    n_buf_write(nbuf, "", 1);   /* unterminated last one */
+
+    args = n_array_new(8, free, NULL);
+    p = n_buf_ptr(nbuf);
+    end = p + n_buf_size(nbuf) - 1;
+
+    while (p < end) {
+        n_array_push(args, n_strdup(p));
+        p += strlen(p) + 1;
+    }
+
+l_end:
+    n_buf_free(nbuf);
+    return args;
+}
+
+static void set_timeouts(int fd)
+{
+    struct timeval tv;
+
+    tv.tv_sec = DAEMON_IO_TIMEOUT;
+    tv.tv_usec = 0;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0)
+        logn(LOGWARN, "daemon: setsockopt: %m");
+}
+
+/* reload what has been changed by other processes, if anything */
+static void refresh(struct poclidek_ctx *cctx)
+{
+    if (poclidek__reload_available(cctx) < 0)
+        logn(LOGERR, _("daemon: reload of available packages failed"));
+
+    if (poclidek__installed_changed(cctx)) {
+        msgn(1, _("Reloading installed packages..."));
+        poclidek_load_packages(cctx, POCLIDEK_LOAD_INSTALLED |
+                               POCLIDEK_LOAD_RELOAD);
+    }
+}
+
+static void serve(struct poclidek_ctx *cctx, int fd)
+{
+    struct poclidek_rcmd *rcmd;
+    tn_array *args;
+    const char **argv;
+    char rcbuf[32];
+    tn_buf *nbuf;
+    int rc, n, i;
+
+    set_timeouts(fd);
+
+    if ((args = read_request(fd)) == NULL)
+        return;
+
+    argv = n_malloc((n_array_size(args) + 1) * sizeof(*argv));
+    for (i=0; i < n_array_size(args); i++) {
+        argv[i] = n_array_nth(args, i);
+        msgn(2, "daemon: argv[%d] = %s", i, argv[i]);
+    }
+    argv[i] = NULL;
+
+    refresh(cctx);
+
+    rcmd = poclidek_rcmd_new(cctx, NULL);
+    rc = poclidek_rcmd_exec(rcmd, n_array_size(args), argv);
+
+    n = n_snprintf(rcbuf, sizeof(rcbuf), "%d\n", rc);
+    if (write_all(fd, rcbuf, n) && (nbuf = poclidek_rcmd_get_buf(rcmd))) {
+        write_all(fd, n_buf_ptr(nbuf), n_buf_size(nbuf));
+        n_buf_free(nbuf);
+    }
+
+    poclidek_rcmd_free(rcmd);
+    free(argv);
+    n_array_free(args);
+}
+
+int poclidek_daemon(struct poclidek_ctx *cctx, const char *sockpath)
+{
+    struct sockaddr_un addr;
+    mode_t mask;
+    int sock, rc = 0;
+
+    if (!mkaddr(&addr, sockpath))
+        return 0;
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        logn(LOGERR, "socket: %m");
+        return 0;
+    }
+
+    unlink(sockpath);           /* stale one */
+
+    mask = umask(0077);         /* for owner only */
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        logn(LOGERR, "%s: bind: %m", sockpath);
+        umask(mask);
+        close(sock);
+        return 0;
+    }
+    umask(mask);
+
+    if (listen(sock, 16) != 0) {
+        logn(LOGERR, "%s: listen: %m", sockpath);
+        goto l_end;
+    }
+
+    poclidek_setup(cctx);
+    if (!poclidek_load_packages(cctx, POCLIDEK_LOAD_ALL))
+        goto l_end;
+
+    msgn(1, _("Listening on %s..."), sockpath);
+    rc = 1;
+
+    while (!sigint_reached()) {
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        int fd, n;
+
+        /* signal() restarts accept(), so do not block in it */
+        if ((n = poll(&pfd, 1, DAEMON_POLL_TIMEOUT)) <= 0) {
+            if (n == 0 || errno == EINTR)
+                continue;
+
+            logn(LOGERR, "%s: poll: %m", sockpath);
+            break;
+        }
+
+        if ((fd = accept(sock, NULL, NULL)) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            logn(LOGERR, "%s: accept: %m", sockpath);
+            break;
+        }
+
+        serve(cctx, fd);
+        close(fd);
+    }
+
+l_end:
+    close(sock);
+    unlink(sockpath);
+    return rc;
+}
+
+int poclidek_daemon_exec(const char *sockpath, int argc, const char **argv)
+{
+    struct sockaddr_un addr;
+    char buf[4096], *p;
+    int sock, i, rc = -1, got_rc = 0;
+    ssize_t n;
+
+    if (!mkaddr(&addr, sockpath))
+        return -1;
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        logn(LOGERR, "socket: %m");
+        return -1;
+    }
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        logn(LOGERR, "%s: connect: %m", sockpath);
+        close(sock);
+        return -1;
+    }
+
+    for (i=0; i < argc; i++) {
+        if (!write_all(sock, argv[i], strlen(argv[i]) + 1)) /* with '\0' */
+            goto l_end;
+    }
+    shutdown(sock, SHUT_WR);
+
+    while ((n = read(sock, buf, sizeof(buf) - 1)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        p = buf;
+        if (!got_rc) {          /* first line is command's return code */
+            char *nl;
+
+            buf[n] = '\0';
+            if ((nl = strchr(buf, '\n')) == NULL)
+                break;
+
+            *nl = '\0';
+            rc = atoi(buf);
+            got_rc = 1;
+
+            p = nl + 1;
+            n -= p - buf;
+        }
+
+        if (n > 0)
+            fwrite(p, 1, n, stdout);
+    }
+
+    if (!got_rc)
+        logn(LOGERR, _("%s: no response from daemon"), sockpath);
+
+l_end:
+    close(sock);
+    return got_rc ? rc : -1;
+}
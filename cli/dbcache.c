@@ -200,6 +200,27 @@ static void timethis_end(int verbose_level, void *tvp, const char *prefix)
     free(tvp);
 }
 
+/* is installed packages database changed since it was loaded? */
+int poclidek__installed_changed(struct poclidek_ctx *cctx)
+{
+    char dbpath[PATH_MAX], rpmdb_path[PATH_MAX];
+    struct poldek_ts *ts = cctx->ctx->ts; /* for short */
+    time_t mtime_rpmdb;
+
+    if (cctx->dbpkgdir == NULL)
+        return 0;
+
+    if (!pm_dbpath(cctx->ctx->pmctx, dbpath, sizeof(dbpath)))
+        return 0;
+
+    if (mkrpmdb_path(rpmdb_path, sizeof(rpmdb_path), ts->rootdir,
+                     dbpath) == NULL)
+        return 0;
+
+    mtime_rpmdb = pm_dbmtime(cctx->ctx->pmctx, rpmdb_path);
+    return mtime_rpmdb > cctx->ts_dbpkgdir;
+}
+
 static
 struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload)
 {
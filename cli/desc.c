@@ -33,6 +33,7 @@
 #include "pkg.h"
 #include "pkgfl.h"
 #include "pkgu.h"
+#include "pkgprefetch.h"
 #include "capreq.h"
 #include "sigint/sigint.h"
 #include "pkgset.h"             /* struct reqpkg, TOFIX */
@@ -102,7 +103,7 @@ static struct argp_option options[] = {
 
 
 struct poclidek_cmd command_desc = {
-    COMMAND_NEEDAVAIL | COMMAND_PIPE_DEFAULTS,
+    COMMAND_NEEDAVAIL | COMMAND_PIPE_DEFAULTS | COMMAND_PIPE_STREAM,
     "desc", N_("PACKAGE..."), N_("Display packages info"),
     options, parse_opt,
     NULL, desc,
@@ -1031,7 +1032,9 @@ static void show_description(struct cmdctx *cmdctx, struct pkg *pkg, struct pkgu
 static int desc(struct cmdctx *cmdctx)
 {
     tn_array               *pkgs = NULL;
+    struct pkg_prefetch    *pf = NULL;
     int                    i, err = 0, term_width;
+    unsigned               prefetch = 0;
     const char             *pwd;
 
     pwd = poclidek_pwd(cmdctx->cctx);
@@ -1052,6 +1055,13 @@ static int desc(struct cmdctx *cmdctx)
     if (term_width < 50)
         term_width = 79 - RMARGIN;
 
+    if (cmdctx->_flags & (OPT_DESC_DESCR | OPT_DESC_CHANGELOG))
+        prefetch |= PKG_PREFETCH_UINF;
+
+    if (cmdctx->_flags & OPT_DESC_FL)
+        prefetch |= PKG_PREFETCH_FLIST;
+
+    pf = pkg_prefetch_begin(pkgs, prefetch);
 
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg *pkg;
@@ -1093,7 +1103,7 @@ static int desc(struct cmdctx *cmdctx)
     }
 
  l_end:
-
+    pkg_prefetch_end(pf);
     n_array_cfree(&pkgs);
 
     return err == 0;
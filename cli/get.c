@@ -44,7 +44,8 @@ static struct argp_option options[] = {
 };
 
 struct poclidek_cmd command_get = {
-    COMMAND_NEEDAVAIL,
+    COMMAND_NEEDAVAIL | COMMAND_PIPEABLE_LEFT | COMMAND_PIPE_XARGS |
+    COMMAND_PIPE_PACKAGES | COMMAND_PIPE_STREAM,
     "get", N_("PACKAGE..."), N_("Download packages"),
     options, parse_opt,
     NULL, get, NULL, NULL, NULL, NULL, 0, 5, 0,
@@ -27,6 +27,7 @@
 #include "log.h"
 #include "ls_queryfmt.h"
 #include "arg_packages.h"
+#include "pkgprefetch.h"
 
 static int ls(struct cmdctx *cmdctx);
 static
@@ -170,12 +171,12 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 	    cmdctx->_flags |= OPT_LS_QUERYFMT | OPT_LS_NOSTUBS;
 
 	    if (arg) {
-		struct lsqf_ent_array *array = NULL;
+		struct lsqf_prog *prog = NULL;
 
-		if ((array = lsqf_parse(arg)) == NULL)
+		if ((prog = lsqf_compile(arg)) == NULL)
 		    return EINVAL;
 
-		cmdctx->_data = array;
+		cmdctx->_data = prog;
 	    }
 
 	    break;
@@ -311,20 +312,22 @@ static tn_array *do_upgradeable(struct cmdctx *cmdctx, tn_array *ls_ents,
                 }
 
                 found = 0;
-                if ((inf = pkg_uinf(upkg)) == NULL)
-                    continue;
+                if (pkg_has_sectime(upkg)) { /* precomputed by index */
+                    found = upkg->sectime > ipkg->btime;
 
-                if (pkguinf_changelog_with_security_fixes(inf, ipkg->btime)) {
+                } else if ((inf = pkg_uinf(upkg))) {
+                    found = pkguinf_changelog_with_security_fixes(inf, ipkg->btime);
+                    pkguinf_free(inf);
+                }
+
+                if (found) {
                     char *sp;
                     if ((sp = pkg_srcfilename_s(rpkg))) {
                         n_array_push(srcpkgs, n_strdup(sp));
                         n_array_sort(srcpkgs);
                         DBGF("%s\n", sp);
                     }
-                    found = 1;
                 }
-
-                pkguinf_free(inf);
             }
         }
 
@@ -397,7 +400,7 @@ static int ls(struct cmdctx *cmdctx)
 
  l_end:
     if (cmdctx->_flags & OPT_LS_QUERYFMT) {
-	lsqf_ent_array_free(cmdctx->_data);
+	lsqf_prog_free(cmdctx->_data);
 	cmdctx->_data = NULL;
     }
 
@@ -499,6 +502,36 @@ static int print_pair(int colored, char *line, size_t size,
 }
 
 
+/* prefetch packages' data in listing order */
+static struct pkg_prefetch *ls_prefetch(const tn_array *ents, int i, int incstep,
+                                        unsigned what)
+{
+    struct pkg_prefetch *pf;
+    tn_array *pkgs;
+
+    pkgs = n_array_new(n_array_size(ents), NULL, NULL);
+    for (; i < n_array_size(ents) && i >= 0; i += incstep) {
+        struct pkg_dent *ent = n_array_nth(ents, i);
+
+        if (!pkg_dent_isdir(ent))
+            n_array_push(pkgs, ent->pkg_dent_pkg);
+    }
+
+    pf = pkg_prefetch_begin(pkgs, what);
+    n_array_free(pkgs);
+    return pf;
+}
+
+#define LS_QFBUF_SIZE  (64 * 1024)
+
+static void ls_flush_qfbuf(struct cmdctx *cmdctx, tn_buf *nbuf)
+{
+    if (n_buf_size(nbuf) > 0) {
+        cmdctx_printf(cmdctx, "%.*s", (int)n_buf_size(nbuf), (char*)n_buf_ptr(nbuf));
+        n_buf_clean(nbuf);
+    }
+}
+
 static
 int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
 {
@@ -506,7 +539,9 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
     int                  i, size, err = 0, npkgs = 0;
     register int         incstep = 0;
     int                  term_width, term_width_div2;
-    unsigned             flags;
+    unsigned             flags, prefetch = 0;
+    struct pkg_prefetch  *pf = NULL;
+    tn_buf               *qfbuf = NULL;
 
     if (n_array_size(ents) == 0)
         return 0;
@@ -556,6 +591,15 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
         i = n_array_size(ents) - 1;
     }
 
+    if (flags & OPT_LS_SUMMARY)
+        prefetch |= PKG_PREFETCH_UINF;
+
+    if (flags & OPT_LS_QUERYFMT)
+        prefetch |= lsqf_prefetch_flags(cmdctx->_data);
+
+    if (prefetch)
+        pf = ls_prefetch(ents, i, incstep, prefetch);
+
     while (i < n_array_size(ents) && i >= 0) {
         struct pkg_dent *ent = n_array_nth(ents, i);
         struct pkg      *pkg;
@@ -594,13 +638,14 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
 			  (term_width/7), srcrpm ? srcrpm : "(unset)");
 
         } else if (flags & OPT_LS_QUERYFMT) {
-	    char *queryfmt = NULL;
+	    if (qfbuf == NULL)
+		qfbuf = n_buf_new(LS_QFBUF_SIZE);
 
-	    if ((queryfmt = lsqf_to_string(cmdctx->_data, pkg))) {
-		cmdctx_printf(cmdctx, "%s", queryfmt);
+	    lsqf_format(cmdctx->_data, pkg, qfbuf);
 
-                n_free(queryfmt);
-	    }
+	    /* printed in big chunks, not package by package */
+	    if (n_buf_size(qfbuf) >= LS_QFBUF_SIZE || (flags & OPT_LS_SUMMARY))
+		ls_flush_qfbuf(cmdctx, qfbuf);
 
         } else if ((flags & OPT_LS_LONG) == 0) {
             cmdctx_printf(cmdctx, "%s\n", pkg_name);
@@ -680,6 +725,13 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
         i += incstep;
     }
 
+    pkg_prefetch_end(pf);
+
+    if (qfbuf) {
+        ls_flush_qfbuf(cmdctx, qfbuf);
+        n_buf_free(qfbuf);
+    }
+
     if (npkgs) {
         char buf[1024];
         int n;
@@ -14,11 +14,6 @@
 # include "config.h"
 #endif
 
-/* for asprintf() from stdio.h */
-#ifndef _GNU_SOURCE
-# define _GNU_SOURCE
-#endif
-
 #include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,12 +29,10 @@
 #include "ls_queryfmt.h"
 #include "pkgu.h"
 #include "pkgfl.h"
+#include "pkgprefetch.h"
 
 #define n_strcase_eq(s, p) (strcasecmp(s, p) == 0)
 
-/* to avoid gcc warn about ignored result */
-#define do_asprintf(buf, fmt, args...)   n_assert(asprintf(buf, fmt, ## args) >= 0)
-
 static const char *invalid_format = N_("invalid format:");
 
 enum LsqfParseMode {
@@ -155,54 +148,225 @@ static const struct lsqf_tags lsqf_tags[] = {
     { LSQF_N_TAGS,              0, 0, 0, { NULL } }
 };
 
+/* sources of array tags' items */
+enum {
+    LSQF_SRC_NONE = 0,
+    LSQF_SRC_CAPS,
+    LSQF_SRC_REQS,
+    LSQF_SRC_SUGS,
+    LSQF_SRC_CNFLS,
+    LSQF_SRC_OBSLS,
+    LSQF_SRC_FILES,
+    LSQF_SRC_DIRS,
+
+    LSQF_N_SRCS
+};
+
+/*
+ * Compiled format: flat list of ops; body of an array ([...]) follows its
+ * LSQF_OP_LOOP which points past it.
+ */
+enum {
+    LSQF_OP_STR = 1,
+    LSQF_OP_TAG,
+    LSQF_OP_COUNT,            /* %{#TAG} */
+    LSQF_OP_LOOP
+};
+
+struct lsqf_op {
+    int8_t      code;
+    int8_t      src;          /* LSQF_SRC_* */
+    int8_t      iterate;
+    int8_t      outfmtfnid;
+    int16_t     tagid;
+    int         pad;          /* as printf()'s width, < 0 => left-justified */
+    int         end;          /* LOOP: index of first op after its body */
+    int         len;          /* STR */
+    const char  *str;
+};
+
+struct lsqf_prog {
+    struct lsqf_op        *ops;
+    int                   nops;
+    int                   size;
+    unsigned              prefetch;  /* PKG_PREFETCH_* */
+    struct lsqf_ent_array *tree;     /* owns ops' strings */
+};
+
+/* per package data, fetched on first use */
 struct lsqf_pkgdata {
     const struct pkg  *pkg;
     struct pkgflist   *flist;
     struct pkguinf    *uinf;
+    unsigned          loaded;        /* PKG_PREFETCH_* */
+    tn_array          *cnfls;
+    tn_array          *obsls;
+    int               sizes[LSQF_N_SRCS]; /* -1 if not counted yet */
+
+    /* position of fl_num-th file; files are asked for in sequence */
+    int               fl_num;
+    int               fl_ent;
+    int               fl_file;
 };
 
-static struct lsqf_pkgdata *lsqf_pkgdata_new(const struct pkg *pkg)
+static void lsqf_pkgdata_init(struct lsqf_pkgdata *pkgdata, const struct pkg *pkg)
 {
-    struct lsqf_pkgdata *pkgdata = NULL;
-
-    pkgdata = n_malloc(sizeof(struct lsqf_pkgdata));
+    int i;
 
-    if (pkgdata) {
-	pkgdata->pkg = pkg;
-	pkgdata->flist = NULL;
-	pkgdata->uinf = NULL;
-    }
+    memset(pkgdata, 0, sizeof(*pkgdata));
+    pkgdata->pkg = pkg;
 
-    return pkgdata;
+    for (i = 0; i < LSQF_N_SRCS; i++)
+	pkgdata->sizes[i] = -1;
 }
 
 static struct pkgflist *lsqf_pkgdata_flist(struct lsqf_pkgdata *pkgdata)
 {
-    if (pkgdata->flist == NULL)
+    if ((pkgdata->loaded & PKG_PREFETCH_FLIST) == 0) {
 	pkgdata->flist = pkg_get_flist(pkgdata->pkg);
+	pkgdata->loaded |= PKG_PREFETCH_FLIST;
+    }
 
     return pkgdata->flist;
 }
 
 static struct pkguinf *lsqf_pkgdata_uinf(struct lsqf_pkgdata *pkgdata)
 {
-    if (pkgdata->uinf == NULL)
+    if ((pkgdata->loaded & PKG_PREFETCH_UINF) == 0) {
 	pkgdata->uinf = pkg_uinf(pkgdata->pkg);
+	pkgdata->loaded |= PKG_PREFETCH_UINF;
+    }
 
     return pkgdata->uinf;
 }
 
-static void lsqf_pkgdata_free(struct lsqf_pkgdata *pkgdata)
+static void lsqf_pkgdata_destroy(struct lsqf_pkgdata *pkgdata)
+{
+    if (pkgdata->flist)
+	pkgflist_free(pkgdata->flist);
+
+    if (pkgdata->uinf)
+	pkguinf_free(pkgdata->uinf);
+
+    n_array_cfree(&pkgdata->cnfls);
+    n_array_cfree(&pkgdata->obsls);
+}
+
+/* conflicts and obsoletes are kept together in pkg->cnfls */
+static void lsqf_pkgdata_split_cnfls(struct lsqf_pkgdata *pkgdata)
+{
+    const struct pkg *pkg = pkgdata->pkg;
+    int i;
+
+    pkgdata->cnfls = n_array_new(4, NULL, NULL);
+    pkgdata->obsls = n_array_new(4, NULL, NULL);
+
+    for (i = 0; pkg->cnfls && i < n_array_size(pkg->cnfls); i++) {
+	struct capreq *cr = n_array_nth(pkg->cnfls, i);
+
+	n_array_push(capreq_is_obsl(cr) ? pkgdata->obsls : pkgdata->cnfls, cr);
+    }
+}
+
+static tn_array *lsqf_pkgdata_capreqs(struct lsqf_pkgdata *pkgdata, int src)
 {
-    if (pkgdata) {
-	if (pkgdata->flist)
-	    pkgflist_free(pkgdata->flist);
+    switch (src) {
+	case LSQF_SRC_CAPS:
+	    return pkgdata->pkg->caps;
+
+	case LSQF_SRC_REQS:
+	    return pkgdata->pkg->reqs;
+
+	case LSQF_SRC_SUGS:
+	    return pkgdata->pkg->sugs;
+
+	case LSQF_SRC_CNFLS:
+	case LSQF_SRC_OBSLS:
+	    if (pkgdata->cnfls == NULL)
+		lsqf_pkgdata_split_cnfls(pkgdata);
 
-	if (pkgdata->uinf)
-	    pkguinf_free(pkgdata->uinf);
+	    return src == LSQF_SRC_CNFLS ? pkgdata->cnfls : pkgdata->obsls;
 
-	n_free(pkgdata);
+	default:
+	    n_assert(0);
     }
+
+    return NULL;
+}
+
+static int lsqf_pkgdata_size(struct lsqf_pkgdata *pkgdata, int src)
+{
+    struct pkgflist *flist;
+    tn_array *arr;
+    int i, size = 0;
+
+    if (pkgdata->sizes[src] >= 0)
+	return pkgdata->sizes[src];
+
+    switch (src) {
+	case LSQF_SRC_NONE:
+	    size = 1;
+	    break;
+
+	case LSQF_SRC_FILES:
+	    if ((flist = lsqf_pkgdata_flist(pkgdata))) {
+		for (i = 0; i < n_tuple_size(flist->fl); i++) {
+		    struct pkgfl_ent *flent = n_tuple_nth(flist->fl, i);
+
+		    size += flent->items;
+		}
+	    }
+	    break;
+
+	case LSQF_SRC_DIRS:
+	    if ((flist = lsqf_pkgdata_flist(pkgdata)))
+		size = n_tuple_size(flist->fl);
+	    break;
+
+	default:
+	    if ((arr = lsqf_pkgdata_capreqs(pkgdata, src)))
+		size = n_array_size(arr);
+	    break;
+    }
+
+    pkgdata->sizes[src] = size;
+    return size;
+}
+
+/* RET: num-th file of package; O(1) when asked in sequence */
+static struct flfile *lsqf_pkgdata_file(struct lsqf_pkgdata *pkgdata, int num,
+                                        struct pkgfl_ent **flentp)
+{
+    struct pkgflist *flist = lsqf_pkgdata_flist(pkgdata);
+
+    if (flist == NULL)
+	return NULL;
+
+    if (num < pkgdata->fl_num) {
+	pkgdata->fl_num = 0;
+	pkgdata->fl_ent = 0;
+	pkgdata->fl_file = 0;
+    }
+
+    while (pkgdata->fl_ent < n_tuple_size(flist->fl)) {
+	struct pkgfl_ent *flent = n_tuple_nth(flist->fl, pkgdata->fl_ent);
+
+	if (pkgdata->fl_file >= flent->items) {
+	    pkgdata->fl_ent++;
+	    pkgdata->fl_file = 0;
+	    continue;
+	}
+
+	if (pkgdata->fl_num == num) {
+	    *flentp = flent;
+	    return flent->files[pkgdata->fl_file];
+	}
+
+	pkgdata->fl_num++;
+	pkgdata->fl_file++;
+    }
+
+    return NULL;
 }
 
 static int get_tagid_by_name(char *tag)
@@ -236,54 +400,65 @@ static int get_outfmtfnid_by_name(char *outfmtfn)
     return LSQF_TAG_OUTFMTFN_NONE;
 }
 
-/* TODO: move to capreq.c */
-static int capreq_snprintf_evr(char *str, size_t size, const struct capreq *cr)
+/* padding of right-justified value of len chars */
+static void pad_before(tn_buf *nbuf, int pad, int len)
 {
-    int n = 0;
+    for (; pad > len; pad--)
+	n_buf_putc(nbuf, ' ');
+}
 
-    n_assert(size > 0);
+/* padding of left-justified one */
+static void pad_after(tn_buf *nbuf, int pad, int len)
+{
+    for (; -pad > len; pad++)
+	n_buf_putc(nbuf, ' ');
+}
 
-    if (capreq_has_epoch(cr))
-	n += n_snprintf(&str[n], size - n, "%d:", capreq_epoch(cr));
+static void put_str(tn_buf *nbuf, int pad, const char *str, int len)
+{
+    if (str == NULL)
+	return;
 
-    if (capreq_has_ver(cr))
-	n += n_snprintf(&str[n], size - n, "%s", capreq_ver(cr));
+    if (len < 0)
+	len = strlen(str);
 
-    if (capreq_has_rel(cr)) {
-        n_assert(capreq_has_ver(cr));
+    pad_before(nbuf, pad, len);
+    n_buf_write(nbuf, str, len);
+    pad_after(nbuf, pad, len);
+}
 
-        n += n_snprintf(&str[n], size - n, "-%s", capreq_rel(cr));
-    }
+static void put_int(tn_buf *nbuf, int pad, const char *fmt, int val)
+{
+    char buf[32];
+    int n;
 
-    return n;
+    n = n_snprintf(buf, sizeof(buf), fmt, val);
+    put_str(nbuf, pad, buf, n);
 }
 
-static char *format_date(int outfmtfnid, uint32_t time)
+static void put_date(tn_buf *nbuf, const struct lsqf_op *op, uint32_t time)
 {
-    char *buf = NULL, datestr[32];
-
-    if (outfmtfnid == LSQF_TAG_OUTFMTFN_DATE) {
-	strftime(datestr, sizeof(datestr), "%c", gmtime((time_t *)&time));
-	do_asprintf(&buf, "%s", datestr);
-    } else if (outfmtfnid == LSQF_TAG_OUTFMTFN_DAY) {
-	strftime(datestr, sizeof(datestr), "%a %b %d %Y", gmtime((time_t *)&time));
-	do_asprintf(&buf, "%s", datestr);
-    } else {
-	do_asprintf(&buf, "%u", time);
-    }
+    char datestr[32];
+    time_t t = time;
+    int n = 0;
 
-    return buf;
+    if (op->outfmtfnid == LSQF_TAG_OUTFMTFN_DATE)
+	n = strftime(datestr, sizeof(datestr), "%c", gmtime(&t));
+    else if (op->outfmtfnid == LSQF_TAG_OUTFMTFN_DAY)
+	n = strftime(datestr, sizeof(datestr), "%a %b %d %Y", gmtime(&t));
+    else
+	n = n_snprintf(datestr, sizeof(datestr), "%u", time);
+
+    put_str(nbuf, op->pad, datestr, n);
 }
 
-static char *format_flags(int outfmtfnid, struct capreq *cr)
+static void put_flags(tn_buf *nbuf, const struct lsqf_op *op, const struct capreq *cr)
 {
-    char *buf = NULL;
-
-    if (outfmtfnid == LSQF_TAG_OUTFMTFN_DEPFLAGS) {
-	char relstr[3], *p;
+    if (op->outfmtfnid == LSQF_TAG_OUTFMTFN_DEPFLAGS) {
+	char relstr[8], *p;
 
 	p = relstr;
-	*p = '\0';
+	*p++ = ' ';
 
 	if (cr->cr_relflags & REL_LT)
 	    *p++ = '<';
@@ -293,266 +468,253 @@ static char *format_flags(int outfmtfnid, struct capreq *cr)
 	if (cr->cr_relflags & REL_EQ)
 	    *p++ = '=';
 
-	*p = '\0';
+	*p++ = ' ';
+	put_str(nbuf, op->pad, relstr, p - relstr);
 
-	do_asprintf(&buf, " %s ", relstr);
     } else {
-	do_asprintf(&buf, "%u", cr->cr_relflags);
+	put_int(nbuf, op->pad, "%u", cr->cr_relflags);
     }
-
-    return buf;
 }
 
-static char *get_str_by_tagid(const struct lsqf_ent *ent, struct lsqf_pkgdata *pkgdata,
-                              int num)
+static void put_evr(tn_buf *nbuf, const struct lsqf_op *op, const struct capreq *cr)
 {
-    const struct pkg *pkg = pkgdata->pkg;
-    struct capreq *c = NULL;
-    char *buf = NULL, evr[32];
-    int i;
-
-    if (lsqf_tags[ent->tag.id].need_uinf) {
-	struct pkguinf *pkgu = lsqf_pkgdata_uinf(pkgdata);
-	const char *str = NULL;
-
-	switch (ent->tag.id) {
-	    case LSQF_TAG_BUILDHOST:
-		str = pkguinf_get(pkgu, PKGUINF_BUILDHOST);
-		break;
-
-	    case LSQF_TAG_DESCRIPTION:
-		str = pkguinf_get(pkgu, PKGUINF_DESCRIPTION);
-		break;
+    char evr[256];
+    int n;
 
-	    case LSQF_TAG_LICENSE:
-		str = pkguinf_get(pkgu, PKGUINF_LICENSE);
-		break;
-
-	    case LSQF_TAG_SUMMARY:
-		str = pkguinf_get(pkgu, PKGUINF_SUMMARY);
-		break;
+    if ((n = capreq_snprintf_evr(evr, sizeof(evr), cr)) > 0)
+	put_str(nbuf, op->pad, evr, n);
+}
 
-	    case LSQF_TAG_URL:
-		str = pkguinf_get(pkgu, PKGUINF_URL);
-		break;
+static void put_uinf(tn_buf *nbuf, const struct lsqf_op *op,
+                     struct lsqf_pkgdata *pkgdata, int tag)
+{
+    struct pkguinf *pkgu = lsqf_pkgdata_uinf(pkgdata);
+    const char *str = NULL;
 
-	    case LSQF_TAG_VENDOR:
-		str = pkguinf_get(pkgu, PKGUINF_VENDOR);
-		break;
+    if (pkgu)
+	str = pkguinf_get(pkgu, tag);
 
-	    default:
-		n_assert(0);
-	}
+    put_str(nbuf, op->pad, str ? str : "(none)", -1);
+}
 
-	if (str)
-	    buf = n_strdup(str);
-	else
-	    buf = n_strdup("(none)");
-
-    } else if (lsqf_tags[ent->tag.id].need_flist) {
-	struct pkgflist *flist = lsqf_pkgdata_flist(pkgdata);
-	struct pkgfl_ent *flent = NULL;
-
-	if (flist) {
-	    switch (ent->tag.id) {
-		case LSQF_TAG_BASENAMES:
-    		case LSQF_TAG_FILELINKTOS:
-    		case LSQF_TAG_FILEMODES:
-    		case LSQF_TAG_FILENAMES:
-		case LSQF_TAG_FILESIZES:
-		    for (i = 0; i < n_tuple_size(flist->fl); i++) {
-			flent = n_tuple_nth(flist->fl, i);
-
-			if (flent->items <= num)
-			    num -= flent->items;
-			else
-			    break;
-		    }
-
-		    if (ent->tag.id == LSQF_TAG_BASENAMES)
-			buf = n_strdup(flent->files[num]->basename);
-		    else if (ent->tag.id == LSQF_TAG_FILEMODES)
-			do_asprintf(&buf, "%u", flent->files[num]->mode);
-		    else if (ent->tag.id == LSQF_TAG_FILENAMES) {
-			if (*flent->dirname == '/')
-			    do_asprintf(&buf, "%s%s", flent->dirname, flent->files[num]->basename);
-			else
-			    do_asprintf(&buf, "/%s%s%s", flent->dirname,
-						      *flent->files[num]->basename ? "/" : "",
-						      flent->files[num]->basename);
-		    } else if (ent->tag.id == LSQF_TAG_FILESIZES)
-			do_asprintf(&buf, "%u", flent->files[num]->size);
-		    else
-			if (S_ISLNK(flent->files[num]->mode))
-			    buf = n_strdup(flent->files[num]->basename + strlen(flent->files[num]->basename) + 1);
+static void put_file(tn_buf *nbuf, const struct lsqf_op *op,
+                     struct lsqf_pkgdata *pkgdata, int num)
+{
+    struct pkgfl_ent *flent = NULL;
+    struct flfile *file;
+    int pad = op->pad;
 
-		    break;
+    if ((file = lsqf_pkgdata_file(pkgdata, num, &flent)) == NULL)
+	return;
 
-		case LSQF_TAG_DIRNAMES:
-		    flent = n_tuple_nth(flist->fl, num);
+    switch (op->tagid) {
+	case LSQF_TAG_BASENAMES:
+	    put_str(nbuf, pad, file->basename, -1);
+	    break;
 
-		    do_asprintf(&buf, "%s%s", *flent->dirname == '/' ? "" : "/",
-					   flent->dirname);
-		    break;
+	case LSQF_TAG_FILEMODES:
+	    put_int(nbuf, pad, "%u", file->mode);
+	    break;
 
-		default:
-		    n_assert(0);
-	    }
-	}
-    } else {
-	switch (ent->tag.id) {
-	    case LSQF_TAG_ARCH:
-		buf = n_strdup(pkg_arch(pkg));
-		break;
+	case LSQF_TAG_FILESIZES:
+	    put_int(nbuf, pad, "%u", file->size);
+	    break;
 
-	    case LSQF_TAG_BUILDTIME:
-		buf = format_date(ent->tag.outfmtfnid, pkg->btime);
-		break;
+	case LSQF_TAG_FILELINKTOS:
+	    if (S_ISLNK(file->mode))
+		put_str(nbuf, pad, file->basename + strlen(file->basename) + 1, -1);
+	    break;
 
-	    case LSQF_TAG_CONFLICTFLAGS:
-	    case LSQF_TAG_CONFLICTS:
-	    case LSQF_TAG_CONFLICTVERSION:
-	    case LSQF_TAG_OBSOLETEFLAGS:
-	    case LSQF_TAG_OBSOLETES:
-	    case LSQF_TAG_OBSOLETEVERSION:
-	    {
-		int n = 0;
-
-		for (i = 0; i < n_array_size(pkg->cnfls); i++) {
-		    struct capreq *cr = n_array_nth(pkg->cnfls, i);
-
-		    if (ent->tag.id == LSQF_TAG_CONFLICTS || ent->tag.id == LSQF_TAG_CONFLICTFLAGS) {
-			if (!capreq_is_obsl(cr)) {
-			    if (n == num) {
-				c = cr;
-				break;
-			    }
-
-			    n++;
-			}
-		    } else {
-			if (capreq_is_obsl(cr)) {
-			    if (n == num) {
-				c = cr;
-				break;
-			    }
-
-			    n++;
-			}
-		    }
-		}
+	case LSQF_TAG_FILENAMES:
+	{
+	    int dlen = strlen(flent->dirname), blen = strlen(file->basename);
+	    int len = dlen + blen;
 
-		if (c) {
-		    if (ent->tag.id == LSQF_TAG_CONFLICTS || ent->tag.id == LSQF_TAG_OBSOLETES)
-			buf = n_strdup(capreq_name(c));
-		    else if (ent->tag.id == LSQF_TAG_CONFLICTFLAGS || ent->tag.id == LSQF_TAG_OBSOLETEFLAGS)
-			buf = format_flags(ent->tag.outfmtfnid, c);
-		    else if (ent->tag.id == LSQF_TAG_CONFLICTVERSION || ent->tag.id == LSQF_TAG_OBSOLETEVERSION)
-			if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-			    buf = n_strdup(evr);
+	    if (*flent->dirname != '/')
+		len += *file->basename ? 2 : 1;
 
-		}
-		break;
-	    }
+	    pad_before(nbuf, pad, len);
 
-	    case LSQF_TAG_EPOCH:
-		do_asprintf(&buf, "%d", pkg->epoch);
-		break;
+	    if (*flent->dirname != '/')
+		n_buf_putc(nbuf, '/');
 
-	    case LSQF_TAG_GROUP:
-		buf = n_strdup(pkg_group(pkg));
-		break;
+	    n_buf_write(nbuf, flent->dirname, dlen);
 
-	    case LSQF_TAG_NAME:
-		buf = n_strdup(pkg->name);
-		break;
+	    if (*flent->dirname != '/' && *file->basename)
+		n_buf_putc(nbuf, '/');
 
-	    case LSQF_TAG_NVRA:
-		buf = n_strdup(pkg_id(pkg));
-		break;
-
-	    case LSQF_TAG_PACKAGECOLOR:
-		do_asprintf(&buf, "%d", pkg->color);
-		break;
-
-	    case LSQF_TAG_PROVIDEFLAGS:
-		buf = format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->caps, num));
-		break;
+	    n_buf_write(nbuf, file->basename, blen);
+	    pad_after(nbuf, pad, len);
+	    break;
+	}
 
-	    case LSQF_TAG_PROVIDES:
-		c = n_array_nth(pkg->caps, num);
-		buf = n_strdup(capreq_name(c));
-		break;
+	default:
+	    n_assert(0);
+    }
+}
 
-	    case LSQF_TAG_PROVIDEVERSION:
-		c = n_array_nth(pkg->caps, num);
+static void put_dir(tn_buf *nbuf, const struct lsqf_op *op,
+                    struct lsqf_pkgdata *pkgdata, int num)
+{
+    struct pkgflist *flist = lsqf_pkgdata_flist(pkgdata);
+    struct pkgfl_ent *flent;
+    int pad = op->pad, len;
 
-		if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-		    buf = n_strdup(evr);
+    if (flist == NULL || num >= n_tuple_size(flist->fl))
+	return;
 
-		break;
+    flent = n_tuple_nth(flist->fl, num);
+    len = strlen(flent->dirname);
 
-	    case LSQF_TAG_RELEASE:
-		buf = n_strdup(pkg->rel);
-		break;
+    if (*flent->dirname == '/') {
+	put_str(nbuf, pad, flent->dirname, len);
+	return;
+    }
 
-	    case LSQF_TAG_REQUIREFLAGS:
-		buf = format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->reqs, num));
-		break;
+    pad_before(nbuf, pad, len + 1);
+    n_buf_putc(nbuf, '/');
+    n_buf_write(nbuf, flent->dirname, len);
+    pad_after(nbuf, pad, len + 1);
+}
 
-	    case LSQF_TAG_REQUIRES:
-		c = n_array_nth(pkg->reqs, num);
+static void put_tag(tn_buf *nbuf, const struct lsqf_op *op,
+                    struct lsqf_pkgdata *pkgdata, int num)
+{
+    const struct pkg *pkg = pkgdata->pkg;
+    const struct capreq *cr = NULL;
+    int pad = op->pad;
 
-		if (capreq_is_rpmlib(c))
-		    do_asprintf(&buf, "rpmlib(%s)", capreq_name(c));
-		else
-		    buf = n_strdup(capreq_name(c));
+    switch (op->src) {
+	case LSQF_SRC_FILES:
+	    put_file(nbuf, op, pkgdata, num);
+	    return;
 
-		break;
+	case LSQF_SRC_DIRS:
+	    put_dir(nbuf, op, pkgdata, num);
+	    return;
 
-	    case LSQF_TAG_REQUIREVERSION:
-		c = n_array_nth(pkg->reqs, num);
+	case LSQF_SRC_NONE:
+	    break;
 
-		if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-		    buf = n_strdup(evr);
+	default:
+	{
+	    tn_array *arr = lsqf_pkgdata_capreqs(pkgdata, op->src);
 
-		break;
+	    if (arr == NULL || num >= n_array_size(arr))
+		return;
 
-	    case LSQF_TAG_VERSION:
-		buf = n_strdup(pkg->ver);
-		break;
+	    cr = n_array_nth(arr, num);
+	    break;
+	}
+    }
 
-	    case LSQF_TAG_SIZE:
-		do_asprintf(&buf, "%u", pkg->size);
-		break;
+    switch (op->tagid) {
+	case LSQF_TAG_ARCH:
+	    put_str(nbuf, pad, pkg_arch(pkg), -1);
+	    break;
+
+	case LSQF_TAG_BUILDHOST:
+	    put_uinf(nbuf, op, pkgdata, PKGUINF_BUILDHOST);
+	    break;
+
+	case LSQF_TAG_BUILDTIME:
+	    put_date(nbuf, op, pkg->btime);
+	    break;
+
+	case LSQF_TAG_CONFLICTS:
+	case LSQF_TAG_OBSOLETES:
+	case LSQF_TAG_PROVIDES:
+	case LSQF_TAG_SUGGESTS:
+	    put_str(nbuf, pad, capreq_name(cr), -1);
+	    break;
+
+	case LSQF_TAG_CONFLICTFLAGS:
+	case LSQF_TAG_OBSOLETEFLAGS:
+	case LSQF_TAG_PROVIDEFLAGS:
+	case LSQF_TAG_REQUIREFLAGS:
+	case LSQF_TAG_SUGGESTSFLAGS:
+	    put_flags(nbuf, op, cr);
+	    break;
+
+	case LSQF_TAG_CONFLICTVERSION:
+	case LSQF_TAG_OBSOLETEVERSION:
+	case LSQF_TAG_PROVIDEVERSION:
+	case LSQF_TAG_REQUIREVERSION:
+	case LSQF_TAG_SUGGESTSVERSION:
+	    put_evr(nbuf, op, cr);
+	    break;
+
+	case LSQF_TAG_DESCRIPTION:
+	    put_uinf(nbuf, op, pkgdata, PKGUINF_DESCRIPTION);
+	    break;
+
+	case LSQF_TAG_EPOCH:
+	    put_int(nbuf, pad, "%d", pkg->epoch);
+	    break;
+
+	case LSQF_TAG_GROUP:
+	    put_str(nbuf, pad, pkg_group(pkg), -1);
+	    break;
+
+	case LSQF_TAG_LICENSE:
+	    put_uinf(nbuf, op, pkgdata, PKGUINF_LICENSE);
+	    break;
+
+	case LSQF_TAG_NAME:
+	    put_str(nbuf, pad, pkg->name, -1);
+	    break;
+
+	case LSQF_TAG_NVRA:
+	    put_str(nbuf, pad, pkg_id(pkg), -1);
+	    break;
+
+	case LSQF_TAG_PACKAGECOLOR:
+	    put_int(nbuf, pad, "%d", pkg->color);
+	    break;
+
+	case LSQF_TAG_RELEASE:
+	    put_str(nbuf, pad, pkg->rel, -1);
+	    break;
+
+	case LSQF_TAG_REQUIRES:
+	    if (capreq_is_rpmlib(cr)) {
+		int len = strlen(capreq_name(cr)) + sizeof("rpmlib()") - 1;
+
+		pad_before(nbuf, pad, len);
+		n_buf_printf(nbuf, "rpmlib(%s)", capreq_name(cr));
+		pad_after(nbuf, pad, len);
+	    } else {
+		put_str(nbuf, pad, capreq_name(cr), -1);
+	    }
+	    break;
 
-	    case LSQF_TAG_SOURCERPM:
-		buf = n_strdup(pkg_srcfilename_s(pkg));
-		break;
+	case LSQF_TAG_SIZE:
+	    put_int(nbuf, pad, "%u", pkg->size);
+	    break;
 
-	    case LSQF_TAG_SUGGESTSFLAGS:
-		buf = format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->sugs, num));
-		break;
+	case LSQF_TAG_SOURCERPM:
+	    put_str(nbuf, pad, pkg_srcfilename_s(pkg), -1);
+	    break;
 
-	    case LSQF_TAG_SUGGESTS:
-		c = n_array_nth(pkg->sugs, num);
-		buf = n_strdup(capreq_name(c));
-		break;
+	case LSQF_TAG_SUMMARY:
+	    put_uinf(nbuf, op, pkgdata, PKGUINF_SUMMARY);
+	    break;
 
-	    case LSQF_TAG_SUGGESTSVERSION:
-		c = n_array_nth(pkg->sugs, num);
+	case LSQF_TAG_URL:
+	    put_uinf(nbuf, op, pkgdata, PKGUINF_URL);
+	    break;
 
-		if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-		    buf = n_strdup(evr);
+	case LSQF_TAG_VENDOR:
+	    put_uinf(nbuf, op, pkgdata, PKGUINF_VENDOR);
+	    break;
 
-		break;
+	case LSQF_TAG_VERSION:
+	    put_str(nbuf, pad, pkg->ver, -1);
+	    break;
 
-	    default:
-		n_assert(0);
-	}
+	default:
+	    n_assert(0);
     }
-
-    return buf;
 }
 
 static char get_escaped_char(char zn)
@@ -869,219 +1031,270 @@ struct lsqf_ent_array *lsqf_parse(char *fmt)
     return array;
 }
 
-static int get_tag_array_size(const struct lsqf_ent *ent, struct lsqf_pkgdata *pkgdata)
+static int get_tag_src(int tagid)
 {
-    const struct pkg *pkg = pkgdata->pkg;
-    int i;
-    int size = 1;
+    switch (tagid) {
+	case LSQF_TAG_CONFLICTFLAGS:
+	case LSQF_TAG_CONFLICTS:
+	case LSQF_TAG_CONFLICTVERSION:
+	    return LSQF_SRC_CNFLS;
+
+	case LSQF_TAG_OBSOLETEFLAGS:
+	case LSQF_TAG_OBSOLETES:
+	case LSQF_TAG_OBSOLETEVERSION:
+	    return LSQF_SRC_OBSLS;
+
+	case LSQF_TAG_PROVIDEFLAGS:
+	case LSQF_TAG_PROVIDES:
+	case LSQF_TAG_PROVIDEVERSION:
+	    return LSQF_SRC_CAPS;
+
+	case LSQF_TAG_REQUIREFLAGS:
+	case LSQF_TAG_REQUIRES:
+	case LSQF_TAG_REQUIREVERSION:
+	    return LSQF_SRC_REQS;
+
+	case LSQF_TAG_SUGGESTSFLAGS:
+	case LSQF_TAG_SUGGESTS:
+	case LSQF_TAG_SUGGESTSVERSION:
+	    return LSQF_SRC_SUGS;
+
+	case LSQF_TAG_BASENAMES:
+	case LSQF_TAG_FILELINKTOS:
+	case LSQF_TAG_FILEMODES:
+	case LSQF_TAG_FILENAMES:
+	case LSQF_TAG_FILESIZES:
+	    return LSQF_SRC_FILES;
+
+	case LSQF_TAG_DIRNAMES:
+	    return LSQF_SRC_DIRS;
+    }
 
-    n_assert(ent->type == LSQF_ENT_TYPE_TAG);
+    n_assert(!lsqf_tags[tagid].is_array);
+    return LSQF_SRC_NONE;
+}
 
-    if (lsqf_tags[ent->tag.id].is_array) {
-	size = 0;
+static struct lsqf_op *prog_add_op(struct lsqf_prog *prog, int code)
+{
+    struct lsqf_op *op;
 
-	if (lsqf_tags[ent->tag.id].need_flist) {
-	    struct pkgflist *flist = lsqf_pkgdata_flist(pkgdata);
+    if (prog->nops == prog->size) {
+	prog->size = prog->size ? prog->size * 2 : 16;
+	prog->ops = n_realloc(prog->ops, prog->size * sizeof(*prog->ops));
+    }
 
-	    if (flist) {
-		switch (ent->tag.id) {
-		    case LSQF_TAG_BASENAMES:
-		    case LSQF_TAG_FILELINKTOS:
-		    case LSQF_TAG_FILEMODES:
-		    case LSQF_TAG_FILENAMES:
-		    case LSQF_TAG_FILESIZES:
-			for (i = 0; i < n_tuple_size(flist->fl); i++) {
-			    struct pkgfl_ent *flent = n_tuple_nth(flist->fl, i);
+    op = &prog->ops[prog->nops++];
+    memset(op, 0, sizeof(*op));
+    op->code = code;
 
-			    size += flent->items;
-			}
+    return op;
+}
 
-			break;
+static void compile_ent_array(struct lsqf_prog *prog, const struct lsqf_ent_array *array)
+{
+    unsigned int i;
 
-	    	    case LSQF_TAG_DIRNAMES:
-		        size = n_tuple_size(flist->fl);
-			break;
+    for (i = 0; i < array->items; i++) {
+	const struct lsqf_ent *ent = array->ents[i];
+	struct lsqf_op *op;
+	int n;
 
-		    default:
-			n_assert(0);
-		}
-	    }
-	} else {
-	    switch (ent->tag.id) {
-		case LSQF_TAG_CONFLICTFLAGS:
-		case LSQF_TAG_CONFLICTS:
-		case LSQF_TAG_CONFLICTVERSION:
-		case LSQF_TAG_OBSOLETEFLAGS:
-		case LSQF_TAG_OBSOLETES:
-		case LSQF_TAG_OBSOLETEVERSION:
-		    if (pkg->cnfls) {
-			int nobsl = 0, ncnfls = 0;
-
-			for (i = 0; i < n_array_size(pkg->cnfls); i++) {
-			    struct capreq *cr = n_array_nth(pkg->cnfls, i);
-
-			    if (capreq_is_obsl(cr))
-				nobsl++;
-			    else
-				ncnfls++;
-			}
-
-			if (ent->tag.id == LSQF_TAG_CONFLICTFLAGS || ent->tag.id == LSQF_TAG_CONFLICTS
-			 || ent->tag.id == LSQF_TAG_CONFLICTVERSION)
-			    size = ncnfls;
-			else
-			    size = nobsl;
-		    }
+	switch (ent->type) {
+	    case LSQF_ENT_TYPE_STRING:
+		op = prog_add_op(prog, LSQF_OP_STR);
+		op->str = ent->string;
+		op->len = strlen(ent->string);
+		break;
 
-		    break;
+	    case LSQF_ENT_TYPE_TAG:
+		op = prog_add_op(prog, ent->tag.countArray ? LSQF_OP_COUNT : LSQF_OP_TAG);
+		op->tagid = ent->tag.id;
+		op->src = get_tag_src(ent->tag.id);
+		op->iterate = ent->tag.iterate;
+		op->pad = ent->tag.pad;
+		op->outfmtfnid = ent->tag.outfmtfnid;
+
+		if (lsqf_tags[ent->tag.id].need_uinf)
+		    prog->prefetch |= PKG_PREFETCH_UINF;
+
+		if (lsqf_tags[ent->tag.id].need_flist)
+		    prog->prefetch |= PKG_PREFETCH_FLIST;
+		break;
 
-		case LSQF_TAG_PROVIDEFLAGS:
-		case LSQF_TAG_PROVIDES:
-		case LSQF_TAG_PROVIDEVERSION:
-		    if (pkg->caps)
-			size = n_array_size(pkg->caps);
-		    break;
+	    case LSQF_ENT_TYPE_ARRAY:
+		n = prog->nops;
+		prog_add_op(prog, LSQF_OP_LOOP);
+		compile_ent_array(prog, ent->array);
+		prog->ops[n].end = prog->nops; /* ops may be reallocated */
+		break;
 
-		case LSQF_TAG_REQUIREFLAGS:
-		case LSQF_TAG_REQUIRES:
-		case LSQF_TAG_REQUIREVERSION:
-		    if (pkg->reqs)
-			size = n_array_size(pkg->reqs);
-		    break;
+	    default:
+		n_assert(0);
+	}
+    }
+}
 
-		case LSQF_TAG_SUGGESTSFLAGS:
-		case LSQF_TAG_SUGGESTS:
-		case LSQF_TAG_SUGGESTSVERSION:
-		    if (pkg->sugs)
-			size = n_array_size(pkg->sugs);
-		    break;
+/**
+ * lsqf_compile:
+ *
+ * Returns: compiled format or NULL when parsing failed.
+ **/
+struct lsqf_prog *lsqf_compile(char *fmt)
+{
+    struct lsqf_ent_array *tree;
+    struct lsqf_prog *prog;
 
-		default:
-		    n_assert(0);
-	    }
-	}
+    if ((tree = lsqf_parse(fmt)) == NULL)
+	return NULL;
+
+    prog = n_calloc(1, sizeof(*prog));
+    prog->tree = tree;
+    compile_ent_array(prog, tree);
+
+    return prog;
+}
+
+void lsqf_prog_free(struct lsqf_prog *prog)
+{
+    if (prog) {
+	lsqf_ent_array_free(prog->tree);
+	n_cfree(&prog->ops);
+	n_free(prog);
     }
+}
 
-    return size;
+unsigned lsqf_prefetch_flags(const struct lsqf_prog *prog)
+{
+    return prog->prefetch;
 }
 
 /**
- * Returns 1 when arrays size differ.
+ * loop_size:
+ *
+ * Returns: number of iterations of loop at ops[k] or -1 when arrays
+ * used in its body differ in size.
  **/
-static int check_size(const struct lsqf_ent_array *array, struct lsqf_pkgdata *pkgdata, unsigned int *s)
+static int loop_size(const struct lsqf_prog *prog, int k, struct lsqf_pkgdata *pkgdata)
 {
-    unsigned int i;
-    int size = 1, prev_size = -1;
+    int i, size = 1, prev_size = -1;
 
-    for (i = 0; i < array->items; i++) {
-	struct lsqf_ent *ent = array->ents[i];
+    for (i = k + 1; i < prog->ops[k].end; i++) {
+	const struct lsqf_op *op = &prog->ops[i];
 
-	if (ent->type == LSQF_ENT_TYPE_TAG) {
-	    if (lsqf_tags[ent->tag.id].is_array) {
-		size = get_tag_array_size(ent, pkgdata);
-	    } else {
-		/* check whether we want to print this tag with every iteration */
-		if (ent->tag.iterate)
-		    continue;
+	if (op->code == LSQF_OP_LOOP) {
+	    i = op->end - 1;     /* nested loop is checked on its own */
+	    continue;
+	}
 
-		size = 1;
-	    }
+	if (op->code != LSQF_OP_TAG && op->code != LSQF_OP_COUNT)
+	    continue;
 
-	    if (prev_size < 0)
-		prev_size = size;
+	if (op->src != LSQF_SRC_NONE) {
+	    size = lsqf_pkgdata_size(pkgdata, op->src);
+	} else {
+	    /* check whether we want to print this tag with every iteration */
+	    if (op->iterate)
+		continue;
 
-	    if (prev_size != size)
-		return 1;
+	    size = 1;
 	}
-    }
 
-    *s = size;
+	if (prev_size < 0)
+	    prev_size = size;
 
-    return 0;
+	if (prev_size != size)
+	    return -1;
+    }
+
+    return size;
 }
 
-static void add_tagstr_to_nbuf(tn_buf *nbuf, const struct lsqf_ent *ent, struct lsqf_pkgdata *pkgdata, unsigned int num)
+/* checks loops which are going to be run; sizes are cached in pkgdata */
+static int check_loops(const struct lsqf_prog *prog, int from, int to,
+                       struct lsqf_pkgdata *pkgdata)
 {
-    char *str = NULL, fmt[16];
+    int i, size;
+
+    for (i = from; i < to; i++) {
+	const struct lsqf_op *op = &prog->ops[i];
 
-    if (ent->tag.countArray) {
-	n_snprintf(fmt, sizeof(fmt), "%%%dd", ent->tag.pad);
-	n_buf_printf(nbuf, fmt, get_tag_array_size(ent, pkgdata));
+	if (op->code != LSQF_OP_LOOP)
+	    continue;
 
-    } else if ((str = get_str_by_tagid(ent, pkgdata, num))) {
-	n_snprintf(fmt, sizeof(fmt), "%%%ds", ent->tag.pad);
-	n_buf_printf(nbuf, fmt, str);
+	if ((size = loop_size(prog, i, pkgdata)) < 0)
+	    return 0;
 
-	n_free(str);
+	if (size > 0 && !check_loops(prog, i + 1, op->end, pkgdata))
+	    return 0;
+
+	i = op->end - 1;
     }
+
+    return 1;
 }
 
-/**
- * tags_size - number of items in tags. It's mostly used by tag-arrays (for example REQUIRES)
- */
-static int ent_array_to_string(const struct lsqf_ent_array *array,
-                               struct lsqf_pkgdata *pkgdata,
-                               tn_buf *nbuf, int tags_size)
+static void exec_ops(const struct lsqf_prog *prog, int from, int to,
+                     struct lsqf_pkgdata *pkgdata, int num, tn_buf *nbuf)
 {
-    unsigned i, size = 0;
-    int j;
+    int i, j, size;
 
-    for (j = 0; j < tags_size; j++) {
-	for (i = 0; i < array->items; i++) {
-	    struct lsqf_ent *ent = array->ents[i];
-	    int ret = 1;
+    for (i = from; i < to; i++) {
+	const struct lsqf_op *op = &prog->ops[i];
 
-	    switch (ent->type) {
-		case LSQF_ENT_TYPE_TAG:
-		    add_tagstr_to_nbuf(nbuf, ent, pkgdata, j);
-		    break;
+	switch (op->code) {
+	    case LSQF_OP_STR:
+		n_buf_write(nbuf, op->str, op->len);
+		break;
 
-		case LSQF_ENT_TYPE_STRING:
-		    n_buf_puts_z(nbuf, ent->string);
-		    break;
+	    case LSQF_OP_TAG:
+		put_tag(nbuf, op, pkgdata, num);
+		break;
 
-		case LSQF_ENT_TYPE_ARRAY:
-		    if (check_size(ent->array, pkgdata, &size)) {
-			logn(LOGERR, _("%s array iterator used with different sized arrays"), invalid_format);
-			ret = 0;
-		    } else {
-			ret = ent_array_to_string(ent->array, pkgdata, nbuf, size);
-		    }
+	    case LSQF_OP_COUNT:
+		put_int(nbuf, op->pad, "%d", lsqf_pkgdata_size(pkgdata, op->src));
+		break;
 
-		    break;
+	    case LSQF_OP_LOOP:
+		size = loop_size(prog, i, pkgdata);
+		for (j = 0; j < size; j++)
+		    exec_ops(prog, i + 1, op->end, pkgdata, j, nbuf);
 
-		default:
-		    n_assert(0);
-	    }
+		i = op->end - 1;
+		break;
 
-	    /* break on error */
-	    if (ret == 0)
-		return 0;
+	    default:
+		n_assert(0);
 	}
     }
-
-    return 1;
 }
 
-char *lsqf_to_string(const struct lsqf_ent_array *array, const struct pkg *pkg)
+/**
+ * lsqf_format:
+ *
+ * Appends pkg formatted by prog to nbuf; nothing is appended on error.
+ *
+ * Returns: 1 on success, 0 on error.
+ **/
+int lsqf_format(const struct lsqf_prog *prog, const struct pkg *pkg, tn_buf *nbuf)
 {
-    struct lsqf_pkgdata *pkgdata = NULL;
-    tn_buf		*nbuf = NULL;
-    char		*buf = NULL;
+    struct lsqf_pkgdata pkgdata;
+    int rc = 1;
 
-    pkgdata = lsqf_pkgdata_new(pkg);
-    nbuf = n_buf_new(64);
+    lsqf_pkgdata_init(&pkgdata, pkg);
 
-    /* In the first array there can't be more than one item per tag,
-     * so force tags_size = 1 */
-    if (ent_array_to_string(array, pkgdata, nbuf, 1)) {
-	buf = n_strdup(n_buf_ptr(nbuf));
+    if (!check_loops(prog, 0, prog->nops, &pkgdata)) {
+	logn(LOGERR, _("%s array iterator used with different sized arrays"), invalid_format);
+	rc = 0;
+
+    } else {
+	/* In the first array there can't be more than one item per tag,
+	 * so its tags are printed once, as the 0th item */
+	exec_ops(prog, 0, prog->nops, &pkgdata, 0, nbuf);
     }
 
-    n_buf_free(nbuf);
-    lsqf_pkgdata_free(pkgdata);
+    lsqf_pkgdata_destroy(&pkgdata);
 
-    return buf;
+    return rc;
 }
 
 /**
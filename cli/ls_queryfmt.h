@@ -13,10 +13,13 @@
 #ifndef POCLIDEK_LS_QUERYFMT_H
 #define POCLIDEK_LS_QUERYFMT_H
 
+#include <trurl/nbuf.h>
+
 #include "cmd.h"
 #include "pkg.h"
 
 struct lsqf_ent;
+struct lsqf_prog;
 
 struct lsqf_ent_array {
     struct lsqf_ent **ents;
@@ -49,7 +52,14 @@ struct lsqf_ent {
 
 
 struct lsqf_ent_array *lsqf_parse(char *fmt);
-char                  *lsqf_to_string(const struct lsqf_ent_array *array, const struct pkg *pkg);
+
+/* format compiled into flat list of ops, see lsqf_format() */
+struct lsqf_prog      *lsqf_compile(char *fmt);
+void                   lsqf_prog_free(struct lsqf_prog *prog);
+int                    lsqf_format(const struct lsqf_prog *prog, const struct pkg *pkg,
+                                   tn_buf *nbuf);
+/* PKG_PREFETCH_* flags of data used by format */
+unsigned               lsqf_prefetch_flags(const struct lsqf_prog *prog);
 
 struct lsqf_ent_array *lsqf_ent_array_new(void);
 void                   lsqf_ent_array_free(struct lsqf_ent_array *array);
@@ -82,6 +82,9 @@ static void argp_as_docbook(struct argp *argp);
 #define OPT_NOPROGRESS          (OPT_GID + 20)
 #define OPT_FORCECOLOR        (OPT_GID + 21)
 #define OPT_DOCB              (OPT_GID + 24)
+#define OPT_DAEMON            (OPT_GID + 25)
+#define OPT_REMOTE            (OPT_GID + 26)
+#define OPT_TRACE             (OPT_GID + 27)
 
 #define OPT_AS_FLAG(OPT)       (1 << (OPT - OPT_GID))
 
@@ -125,10 +128,17 @@ static struct argp_option common_options[] = {
      N_("Display program version information and exit"), OPT_GID },
 
 {"log", OPT_LOG, "FILE", 0, N_("Log program messages to FILE"), OPT_GID },
+{"trace", OPT_TRACE, "FILE", 0,
+     N_("Write timing trace to FILE (Chrome trace format if FILE ends with "
+        "\".json\", summary otherwise)"), OPT_GID },
 {"runas", OPT_RUNAS, "USER", 0, N_("Run program as user USER"), OPT_GID },
 {NULL, OPT_OPTION, "OPTION=VALUE", 0, N_("Set configuration option"), OPT_GID },
 {"docbook", OPT_DOCB, 0, OPTION_HIDDEN,
         N_("Dump options in docbook format"), OPT_GID },
+{"daemon", OPT_DAEMON, "SOCKET", 0,
+     N_("Keep packages loaded and serve commands on unix SOCKET"), OPT_GID },
+{"remote", OPT_REMOTE, "SOCKET", 0,
+     N_("Execute command by poldek daemon listening on SOCKET"), OPT_GID },
 {"noprogress", OPT_NOPROGRESS, 0, 0, N_("Do not show progress bar"), OPT_GID },
 {"color", OPT_FORCECOLOR, 0, 0, N_("Force color on non-tty output"), OPT_GID },
 {0,  'v', 0, 0, N_("Be verbose."), OPT_GID },
@@ -178,6 +188,8 @@ struct args {
     char        *path_log;
 
     char        *shcmd;
+    char        *daemon_socket;
+    char        *remote_socket;
 
     tn_array    *opgroup_rts;
 
@@ -220,6 +232,11 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
             poldek_configure(ctx, POLDEK_CONF_LOGFILE, arg);
             break;
 
+        case OPT_TRACE:
+            if (!poldek_configure(ctx, POLDEK_CONF_TRACEFILE, arg))
+                exit(EXIT_FAILURE);
+            break;
+
         case OPT_CACHEDIR:
             poldek_configure(ctx, POLDEK_CONF_CACHEDIR, arg);
             if (!poldek_setup_cachedir(argsp->ctx)) /* set up immediately */
@@ -271,6 +288,15 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
         case OPT_RUNAS:         /* ignored, catched at startup */
             break;
 
+        case OPT_DAEMON:
+            argsp->daemon_socket = arg;
+            break;
+
+        case OPT_REMOTE:        /* the rest of args is a command */
+            argsp->remote_socket = arg;
+            argsp->mode = RUNMODE_APT;
+            break;
+
         case OPT_SHELL:         /* default */
             argsp->mjrmode = MODE_SHELL;
             argsp->cnflags |= OPT_AS_FLAG(OPT_SHELL);
@@ -715,6 +741,13 @@ int main(int argc, char **argv)
 
     parse_options(cctx, ts, argc, argv, mode);
 
+    if (g_args.remote_socket) { /* thin client, nothing to set up */
+        rc = poclidek_daemon_exec(g_args.remote_socket, g_args.argc,
+                                  (const char **)g_args.argv);
+        rc = rc > 0;
+        goto out;
+    }
+
     if (!poldek_setup(ctx))
         exit(EXIT_FAILURE);
 
@@ -736,6 +769,11 @@ int main(int argc, char **argv)
     printf("\n");
 #endif
 
+    if (g_args.daemon_socket) {
+        rc = poclidek_daemon(cctx, g_args.daemon_socket);
+        goto out;
+    }
+
     if ((g_args.cnflags & OPT_AS_FLAG(OPT_SHELL)) == 0) { /*no explicit --shell*/
         if (g_args.argc == 0 && (rrc & OPGROUP_RC_OK)) /* something minor cmd was executed  */
             goto out;
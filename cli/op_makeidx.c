@@ -84,6 +84,10 @@ static struct mopt valid_mopts[] = {
     },
 
     { "nodiff", PKGDIR_CREAT_NOPATCH, N_("Don't create index delta files") },
+    {
+        "depgraph", PKGDIR_CREAT_DEPGRAPH,
+        N_("Save resolved dependency graph along with index")
+    },
     { "gzip", 0, N_("Gzip compressed index (default)") },
     { "gz", 0, N_("Gzip compressed index (default)") },
     { "zstd", 0, N_("ZSTD compressed index") },
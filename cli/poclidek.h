@@ -56,6 +56,11 @@ EXPORT tn_array *poclidek_rcmd_get_packages(struct poclidek_rcmd *rcmd);
 EXPORT tn_buf *poclidek_rcmd_get_buf(struct poclidek_rcmd *rcmd);
 EXPORT const char *poclidek_rcmd_get_output(struct poclidek_rcmd *rcmd);
 
+/* resident mode, serve commands on unix socket until SIGINT */
+EXPORT int poclidek_daemon(struct poclidek_ctx *cctx, const char *sockpath);
+/* execute command by daemon, returns command rc or -1 on error */
+EXPORT int poclidek_daemon_exec(const char *sockpath, int argc, const char **argv);
+
 /* library internals */
 #include "dent.h"
 #include "cmd.h"
@@ -93,33 +93,35 @@ static int pull(struct cmdctx *cmdctx)
 {
     tn_array *sources = poldek_get_sources(cmdctx->cctx->ctx);
     struct arg_s *args = cmdctx->_data;
-    int nerr = 0;
+    int rc = 1;
 
     if (args->action == ACTION_LIST) {
         poclidek__print_source_list(cmdctx->cctx->ctx, sources, 1);
 
     } else {
+        tn_array *todo = n_array_new(n_array_size(sources), NULL, NULL);
+
         if (args->repos)
             n_array_sort(args->repos);
 
         for (int i=0; i < n_array_size(sources); i++) {
             struct source *src = n_array_nth(sources, i);
 
-            if (args->repos && n_array_bsearch(args->repos, src->name) == NULL) {
-                continue;
-            } else if (src->flags & PKGSOURCE_NOAUTOUP) {
+            if (args->repos && n_array_bsearch(args->repos, src->name) == NULL)
                 continue;
-            }
 
-            if (!source_update(src, PKGSOURCE_UP | PKGSOURCE_UPAUTOA))
-                nerr++;
+            n_array_push(todo, src);
         }
 
+        /* NOAUTOUP ones are skipped by sources_update() */
+        rc = sources_update(todo, PKGSOURCE_UP | PKGSOURCE_UPAUTOA);
+        n_array_free(todo);
+
         if (args->repos)
             n_array_free(args->repos);
     }
 
 
     n_array_free(sources);
-    return nerr == 0;
+    return rc;
 }
@@ -50,6 +50,7 @@
 #include "capreq.h"
 #include "search.h"
 #include "pkgu.h"
+#include "thread.h"
 #include "cli.h"
 
 static const unsigned char   *pcre_chartable = NULL;
@@ -61,6 +62,8 @@ static int                    pcre_established = 0;
 struct pattern {
     int              type;
     char             *regexp;
+    int              regexp_len;
+    int              literal;   /* PATTERN_FMASK without wildcards */
     int              fnmatch_flags;
     unsigned         pcre_flags;
     pcre             *pcre;
@@ -204,6 +207,10 @@ static struct pattern *build_pattern(struct cmdctx *cmdctx, char *arg)
         pt->type = PATTERN_FMASK;
 
     pt->regexp = n_strdup(regexp);
+    pt->regexp_len = strlen(regexp);
+    pt->literal = 0;
+    if (pt->type == PATTERN_FMASK && strpbrk(regexp, "*?[\\") == NULL)
+        pt->literal = 1;
     pt->fnmatch_flags = 0;
     pt->pcre_flags = flags;
     pt->pcre = NULL;
@@ -338,8 +345,12 @@ int pattern_compile(struct pattern *pt, int ntimes)
     }
 
     if (ntimes > 10) {
+        int study_flags = 0;
+#ifdef PCRE_STUDY_JIT_COMPILE
+        study_flags |= PCRE_STUDY_JIT_COMPILE;
+#endif
         pcre_err = NULL;
-        pt->pcre_extra = pcre_study(pt->pcre, 0, &pcre_err);
+        pt->pcre_extra = pcre_study(pt->pcre, study_flags, &pcre_err);
         if (pt->pcre_extra == NULL && pcre_err) {
             logn(LOGERR, _("search: pattern study: %s: %s"), pt->regexp,
                  pcre_err);
@@ -349,6 +360,19 @@ int pattern_compile(struct pattern *pt, int ntimes)
     return 1;
 }
 
+static inline
+int literal_eq(struct pattern *pt, const char *p, const char *s, int len)
+{
+#ifdef FNM_CASEFOLD
+    if (pt->fnmatch_flags & FNM_CASEFOLD)
+        return strncasecmp(p, s, len) == 0;
+#endif
+    (void)pt;
+    return strncmp(p, s, len) == 0;
+}
+
+/* pcre_exec() keeps match state on the caller's stack, so compiled
+   pattern (and its JIT code) is shared by all search threads */
 static
 int pattern_match(struct pattern *pt, const char *s, int len)
 {
@@ -360,7 +384,12 @@ int pattern_match(struct pattern *pt, const char *s, int len)
     switch (pt->type) {
         case PATTERN_FMASK:
             n_assert(s[len] == '\0');
-            match = (fnmatch(pt->regexp, s, pt->fnmatch_flags) == 0);
+            if (pt->literal) {
+                if (len == pt->regexp_len)
+                    match = literal_eq(pt, pt->regexp, s, len);
+            } else {
+                match = (fnmatch(pt->regexp, s, pt->fnmatch_flags) == 0);
+            }
             break;
 
         case PATTERN_PCRE:
@@ -392,7 +421,11 @@ void pattern_free(struct pattern *pt)
     }
 
     if (pt->pcre_extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+        pcre_free_study(pt->pcre_extra);
+#else
         free(pt->pcre_extra);
+#endif
         pt->pcre_extra = NULL;
     }
 
@@ -400,39 +433,85 @@ void pattern_free(struct pattern *pt)
 }
 
 
+/* literal path pattern vs dirname part, returns basename part offset or 0 */
+static int literal_dirname_match(struct pattern *pt, const char *dn)
+{
+    int dlen;
+
+    if (*pt->regexp != '/')
+        return 0;
+
+    if (*dn == '/')             /* root dir */
+        return 1;
+
+    dlen = strlen(dn);
+    if (pt->regexp_len < dlen + 2 || pt->regexp[dlen + 1] != '/')
+        return 0;
+
+    if (!literal_eq(pt, &pt->regexp[1], dn, dlen))
+        return 0;
+
+    return dlen + 2;
+}
+
 static int fl_match(tn_tuple *fl, struct pattern *pt)
 {
     int i, j, match = 0;
 
-
     for (i=0; i < n_tuple_size(fl); i++) {
         struct pkgfl_ent    *flent = n_tuple_nth(fl, i);
         char                path[PATH_MAX], *dn;
-        int                 n;
+        int                 n, bn_off = 0;
 
         dn = flent->dirname;
-        if (*dn == '/') {
-            n_assert(*(dn + 1) == '\0');
-            n = n_snprintf(path, sizeof(path), dn);
 
-        } else {
-            n = n_snprintf(path, sizeof(path), "/%s/", dn);
+        /* literal path: match dirname and basename parts separately */
+        if (pt->literal)
+            bn_off = literal_dirname_match(pt, dn);
+
+        n = 0;
+        if (!pt->literal) {     /* dirname part built once per directory */
+            int dlen;
+
+            path[n++] = '/';
+            if (*dn == '/') {
+                n_assert(*(dn + 1) == '\0');
+
+            } else if ((dlen = strlen(dn)) + 2 < (int)sizeof(path)) {
+                memcpy(&path[n], dn, dlen);
+                n += dlen;
+                path[n++] = '/';
+
+            } else {
+                continue;
+            }
         }
 
         for (j=0; j < flent->items; j++) {
             struct flfile *f = flent->files[j];
-            int nn;
+            int bnlen = strlen(f->basename);
 
             if (S_ISLNK(f->mode)) {
-                char *name;
+                const char *name = f->basename + bnlen + 1;
 
-                name = f->basename + strlen(f->basename) + 1;
                 if ((match = pattern_match(pt, name, 0)))
                     goto l_end;
             }
 
-            nn = n_snprintf(&path[n], sizeof(path) - n, "%s", f->basename);
-            if ((match = pattern_match(pt, path, n + nn)))
+            if (pt->literal) {
+                if (bn_off > 0 && bn_off + bnlen == pt->regexp_len &&
+                    literal_eq(pt, &pt->regexp[bn_off], f->basename, bnlen)) {
+                    match = 1;
+                    goto l_end;
+                }
+                continue;
+            }
+
+            if (n + bnlen >= (int)sizeof(path))
+                continue;
+
+            memcpy(&path[n], f->basename, bnlen + 1);
+            if ((match = pattern_match(pt, path, n + bnlen)))
                 goto l_end;
         }
     }
@@ -441,6 +520,10 @@ l_end:
     return match;
 }
 
+#ifdef ENABLE_THREADS
+/* index (tndb) reads are not thread safe */
+static pthread_mutex_t hdd_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 static int search_pkg_files(struct pkg *pkg, struct pattern *pt)
 {
@@ -451,7 +534,11 @@ static int search_pkg_files(struct pkg *pkg, struct pattern *pt)
     if (pkg->fl && fl_match(pkg->fl, pt))
         return 1;
 
-    if ((flist = pkg_get_nodep_flist(pkg)) != NULL) {
+    mutex_lock(&hdd_mutex);
+    flist = pkg_get_nodep_flist(pkg);
+    mutex_unlock(&hdd_mutex);
+
+    if (flist != NULL) {
         match = fl_match(flist->fl, pt);
         pkgflist_free(flist);
     }
@@ -540,8 +627,12 @@ static int pkg_match(struct pkg *pkg, struct pattern *pt, unsigned flags)
         struct pkguinf *pkgu;
         const char *s;
 
-        if ((pkgu = pkg_uinf(pkg)) == NULL) {
-            logn(LOGERR, _("%s: load package info failed"), pkg_snprintf_s(pkg));
+        mutex_lock(&hdd_mutex);
+        pkgu = pkg_uinf(pkg);
+        mutex_unlock(&hdd_mutex);
+
+        if (pkgu == NULL) {
+            logn(LOGERR, _("%s: load package info failed"), pkg_id(pkg));
 
         } else {
             if (flags & OPT_SEARCH_SUMM) {
@@ -578,12 +669,66 @@ l_end:
 }
 
 
+#define SEARCH_CHUNK 32
+
+struct search_job {
+    tn_array        *pkgs;
+    struct pattern  *pt;
+    unsigned        flags;
+    unsigned char   *matches;   /* match flag per pkgs item */
+    int             next;       /* next chunk to take */
+    int             interrupted;
+    int             display_bar;
+    int             bar_v;
+};
+
+static void search_worker(void *data, int worker_no, int nworkers)
+{
+    struct search_job *job = data;
+    int n = n_array_size(job->pkgs);
+
+    (void)nworkers;
+
+    while (!__atomic_load_n(&job->interrupted, __ATOMIC_RELAXED)) {
+        int i, from, to;
+
+        /* chunks are taken in order, so index reads remain (almost) sequential */
+        from = __atomic_fetch_add(&job->next, SEARCH_CHUNK, __ATOMIC_RELAXED);
+        if (from >= n)
+            break;
+
+        to = from + SEARCH_CHUNK;
+        if (to > n)
+            to = n;
+
+        for (i = from; i < to; i++) {
+            struct pkg *pkg = n_array_nth(job->pkgs, i);
+            job->matches[i] = pkg_match(pkg, job->pt, job->flags);
+        }
+
+        if (sigint_reached()) {
+            __atomic_store_n(&job->interrupted, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        if (job->display_bar && worker_no == 0) {
+            int v, j;
+
+            v = to * 40 / n;
+            for (j = job->bar_v; j < v; j++)
+                msg(0, "_.");
+            job->bar_v = v;
+        }
+    }
+}
+
 static int search(struct cmdctx *cmdctx)
 {
     struct poclidek_ctx   *cctx = NULL;
     tn_array               *pkgs = NULL;
     tn_array               *matched_pkgs = NULL;
-    int                    i, err = 0, display_bar = 0, bar_v;
+    struct search_job      job;
+    int                    i, err = 0, display_bar = 0;
     int                    term_height;
     struct pattern         *pt;
     unsigned               flags;
@@ -602,12 +747,6 @@ static int search(struct cmdctx *cmdctx)
     if (flags == 0)
         cmdctx->_flags |= OPT_SEARCH_DEFAULT;
 
-    init_pcre();
-    if (!pattern_compile(pt, poldek_ts_get_arg_count(cmdctx->ts))) {
-        err++;
-        goto l_end;
-    }
-
     if (poldek_ts_get_arg_count(cmdctx->ts) == 0) {
         pkgs = poclidek_get_dent_packages(cctx, NULL, 0);
     } else {
@@ -619,12 +758,18 @@ static int search(struct cmdctx *cmdctx)
 
     n_assert(n_array_size(pkgs) > 0);
 
+    init_pcre();
+    /* study (and JIT-compile) the pattern if it's worth to */
+    if (!pattern_compile(pt, n_array_size(pkgs))) {
+        err++;
+        goto l_end;
+    }
+
     matched_pkgs = n_array_new(32, NULL, NULL);
     if (n_array_size(pkgs) > 5 && (cmdctx->_flags & OPT_SEARCH_HDD)) {
         display_bar = 1;
         msg(0, _("Searching packages..."));
     }
-    bar_v = 0;
 
     /*
        sort by sequence number avoids index backward seeks
@@ -637,25 +782,26 @@ static int search(struct cmdctx *cmdctx)
             n_array_sort_ex(pkgs, (tn_fn_cmp)pkg_cmp_seqno);
     }
 
-    for (i=0; i < n_array_size(pkgs); i++) {
-        struct pkg *pkg = n_array_nth(pkgs, i);
-
-        if (pkg_match(pkg, pt, cmdctx->_flags))
-            n_array_push(matched_pkgs, pkg);
+    memset(&job, 0, sizeof(job));
+    job.pkgs = pkgs;
+    job.pt = pt;
+    job.flags = cmdctx->_flags;
+    job.matches = n_calloc(n_array_size(pkgs), sizeof(*job.matches));
+    job.display_bar = display_bar;
 
-        if (display_bar) {
-            int v, j;
+    poldek_run_workers(poldek_nworkers(n_array_size(pkgs), 256),
+                       search_worker, &job);
 
-            v = i * 40 / n_array_size(pkgs);
-            for (j = bar_v; j < v; j++)
-                msg(0, "_.");
-            bar_v = v;
-        }
+    /* merge in original order */
+    for (i=0; i < n_array_size(pkgs); i++) {
+        if (job.matches[i])
+            n_array_push(matched_pkgs, n_array_nth(pkgs, i));
+    }
+    free(job.matches);
 
-        if (sigint_reached()) {
-            msgn(0, _("_interrupted."));
-            goto l_end;
-        }
+    if (job.interrupted) {
+        msgn(0, _("_interrupted."));
+        goto l_end;
     }
 
     if (display_bar)
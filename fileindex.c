@@ -32,6 +32,7 @@
 #include "capreq.h"
 #include "fileindex.h"
 #include "pkgset.h"
+#include "thread.h"
 
 extern int poldek_conf_MULTILIB;
 
@@ -210,6 +211,12 @@ int findfile(const struct file_index *fi,
         return 0;
     }
 
+#ifdef ENABLE_THREADS
+    /* no lazy sort on shared arrays, see file_index_setup() */
+    if (poldek_threading_is_on())
+        n_assert(n_array_is_sorted(files));
+    else
+#endif
     if (!n_array_is_sorted(files)) { /* lazy sort */
         n_array_sort(files);
     }
@@ -421,17 +428,50 @@ void verify_dups(int from, int to, const char *path, tn_array *fents,
     }
 }
 
+/*
+  Directories are scanned for duplicated basenames on worker threads, each
+  one takes a contiguous part of directories in n_hash_map() order and
+  collects ranges of duplicates. Conflicts are registered afterwards, in
+  the same order, by single thread: verify_dups() depends on conflicts
+  registered so far and modifies packages.
+*/
+struct dup_range {
+    int dir;                    /* index of dirs[] */
+    int from;
+    int to;
+};
+
+struct fidx_dir {
+    const char *name;
+    tn_array   *files;
+};
+
+struct dups_ctx {
+    struct fidx_dir  *dirs;
+    int              ndirs;
+    tn_array         **ranges;  /* dup_range[], per worker */
+    int              *nfiles;   /* per worker */
+};
+
+static void collect_dir(const char *dirname, void *data, void *ctx_)
+{
+    struct dups_ctx *ctx = ctx_;
+
+    ctx->dirs[ctx->ndirs].name = dirname;
+    ctx->dirs[ctx->ndirs].files = data;
+    ctx->ndirs++;
+}
+
 static
-void find_dups(const char *dirname, void *data, void *ms_)
+void find_dups(struct dups_ctx *ctx, int dir, tn_array *ranges)
 {
     struct file_ent *prev_ent, *ent;
+    tn_array *data = ctx->dirs[dir].files;
     int i, ii, from;
-    char path[PATH_MAX];
-    struct map_struct *ms = ms_;
 
     prev_ent = n_array_nth(data, 0);
     from = 0;
-    ms->nfiles += n_array_size(data);
+
     for (i=1; i < n_array_size(data); i++) {
         ent = n_array_nth(data, i);
         ii = i;
@@ -443,9 +483,12 @@ void find_dups(const char *dirname, void *data, void *ms_)
         }
 
         if (ii != i) {
-            snprintf(path, sizeof(path), "%s/%s", dirname,
-                     prev_ent->flfile->basename);
-            verify_dups(from, ii, path, data, ms);
+            struct dup_range *r = n_malloc(sizeof(*r));
+
+            r->dir = dir;
+            r->from = from;
+            r->to = ii;
+            n_array_push(ranges, r);
         }
 
         prev_ent = ent;
@@ -454,15 +497,64 @@ void find_dups(const char *dirname, void *data, void *ms_)
     }
 }
 
+static void find_dups_worker(void *data, int worker_no, int nworkers)
+{
+    struct dups_ctx *ctx = data;
+    int i, start, end;
+
+    start = (int)((long)ctx->ndirs * worker_no / nworkers);
+    end = (int)((long)ctx->ndirs * (worker_no + 1) / nworkers);
+
+    for (i = start; i < end; i++) {
+        ctx->nfiles[worker_no] += n_array_size(ctx->dirs[i].files);
+        find_dups(ctx, i, ctx->ranges[worker_no]);
+    }
+}
+
 static
 tn_hash *file_index_find_conflicts(const struct file_index *fi, int strict)
 {
     struct map_struct ms;
+    struct dups_ctx ctx;
+    int i, j, nworkers;
+
     ms.strict = strict;
     ms.nfiles = 0;
     ms.cnflh = n_hash_new(64, (tn_fn_free)n_array_free);
     n_hash_ctl(ms.cnflh, TN_HASH_NOCPKEY);
-    n_hash_map_arg(fi->dirs, find_dups, &ms);
+
+    ctx.dirs = n_malloc((n_hash_size(fi->dirs) + 1) * sizeof(*ctx.dirs));
+    ctx.ndirs = 0;
+    n_hash_map_arg(fi->dirs, collect_dir, &ctx);
+
+    nworkers = poldek_nworkers(ctx.ndirs, 1024);
+    ctx.ranges = n_malloc(nworkers * sizeof(*ctx.ranges));
+    ctx.nfiles = n_calloc(nworkers, sizeof(*ctx.nfiles));
+
+    for (i=0; i < nworkers; i++)
+        ctx.ranges[i] = n_array_new(64, free, NULL);
+
+    poldek_run_workers(nworkers, find_dups_worker, &ctx);
+
+    for (i=0; i < nworkers; i++) {
+        for (j=0; j < n_array_size(ctx.ranges[i]); j++) {
+            struct dup_range *r = n_array_nth(ctx.ranges[i], j);
+            struct fidx_dir *dir = &ctx.dirs[r->dir];
+            struct file_ent *ent = n_array_nth(dir->files, r->from);
+            char path[PATH_MAX];
+
+            snprintf(path, sizeof(path), "%s/%s", dir->name,
+                     ent->flfile->basename);
+            verify_dups(r->from, r->to, path, dir->files, &ms);
+        }
+
+        ms.nfiles += ctx.nfiles[i];
+        n_array_free(ctx.ranges[i]);
+    }
+
+    free(ctx.ranges);
+    free(ctx.nfiles);
+    free(ctx.dirs);
 
     DBGF("%d dirnames, %d files\n", n_hash_size(fi->dirs), ms.nfiles);
     return ms.cnflh;
@@ -579,31 +671,39 @@ static tn_array *get_pkg_dirs(struct pkg *pkg)
 }
 
 
-int file_index_report_orphans(const struct file_index *fi, tn_array *pkgs)
+/* packages are scanned on worker threads, each one takes a contiguous
+   part of pkgs and collects its own dir => orphaning packages table */
+struct orphans_ctx {
+    const struct file_index *fi;
+    tn_array                *pkgs;
+    tn_hash                 **orphanh; /* per worker */
+};
+
+static void find_orphans_worker(void *data, int worker_no, int nworkers)
 {
+    struct orphans_ctx *ctx = data;
     struct pkg *result[2048];
-    tn_array   *paths;
-    tn_hash    *orphanh; //, *missreqh, *is_path_to_cache; unused?
-    int        i, j, norphans = 0, modv = 0;
+    tn_hash    *orphanh = ctx->orphanh[worker_no];
+    int        i, j, start, end, modv = 0;
 
-    orphanh  = n_hash_new(n_array_size(pkgs)/100, (tn_fn_free)n_hash_free);
-    //missreqh = n_hash_new(n_array_size(pkgs), (tn_fn_free)n_array_free);
-    //is_path_to_cache = n_hash_new(n_array_size(pkgs)/100, NULL);
+    start = (int)((long)n_array_size(ctx->pkgs) * worker_no / nworkers);
+    end = (int)((long)n_array_size(ctx->pkgs) * (worker_no + 1) / nworkers);
 
-    if (n_array_size(pkgs) > 100) {
-        modv = n_array_size(pkgs) / 100.0;
+    /* progress is reported by the first one only */
+    if (worker_no == 0 && end - start > 100) {
+        modv = (end - start) / 100.0;
         modv = modv > 0 ? modv : 1;
     }
 
-    for (i=0; i < n_array_size(pkgs); i++) {
+    for (i = start; i < end; i++) {
         struct pkg *pkg;
         tn_array *dirs;
 
-        pkg = n_array_nth(pkgs, i);
+        pkg = n_array_nth(ctx->pkgs, i);
 
-        if (modv && i % modv == 0)
+        if (modv && (i - start) % modv == 0)
             msg_tty(1, "\r%.1lf%% done",
-                    ((float)i / n_array_size(pkgs)) * 100.0);
+                    ((float)(i - start) / (end - start)) * 100.0);
 
         if (pkg->fl == NULL)
             continue;
@@ -613,25 +713,77 @@ int file_index_report_orphans(const struct file_index *fi, tn_array *pkgs)
 
         for (j=0; j < n_array_size(dirs); j++) {
             char *dir = n_array_nth(dirs, j);
+            tn_array *opkgs;
             int nfound;
 
-            if (n_hash_exists(orphanh, dir)) {
-                tn_hash *opkgh = n_hash_get(orphanh, dir);
-                n_hash_replace(opkgh, pkg_snprintf_s0(pkg), pkg);
+            if ((opkgs = n_hash_get(orphanh, dir))) {
+                n_array_push(opkgs, pkg);
                 continue;
             }
 
-            nfound = file_index_lookup(fi, dir, strlen(dir), result, 2048);
+            nfound = file_index_lookup(ctx->fi, dir, strlen(dir), result, 2048);
             if (nfound == 0) {
-                tn_hash *opkgh = n_hash_new(128, NULL);
-                n_hash_insert(opkgh, pkg_id(pkg), pkg);
-                n_hash_insert(orphanh, dir, opkgh);
+                opkgs = n_array_new(4, NULL, NULL);
+                n_array_push(opkgs, pkg);
+                n_hash_insert(orphanh, dir, opkgs);
             }
         }
         n_array_free(dirs);
     }
+
     if (modv)
         msg_tty(1, "\r          \r");
+}
+
+int file_index_report_orphans(const struct file_index *fi, tn_array *pkgs)
+{
+    struct orphans_ctx ctx;
+    tn_array   *paths;
+    tn_hash    *orphanh;
+    int        i, j, k, norphans = 0, nworkers;
+
+    orphanh  = n_hash_new(n_array_size(pkgs)/100, (tn_fn_free)n_hash_free);
+
+    nworkers = poldek_nworkers(n_array_size(pkgs), 256);
+    ctx.fi = fi;
+    ctx.pkgs = pkgs;
+    ctx.orphanh = n_malloc(nworkers * sizeof(*ctx.orphanh));
+    for (i=0; i < nworkers; i++)
+        ctx.orphanh[i] = n_hash_new(128, (tn_fn_free)n_array_free);
+
+    /* findfile() must not sort shared arrays on worker threads */
+    file_index_setup((struct file_index*)fi);
+    poldek_run_workers(nworkers, find_orphans_worker, &ctx);
+
+    /* merge in pkgs order; first package of a directory is keyed by its
+       id, next ones by pkg_snprintf() (as it always was) */
+    for (i=0; i < nworkers; i++) {
+        tn_array *dirs = n_hash_keys(ctx.orphanh[i]);
+
+        for (j=0; j < n_array_size(dirs); j++) {
+            char *dir = n_array_nth(dirs, j);
+            tn_array *opkgs = n_hash_get(ctx.orphanh[i], dir);
+            tn_hash *opkgh;
+
+            k = 0;
+            if ((opkgh = n_hash_get(orphanh, dir)) == NULL) {
+                struct pkg *pkg = n_array_nth(opkgs, k++);
+
+                opkgh = n_hash_new(128, NULL);
+                n_hash_insert(opkgh, pkg_id(pkg), pkg);
+                n_hash_insert(orphanh, dir, opkgh);
+            }
+
+            for (; k < n_array_size(opkgs); k++) {
+                struct pkg *pkg = n_array_nth(opkgs, k);
+                n_hash_replace(opkgh, pkg_snprintf_s0(pkg), pkg);
+            }
+        }
+
+        n_array_free(dirs);
+        n_hash_free(ctx.orphanh[i]);
+    }
+    free(ctx.orphanh);
 
     paths = n_hash_keys(orphanh);
     n_array_sort(paths);
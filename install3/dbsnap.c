@@ -0,0 +1,158 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/*
+  In-memory snapshot of installed packages (NEVRA, color and caps), read
+  once per transaction, so candidate scoring does not query the database
+  for every package and requirement. Snapshot follows ts->db generation,
+  i.e. it is rebuilt after database has been reopened or modified.
+*/
+
+#include "ictx.h"
+#include "trace.h"
+
+struct i3_dbsnap {
+    unsigned  generation;       /* of ts->db */
+    tn_array  *pkgs;
+    tn_hash   *nameh;           /* name => packages, newest first */
+    tn_hash   *caph;            /* cap name => packages */
+};
+
+static void snap_index(tn_hash *h, const char *key, struct pkg *pkg)
+{
+    tn_array *pkgs;
+
+    if ((pkgs = n_hash_get(h, key)) == NULL) {
+        pkgs = n_array_new(2, NULL, NULL);
+        n_hash_insert(h, key, pkgs);
+    }
+
+    n_array_push(pkgs, pkg);
+}
+
+static struct i3_dbsnap *dbsnap_new(struct pkgdb *db)
+{
+    struct trace_span *span = trace_begin("i3.dbsnap");
+    struct i3_dbsnap *snap;
+    tn_array *pkgs = NULL;
+    int i, j;
+
+    pkgdb_search(db, &pkgs, PMTAG_RECNO, NULL, NULL, PKG_LDCAPS);
+    if (pkgs == NULL)
+        pkgs = pkgs_array_new(16);
+
+    /* newest first within a name */
+    n_array_ctl_set_cmpfn(pkgs, (tn_fn_cmp)pkg_cmp_name_evr_rev);
+    n_array_sort(pkgs);
+
+    snap = n_malloc(sizeof(*snap));
+    snap->generation = db->_generation;
+    snap->pkgs = pkgs;
+    snap->nameh = n_hash_new(n_array_size(pkgs) + 16, (tn_fn_free)n_array_free);
+    snap->caph = n_hash_new(n_array_size(pkgs) * 4 + 16, (tn_fn_free)n_array_free);
+    n_hash_ctl(snap->caph, TN_HASH_REHASH);
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+
+        snap_index(snap->nameh, pkg->name, pkg);
+
+        for (j=0; pkg->caps && j < n_array_size(pkg->caps); j++) {
+            struct capreq *cap = n_array_nth(pkg->caps, j);
+            tn_array *cpkgs = n_hash_get(snap->caph, capreq_name(cap));
+
+            /* package may provide the same name several times */
+            if (cpkgs && n_array_nth(cpkgs, n_array_size(cpkgs) - 1) == pkg)
+                continue;
+
+            snap_index(snap->caph, capreq_name(cap), pkg);
+        }
+    }
+
+    trace_count(span, "packages", n_array_size(pkgs));
+    trace_end(span);
+
+    msgn(3, "Installed packages snapshot: %d package(s)", n_array_size(pkgs));
+    return snap;
+}
+
+void i3_dbsnap_free(struct i3_dbsnap *snap)
+{
+    if (snap == NULL)
+        return;
+
+    n_hash_free(snap->nameh);
+    n_hash_free(snap->caph);
+    n_array_free(snap->pkgs);
+    free(snap);
+}
+
+struct i3_dbsnap *i3_dbsnap(struct poldek_ts *ts)
+{
+    struct pkgdb *db = ts->db;
+
+    if (db == NULL || !db->_opened)
+        return NULL;
+
+    if (ts->_dbsnap && ts->_dbsnap->generation == db->_generation)
+        return ts->_dbsnap;
+
+    i3_dbsnap_free(ts->_dbsnap);
+    ts->_dbsnap = dbsnap_new(db);
+    ts->_dbsnap_free = i3_dbsnap_free; /* called by poldek_ts_free() */
+
+    return ts->_dbsnap;
+}
+
+const tn_array *i3_dbsnap_get_name(struct i3_dbsnap *snap, const char *name)
+{
+    return n_hash_get(snap->nameh, name);
+}
+
+const tn_array *i3_dbsnap_get_cap(struct i3_dbsnap *snap, const char *name)
+{
+    return n_hash_get(snap->caph, name);
+}
+
+int i3_dbsnap_match_req(struct i3_dbsnap *snap, const struct capreq *req,
+                        unsigned ma_flags, const tn_array *exclude)
+{
+    tn_array *pkgs;
+    int i, is_file = capreq_is_file(req);
+
+    /* like pkgdb_match_req(): package names first, caps next */
+    if (!is_file && (pkgs = n_hash_get(snap->nameh, capreq_name(req)))) {
+        for (i=0; i < n_array_size(pkgs); i++) {
+            struct pkg *pkg = n_array_nth(pkgs, i);
+
+            /* exclude is sorted by recno */
+            if (exclude && n_array_bsearch(exclude, pkg))
+                continue;
+
+            if (pkg_evr_match_req(pkg, req, POLDEK_MA_PROMOTE_VERSION))
+                return 1;
+        }
+    }
+
+    if ((pkgs = n_hash_get(snap->caph, capreq_name(req)))) {
+        for (i=0; i < n_array_size(pkgs); i++) {
+            struct pkg *pkg = n_array_nth(pkgs, i);
+
+            if (exclude && n_array_bsearch(exclude, pkg))
+                continue;
+
+            if (pkg_caps_match_req(pkg, req, ma_flags))
+                return 1;
+        }
+    }
+
+    /* file lists are not in snapshot */
+    return is_file ? -1 : 0;
+}
@@ -223,6 +223,7 @@ void i3ctx_init(struct i3ctx *ictx, struct poldek_ts *ts)
     ictx->multi_obsoleted = n_hash_new(8, (tn_fn_free)n_array_free);
     ictx->errors = n_hash_new(8, (tn_fn_free)n_array_free);
     ictx->abort = 0;
+    ictx->solution = NULL;
 }
 
 void i3ctx_destroy(struct i3ctx *ictx)
@@ -237,6 +238,10 @@ void i3ctx_destroy(struct i3ctx *ictx)
 
     n_hash_free(ictx->multi_obsoleted);
     n_hash_free(ictx->errors);
+
+    if (ictx->solution)
+        pkgmark_set_free(ictx->solution);
+
     memset(ictx, 0, sizeof(*ictx));
 }
 
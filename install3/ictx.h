@@ -105,6 +105,8 @@ struct i3ctx {
 
     unsigned           ma_flags;    /* match flags (POLDEK_MA_*) */
     int                abort;       /* abort processing? */
+
+    struct pkgmark_set *solution;   /* preferred providers (sat.c), or NULL */
 };
 
 
@@ -139,6 +141,23 @@ int i3_is_other_version_marked(struct i3ctx *ictx, const struct pkg *pkg,
 int i3_mark_namegroup(struct i3ctx *ictx,
                       struct pkg *pkg, tn_array *pkgs);
 
+/* dbsnap.c */
+struct i3_dbsnap;
+
+/* snapshot of ts->db, NULL if the database is not opened */
+struct i3_dbsnap *i3_dbsnap(struct poldek_ts *ts);
+void i3_dbsnap_free(struct i3_dbsnap *snap);
+
+/* installed packages named name, newest first, NULL if none */
+const tn_array *i3_dbsnap_get_name(struct i3_dbsnap *snap, const char *name);
+
+/* installed packages providing cap named name, NULL if none */
+const tn_array *i3_dbsnap_get_cap(struct i3_dbsnap *snap, const char *name);
+
+/* RET: 1 if req is provided, -1 if the database must be asked (files) */
+int i3_dbsnap_match_req(struct i3_dbsnap *snap, const struct capreq *req,
+                        unsigned ma_flags, const tn_array *exclude);
+
 /* misc.c */
 int i3_pkgdb_match_req(struct i3ctx *ictx, const struct capreq *req);
 
@@ -149,6 +168,10 @@ int i3_is_pkg_installable(struct poldek_ts *ts, const struct pkg *pkg,
 int i3_select_best_pkg(int indent, struct i3ctx *ictx,
                        const struct pkg *marker, tn_array *candidates);
 
+/* like above, but w/o color filtering; RET: best of candidates */
+struct pkg *i3_choose_best_pkg(int indent, struct i3ctx *ictx,
+                               const struct pkg *marker, tn_array *candidates);
+
 int i3_find_req(int indent, struct i3ctx *ictx,
                  const struct pkg *pkg, const struct capreq *req,
                  struct pkg **best_pkg, tn_array *candidates);
@@ -179,6 +202,16 @@ void i3_req_iter_destroy(struct i3_req_iter *it);
 
 const struct i3req *i3_req_iter_get(struct i3_req_iter *it);
 
+/* sat.c */
+/* RET: 1 if solution is found and stored in ictx->solution */
+int i3_sat_resolve(struct i3ctx *ictx, const tn_array *pkgs);
+
+/* speculate.c */
+/* RET: first of best and candidates which requirements do not lead
+   to a dead end, best if there is no such one */
+struct pkg *i3_speculate(int indent, struct i3ctx *ictx, const struct pkg *pkg,
+                         tn_array *candidates, struct pkg *best);
+
 /* conflicts.c */
 int i3_resolve_conflict(int indent, struct i3ctx *ictx,
                         struct pkg *pkg, const struct capreq *cnfl,
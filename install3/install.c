@@ -18,6 +18,7 @@
 #include "pkgdir/pkgdir.h"
 #include "ictx.h"
 #include "iset.h"
+#include "trace.h"
 
 static int verify_held_packages(struct i3ctx *ictx)
 {
@@ -256,6 +257,8 @@ static int install_packages(struct i3ctx *ictx)
     msgn(1, _("Processing dependencies..."));
     //pkgs_array_dump(toinstall, "inset");
 
+    struct trace_span *span = trace_begin("i3.resolve");
+
     for (i = 0; i < n_array_size(toinstall); i++) {
         struct pkg *pkg = n_array_nth(toinstall, i);
 
@@ -266,6 +269,9 @@ static int install_packages(struct i3ctx *ictx)
         if (sigint_reached())
             break;
     }
+    trace_count(span, "packages", n_array_size(toinstall));
+    trace_count(span, "marked", n_array_size(iset_packages(ictx->inset)));
+    trace_end(span);
     n_array_free(toinstall);
 
     i3_return_zero_if_stoppped(ictx);
@@ -437,8 +443,12 @@ int i3_do_poldek_ts_install(struct poldek_ts *ts)
         }
     }
 
-    if (!ts->getop(ts, POLDEK_OP_PARTICLE))
+    if (!ts->getop(ts, POLDEK_OP_PARTICLE)) {
+        if (ts->ctx->_depsolver == 4) /* falls back to plain install3 if fails */
+            i3_sat_resolve(&ictx, pkgs);
+
         nerr = !install_packages(&ictx);
+    }
 
  l_end:
 
@@ -26,7 +26,9 @@
 
 #include "i18n.h"
 #include "pkg.h"
+#include "pkgfl.h"
 #include "capreq.h"
+#include "pkgdir/pkgdir.h"
 #include "iset.h"
 #include "log.h"
 
@@ -36,10 +38,79 @@ extern int poldek_conf_MULTILIB;
 struct iset {
     tn_array             *pkgs;
     tn_array             *pkgs_by_recno;
-    tn_hash              *capcache; /* cache of resolved packages caps */
+    tn_hash              *caph;     /* cap name => packages providing it */
+    tn_hash              *fileh;    /* path => packages owning it */
+    tn_array             *pkgdirs;  /* with dirindex, to look up dirs */
     struct pkgmark_set   *pms;
 };
 
+static void index_add(tn_hash *h, const char *key, struct pkg *pkg)
+{
+    tn_array *pkgs;
+
+    if ((pkgs = n_hash_get(h, key)) == NULL) {
+        pkgs = n_array_new(2, NULL, NULL);
+        n_hash_insert(h, key, pkgs);
+    }
+
+    n_array_push(pkgs, pkg);
+}
+
+static void index_remove(tn_hash *h, const char *key, struct pkg *pkg)
+{
+    tn_array *pkgs;
+    int i;
+
+    if ((pkgs = n_hash_get(h, key)) == NULL)
+        return;
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        if (n_array_nth(pkgs, i) == pkg) {
+            n_array_remove_nth(pkgs, i);
+            break;
+        }
+    }
+
+    if (n_array_size(pkgs) == 0)
+        n_array_free(n_hash_remove(h, key));
+}
+
+/* index (or unindex) package name, capabilities and files */
+static void index_pkg(struct iset *iset, struct pkg *pkg, int remove)
+{
+    void (*fn)(tn_hash *, const char *, struct pkg *);
+    int i;
+
+    fn = remove ? index_remove : index_add;
+
+    fn(iset->caph, pkg->name, pkg);
+
+    for (i=0; pkg->caps && i < n_array_size(pkg->caps); i++) {
+        struct capreq *cap = n_array_nth(pkg->caps, i);
+
+        if (n_str_ne(capreq_name(cap), pkg->name))
+            fn(iset->caph, capreq_name(cap), pkg);
+    }
+
+    if (pkg->fl && n_tuple_size(pkg->fl) > 0) {
+        struct pkgfl_it it;
+        const char *path;
+
+        pkgfl_it_init(&it, pkg->fl);
+        while ((path = pkgfl_it_get(&it, NULL)))
+            fn(iset->fileh, path, pkg);
+    }
+
+    if (!remove && pkg->pkgdir && pkg->pkgdir->dirindex) {
+        for (i=0; i < n_array_size(iset->pkgdirs); i++)
+            if (n_array_nth(iset->pkgdirs, i) == pkg->pkgdir)
+                break;
+
+        if (i == n_array_size(iset->pkgdirs))
+            n_array_push(iset->pkgdirs, pkg->pkgdir);
+    }
+}
+
 void iset_markf(struct iset *iset, struct pkg *pkg, unsigned mflag)
 {
     pkg_set_mf(iset->pms, pkg, mflag);
@@ -74,7 +145,11 @@ struct iset *iset_new(void)
     iset = n_malloc(sizeof(*iset));
     iset->pkgs = pkgs_array_new(128);
     iset->pkgs_by_recno = pkgs_array_new_ex(128, pkg_cmp_recno);
-    iset->capcache = n_hash_new(128, NULL);
+    iset->caph = n_hash_new(1024, (tn_fn_free)n_array_free);
+    iset->fileh = n_hash_new(4096, (tn_fn_free)n_array_free);
+    n_hash_ctl(iset->caph, TN_HASH_REHASH);
+    n_hash_ctl(iset->fileh, TN_HASH_REHASH);
+    iset->pkgdirs = n_array_new(4, NULL, NULL);
     iset->pms = pkgmark_set_new(NULL, 0, 0);
     return iset;
 }
@@ -83,7 +158,9 @@ void iset_free(struct iset *iset)
 {
     n_array_free(iset->pkgs);
     n_array_free(iset->pkgs_by_recno);
-    n_hash_free(iset->capcache);
+    n_hash_free(iset->caph);
+    n_hash_free(iset->fileh);
+    n_array_free(iset->pkgdirs);
     pkgmark_set_free(iset->pms);
     free(iset);
 }
@@ -93,6 +170,7 @@ void iset_add(struct iset *iset, struct pkg *pkg, unsigned mflag)
     DBGF("add %s\n", pkg_id(pkg));
     n_array_push(iset->pkgs, pkg_link(pkg));
     n_array_push(iset->pkgs_by_recno, pkg_link(pkg));
+    index_pkg(iset, pkg, 0);
     mflag |= PKGMARK_ISET;
     iset_markf(iset, pkg, mflag);
 }
@@ -104,7 +182,6 @@ int iset_remove(struct iset *iset, struct pkg *pkg)
     if (!iset_ismarkedf(iset, pkg, PKGMARK_ISET)) /* not here */
         return 0;
 
-    n_hash_clean(iset->capcache); /* flush all, TODO: remove pkg caps only */
     pkg_clr_mf(iset->pms, pkg, PKGMARK_ISET);
 
     i = n_array_bsearch_idx(iset->pkgs, pkg);
@@ -116,6 +193,7 @@ int iset_remove(struct iset *iset, struct pkg *pkg)
         if (poldek_conf_MULTILIB)
             n_assert(pkg_cmp_arch(p, pkg) == 0);
 
+        index_pkg(iset, p, 1);
         n_array_remove_nth(iset->pkgs, i);
 
         /* recreate pkgs_by_recno (cheaper than manually find item to remove) */
@@ -158,69 +236,46 @@ struct pkg *iset_has_kind_of_pkg(struct iset *iset, const struct pkg *pkg)
 
 int iset_provides(struct iset *iset, const struct capreq *cap)
 {
-    char             *dirname, *basename, path[PATH_MAX];
-    char             *capnvr = NULL, *capname = NULL;
-    int              i, is_file = 0;
+    const char       *name = capreq_name(cap);
     struct pkg       *pkg = NULL;
+    tn_array         *pkgs;
+    int              i;
 
+    if (capreq_is_file(cap) && (pkgs = n_hash_get(iset->fileh, name)))
+        pkg = n_array_nth(pkgs, 0);
 
-    if (!capreq_has_ver(cap)) {
-        capname = (char*)capreq_name(cap);
+    if (pkg == NULL && (pkgs = n_hash_get(iset->caph, name))) {
+        for (i=0; i < n_array_size(pkgs); i++) {
+            struct pkg *p = n_array_nth(pkgs, i);
 
-    } else {
-        capname = capnvr = alloca(256);
-        capreq_snprintf(capnvr, 256, cap);
-    }
-
-    if ((pkg = n_hash_get(iset->capcache, capname))) {
-        DBGF("cache hit %s\n", capreq_stra(cap));
-        return 1;
-    }
-
-    if (capreq_is_file(cap)) {
-        is_file = 1;
-        strncpy(path, capreq_name(cap), sizeof(path));
-        path[PATH_MAX - 1] = '\0';
-        n_basedirnam(path, &dirname, &basename);
-        n_assert(dirname);
-
-        if (*dirname == '\0') { /* path = "/foo" */
-            char *tmp;
-            n_strdupap("/", &tmp);
-            dirname = tmp;
+            if (pkg_match_req(p, cap, 1)) {
+                pkg = p;
+                break;
+            }
         }
-
-        n_assert(*dirname);
-        if (*dirname == '/' && *(dirname + 1) != '\0')
-            dirname++;
     }
 
-    pkg = NULL;
-    for (i=0; i < n_array_size(iset->pkgs); i++) {
-        struct pkg *p = n_array_nth(iset->pkgs, i);
-
-        if (is_file && pkg_has_path(p, dirname, basename))
-            pkg = p;
-
-        else if (pkg_match_req(p, cap, 1))
-            pkg = p;
+    /* directories not in file lists, ask dirindexes */
+    if (pkg == NULL && capreq_is_file(cap)) {
+        for (i=0; i < n_array_size(iset->pkgdirs); i++) {
+            struct pkgdir *pkgdir = n_array_nth(iset->pkgdirs, i);
+            int j;
 
-        DBGF("  - %s provides %s -> %s\n", pkg_id(p),
-             capreq_stra(cap), pkg ? "YES" : "NO");
+            if ((pkgs = pkgdir_dirindex_get(pkgdir, NULL, name)) == NULL)
+                continue;
 
-        if (pkg)
-            break;
-    }
+            for (j=0; j < n_array_size(pkgs); j++) {
+                struct pkg *p = n_array_nth(pkgs, j);
 
-    if (pkg != NULL) {
-        DBGF("addto cache %s\n", capnvr ? capnvr : capname);
-        if (capnvr == NULL) {
-            n_hash_insert(iset->capcache, capname, pkg);
+                if (iset_has_pkg(iset, p)) {
+                    pkg = p;
+                    break;
+                }
+            }
+            n_array_free(pkgs);
 
-        } else {
-            n_hash_insert(iset->capcache, capnvr, pkg);
-            if (!n_hash_exists(iset->capcache, capname))
-                n_hash_insert(iset->capcache, capname, pkg);
+            if (pkg)
+                break;
         }
     }
 
@@ -15,33 +15,25 @@
 #endif
 
 #include "ictx.h"
+#include "trace.h"
 
-int i3_is_pkg_installed(struct poldek_ts *ts, const struct pkg *pkg, int *cmprc)
+/* count instances of pkg in dbpkgs (all named pkg->name), cmprc is set
+   against the newest one */
+static int count_installed(struct poldek_ts *ts, const struct pkg *pkg,
+                           const tn_array *dbpkgs, int *cmprc)
 {
-    tn_array *dbpkgs = NULL;
-    int n = 0, freshen = 0;
+    struct pkg *newest = NULL;
+    int i, n = 0, freshen = 0;
 
     freshen = ts->getop(ts, POLDEK_OP_FRESHEN)
 	    || poldek_ts_issetf(ts, POLDEK_TS_UPGRADE)
 	    || poldek_ts_issetf(ts, POLDEK_TS_DOWNGRADE)
 	    || poldek_ts_issetf(ts, POLDEK_TS_UPGRADEDIST);
 
-    n = pkgdb_search(ts->db, &dbpkgs, PMTAG_NAME, pkg->name, NULL, PKG_LDNEVR);
-    n_assert(n >= 0);
-
-    if (n == 0) {
-        n_assert(dbpkgs == NULL);
-        return 0;
-    }
-
-    if (poldek_conf_MULTILIB) { /* filter out different architectures */
-        tn_array *arr = n_array_clone(dbpkgs);
-
-        //DBGF("pkg = %s\n", pkg_id(pkg));
-        //pkgs_array_dump(dbpkgs, "before_multilib");
-        for (int i=0; i < n_array_size(dbpkgs); i++) {
-            struct pkg *dbpkg = n_array_nth(dbpkgs, i);
+    for (i=0; i < n_array_size(dbpkgs); i++) {
+        struct pkg *dbpkg = n_array_nth(dbpkgs, i);
 
+        if (poldek_conf_MULTILIB) { /* filter out different architectures */
 	    msgn(4, "from pkg %s.%s => to pkg %s-%s-%s.%s freshen:%d kind:%d up_arch:%d",
 	    pkg_snprintf_s(dbpkg), pkg_arch(dbpkg), pkg->name, pkg->ver, pkg->rel, pkg_arch(pkg),
 	    freshen, pkg_is_kind_of(dbpkg, pkg), pkg_is_arch_compat(dbpkg, pkg));
@@ -49,30 +41,43 @@ int i3_is_pkg_installed(struct poldek_ts *ts, const struct pkg *pkg, int *cmprc)
 	    // if freshen (upgrade) preffer same arch but
 	    // change from/to noarch depends on which pkg is noarch
 	    // add package if pkg_is_kind_of (have same name and color)
-            if (pkg_is_kind_of(dbpkg, pkg)
-		&& !(freshen && !pkg_is_arch_compat(dbpkg, pkg)))
-                n_array_push(arr, pkg_link(dbpkg));
+            if (!pkg_is_kind_of(dbpkg, pkg)
+                || (freshen && !pkg_is_arch_compat(dbpkg, pkg)))
+                continue;
         }
 
-        n_array_cfree(&dbpkgs);
-        dbpkgs = arr;
-        n = n_array_size(arr);
-        //pkgs_array_dump(dbpkgs, "after_multilib");
+        n++;
+        /* compare with newest installed version */
+        if (newest == NULL || pkg_cmp_evr(dbpkg, newest) > 0)
+            newest = dbpkg;
     }
 
-    if (n) {
-        if (n > 1) {
-            /*
-               order by E-V-R, DESC to compare with newest installed version
-            */
-            n_array_sort_ex(dbpkgs, (tn_fn_cmp)pkg_cmp_evr);
-            n_array_reverse(dbpkgs);
-        }
+    if (newest)
+        *cmprc = pkg_cmp_evr(pkg, newest);
+
+    return n;
+}
+
+int i3_is_pkg_installed(struct poldek_ts *ts, const struct pkg *pkg, int *cmprc)
+{
+    struct i3_dbsnap *snap;
+    tn_array *dbpkgs = NULL;
+    int n = 0;
+
+    if ((snap = i3_dbsnap(ts))) {
+        const tn_array *pkgs = i3_dbsnap_get_name(snap, pkg->name);
+        return pkgs ? count_installed(ts, pkg, pkgs, cmprc) : 0;
+    }
+
+    n = pkgdb_search(ts->db, &dbpkgs, PMTAG_NAME, pkg->name, NULL, PKG_LDNEVR);
+    n_assert(n >= 0);
 
-        struct pkg *dbpkg = n_array_nth(dbpkgs, 0);
-        *cmprc = pkg_cmp_evr(pkg, dbpkg);
+    if (n == 0) {
+        n_assert(dbpkgs == NULL);
+        return 0;
     }
 
+    n = count_installed(ts, pkg, dbpkgs, cmprc);
     n_array_free(dbpkgs);
 
     return n;
@@ -493,6 +498,40 @@ int i3_select_best_pkg(int indent, struct i3ctx *ictx,
     return i;
 }
 
+struct pkg *i3_choose_best_pkg(int indent, struct i3ctx *ictx,
+                               const struct pkg *marker, tn_array *candidates)
+{
+    struct pkg *best;
+    tn_array *tmp;
+
+    tmp = n_array_dup(candidates, (tn_fn_dup)pkg_link);
+    best = n_array_nth(tmp, do_select_best_pkg(indent, ictx, marker, tmp));
+    n_array_free(tmp);
+
+    return best;                /* still referenced by candidates */
+}
+
+/* leave packages choosen by SAT solver only, if any */
+static void prefer_solution(int indent, struct i3ctx *ictx, tn_array *pkgs)
+{
+    int i, n = 0;
+
+    for (i=0; i < n_array_size(pkgs); i++)
+        if (pkg_isset_mf(ictx->solution, n_array_nth(pkgs, i), PKGMARK_MARK))
+            n++;
+
+    if (n == 0 || n == n_array_size(pkgs))
+        return;
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+
+        if (!pkg_isset_mf(ictx->solution, pkg, PKGMARK_MARK)) {
+            trace(indent, "- not in SAT solution %s", pkg_id(pkg));
+            n_array_remove_nth(pkgs, i--);
+        }
+    }
+}
 
 static inline int any_is_marked(struct i3ctx *ictx, tn_array *pkgs)
 {
@@ -514,6 +553,7 @@ int i3_find_req(int indent, struct i3ctx *ictx,
 
     *best_pkg = NULL;
     found = pkgset_find_match_packages(ictx->ps, pkg, req, &suspkgs, 1);//ictx->strict);
+    trace_count(NULL, found ? "reqs.resolved" : "reqs.unresolved", 1);
 
     //trace(indent, "PROMOTE pkg test satisfied %d", pkg_satisfies_req(pkg,req,1));
 
@@ -565,6 +605,9 @@ int i3_find_req(int indent, struct i3ctx *ictx,
         goto l_end;
     }
 
+    if (ictx->solution)
+        prefer_solution(indent, ictx, suspkgs);
+
     /* return found and *best_pkg=NULL if any package is already marked */
     if (!any_is_marked(ictx, suspkgs)) {
         int best_i;
@@ -609,9 +652,15 @@ int i3_pkgdb_match_req(struct i3ctx *ictx, const struct capreq *req)
 {
     /* missing epoch in db package is not a problem, usually */
     unsigned ma_flags = ictx->ma_flags | POLDEK_MA_PROMOTE_CAPEPOCH;
+    const tn_array *exclude = iset_packages_by_recno(ictx->unset);
+    struct i3_dbsnap *snap;
+    int rc;
+
+    if ((snap = i3_dbsnap(ictx->ts)) &&
+        (rc = i3_dbsnap_match_req(snap, req, ma_flags, exclude)) >= 0)
+        return rc;
 
-    return pkgdb_match_req(ictx->ts->db, req, ma_flags,
-                           iset_packages_by_recno(ictx->unset));
+    return pkgdb_match_req(ictx->ts->db, req, ma_flags, exclude);
 }
 
 struct pkg *i3_choose_equiv(struct poldek_ts *ts,
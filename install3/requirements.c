@@ -641,6 +641,11 @@ static int process_req(int indent, struct i3ctx *ictx,
 #endif
         }
 
+        /* probe alternatives before committing to the best one */
+        if ((i3pkg->flags & I3PKG_CROSSROAD) && real_tomark == tomark &&
+            !i3_is_user_choosable_equiv(ts) && ts->getop(ts, POLDEK_OP_SPECULATE))
+            real_tomark = i3_speculate(indentt, ictx, pkg, candidates, tomark);
+
         if (i3pkg->flags & I3PKG_BACKTRACKABLE) {
             DBGF("%s INDIRECT\n", pkg_id(pkg));
             i3pkg_flag |= I3PKG_CROSSROAD_INDIR;
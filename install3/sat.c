@@ -0,0 +1,441 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/*
+  SAT based resolving ("dependency solver = 4"). Transaction is encoded
+  as clauses over two kinds of variables: A(p) - available p is installed
+  and I(d) - installed d is kept. Encoded are requirements (boolean ones
+  as expanded by booldep_eval), single instance of a name, obsoletes and
+  conflicts, starting from packages marked by the user. Branching follows
+  install3 candidate scoring, so found model is what install3 would choose
+  if it had not to backtrack. Model is handed to install3 as preferred
+  providers (ictx->solution), which does the actual marking, orphans
+  processing and error reporting.
+*/
+
+#include "ictx.h"
+#include "trace.h"
+#include "satsolver.h"
+
+#define SAT_MAX_CONFLICTS 100000
+
+struct satvar {
+    struct pkg *pkg;
+    int        var;
+    int        installed;
+};
+
+/* requirement of A(var) satisfied by one of lits */
+struct satreq {
+    int var;
+    int n;
+    int lits[0];
+};
+
+struct satenc {
+    struct i3ctx     *ictx;
+    struct i3_dbsnap *snap;
+    struct i3sat     *s;
+    tn_array         *vars;     /* var - 1 => satvar */
+    tn_hash          *varh;     /* "A:pkg_id" or "I:pkg_id" => var */
+    tn_array         *queue;    /* available packages to be encoded */
+    tn_array         *reqs;     /* satreq[] */
+    unsigned         ma_flags;
+};
+
+static struct satvar *satvar(struct satenc *enc, int var)
+{
+    return n_array_nth(enc->vars, var - 1);
+}
+
+/* RET: installed package same as pkg or NULL */
+static struct pkg *installed_twin(struct satenc *enc, const struct pkg *pkg)
+{
+    const tn_array *dbpkgs = i3_dbsnap_get_name(enc->snap, pkg->name);
+    int i;
+
+    for (i=0; dbpkgs && i < n_array_size(dbpkgs); i++) {
+        struct pkg *dbpkg = n_array_nth(dbpkgs, i);
+
+        if (pkg_cmp_name_evr(pkg, dbpkg) == 0 && pkg_cmp_arch(pkg, dbpkg) == 0)
+            return dbpkg;
+    }
+
+    return NULL;
+}
+
+/* RET: variable of pkg, 0 if package is not worth a variable */
+static int pkgvar(struct satenc *enc, struct pkg *pkg, int installed,
+                  int create)
+{
+    struct satvar *sv;
+    char key[512];
+    int var;
+
+    n_snprintf(key, sizeof(key), "%c:%s", installed ? 'I' : 'A', pkg_id(pkg));
+    if ((var = (intptr_t)n_hash_get(enc->varh, key)))
+        return var;
+
+    if (!create)
+        return 0;
+
+    /* the same package is already installed */
+    if (!installed && !poldek_ts_issetf(enc->ictx->ts, POLDEK_TS_REINSTALL) &&
+        installed_twin(enc, pkg))
+        return 0;
+
+    var = i3sat_add_var(enc->s);
+    n_hash_insert(enc->varh, key, (void*)(intptr_t)var);
+
+    sv = n_malloc(sizeof(*sv));
+    sv->pkg = pkg_link(pkg);
+    sv->var = var;
+    sv->installed = installed;
+    n_array_push(enc->vars, sv);
+
+    if (!installed)
+        n_array_push(enc->queue, pkg_link(pkg));
+
+    return var;
+}
+
+static void satvar_free(struct satvar *sv)
+{
+    pkg_free(sv->pkg);
+    free(sv);
+}
+
+static void add_clause2(struct satenc *enc, int lit1, int lit2)
+{
+    int lits[2] = { lit1, lit2 };
+    i3sat_add_clause(enc->s, lits, 2);
+}
+
+static int push_lit(int *lits, int n, int lit)
+{
+    int i;
+
+    for (i=0; i < n; i++)
+        if (lits[i] == lit)
+            return n;
+
+    lits[n++] = lit;
+    return n;
+}
+
+static void encode_req(struct satenc *enc, struct pkg *pkg, int var,
+                       const struct capreq *req)
+{
+    struct i3ctx *ictx = enc->ictx;
+    const tn_array *dbpkgs;
+    tn_array *pkgs = NULL;
+    struct satreq *sr;
+    int i, n = 0, size, *lits;
+
+    if (capreq_is_rpmlib(req) || pkg_satisfies_req(pkg, req, 1))
+        return;
+
+    /* file lists of installed packages are not in snapshot, assume
+       database provider stays */
+    if (capreq_is_file(req) && i3_pkgdb_match_req(ictx, req))
+        return;
+
+    dbpkgs = i3_dbsnap_get_cap(enc->snap, capreq_name(req));
+    pkgset_find_match_packages(ictx->ps, pkg, req, &pkgs, 1);
+
+    size = (dbpkgs ? n_array_size(dbpkgs) : 0) + (pkgs ? n_array_size(pkgs) : 0);
+    lits = alloca((size + 1) * sizeof(*lits));
+    lits[n++] = -var;
+
+    for (i=0; dbpkgs && i < n_array_size(dbpkgs); i++) {
+        struct pkg *dbpkg = n_array_nth(dbpkgs, i);
+
+        if (pkg_caps_match_req(dbpkg, req, enc->ma_flags))
+            n = push_lit(lits, n, pkgvar(enc, dbpkg, 1, 1));
+    }
+
+    for (i=0; pkgs && i < n_array_size(pkgs); i++) {
+        struct pkg *p = n_array_nth(pkgs, i);
+        int v;
+
+        if (pkg_isset_mf(ictx->processed, p, PKGMARK_BLACK))
+            continue;
+
+        if ((v = pkgvar(enc, p, 0, 1)))
+            n = push_lit(lits, n, v);
+    }
+    n_array_cfree(&pkgs);
+
+    if (n == 1)
+        msgn(3, "%s: %s not found, package is not installable", pkg_id(pkg),
+             capreq_stra(req));
+
+    i3sat_add_clause(enc->s, lits, n);
+
+    sr = n_malloc(sizeof(*sr) + (n - 1) * sizeof(*lits));
+    sr->var = var;
+    sr->n = n - 1;
+    memcpy(sr->lits, &lits[1], (n - 1) * sizeof(*lits));
+    n_array_push(enc->reqs, sr);
+}
+
+static void encode_replaced(struct satenc *enc, struct pkg *pkg, int var)
+{
+    const tn_array *dbpkgs;
+    int i, j;
+
+    /* upgrade */
+    dbpkgs = i3_dbsnap_get_name(enc->snap, pkg->name);
+    for (i=0; dbpkgs && i < n_array_size(dbpkgs); i++) {
+        struct pkg *dbpkg = n_array_nth(dbpkgs, i);
+
+        if (poldek_conf_MULTILIB && !pkg_is_kind_of(dbpkg, pkg))
+            continue;
+
+        add_clause2(enc, -var, -pkgvar(enc, dbpkg, 1, 1));
+    }
+
+    for (i=0; pkg->cnfls && i < n_array_size(pkg->cnfls); i++) {
+        struct capreq *cnfl = n_array_nth(pkg->cnfls, i);
+
+        dbpkgs = i3_dbsnap_get_cap(enc->snap, capreq_name(cnfl));
+        for (j=0; dbpkgs && j < n_array_size(dbpkgs); j++) {
+            struct pkg *dbpkg = n_array_nth(dbpkgs, j);
+
+            if (capreq_is_obsl(cnfl) ? pkg_obsoletes_pkg(pkg, dbpkg) :
+                pkg_caps_match_req(dbpkg, cnfl, enc->ma_flags))
+                add_clause2(enc, -var, -pkgvar(enc, dbpkg, 1, 1));
+        }
+    }
+}
+
+static void encode_pkg(struct satenc *enc, struct pkg *pkg)
+{
+    struct i3_req_iter iter;
+    const struct i3req *i3req;
+    int var = pkgvar(enc, pkg, 0, 0);
+
+    n_assert(var > 0);
+    encode_replaced(enc, pkg, var);
+
+    if (pkg->reqs == NULL)
+        return;
+
+    i3_req_iter_init(&iter, 0, enc->ictx, pkg, PKG_ITER_REQIN);
+    while ((i3req = i3_req_iter_get(&iter)))
+        encode_req(enc, pkg, var, i3req->req);
+    i3_req_iter_destroy(&iter);
+}
+
+static int satvar_cmp_name(const struct satvar *sv1, const struct satvar *sv2)
+{
+    return pkg_cmp_name(sv1->pkg, sv2->pkg);
+}
+
+/* conflicts and single instance of a name, among encoded packages only */
+static void encode_exclusions(struct satenc *enc)
+{
+    tn_array *avail;
+    int i, j;
+
+    avail = n_array_new(n_array_size(enc->vars), NULL,
+                        (tn_fn_cmp)satvar_cmp_name);
+
+    for (i=0; i < n_array_size(enc->vars); i++) {
+        struct satvar *sv = n_array_nth(enc->vars, i);
+        tn_array *cnflpkgs;
+
+        if (sv->installed)
+            continue;
+
+        n_array_push(avail, sv);
+
+        if ((cnflpkgs = i3_get_package_conflicted_pkgs(0, enc->ictx, sv->pkg))) {
+            for (j=0; j < n_array_size(cnflpkgs); j++) {
+                struct reqpkg *rp = n_array_nth(cnflpkgs, j);
+                int v;
+
+                if ((v = pkgvar(enc, rp->pkg, 0, 0)) && v != sv->var)
+                    add_clause2(enc, -sv->var, -v);
+            }
+            n_array_free(cnflpkgs);
+        }
+    }
+
+    n_array_sort(avail);
+    for (i=0; i < n_array_size(avail); i++) {
+        struct satvar *sv = n_array_nth(avail, i);
+
+        for (j=i + 1; j < n_array_size(avail); j++) {
+            struct satvar *sv2 = n_array_nth(avail, j);
+
+            if (pkg_cmp_name(sv->pkg, sv2->pkg) != 0)
+                break;
+
+            if (!poldek_conf_MULTILIB || pkg_is_kind_of(sv->pkg, sv2->pkg))
+                add_clause2(enc, -sv->var, -sv2->var);
+        }
+    }
+
+    n_array_free(avail);
+}
+
+/* prefer installed providers, next best scored available one */
+static int decide(struct i3sat *s, void *data)
+{
+    struct satenc *enc = data;
+    tn_array *candidates = NULL;
+    int i, j, lit = 0;
+
+    for (i=0; i < n_array_size(enc->reqs) && lit == 0; i++) {
+        struct satreq *sr = n_array_nth(enc->reqs, i);
+        struct pkg *best;
+
+        if (i3sat_value(s, sr->var) <= 0)
+            continue;
+
+        for (j=0; j < sr->n; j++)
+            if (i3sat_value(s, sr->lits[j]) > 0)
+                break;
+
+        if (j < sr->n)          /* satisfied */
+            continue;
+
+        if (candidates == NULL)
+            candidates = pkgs_array_new(8);
+
+        for (j=0; j < sr->n && lit == 0; j++) {
+            struct satvar *sv = satvar(enc, sr->lits[j]);
+
+            if (i3sat_value(s, sr->lits[j]) != 0)
+                continue;
+
+            if (sv->installed)
+                lit = sr->lits[j];
+            else
+                n_array_push(candidates, pkg_link(sv->pkg));
+        }
+
+        if (lit || n_array_size(candidates) == 0)
+            continue;
+
+        best = n_array_nth(candidates, 0);
+        if (n_array_size(candidates) > 1)
+            best = i3_choose_best_pkg(4, enc->ictx, satvar(enc, sr->var)->pkg,
+                                      candidates);
+
+        lit = pkgvar(enc, best, 0, 0);
+        n_array_clean(candidates);
+    }
+
+    n_array_cfree(&candidates);
+
+    /* keep remaining installed packages */
+    for (i=0; lit == 0 && i < n_array_size(enc->vars); i++) {
+        struct satvar *sv = n_array_nth(enc->vars, i);
+
+        if (sv->installed && i3sat_value(s, sv->var) == 0)
+            lit = sv->var;
+    }
+
+    return lit;
+}
+
+static void satenc_init(struct satenc *enc, struct i3ctx *ictx,
+                        struct i3_dbsnap *snap)
+{
+    enc->ictx = ictx;
+    enc->snap = snap;
+    enc->s = i3sat_new();
+    enc->vars = n_array_new(256, (tn_fn_free)satvar_free, NULL);
+    enc->varh = n_hash_new(1024, NULL);
+    enc->queue = pkgs_array_new(256);
+    enc->reqs = n_array_new(1024, free, NULL);
+    enc->ma_flags = ictx->ma_flags | POLDEK_MA_PROMOTE_CAPEPOCH;
+    n_hash_ctl(enc->varh, TN_HASH_REHASH);
+}
+
+static void satenc_destroy(struct satenc *enc)
+{
+    i3sat_free(enc->s);
+    n_array_free(enc->vars);
+    n_hash_free(enc->varh);
+    n_array_free(enc->queue);
+    n_array_free(enc->reqs);
+}
+
+int i3_sat_resolve(struct i3ctx *ictx, const tn_array *pkgs)
+{
+    struct trace_span *span;
+    struct i3_dbsnap *snap;
+    struct satenc enc;
+    int i, rc, nselected = 0;
+
+    if ((snap = i3_dbsnap(ictx->ts)) == NULL)
+        return 0;
+
+    msgn(1, _("Encoding dependencies..."));
+    span = trace_begin("i3.sat");
+    satenc_init(&enc, ictx, snap);
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+        int var;
+
+        if (!pkg_is_marked_i(ictx->ts->pms, pkg))
+            continue;
+
+        if ((var = pkgvar(&enc, pkg, 0, 1)))
+            i3sat_add_clause(enc.s, &var, 1);
+    }
+
+    /* queue grows while encoding */
+    for (i=0; i < n_array_size(enc.queue); i++) {
+        encode_pkg(&enc, n_array_nth(enc.queue, i));
+
+        if (sigint_reached())
+            break;
+    }
+    encode_exclusions(&enc);
+
+    trace_count(span, "vars", i3sat_nvars(enc.s));
+    trace_count(span, "clauses", i3sat_nclauses(enc.s));
+
+    rc = sigint_reached() ? 0 : i3sat_solve(enc.s, decide, &enc, SAT_MAX_CONFLICTS);
+    trace_count(span, "conflicts", i3sat_nconflicts(enc.s));
+
+    if (rc > 0) {
+        if (ictx->solution == NULL)
+            ictx->solution = pkgmark_set_new(NULL, 0, PKGMARK_SET_IDPTR);
+
+        for (i=0; i < n_array_size(enc.vars); i++) {
+            struct satvar *sv = n_array_nth(enc.vars, i);
+
+            if (!sv->installed && i3sat_value(enc.s, sv->var) > 0) {
+                pkg_set_mf(ictx->solution, sv->pkg, PKGMARK_MARK);
+                nselected++;
+            }
+        }
+    }
+
+    msgn(2, "SAT: %d variables, %d clauses, %d conflicts => %s",
+         i3sat_nvars(enc.s), i3sat_nclauses(enc.s), i3sat_nconflicts(enc.s),
+         rc > 0 ? "solved" : rc == 0 ? "unsatisfiable" : "gave up");
+
+    if (rc <= 0)
+        msgn(1, _("No SAT solution found, falling back to default solver"));
+    else
+        msgn(3, "SAT: %d package(s) selected", nselected);
+
+    satenc_destroy(&enc);
+    trace_end(span);
+
+    return rc > 0;
+}
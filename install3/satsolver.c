@@ -0,0 +1,409 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+
+#include "satsolver.h"
+
+/*
+  Clauses live in one pool as [size, lit0, lit1, ...] and are referred
+  by their offset; first two literals of each clause are the watched
+  ones, literal implied by a clause is always put at position 0.
+*/
+struct watches {
+    int n;
+    int a;
+    int *refs;
+};
+
+struct i3sat {
+    int            nvars;
+    int            avars;           /* allocated */
+
+    signed char    *value;          /* var => 1, -1 or 0 */
+    int            *level;          /* var => decision level */
+    int            *reason;         /* var => clause ref, -1 if decided */
+    unsigned char  *seen;           /* for analyze() */
+    struct watches *watches;        /* literal index => clauses */
+
+    int            *pool;           /* clauses */
+    int            npool;
+    int            apool;
+    int            nclauses;
+
+    int            *units;          /* unit clauses */
+    int            nunits;
+    int            aunits;
+    int            empty;           /* empty clause added */
+
+    int            *trail;          /* assigned literals, in order */
+    int            ntrail;
+    int            qhead;           /* propagation queue head */
+    int            *trail_lim;      /* level => trail size at its start */
+    int            dlevel;          /* current decision level */
+
+    int            *learnt;         /* analyze() buffer */
+    int            nconflicts;
+};
+
+#define VAR(lit) ((lit) < 0 ? -(lit) : (lit))
+#define LIDX(lit) (2 * VAR(lit) + ((lit) < 0))
+
+static void *grow(void *ptr, int *alloced, int need, size_t size)
+{
+    if (need <= *alloced)
+        return ptr;
+
+    while (*alloced < need)
+        *alloced = *alloced ? *alloced * 2 : 16;
+
+    return n_realloc(ptr, *alloced * size);
+}
+
+struct i3sat *i3sat_new(void)
+{
+    struct i3sat *s = n_calloc(1, sizeof(*s));
+    return s;
+}
+
+void i3sat_free(struct i3sat *s)
+{
+    int i;
+
+    if (s->watches) {           /* no variables => nothing allocated */
+        for (i=0; i < 2 * s->avars + 2; i++)
+            free(s->watches[i].refs);
+    }
+
+    free(s->watches);
+    free(s->value);
+    free(s->level);
+    free(s->reason);
+    free(s->seen);
+    free(s->pool);
+    free(s->units);
+    free(s->trail);
+    free(s->trail_lim);
+    free(s->learnt);
+    free(s);
+}
+
+int i3sat_add_var(struct i3sat *s)
+{
+    int v = ++s->nvars;
+
+    if (v >= s->avars) {
+        int old = s->avars, n = old ? old : 16, i;
+
+        while (n < v + 1)
+            n *= 2;
+
+        s->value = n_realloc(s->value, n * sizeof(*s->value));
+        s->level = n_realloc(s->level, n * sizeof(*s->level));
+        s->reason = n_realloc(s->reason, n * sizeof(*s->reason));
+        s->seen = n_realloc(s->seen, n * sizeof(*s->seen));
+        s->trail = n_realloc(s->trail, n * sizeof(*s->trail));
+        s->trail_lim = n_realloc(s->trail_lim, n * sizeof(*s->trail_lim));
+        s->learnt = n_realloc(s->learnt, n * sizeof(*s->learnt));
+        s->watches = n_realloc(s->watches, (2 * n + 2) * sizeof(*s->watches));
+
+        for (i = old; i < n; i++) {
+            s->value[i] = 0;
+            s->level[i] = 0;
+            s->reason[i] = -1;
+            s->seen[i] = 0;
+        }
+        memset(&s->watches[old ? 2 * old + 2 : 0], 0,
+               (2 * n + 2 - (old ? 2 * old + 2 : 0)) * sizeof(*s->watches));
+
+        s->avars = n;
+    }
+
+    return v;
+}
+
+int i3sat_nvars(const struct i3sat *s)
+{
+    return s->nvars;
+}
+
+int i3sat_nclauses(const struct i3sat *s)
+{
+    return s->nclauses;
+}
+
+int i3sat_nconflicts(const struct i3sat *s)
+{
+    return s->nconflicts;
+}
+
+int i3sat_value(const struct i3sat *s, int lit)
+{
+    int v = s->value[VAR(lit)];
+    return lit < 0 ? -v : v;
+}
+
+static void watch(struct i3sat *s, int lit, int cref)
+{
+    struct watches *w = &s->watches[LIDX(lit)];
+
+    w->refs = grow(w->refs, &w->a, w->n + 1, sizeof(*w->refs));
+    w->refs[w->n++] = cref;
+}
+
+static int store_clause(struct i3sat *s, const int *lits, int n)
+{
+    int cref;
+
+    s->pool = grow(s->pool, &s->apool, s->npool + n + 1, sizeof(*s->pool));
+    cref = s->npool;
+    s->pool[cref] = n;
+    memcpy(&s->pool[cref + 1], lits, n * sizeof(*lits));
+    s->npool += n + 1;
+    s->nclauses++;
+
+    watch(s, lits[0], cref);
+    watch(s, lits[1], cref);
+
+    return cref;
+}
+
+void i3sat_add_clause(struct i3sat *s, const int *lits, int n)
+{
+    int *c, i, j, k;
+
+    n_assert(s->dlevel == 0);
+
+    c = alloca(n * sizeof(*c));
+    for (i=0, k=0; i < n; i++) {
+        n_assert(VAR(lits[i]) > 0 && VAR(lits[i]) <= s->nvars);
+
+        for (j=0; j < k; j++) {
+            if (c[j] == lits[i])
+                break;
+
+            if (c[j] == -lits[i]) /* tautology */
+                return;
+        }
+
+        if (j == k)
+            c[k++] = lits[i];
+    }
+
+    if (k == 0) {
+        s->empty = 1;
+
+    } else if (k == 1) {        /* assigned in i3sat_solve() */
+        s->units = grow(s->units, &s->aunits, s->nunits + 1, sizeof(*s->units));
+        s->units[s->nunits++] = c[0];
+
+    } else {
+        store_clause(s, c, k);
+    }
+}
+
+static void assign(struct i3sat *s, int lit, int reason)
+{
+    int v = VAR(lit);
+
+    s->value[v] = lit > 0 ? 1 : -1;
+    s->level[v] = s->dlevel;
+    s->reason[v] = reason;
+    s->trail[s->ntrail++] = lit;
+}
+
+/* RET: conflicting clause or -1 */
+static int propagate(struct i3sat *s)
+{
+    while (s->qhead < s->ntrail) {
+        int fl = -s->trail[s->qhead++]; /* just falsified literal */
+        struct watches *w = &s->watches[LIDX(fl)];
+        int i, j, k;
+
+        for (i = 0, j = 0; i < w->n; i++) {
+            int cref = w->refs[i];
+            int size = s->pool[cref], *cl = &s->pool[cref + 1];
+
+            if (cl[0] == fl) {  /* keep false watch at [1] */
+                cl[0] = cl[1];
+                cl[1] = fl;
+            }
+
+            if (i3sat_value(s, cl[0]) > 0) { /* satisfied */
+                w->refs[j++] = cref;
+                continue;
+            }
+
+            for (k = 2; k < size; k++) {
+                if (i3sat_value(s, cl[k]) >= 0) { /* new watch found */
+                    cl[1] = cl[k];
+                    cl[k] = fl;
+                    watch(s, cl[1], cref);
+                    break;
+                }
+            }
+
+            if (k < size)
+                continue;
+
+            w->refs[j++] = cref;
+
+            if (i3sat_value(s, cl[0]) < 0) { /* conflict */
+                for (i++; i < w->n; i++)
+                    w->refs[j++] = w->refs[i];
+                w->n = j;
+                return cref;
+            }
+
+            assign(s, cl[0], cref);
+        }
+        w->n = j;
+    }
+
+    return -1;
+}
+
+/* first UIP learning; RET: learnt clause size, *btlevel is level to go */
+static int analyze(struct i3sat *s, int confl, int *btlevel)
+{
+    int pathc = 0, p = 0, idx = s->ntrail - 1, n = 1, i, k;
+
+    do {
+        int size = s->pool[confl], *cl = &s->pool[confl + 1];
+
+        for (k = (p == 0 ? 0 : 1); k < size; k++) {
+            int q = cl[k], v = VAR(q);
+
+            if (s->seen[v] || s->level[v] == 0)
+                continue;
+
+            s->seen[v] = 1;
+            if (s->level[v] >= s->dlevel)
+                pathc++;
+            else
+                s->learnt[n++] = q;
+        }
+
+        while (!s->seen[VAR(s->trail[idx])])
+            idx--;
+
+        p = s->trail[idx--];
+        confl = s->reason[VAR(p)];
+        s->seen[VAR(p)] = 0;
+        pathc--;
+    } while (pathc > 0);
+
+    s->learnt[0] = -p;
+
+    /* second watch goes to the literal of the highest level */
+    *btlevel = 0;
+    for (i = 1; i < n; i++) {
+        int v = VAR(s->learnt[i]);
+
+        s->seen[v] = 0;
+        if (s->level[v] > *btlevel) {
+            int tmp = s->learnt[1];
+
+            *btlevel = s->level[v];
+            s->learnt[1] = s->learnt[i];
+            s->learnt[i] = tmp;
+        }
+    }
+
+    return n;
+}
+
+static void cancel_until(struct i3sat *s, int level)
+{
+    int i;
+
+    if (s->dlevel <= level)
+        return;
+
+    for (i = s->ntrail - 1; i >= s->trail_lim[level + 1]; i--) {
+        int v = VAR(s->trail[i]);
+
+        s->value[v] = 0;
+        s->reason[v] = -1;
+    }
+
+    s->ntrail = s->qhead = s->trail_lim[level + 1];
+    s->dlevel = level;
+}
+
+static int next_unassigned(const struct i3sat *s)
+{
+    int v;
+
+    for (v = 1; v <= s->nvars; v++)
+        if (s->value[v] == 0)
+            return -v;
+
+    return 0;
+}
+
+int i3sat_solve(struct i3sat *s, i3sat_fn_decide decide, void *data,
+                int max_conflicts)
+{
+    int i;
+
+    if (s->empty)
+        return 0;
+
+    for (i = 0; i < s->nunits; i++) {
+        int val = i3sat_value(s, s->units[i]);
+
+        if (val < 0)
+            return 0;
+
+        if (val == 0)
+            assign(s, s->units[i], -1);
+    }
+
+    for (;;) {
+        int confl, lit;
+
+        if ((confl = propagate(s)) >= 0) {
+            int n, btlevel;
+
+            s->nconflicts++;
+            if (s->dlevel == 0)
+                return 0;
+
+            if (max_conflicts > 0 && s->nconflicts > max_conflicts)
+                return -1;
+
+            n = analyze(s, confl, &btlevel);
+            cancel_until(s, btlevel);
+
+            if (n == 1) {
+                assign(s, s->learnt[0], -1);
+            } else {
+                int cref = store_clause(s, s->learnt, n);
+                assign(s, s->learnt[0], cref);
+            }
+            continue;
+        }
+
+        if ((lit = decide ? decide(s, data) : 0) == 0)
+            lit = next_unassigned(s);
+
+        if (lit == 0)           /* all assigned */
+            return 1;
+
+        n_assert(i3sat_value(s, lit) == 0);
+        s->trail_lim[++s->dlevel] = s->ntrail;
+        assign(s, lit, -1);
+    }
+}
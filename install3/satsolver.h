@@ -0,0 +1,45 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifndef POLDEK_INSTALL3_SATSOLVER_H
+#define POLDEK_INSTALL3_SATSOLVER_H
+
+/*
+  Minimal CDCL SAT solver: two watched literals, first-UIP clause learning
+  and non-chronological backtracking. Branching is left to the caller,
+  which is how install3's package preferences drive the search.
+
+  Variables are numbered from 1, literal is +var or -var.
+*/
+
+struct i3sat;
+
+struct i3sat *i3sat_new(void);
+void i3sat_free(struct i3sat *s);
+
+/* RET: number of new variable */
+int i3sat_add_var(struct i3sat *s);
+int i3sat_nvars(const struct i3sat *s);
+
+/* lits are copied, duplicates are allowed */
+void i3sat_add_clause(struct i3sat *s, const int *lits, int n);
+int i3sat_nclauses(const struct i3sat *s);
+
+/* RET: 1 true, -1 false, 0 unassigned */
+int i3sat_value(const struct i3sat *s, int lit);
+
+/* Returns unassigned literal to be set true next or 0 to let the solver
+   set remaining variables false */
+typedef int (*i3sat_fn_decide)(struct i3sat *s, void *data);
+
+/* RET: 1 satisfiable (model available via i3sat_value()),
+        0 unsatisfiable, -1 max_conflicts reached */
+int i3sat_solve(struct i3sat *s, i3sat_fn_decide decide, void *data,
+                int max_conflicts);
+
+int i3sat_nconflicts(const struct i3sat *s);
+
+#endif
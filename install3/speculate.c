@@ -0,0 +1,281 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/*
+  Speculative exploration of crossroad candidates. Instead of marking the
+  best scored candidate and backtracking on its failure, up to
+  SPEC_MAX_CANDIDATES of them are probed concurrently: every probe follows
+  requirements with a single possible provider (forced choices) on its
+  own overlay of speculatively marked packages, on top of read-only
+  install set, until a requirement cannot be satisfied or a package
+  collides with already marked one. Probes do not touch shared state, so
+  the first viable candidate in score order is chosen regardless of
+  threads timing.
+*/
+
+#include "ictx.h"
+#include "thread.h"
+#include "trace.h"
+
+#define SPEC_MAX_CANDIDATES  8
+#define SPEC_MAX_DEPTH       4
+#define SPEC_MAX_PKGS        256
+
+struct spec_probe {
+    struct pkg          *pkg;
+    int                 viable;
+    struct pkg          *failpkg;  /* dead end */
+    const struct capreq *failreq;
+};
+
+struct spec_ctx {
+    struct i3ctx      *ictx;
+    struct i3_dbsnap  *snap;
+    const tn_array    *exclude;  /* iset_packages_by_recno(unset) */
+    tn_array          *marked;   /* inset packages, sorted by name */
+    unsigned          ma_flags;
+    struct spec_probe *probes;
+    int               nprobes;
+};
+
+struct spec_node {
+    struct pkg *pkg;
+    int        depth;
+};
+
+/* RET: marked package of the same kind but different than pkg */
+static struct pkg *other_marked(struct spec_ctx *sctx, const struct pkg *pkg)
+{
+    int i;
+
+    i = n_array_bsearch_idx_ex(sctx->marked, pkg, (tn_fn_cmp)pkg_cmp_name);
+    if (i < 0)
+        return NULL;
+
+    for (; i < n_array_size(sctx->marked); i++) {
+        struct pkg *p = n_array_nth(sctx->marked, i);
+
+        if (pkg_cmp_name(p, pkg) != 0)
+            break;
+
+        if (p != pkg && pkg_is_kind_of(p, pkg))
+            return p;
+    }
+
+    return NULL;
+}
+
+static int conflicts_with_marked(struct spec_ctx *sctx, const struct pkg *pkg)
+{
+    struct i3ctx *ictx = sctx->ictx;
+    int i, j;
+
+    for (i=0; pkg->cnfls && i < n_array_size(pkg->cnfls); i++) {
+        struct capreq *cnfl = n_array_nth(pkg->cnfls, i);
+        struct pkg *const *pkgs;
+        int n;
+
+        if (capreq_is_obsl(cnfl))
+            continue;
+
+        n = capreq_idx_get(&ictx->ps->cap_idx, capreq_name(cnfl),
+                           capreq_name_len(cnfl), &pkgs);
+
+        for (j=0; j < n; j++) {
+            if (pkgs[j] != pkg && i3_is_marked(ictx, pkgs[j]) &&
+                pkg_match_req(pkgs[j], cnfl, 1))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* RET: -1 unsatisfiable, 0 satisfied, 1 satisfied by *forced only */
+static int probe_req(struct spec_ctx *sctx, tn_hash *overlay,
+                     const struct pkg *pkg, const struct capreq *req,
+                     struct pkg **forced)
+{
+    struct i3ctx *ictx = sctx->ictx;
+    struct pkg *const *pkgs, *provider = NULL;
+    int i, n, nproviders = 0;
+
+    if (iset_provides(ictx->inset, req))
+        return 0;
+
+    if (sctx->snap &&
+        i3_dbsnap_match_req(sctx->snap, req, sctx->ma_flags, sctx->exclude) > 0)
+        return 0;
+
+    n = capreq_idx_get(&ictx->ps->cap_idx, capreq_name(req),
+                       capreq_name_len(req), &pkgs);
+
+    for (i=0; i < n; i++) {
+        struct pkg *p = pkgs[i];
+
+        if (p == pkg)
+            return 0;
+
+        if (capreq_has_ver(req) && !pkg_match_req(p, req, 1))
+            continue;
+
+        if (i3_is_marked(ictx, p) || n_hash_exists(overlay, pkg_id(p)))
+            return 0;
+
+        if (pkg_isset_mf(ictx->processed, p, PKGMARK_BLACK))
+            continue;
+
+        provider = p;
+        nproviders++;
+    }
+
+    if (nproviders == 0)
+        return -1;
+
+    if (nproviders > 1)         /* next crossroad, leave it */
+        return 0;
+
+    *forced = provider;
+    return 1;
+}
+
+static void probe(struct spec_ctx *sctx, struct spec_probe *pr)
+{
+    struct spec_node *queue;
+    tn_hash *overlay;
+    int qhead = 0, qtail = 0;
+
+    queue = n_malloc(SPEC_MAX_PKGS * sizeof(*queue));
+    overlay = n_hash_new(SPEC_MAX_PKGS, NULL);
+
+    queue[qtail].pkg = pr->pkg;
+    queue[qtail++].depth = 0;
+    n_hash_insert(overlay, pkg_id(pr->pkg), pr->pkg);
+    pr->viable = 1;
+
+    while (qhead < qtail && pr->viable) {
+        struct spec_node *node = &queue[qhead++];
+        struct pkg *pkg = node->pkg;
+        struct pkg_req_iter *it;
+        const struct capreq *req;
+
+        if (other_marked(sctx, pkg) || conflicts_with_marked(sctx, pkg)) {
+            pr->viable = 0;
+            pr->failpkg = pkg;
+            break;
+        }
+
+        if (pkg->reqs == NULL)
+            continue;
+
+        it = pkg_req_iter_new(pkg, PKG_ITER_REQIN);
+        while ((req = pkg_req_iter_get(it))) {
+            struct pkg *forced = NULL;
+            int rc;
+
+            /* boolean, file and rpmlib() ones are left to install3 */
+            if (capreq_is_boolean(req) || capreq_is_file(req) ||
+                capreq_is_rpmlib(req))
+                continue;
+
+            if ((rc = probe_req(sctx, overlay, pkg, req, &forced)) < 0) {
+                pr->viable = 0;
+                pr->failpkg = pkg;
+                pr->failreq = req;
+                break;
+            }
+
+            if (rc > 0 && node->depth < SPEC_MAX_DEPTH && qtail < SPEC_MAX_PKGS) {
+                queue[qtail].pkg = forced;
+                queue[qtail++].depth = node->depth + 1;
+                n_hash_insert(overlay, pkg_id(forced), forced);
+            }
+        }
+        pkg_req_iter_free(it);
+    }
+
+    n_hash_free(overlay);
+    free(queue);
+}
+
+static void probe_worker(void *data, int worker_no, int nworkers)
+{
+    struct spec_ctx *sctx = data;
+    int i;
+
+    for (i = worker_no; i < sctx->nprobes; i += nworkers)
+        probe(sctx, &sctx->probes[i]);
+}
+
+struct pkg *i3_speculate(int indent, struct i3ctx *ictx, const struct pkg *pkg,
+                         tn_array *candidates, struct pkg *best)
+{
+    struct trace_span *span = trace_begin("i3.speculate");
+    struct spec_probe probes[SPEC_MAX_CANDIDATES];
+    struct spec_ctx sctx;
+    struct pkg *choosen = best;
+    int i, n = 0;
+
+    /* best scored one first, others in candidates order */
+    probes[n++].pkg = best;
+    for (i=0; i < n_array_size(candidates) && n < SPEC_MAX_CANDIDATES; i++) {
+        struct pkg *p = n_array_nth(candidates, i);
+
+        if (p != best && !pkg_isset_mf(ictx->processed, p, PKGMARK_BLACK))
+            probes[n++].pkg = p;
+    }
+
+    for (i=0; i < n; i++) {
+        probes[i].viable = 0;
+        probes[i].failpkg = NULL;
+        probes[i].failreq = NULL;
+    }
+
+    sctx.ictx = ictx;
+    sctx.snap = i3_dbsnap(ictx->ts);
+    sctx.exclude = iset_packages_by_recno(ictx->unset);
+    sctx.ma_flags = ictx->ma_flags | POLDEK_MA_PROMOTE_CAPEPOCH;
+    sctx.probes = probes;
+    sctx.nprobes = n;
+
+    sctx.marked = n_array_dup(iset_packages(ictx->inset), (tn_fn_dup)pkg_link);
+    n_array_ctl_set_cmpfn(sctx.marked, (tn_fn_cmp)pkg_cmp_name);
+    n_array_sort(sctx.marked);
+
+    poldek_run_workers(poldek_nworkers(n, 1), probe_worker, &sctx);
+
+    for (i=0; i < n; i++) {
+        struct spec_probe *pr = &probes[i];
+
+        if (pr->viable) {
+            choosen = pr->pkg;
+            break;
+        }
+
+        if (pr->failreq)
+            trace(indent, "- %s: dead end at %s (req %s)", pkg_id(pr->pkg),
+                  pkg_id(pr->failpkg), capreq_stra(pr->failreq));
+        else
+            trace(indent, "- %s: dead end at %s (collision)", pkg_id(pr->pkg),
+                  pkg_id(pr->failpkg));
+    }
+
+    if (choosen != best)
+        msgn_i(3, indent, "%s: %s choosen instead of %s", pkg_id(pkg),
+               pkg_id(choosen), pkg_id(best));
+
+    n_array_free(sctx.marked);
+
+    trace_count(span, "candidates", n);
+    trace_count(span, "rejected", i < n ? i : n);
+    trace_end(span);
+
+    return choosen;
+}
@@ -27,6 +27,7 @@
 #include "sigint/sigint.h"
 
 #include "compiler.h"
+#include "capreq.h"
 #include "pkgdir/pkgdir.h"
 #include "pkgdir/pkgdir_intern.h"
 #include "pkgset.h"
@@ -39,6 +40,7 @@
 #include "poldek_term.h"
 #include "pm/pm.h"
 #include "conf_intern.h"
+#include "trace.h"
 
 extern int (*poldek_log_say_goodbye)(const char *msg); /* log.c */
 
@@ -49,6 +51,7 @@ static int poldeklib_init_called = 0;
 #define CACHEDIR_SETUPDONE  (1 << 2)
 #define SOURCES_LOADED      (1 << 3)
 #define SETUP_DONE          (1 << 4)
+#define SOURCES_PARTIAL     (1 << 5) /* dependency closure only */
 
 
 #ifdef VERSION_STATUS
@@ -1047,6 +1050,9 @@ int poldek_load_config(struct poldek_ctx *ctx, const char *path,
     if ((v = poldek_conf_get_int(htcnf, "vfile_retries", 100)) > 0)
         vfile_configure(VFILE_CONF_STUBBORN_NRETRIES, v);
 
+    if ((v = poldek_conf_get_int(htcnf, "parallel_updates", 4)) > 0)
+        poldek_conf_PKGDIR_PARALLEL_UPDATES = v;
+
     return 1;
 }
 
@@ -1144,6 +1150,7 @@ void poldek_destroy(struct poldek_ctx *ctx)
     ctx = ctx;
 
     vfile_destroy();
+    poldek_trace_close();
 
     if (ctx->htconf)
         n_hash_free(ctx->htconf);
@@ -1250,6 +1257,11 @@ int poldek_configure(struct poldek_ctx *ctx, int param, ...)
             poldek_log_set_default_appender("_TTY", NULL, NULL);
             break;
 
+        case POLDEK_CONF_TRACEFILE:
+            if ((vs = va_arg(ap, char*)) && !poldek_trace_open(vs))
+                rc = 0;
+            break;
+
         case POLDEK_CONF_FORCECOLOR:
             n_hash_replace(ctx->_cnf, "ttycolor", n_strdup("t"));
             poldek_term_init(1);
@@ -1705,6 +1717,11 @@ static int setup_pm(struct poldek_ctx *ctx)
 
         if ((op = poldek_conf_get(htcnf, "sudo command", NULL)))
             pm_configure(ctx->pmctx, "sudocmd", (void*)op);
+
+        if (strcmp(pm, "rpm") == 0) {
+            int v = poldek_conf_get_bool(htcnf, "pm inprocess", 1);
+            pm_configure(ctx->pmctx, "inprocess", &v);
+        }
     }
 
     return ctx->pmctx != NULL;
@@ -1742,24 +1759,74 @@ int poldek_setup(struct poldek_ctx *ctx)
 
 int poldek_is_sources_loaded(struct poldek_ctx *ctx)
 {
-    return ctx->_iflags & SOURCES_LOADED;
+    return (ctx->_iflags & (SOURCES_LOADED | SOURCES_PARTIAL)) == SOURCES_LOADED;
 }
 
-int poldek_load_sources(struct poldek_ctx *ctx)
+static void unload_sources(struct poldek_ctx *ctx)
+{
+    /* packages are refcounted, so references taken by caller stay valid */
+    if (ctx->ps) {
+        pkgset_free(ctx->ps);
+        ctx->ps = NULL;
+    }
+    n_array_cfree(&ctx->pkgdirs);
+
+    ctx->_iflags &= ~(SOURCES_LOADED | SOURCES_PARTIAL);
+}
+
+static int load_sources(struct poldek_ctx *ctx, const tn_array *names)
 {
     int rc;
 
     check_if_setup_done(ctx);
 
     if (ctx->_iflags & SOURCES_LOADED) {
-        return 1;
+        if ((ctx->_iflags & SOURCES_PARTIAL) == 0)
+            return 1;
+
+        /* closure of previous transaction's packages */
+        unload_sources(ctx);
     }
 
-    rc = poldek__load_sources_internal(ctx);
+    rc = poldek__load_sources_internal(ctx, names);
     ctx->_iflags |= SOURCES_LOADED;
+
+    if (rc && ctx->ps && poldek__pkgdirs_partial(ctx->ps->pkgdirs))
+        ctx->_iflags |= SOURCES_PARTIAL;
+
     return rc;
 }
 
+int poldek_load_sources(struct poldek_ctx *ctx)
+{
+    return load_sources(ctx, NULL);
+}
+
+int poldek__load_sources_closure(struct poldek_ctx *ctx, const tn_array *names)
+{
+    return load_sources(ctx, names);
+}
+
+int poldek_reload_sources(struct poldek_ctx *ctx, unsigned flags)
+{
+    check_if_setup_done(ctx);
+
+    if ((ctx->_iflags & SOURCES_LOADED) == 0)
+        return poldek_load_sources(ctx) ? 1 : -1;
+
+    if ((flags & POLDEK_RELOAD_FORCE) == 0 && ctx->ps &&
+        (ctx->_iflags & SOURCES_PARTIAL) == 0 &&
+        poldek__pkgdirs_mtime(ctx->ps->pkgdirs) <= ctx->_ps_mtime)
+        return 0;
+
+    msgn(1, _("Reloading changed indexes..."));
+
+    /* don't keep capreqs of unloaded packages for the process lifetime */
+    capreq_shared_reset();
+    unload_sources(ctx);
+    return poldek_load_sources(ctx) ? 1 : -1;
+}
+
 struct pkgdir *poldek_load_destination_pkgdir(struct poldek_ctx *ctx,
                                               unsigned ldflags)
 {
@@ -26,6 +26,7 @@
 
 #include "pkgdir/source.h"
 #include "pkgdir/pkgdir.h"
+#include "pkgdir/pkgdir_intern.h"
 #include "pkgset.h"
 #include "pkgmisc.h"
 #include "conf.h"
@@ -39,7 +40,8 @@
 
 extern const char *poldek_conf_PKGDIR_DEFAULT_TYPE;
 
-int poldek__load_sources_internal(struct poldek_ctx *ctx)
+/* names, if any, limit loading to dependency closure of them */
+int poldek__load_sources_internal(struct poldek_ctx *ctx, const tn_array *names)
 {
     struct pkgset *ps;
     struct poldek_ts *ts;
@@ -63,6 +65,9 @@ int poldek__load_sources_internal(struct poldek_ctx *ctx)
     if (ctx->ts->getop(ctx->ts, POLDEK_OP_LDFULLFILELIST))
         ldflags |= PKGDIR_LD_FULLFLIST;
 
+    if (ctx->ts->getop(ctx->ts, POLDEK_OP_LDFLIMAGE))
+        ldflags |= PKGDIR_LD_FLIMAGE;
+
     if (ctx->ts->getop(ctx->ts, POLDEK_OP_LDALLDESC))
 	ldflags |= PKGDIR_LD_ALLDESC;
 
@@ -81,7 +86,7 @@ int poldek__load_sources_internal(struct poldek_ctx *ctx)
         poldek_disable_threads();
     }
 
-    if (!pkgset_load(ps, ldflags, ctx->sources)) {
+    if (!pkgset_load_closure(ps, ldflags, ctx->sources, names)) {
         if (poldek_verbose() > 0)
             logn(LOGWARN, _("no packages loaded"));
     }
@@ -113,11 +118,46 @@ int poldek__load_sources_internal(struct poldek_ctx *ctx)
     //    packages_set_priorities(ps->pkgs, ctx->ts->prifile);
 
     ctx->ps = ps;
+    ctx->_ps_mtime = poldek__pkgdirs_mtime(ps->pkgdirs);
     MEMINF("after ps setup");
 
     return 1;
 }
 
+/* is any of pkgdirs loaded partially (dependency closure only)? */
+int poldek__pkgdirs_partial(const tn_array *pkgdirs)
+{
+    int i;
+
+    for (i=0; i < n_array_size(pkgdirs); i++) {
+        struct pkgdir *pkgdir = n_array_nth(pkgdirs, i);
+
+        if (pkgdir->_ld_keys)
+            return 1;
+    }
+
+    return 0;
+}
+
+time_t poldek__pkgdirs_mtime(const tn_array *pkgdirs)
+{
+    time_t mtime = 0;
+    int i;
+
+    for (i=0; i < n_array_size(pkgdirs); i++) {
+        struct pkgdir *pkgdir = n_array_nth(pkgdirs, i);
+        time_t t;
+
+        if ((pkgdir->flags & PKGDIR_LOADED) == 0)
+            continue;
+
+        if ((t = pkgdir_mtime(pkgdir)) > mtime)
+            mtime = t;
+    }
+
+    return mtime;
+}
+
 tn_array *poldek_load_stubs(struct poldek_ctx *ctx)
 {
     tn_array *sources = ctx->sources;
@@ -38,6 +38,7 @@
 #include "pkgdir/pkgdir.h"
 #include "pkgroup.h"
 #include "pkgcmp.h"
+#include "pkgprefetch.h"
 #include "pkg_ver_cmp.h"
 #include "thread.h"
 
@@ -289,6 +290,7 @@ struct pkg *pkg_new_ext(tn_alloc *na,
         pkg->na = n_ref(na);
         DBGF("+%p %p %d\n", na, &na->_refcnt, na->_refcnt);
     }
+    pkg->_crtab = capreq_shared_tab_ref();
     pkg->flags = flags;
     pkg->epoch = epoch;
     pkg->size = size;
@@ -465,6 +467,9 @@ void pkg_free(struct pkg *pkg)
     n_array_cfree(&pkg->sugs);
     n_array_cfree(&pkg->revreqs);
 
+    capreq_shared_tab_unref(pkg->_crtab);
+    pkg->_crtab = NULL;
+
     if (pkg->fl) {
         n_tuple_free(pkg->na, pkg->fl);
         pkg->fl = NULL;
@@ -1049,10 +1054,12 @@ struct pkguinf *pkg_xuinf(const struct pkg *pkg, tn_array *langs)
 {
     struct pkguinf *pkgu = NULL;
 
-    if (pkg->load_pkguinf)
+    if (pkg->load_pkguinf) {
+        pkg_prefetch__io_lock();
         pkgu = pkg->load_pkguinf(NULL, pkg, pkg->pkgdir_data, langs);
+        pkg_prefetch__io_unlock();
 
-    else if (pkg_has_ldpkguinf(pkg))
+    } else if (pkg_has_ldpkguinf(pkg))
         pkgu = pkguinf_link(pkg->pkg_pkguinf);
 
     return pkgu;
@@ -1064,8 +1071,11 @@ struct pkguinf *pkg_uinf(const struct pkg *pkg)
     if (pkg_has_ldpkguinf(pkg))
         pkgu = pkguinf_link(pkg->pkg_pkguinf);
 
-    else if (pkg->load_pkguinf)
+    else if (pkg->load_pkguinf && !pkg_prefetch__uinf(pkg, &pkgu)) {
+        pkg_prefetch__io_lock();
         pkgu = pkg->load_pkguinf(NULL, pkg, pkg->pkgdir_data, NULL);
+        pkg_prefetch__io_unlock();
+    }
 
     return pkgu;
 }
@@ -1103,11 +1113,14 @@ static tn_tuple *do_pkg_other_fl(tn_alloc *na, const struct pkg *pkg)
 {
     tn_tuple *fl = NULL;
 
-    if (pkg->load_nodep_fl)
+    if (pkg->load_nodep_fl) {
+        pkg_prefetch__io_lock();
         fl = pkg->load_nodep_fl(na, pkg,
                                 pkg->pkgdir_data,
                                 pkg->pkgdir ?
                                 pkg->pkgdir->foreign_depdirs : NULL);
+        pkg_prefetch__io_unlock();
+    }
 
     return fl;
 }
@@ -1132,6 +1145,16 @@ struct pkgflist *pkg_get_nodep_flist(const struct pkg *pkg)
 
 
 struct pkgflist *pkg_get_flist(const struct pkg *pkg)
+{
+    struct pkgflist *flist = NULL;
+
+    if (pkg_prefetch__flist(pkg, &flist))
+        return flist;
+
+    return pkg__load_flist(pkg);
+}
+
+struct pkgflist *pkg__load_flist(const struct pkg *pkg)
 {
     struct pkgflist *flist = NULL;
     tn_tuple *fl = NULL;
@@ -28,6 +28,7 @@
 #endif
 
 struct capreq;                  /* defined in capreq.h */
+struct capreq_table;
 struct pkguinf;                 /* defined in pkgu.h   */
 struct pkgdir;                  /* defined in pkgdir/pkgdir.h */
 
@@ -35,37 +36,17 @@ struct pkgdir;                  /* defined in pkgdir/pkgdir.h */
 #define PKG_HAS_PKGUINF     (1 << 5) /* loaded user-level info (pkgu.c) */
 #define PKG_HAS_ALLFILES    (1 << 6) /* loaded all files */
 #define PKG_HAS_SELFCAP     (1 << 7) /* name = e:v-r cap */
+#define PKG_HAS_SECTIME     (1 << 8) /* sectime is set (by index) */
 
 #define PKG_HELD            (1 << 12) /* non upgradable */
 #define PKG_IGNORED         (1 << 13) /* invisible      */
 #define PKG_IGNORED_UNIQ    (1 << 14) /* uniqued        */
 
-#define PKG_ORDER_PREREQ    (1 << 15) /* see pkgset-order.c */
-
 #define PKG_DBPKG           (1 << 16) /* loaded from database, i.e. installed */
 #define PKG_INCLUDED_DIRREQS (1 << 17) /* auto-dir-reqs added directly to reqs */
 
-#ifdef POLDEK_PKG_DAG_COLOURS
-/* DAG node colours (pkgset-order.c) */
-# define PKG_COLOR_WHITE    (1 << 20)
-# define PKG_COLOR_GRAY     (1 << 21)
-# define PKG_COLOR_BLACK    (1 << 22)
-# define PKG_ALL_COLORS     (PKG_COLOR_WHITE | PKG_COLOR_GRAY | PKG_COLOR_BLACK)
-
-/* colours */
-# define pkg_set_color(pkg, color) \
-   ((pkg)->flags &= ~(PKG_ALL_COLORS), (pkg)->flags |= (color))
-
-# define pkg_is_color(pkg, color) \
-   ((pkg)->flags & color)
-#endif  /* POLDEK_PKG_DAG_COLOURS */
-
 #define pkg_is_noarch(pkg)  (0 == strcmp(pkg_arch((pkg)), "noarch"))
 
-#define pkg_set_prereqed(pkg) ((pkg)->flags |= PKG_ORDER_PREREQ)
-#define pkg_clr_prereqed(pkg)  ((pkg)->flags &= ~PKG_ORDER_PREREQ)
-#define pkg_is_prereqed(pkg)  ((pkg)->flags & PKG_ORDER_PREREQ)
-
 #define pkg_score(pkg, v) ((pkg)->flags |= v)
 #define pkg_is_scored(pkg, v) ((pkg)->flags & v)
 #define pkg_clr_score(pkg, v) ((pkg)->flags &= ~(v))
@@ -74,6 +55,9 @@ struct pkgdir;                  /* defined in pkgdir/pkgdir.h */
 #define pkg_set_ldpkguinf(pkg) ((pkg)->flags |= PKG_HAS_PKGUINF)
 #define pkg_clr_ldpkguinf(pkg) ((pkg)->flags &= (~PKG_HAS_PKGUINF))
 
+#define pkg_has_sectime(pkg) ((pkg)->flags & PKG_HAS_SECTIME)
+#define pkg_set_sectime(pkg, t) ((pkg)->sectime = (t), (pkg)->flags |= PKG_HAS_SECTIME)
+
 #define pkg_has_ldallfiles(pkg) ((pkg)->flags & PKG_HAS_ALLFILES)
 #define pkg_set_ldallfiles(pkg) ((pkg)->flags |= PKG_HAS_ALLFILES)
 #define pkg_clr_ldallfiles(pkg) ((pkg)->flags &= (~PKG_HAS_ALLFILES))
@@ -131,6 +115,11 @@ struct pkg {
     uint16_t     _refcnt;
     tn_alloc     *na;
     int16_t      _buf_size;
+
+    /* appended to keep offsets of public fields above */
+    uint32_t     sectime;     /* time of the latest changelog entry with
+                                 security fix, see PKG_HAS_SECTIME */
+    struct capreq_table *_crtab; /* shared capreqs table, see capreq.c */
     char         _buf[0];  /* private, store all string members */
 };
 
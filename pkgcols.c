@@ -0,0 +1,257 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+#include <trurl/nbuf.h>
+#include <trurl/nhash.h>
+
+#include "compiler.h"
+#include "capreq.h"
+#include "pkg.h"
+#include "pkgcols.h"
+#include "pkgdir/pkgdir.h"
+#include "vfile/vfile.h"
+
+enum {
+    COL_NAME = 0,
+    COL_EVR,
+    COL_ARCH,
+    COL_SOURCE,
+    COL_SIZE,
+    COL_FSIZE,
+    COL_BTIME,
+    COL_CAPS,
+    COL_CAP_NAME,
+    COL_CAP_EVR,
+    COL_CAP_FLAGS,
+    COL_REQS,
+    COL_REQ_NAME,
+    COL_REQ_EVR,
+    COL_REQ_FLAGS,
+    COL_ARCHS,
+    COL_SOURCES,
+    COL_STRPOOL,
+
+    NCOLS
+};
+
+/* distinct pointers (arch names, pkgdirs) in order of appearance */
+struct ptrmap {
+    const void  **ptrs;
+    int         n;
+};
+
+struct pkgcols {
+    struct pkgcol  cols[NCOLS];
+    tn_buf         *strpool;
+    tn_hash        *strh;        /* string => its offset in strpool */
+};
+
+static void *col_init(struct pkgcols *cols, int i, const char *name,
+                      const char *format, int itemsize, size_t nitems)
+{
+    struct pkgcol *col = &cols->cols[i];
+
+    col->name = name;
+    col->format = format;
+    col->itemsize = itemsize;
+    col->nitems = nitems;
+    col->data = n_calloc(nitems ? nitems : 1, itemsize);
+
+    return (void*)col->data;
+}
+
+static uint32_t add_str(struct pkgcols *cols, const char *s)
+{
+    uint32_t off;
+    void *v;
+
+    if (s == NULL || *s == '\0')
+        return 0;
+
+    if ((v = n_hash_get(cols->strh, s)))
+        return (uint32_t)(uintptr_t)v;
+
+    off = n_buf_size(cols->strpool);
+    n_assert(off < UINT32_MAX - strlen(s));
+
+    n_buf_write(cols->strpool, s, strlen(s) + 1);
+    n_hash_insert(cols->strh, s, (void*)(uintptr_t)off);
+
+    return off;
+}
+
+static uint16_t ptrmap_index(struct ptrmap *map, const void *ptr)
+{
+    int i;
+
+    for (i = map->n - 1; i >= 0; i--)
+        if (map->ptrs[i] == ptr)
+            return i;
+
+    n_assert(map->n < UINT16_MAX);
+    map->ptrs = n_realloc(map->ptrs, (map->n + 1) * sizeof(*map->ptrs));
+    map->ptrs[map->n] = ptr;
+
+    return map->n++;
+}
+
+/* fills capreqs columns from index col, RET: number of items filled */
+static uint32_t add_capreqs(struct pkgcols *cols, int col, uint32_t from,
+                            const tn_array *capreqs)
+{
+    uint32_t *names = (uint32_t*)cols->cols[col + 1].data;
+    uint32_t *evrs = (uint32_t*)cols->cols[col + 2].data;
+    uint8_t *flags = (uint8_t*)cols->cols[col + 3].data;
+    char evr[256];
+    int i;
+
+    if (capreqs == NULL)
+        return 0;
+
+    for (i = 0; i < n_array_size(capreqs); i++) {
+        const struct capreq *cr = n_array_nth(capreqs, i);
+
+        names[from + i] = add_str(cols, capreq_name(cr));
+
+        evrs[from + i] = 0;
+        if (capreq_snprintf_evr(evr, sizeof(evr), cr) > 0)
+            evrs[from + i] = add_str(cols, evr);
+
+        flags[from + i] = cr->cr_relflags & REL_ALL; /* no internal bits */
+    }
+
+    return i;
+}
+
+struct pkgcols *pkgcols_new(const tn_array *pkgs)
+{
+    struct pkgcols *cols;
+    struct ptrmap archs = { NULL, 0 }, pkgdirs = { NULL, 0 };
+    uint32_t *name, *evr, *size, *fsize, *btime, *caps, *reqs, *names;
+    uint16_t *arch, *source;
+    size_t ncaps = 0, nreqs = 0;
+    char buf[PATH_MAX];
+    int i, npkgs;
+
+    npkgs = n_array_size(pkgs);
+    for (i = 0; i < npkgs; i++) {
+        const struct pkg *pkg = n_array_nth(pkgs, i);
+
+        if (pkg->caps)
+            ncaps += n_array_size(pkg->caps);
+
+        if (pkg->reqs)
+            nreqs += n_array_size(pkg->reqs);
+    }
+
+    cols = n_calloc(1, sizeof(*cols));
+    cols->strpool = n_buf_new(npkgs * 64 + 1024);
+    n_buf_putc(cols->strpool, '\0'); /* "" at 0 */
+
+    cols->strh = n_hash_new(npkgs * 8 + 16, NULL);
+    n_hash_ctl(cols->strh, TN_HASH_REHASH);
+
+    name = col_init(cols, COL_NAME, "name", "I", sizeof(uint32_t), npkgs);
+    evr = col_init(cols, COL_EVR, "evr", "I", sizeof(uint32_t), npkgs);
+    arch = col_init(cols, COL_ARCH, "arch", "H", sizeof(uint16_t), npkgs);
+    source = col_init(cols, COL_SOURCE, "source", "H", sizeof(uint16_t), npkgs);
+    size = col_init(cols, COL_SIZE, "size", "I", sizeof(uint32_t), npkgs);
+    fsize = col_init(cols, COL_FSIZE, "fsize", "I", sizeof(uint32_t), npkgs);
+    btime = col_init(cols, COL_BTIME, "btime", "I", sizeof(uint32_t), npkgs);
+
+    caps = col_init(cols, COL_CAPS, "caps", "I", sizeof(uint32_t), npkgs + 1);
+    col_init(cols, COL_CAP_NAME, "cap_name", "I", sizeof(uint32_t), ncaps);
+    col_init(cols, COL_CAP_EVR, "cap_evr", "I", sizeof(uint32_t), ncaps);
+    col_init(cols, COL_CAP_FLAGS, "cap_flags", "B", sizeof(uint8_t), ncaps);
+
+    reqs = col_init(cols, COL_REQS, "reqs", "I", sizeof(uint32_t), npkgs + 1);
+    col_init(cols, COL_REQ_NAME, "req_name", "I", sizeof(uint32_t), nreqs);
+    col_init(cols, COL_REQ_EVR, "req_evr", "I", sizeof(uint32_t), nreqs);
+    col_init(cols, COL_REQ_FLAGS, "req_flags", "B", sizeof(uint8_t), nreqs);
+
+    caps[0] = reqs[0] = 0;
+    for (i = 0; i < npkgs; i++) {
+        const struct pkg *pkg = n_array_nth(pkgs, i);
+
+        name[i] = add_str(cols, pkg->name);
+
+        evr[i] = 0;
+        if (pkg_evr_snprintf(buf, sizeof(buf), pkg) > 0)
+            evr[i] = add_str(cols, buf);
+
+        arch[i] = ptrmap_index(&archs, pkg_arch(pkg)); /* registered, never freed */
+        source[i] = ptrmap_index(&pkgdirs, pkg->pkgdir);
+        size[i] = pkg->size;
+        fsize[i] = pkg->fsize;
+        btime[i] = pkg->btime;
+
+        caps[i + 1] = caps[i] + add_capreqs(cols, COL_CAPS, caps[i], pkg->caps);
+        reqs[i + 1] = reqs[i] + add_capreqs(cols, COL_REQS, reqs[i], pkg->reqs);
+    }
+
+    names = col_init(cols, COL_ARCHS, "archs", "I", sizeof(uint32_t), archs.n);
+    for (i = 0; i < archs.n; i++)
+        names[i] = add_str(cols, archs.ptrs[i]);
+
+    names = col_init(cols, COL_SOURCES, "sources", "I", sizeof(uint32_t), pkgdirs.n);
+    for (i = 0; i < pkgdirs.n; i++) {
+        const struct pkgdir *pkgdir = pkgdirs.ptrs[i];
+
+        names[i] = 0;
+        if (pkgdir)
+            names[i] = add_str(cols, pkgdir_idstr(pkgdir, buf, sizeof(buf)));
+    }
+
+    free(archs.ptrs);
+    free(pkgdirs.ptrs);
+
+    /* strings are all in, pool is not going to be reallocated */
+    n_hash_free(cols->strh);
+    cols->strh = NULL;
+
+    cols->cols[COL_STRPOOL].name = "strpool";
+    cols->cols[COL_STRPOOL].format = "c";
+    cols->cols[COL_STRPOOL].itemsize = 1;
+    cols->cols[COL_STRPOOL].nitems = n_buf_size(cols->strpool);
+    cols->cols[COL_STRPOOL].data = n_buf_ptr(cols->strpool);
+
+    return cols;
+}
+
+void pkgcols_free(struct pkgcols *cols)
+{
+    int i;
+
+    for (i = 0; i < NCOLS; i++) {
+        if (i != COL_STRPOOL)   /* strpool's buffer */
+            free((void*)cols->cols[i].data);
+    }
+
+    n_buf_free(cols->strpool);
+    free(cols);
+}
+
+int pkgcols_size(const struct pkgcols *cols)
+{
+    n_assert(cols);
+    return NCOLS;
+}
+
+const struct pkgcol *pkgcols_nth(const struct pkgcols *cols, int i)
+{
+    n_assert(i >= 0 && i < NCOLS);
+    return &cols->cols[i];
+}
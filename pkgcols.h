@@ -0,0 +1,51 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifndef POLDEK_PKGCOLS_H
+#define POLDEK_PKGCOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <trurl/narray.h>
+
+#ifndef EXPORT
+# define EXPORT extern
+#endif
+
+/*
+  Column-wise copy of packages' data for bulk readers (Python bindings):
+  i-th item of each per package column belongs to i-th package. Strings
+  are offsets into "strpool" column of NUL-terminated, deduplicated
+  strings (offset 0 is ""). Columns:
+
+  name, evr          string offsets ("[E:]V-R")
+  arch, source       uint16 indexes of "archs" and "sources" columns
+  size, fsize, btime uint32
+  caps, reqs         npkgs + 1 uint32 indexes, capabilities of i-th package
+                     are items caps[i]..caps[i+1]-1 of cap_* columns
+  cap_name, cap_evr  string offsets
+  cap_flags          uint8 relation flags (REL_*)
+  req_name, req_evr, req_flags
+  archs, sources     string offsets
+  strpool            chars
+*/
+struct pkgcol {
+    const char  *name;
+    const char  *format;    /* Python struct module's one: "I", "H", "B", "c" */
+    int         itemsize;
+    size_t      nitems;
+    const void  *data;
+};
+
+struct pkgcols;
+
+EXPORT struct pkgcols *pkgcols_new(const tn_array *pkgs);
+EXPORT void pkgcols_free(struct pkgcols *cols);
+
+EXPORT int pkgcols_size(const struct pkgcols *cols);
+EXPORT const struct pkgcol *pkgcols_nth(const struct pkgcols *cols, int i);
+
+#endif
@@ -239,6 +239,8 @@ struct pkg *pkg_restore_st(tn_stream *st, tn_alloc *na, struct pkg *pkg,
             pkg->recno = tmpkg.recno;
             pkg->fmtime = tmpkg.fmtime;
             pkg->color  = tmpkg.color;
+            if (pkg_has_sectime(&tmpkg))
+                pkg_set_sectime(pkg, tmpkg.sectime);
             pkg_loaded = 1;
             msgn(3, "Loaded %s, color=%d", pkg_id(pkg), pkg->color);
             break;
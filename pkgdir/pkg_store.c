@@ -199,6 +199,7 @@ static void store_capreq_array(const struct pkg *pkg, tn_array *capreqs, int8_t
 #define PKGFIELD_TAG_RECNO   'r'
 #define PKGFIELD_TAG_FMTIME  't'
 #define PKGFIELD_TAG_COLOR   'C'
+#define PKGFIELD_TAG_SECTIME 'x'
 
 static
 void pkg_store_fields(tn_buf *nbuf, const struct pkg *pkg, unsigned flags)
@@ -230,6 +231,9 @@ void pkg_store_fields(tn_buf *nbuf, const struct pkg *pkg, unsigned flags)
     if (pkg->color)
         n++;
 
+    if (pkg_has_sectime(pkg))   /* stored even if 0, "no security fixes" */
+        n++;
+
     size = (sizeof(int32_t) + 1) * n;
     n_assert(size < UINT8_MAX);
     size8t = size;
@@ -278,6 +282,11 @@ void pkg_store_fields(tn_buf *nbuf, const struct pkg *pkg, unsigned flags)
         n_buf_add_int32(nbuf, pkg->color);
     }
 
+    if (pkg_has_sectime(pkg)) {
+        n_buf_add_int8(nbuf, PKGFIELD_TAG_SECTIME);
+        n_buf_add_int32(nbuf, pkg->sectime);
+    }
+
     n_buf_printf(nbuf, "\n");
 }
 
@@ -325,6 +334,11 @@ int pkg_restore_fields(tn_stream *st, struct pkg *pkg)
                 n_stream_read_uint32(st, &pkg->color);
                 break;
 
+            case PKGFIELD_TAG_SECTIME:
+                n_stream_read_uint32(st, &pkg->sectime);
+                pkg->flags |= PKG_HAS_SECTIME;
+                break;
+
             default:            /* skip unknown tag */
                 n_stream_read_uint32(st, &tmp);
                 break;
@@ -47,6 +47,10 @@
 #include "pkgmisc.h"
 #include "pkgdir_dirindex.h"
 #include "pkgdir_stubindex.h"
+#include "pkgdir_depmap.h"
+#include "pkgdir_flimage.h"
+#include "pkgdir_depgraph.h"
+#include "trace.h"
 
 tn_hash *pkgdir__avlangs_new(void)
 {
@@ -521,7 +525,11 @@ struct pkgdir *pkgdir_open_ext(const char *path, const char *pkg_prefix,
     env_pkgdir(pkgdir);
     saved_flags = pkgdir->flags;
     if (mod->open) {
-        if (!mod->open(pkgdir, flags)) {
+        struct trace_span *span = trace_begin_l("source.open", idxpath);
+        int rc = mod->open(pkgdir, flags);
+
+        trace_end(span);
+        if (!rc) {
             pkgdir_free(pkgdir);
             return NULL;
         }
@@ -604,6 +612,16 @@ void pkgdir_free(struct pkgdir *pkgdir)
         pkgdir->lc_lang = NULL;
     }
 
+    if (pkgdir->_ld_keys) {
+        n_hash_free(pkgdir->_ld_keys);
+        pkgdir->_ld_keys = NULL;
+    }
+
+    if (pkgdir->_depgraph) {
+        pkgdir__depgraph_free(pkgdir->_depgraph);
+        pkgdir->_depgraph = NULL;
+    }
+
     pkgdir->flags = 0;
 
     if (pkgdir->mod && pkgdir->mod->free)
@@ -648,6 +666,18 @@ static void do_open_dirindex(struct pkgdir *pkgdir, unsigned ldflags)
     pkgdir->dirindex = pkgdir__dirindex_open(pkgdir, flags);
 }
 
+/* pndir-like modules only, they load depdirs' files separately */
+static int flimage_usable(const struct pkgdir *pkgdir, unsigned ldflags)
+{
+    if ((ldflags & PKGDIR_LD_FLIMAGE) == 0 || (ldflags & PKGDIR_LD_FULLFLIST) == 0)
+        return 0;
+
+    if (pkgdir->flags & PKGDIR_DIFF)
+        return 0;
+
+    return (pkgdir->mod->cap_flags & PKGDIR_CAP_LDKEYS) != 0;
+}
+
 int pkgdir_load(struct pkgdir *pkgdir, const tn_array *depdirs, unsigned ldflags)
 {
     tn_array *foreign_depdirs = NULL;
@@ -688,9 +718,19 @@ int pkgdir_load(struct pkgdir *pkgdir, const tn_array *depdirs, unsigned ldflags
             msgn(2, _("Loading [%s]%s..."), pkgdir->type, t_url_slim(pkgdir->idxpath, 20));
     }
 
+    struct trace_span *span = trace_begin_l("pkgdir.load", pkgdir->idxpath);
+
+    /* full file lists are taken from the image, module loads the
+       depdirs' ones only */
+    unsigned mod_ldflags = ldflags;
+    if (flimage_usable(pkgdir, ldflags)) {
+        if ((pkgdir->_flimage = pkgdir__flimage_open(pkgdir)))
+            mod_ldflags &= ~PKGDIR_LD_FULLFLIST;
+    }
+
     rc = 0;
     uint32_t nth = 1;
-    if (pkgdir->mod->load(pkgdir, ldflags) >= 0) {
+    if (pkgdir->mod->load(pkgdir, mod_ldflags) >= 0) {
         int i;
 
         rc = 1;
@@ -708,6 +748,9 @@ int pkgdir_load(struct pkgdir *pkgdir, const tn_array *depdirs, unsigned ldflags
         n_array_sort(pkgdir->pkgs);
         n_array_freeze(pkgdir->_unsorted_pkgs);
 
+        if (pkgdir->_flimage)
+            pkgdir__flimage_attach(pkgdir);
+
         if (ldflags & PKGDIR_LD_DOIGNORE)
             do_ignore(pkgdir);
 
@@ -726,6 +769,13 @@ int pkgdir_load(struct pkgdir *pkgdir, const tn_array *depdirs, unsigned ldflags
 
     if (rc) {
         n_assert(pkgdir->ts > 0);       /* ts must be set by backend */
+
+        /* partially loaded, none of indexes may be built from it */
+        if (pkgdir->_ld_keys) {
+            ldflags |= PKGDIR_LD_DIRINDEX_NOCREATE;
+            ldflags &= ~(PKGDIR_LD_UPDATE_STUBINDEX | PKGDIR_LD_UPDATE_DEPMAP);
+        }
+
         pkgdir->_ldflags = ldflags;
 
         if (ldflags & PKGDIR_LD_DIRINDEX)
@@ -734,8 +784,16 @@ int pkgdir_load(struct pkgdir *pkgdir, const tn_array *depdirs, unsigned ldflags
         if (ldflags & PKGDIR_LD_UPDATE_STUBINDEX)
             pkgdir__stubindex_update(pkgdir);
 
+        if (ldflags & PKGDIR_LD_UPDATE_DEPMAP)
+            pkgdir__depmap_update(pkgdir);
+
+        if (flimage_usable(pkgdir, ldflags))
+            pkgdir__flimage_update(pkgdir);
     }
 
+    trace_count(span, "packages", n_array_size(pkgdir->pkgs));
+    trace_end(span);
+
     return rc;
 }
 
@@ -987,7 +1045,7 @@ int pkgdir_save_as(struct pkgdir *pkgdir, const char *type,
     const struct pkgdir_module  *mod;
     const char                  *idxpath = NULL;
     tn_hash                     *avlangs_h, *avlangs_h_tmp;
-    int                         nerr = 0;
+    int                         nerr = 0, saved = 0;
 
     n_assert(pkgdir->idxpath);
     mod = pkgdir->mod;
@@ -1036,7 +1094,9 @@ int pkgdir_save_as(struct pkgdir *pkgdir, const char *type,
     n_assert(nerr == 0);
 
     if (orig == NULL) {
-        if (!do_create(pkgdir, type, path, flags))
+        if (do_create(pkgdir, type, path, flags))
+            saved = 1;
+        else
             nerr++;
 
     } else {
@@ -1067,7 +1127,9 @@ int pkgdir_save_as(struct pkgdir *pkgdir, const char *type,
 
 
         if (create) {           /* save index */
-            if (!do_create(pkgdir, type, path, flags))
+            if (do_create(pkgdir, type, path, flags))
+                saved = 1;
+            else
                 nerr++;
 
         } else {
@@ -1089,6 +1151,13 @@ int pkgdir_save_as(struct pkgdir *pkgdir, const char *type,
         orig = NULL;
     }
 
+    /* graph is bound to index timestamp, so it is saved with index only */
+    if (saved && (flags & PKGDIR_CREAT_DEPGRAPH)) {
+        if (!pkgdir__depgraph_create(pkgdir, type,
+                                     path ? path : pkgdir_localidxpath(pkgdir)))
+            nerr++;
+    }
+
     if (avlangs_h_tmp) {
         pkgdir->avlangs_h = avlangs_h_tmp;
         n_hash_free(avlangs_h);
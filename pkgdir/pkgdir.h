@@ -80,6 +80,14 @@ struct pkgdir {
 
     const struct pkgdir_module  *mod;
     void                        *mod_data;
+
+    /* internal ones, appended to keep offsets of fields above */
+    tn_hash             *_ld_keys;       /* keys of packages to load,
+                                            NULL => all (see pkgdir_depmap.h) */
+    const struct pkgdir_flimage *_flimage; /* mapped file lists
+                                              (see pkgdir_flimage.h) */
+    struct pkgdir_depgraph *_depgraph;   /* dependency graph
+                                            (see pkgdir_depgraph.h) */
 };
 
 #define pkgdir_pr_path(pkgdir) \
@@ -134,6 +142,9 @@ EXPORT struct pkgdir *pkgdir_open(const char *path, const char *pkg_prefix,
 #define PKGDIR_LD_ALLDESC            (1 << 8) /* load all i18n descriptions
 				                  (see PKGDIR_OPEN_ALLDESC)
 				               */
+#define PKGDIR_LD_UPDATE_DEPMAP      (1 << 9) /* update dependency map */
+#define PKGDIR_LD_FLIMAGE            (1 << 10) /* use/create file list image
+                                                  with PKGDIR_LD_FULLFLIST */
 
 EXPORT int pkgdir_load(struct pkgdir *pkgdir, const tn_array *depdirs, unsigned ldflags);
 
@@ -151,6 +162,8 @@ EXPORT int pkgdir_load(struct pkgdir *pkgdir, const tn_array *depdirs, unsigned
 #define PKGDIR_CREAT_v018x    (1 << 9) /* pdir: do not store package timestamps
                                           cause it brokes inremental updates
                                           by 0.18.x */
+#define PKGDIR_CREAT_DEPGRAPH (1 << 10) /* save dependency graph next to index
+                                           (see pkgdir_depgraph.h) */
 
 EXPORT int pkgdir_save(struct pkgdir *pkgdir, unsigned flags);
 
@@ -0,0 +1,521 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tndb/tndb.h>
+#include <trurl/nassert.h>
+#include <trurl/nstr.h>
+#include <trurl/nbuf.h>
+#include <trurl/nmalloc.h>
+
+#include <vfile/vfile.h>
+
+#include "compiler.h"
+#include "i18n.h"
+#include "log.h"
+#include "pkgdir.h"
+#include "pkgdir_intern.h"
+#include "pkg.h"
+#include "pkgset.h"
+#include "capreq.h"
+#include "trace.h"
+#include "pkgdir_depgraph.h"
+#include "pndir/pndir.h"        /* for pndir_make_pkgkey() */
+
+/*
+  Records (package number is its position in pkgdir->pkgs), numbers are
+  stored as variable length integers, 7 bits per byte, lowest first:
+   "#NO" => package key (as in pndir), '\0', number of package requirements
+            and conflicts (to detect changed packages), 'complete' flag,
+            then edges preceded by their counts:
+              requirements: requirement number, provider
+              conflicts:    conflict number, conflicted package, REQPKG_* flags
+              required by:  requiring package
+*/
+#define FORMAT_KEY      "_#format"
+#define FORMAT_VERSION  "1"
+#define NPKGS_KEY       "_#npkgs"
+#define TS_KEY          "_#ts"
+
+#define PREFIX_PKG      '#'
+
+static const char *depgraph_basename = "depgraph";
+
+struct pkgdir_depgraph {
+    struct tndb          *db;      /* NULL => no graph */
+    int                  npkgs;
+    struct pkgdir_dgnode **nodes;  /* decoded on demand */
+};
+
+/* placeholder of missing or outdated node */
+static struct pkgdir_dgnode nonode;
+
+static int depgraph_path(char *path, int size, const char *type,
+                         const char *idxpath)
+{
+    const char *p;
+    int len = 0;
+
+    if ((p = strrchr(idxpath, '/')))
+        len = p - idxpath + 1;
+
+    return n_snprintf(path, size, "%.*s%s.%s", len, idxpath,
+                      depgraph_basename, type);
+}
+
+static void put_varint(tn_buf *nbuf, unsigned v)
+{
+    unsigned char b[8];
+    int n = 0;
+
+    while (v >= 0x80) {
+        b[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    b[n++] = v;
+
+    n_buf_write(nbuf, b, n);
+}
+
+/* RET: number of pkg in pkgdir->pkgs or -1 */
+static int pkg_no(const struct pkgdir *pkgdir, const struct pkg *pkg)
+{
+    int n;
+
+    if ((n = n_array_bsearch_idx(pkgdir->pkgs, pkg)) >= 0 &&
+        n_array_nth(pkgdir->pkgs, n) != pkg)
+        n = -1;
+
+    return n;
+}
+
+static int cnfl_no(const struct pkg *pkg, const struct capreq *cnfl)
+{
+    int i;
+
+    for (i=0; i < n_array_size(pkg->cnfls); i++)
+        if (n_array_nth(pkg->cnfls, i) == cnfl)
+            return i;
+
+    return -1;
+}
+
+static void put_reqs(tn_buf *nbuf, tn_buf *ebuf, struct pkgset *ps,
+                     const struct pkgdir *pkgdir, struct pkg *pkg)
+{
+    int i, j, complete = 1, nedges = 0;
+
+    n_buf_clean(ebuf);
+    for (i=0; pkg->reqs && i < n_array_size(pkg->reqs); i++) {
+        struct capreq *req = n_array_nth(pkg->reqs, i);
+        tn_array *matches = NULL;
+
+        if (capreq_is_rpmlib(req))
+            continue;
+
+        /* unresolved ones are left to runtime resolving */
+        if (!pkgset_find_match_packages(ps, pkg, req, &matches, true)) {
+            complete = 0;
+            continue;
+        }
+
+        for (j=0; matches && j < n_array_size(matches); j++) {
+            int to = pkg_no(pkgdir, n_array_nth(matches, j));
+
+            if (to < 0) {
+                complete = 0;
+                continue;
+            }
+
+            put_varint(ebuf, i);
+            put_varint(ebuf, to);
+            nedges++;
+        }
+
+        if (matches)
+            n_array_free(matches);
+    }
+
+    put_varint(nbuf, complete);
+    put_varint(nbuf, nedges);
+    n_buf_write(nbuf, n_buf_ptr(ebuf), n_buf_size(ebuf));
+}
+
+static void put_cnfls(tn_buf *nbuf, tn_buf *ebuf, struct pkgset *ps,
+                      const struct pkgdir *pkgdir, struct pkg *pkg)
+{
+    tn_array *re;
+    int i, nedges = 0;
+
+    n_buf_clean(ebuf);
+    if ((re = pkgset_get_conflicted_packages(0, ps, pkg))) {
+        for (i=0; i < n_array_size(re); i++) {
+            struct reqpkg *rpkg = n_array_nth(re, i);
+            int no = cnfl_no(pkg, rpkg->req), to = pkg_no(pkgdir, rpkg->pkg);
+
+            if (no < 0 || to < 0)
+                continue;
+
+            put_varint(ebuf, no);
+            put_varint(ebuf, to);
+            put_varint(ebuf, rpkg->flags);
+            nedges++;
+        }
+        n_array_free(re);
+    }
+
+    put_varint(nbuf, nedges);
+    n_buf_write(nbuf, n_buf_ptr(ebuf), n_buf_size(ebuf));
+}
+
+static void put_reqby(tn_buf *nbuf, tn_buf *ebuf, struct pkgset *ps,
+                      const struct pkgdir *pkgdir, struct pkg *pkg)
+{
+    tn_array *re;
+    int i, nedges = 0;
+
+    n_buf_clean(ebuf);
+    if ((re = pkgset_get_requiredby_packages(0, ps, pkg))) {
+        for (i=0; i < n_array_size(re); i++) {
+            int to = pkg_no(pkgdir, n_array_nth(re, i));
+
+            if (to < 0)
+                continue;
+
+            put_varint(ebuf, to);
+            nedges++;
+        }
+        n_array_free(re);
+    }
+
+    put_varint(nbuf, nedges);
+    n_buf_write(nbuf, n_buf_ptr(ebuf), n_buf_size(ebuf));
+}
+
+static void put_package(struct tndb *db, struct pkgset *ps,
+                        const struct pkgdir *pkgdir, tn_buf *nbuf,
+                        tn_buf *ebuf, unsigned no, struct pkg *pkg)
+{
+    char key[TNDB_KEY_MAX + 1];
+    int n;
+
+    n_buf_clean(nbuf);
+    n = pndir_make_pkgkey(key, sizeof(key), pkg);
+    n_buf_write(nbuf, key, n + 1);
+
+    put_varint(nbuf, pkg->reqs ? n_array_size(pkg->reqs) : 0);
+    put_varint(nbuf, pkg->cnfls ? n_array_size(pkg->cnfls) : 0);
+
+    put_reqs(nbuf, ebuf, ps, pkgdir, pkg);
+    put_cnfls(nbuf, ebuf, ps, pkgdir, pkg);
+    put_reqby(nbuf, ebuf, ps, pkgdir, pkg);
+
+    n = n_snprintf(key, sizeof(key), "%c%u", PREFIX_PKG, no);
+    tndb_put(db, key, n, n_buf_ptr(nbuf), n_buf_size(nbuf));
+}
+
+int pkgdir__depgraph_create(struct pkgdir *pkgdir, const char *type,
+                            const char *idxpath)
+{
+    struct pkgset *ps;
+    struct tndb   *db;
+    tn_buf        *nbuf, *ebuf;
+    char          path[PATH_MAX], val[32];
+    int           i, n;
+
+    if (n_array_size(pkgdir->pkgs) == 0) /* tndb cannot create empty files */
+        return 1;
+
+    depgraph_path(path, sizeof(path), type, idxpath);
+
+    if ((db = tndb_creat(path, 0, TNDB_SIGN_DIGEST)) == NULL) {
+        logn(LOGERR, "%s: open failed (%m)\n", path);
+        return 0;
+    }
+
+    msgn_i(1, 2, _("Creating dependency graph of %s..."), pkgdir_idstr_s(pkgdir));
+    struct trace_span *span = trace_begin("pkgdir.depgraph");
+
+    /* resolved like pkgset of this pkgdir alone, packages are
+       not owned by pkgset so pkgdir is not added */
+    ps = pkgset_new(NULL);
+    for (i=0; pkgdir->depdirs && i < n_array_size(pkgdir->depdirs); i++)
+        n_array_push(ps->depdirs, n_strdup(n_array_nth(pkgdir->depdirs, i)));
+    n_array_sort(ps->depdirs);
+
+    for (i=0; i < n_array_size(pkgdir->pkgs); i++)
+        pkgset_add_package(ps, n_array_nth(pkgdir->pkgs, i));
+
+    pkgset__index_caps(ps);
+
+    nbuf = n_buf_new(1024);
+    ebuf = n_buf_new(1024);
+
+    for (i=0; i < n_array_size(pkgdir->pkgs); i++)
+        put_package(db, ps, pkgdir, nbuf, ebuf, i, n_array_nth(pkgdir->pkgs, i));
+
+    n = n_snprintf(val, sizeof(val), "%d", n_array_size(pkgdir->pkgs));
+    tndb_put(db, NPKGS_KEY, strlen(NPKGS_KEY), val, n);
+    n = n_snprintf(val, sizeof(val), "%lu", (unsigned long)pkgdir->ts);
+    tndb_put(db, TS_KEY, strlen(TS_KEY), val, n);
+    tndb_put(db, FORMAT_KEY, strlen(FORMAT_KEY), FORMAT_VERSION,
+             strlen(FORMAT_VERSION));
+
+    n_buf_free(nbuf);
+    n_buf_free(ebuf);
+    pkgset_free(ps);
+
+    trace_count(span, "packages", n_array_size(pkgdir->pkgs));
+    trace_end(span);
+
+    tndb_close(db);
+    return 1;
+}
+
+static struct tndb *do_open(const char *path, unsigned vfmode,
+                            const char *srcnam, int *fromcache)
+{
+    struct vfile *vf;
+    struct tndb  *db;
+    int fd;
+
+    if ((vf = vfile_open_ul(path, VFT_IO, vfmode, srcnam)) == NULL)
+        return NULL;
+
+    *fromcache = (vf->vf_flags & VF_FRMCACHE) != 0;
+
+    if ((fd = dup(vf->vf_fd)) == -1) {
+        logn(LOGERR, "dup(%d): %m", vf->vf_fd);
+        vfile_close(vf);
+        return NULL;
+    }
+
+    db = tndb_dopen(fd, vfile_localpath(vf));
+    vfile_close(vf);
+
+    if (db && !tndb_verify(db)) {
+        logn(LOGERR, "%s: broken file", vf_url_slim_s(path, 0));
+        tndb_close(db);
+        db = NULL;
+    }
+
+    return db;
+}
+
+/* RET: 0 if db does not match pkgdir, leaves it to be redownloaded */
+static int verify(struct tndb *db, const struct pkgdir *pkgdir, int *npkgs)
+{
+    char val[32];
+    unsigned long ts;
+
+    if (!tndb_get_str(db, FORMAT_KEY, (unsigned char *)val, sizeof(val)) ||
+        n_str_ne(val, FORMAT_VERSION) ||
+        !tndb_get_str(db, NPKGS_KEY, (unsigned char *)val, sizeof(val)) ||
+        sscanf(val, "%d", npkgs) != 1 ||
+        !tndb_get_str(db, TS_KEY, (unsigned char *)val, sizeof(val)) ||
+        sscanf(val, "%lu", &ts) != 1)
+        return 0;
+
+    return ts == (unsigned long)pkgdir->ts;
+}
+
+static struct pkgdir_depgraph *depgraph_open(struct pkgdir *pkgdir)
+{
+    struct pkgdir_depgraph *dg;
+    unsigned vfmode = VFM_RO | VFM_CACHE | VFM_NOEMPTY | VFM_QUITERR;
+    char path[PATH_MAX];
+    int fromcache = 0;
+
+    dg = n_calloc(1, sizeof(*dg));
+
+    /* closure-loaded or patched in memory */
+    if (pkgdir->_ld_keys || pkgdir->idxpath == NULL ||
+        (pkgdir->flags & PKGDIR_CHANGED))
+        return dg;
+
+    depgraph_path(path, sizeof(path), pkgdir->type, pkgdir->idxpath);
+
+    if ((dg->db = do_open(path, vfmode, pkgdir->name, &fromcache)) &&
+        !verify(dg->db, pkgdir, &dg->npkgs) && fromcache) {
+        tndb_close(dg->db);     /* stale cached copy */
+        vfmode &= ~VFM_CACHE;
+        vfmode |= VFM_NODEL;
+        dg->db = do_open(path, vfmode, pkgdir->name, &fromcache);
+    }
+
+    if (dg->db && (!verify(dg->db, pkgdir, &dg->npkgs) ||
+                   dg->npkgs != n_array_size(pkgdir->pkgs))) {
+        msgn(3, "%s: outdated dependency graph", vf_url_slim_s(path, 0));
+        tndb_close(dg->db);
+        dg->db = NULL;
+    }
+
+    if (dg->db == NULL) {
+        msgn(3, "%s: no dependency graph", pkgdir_idstr_s(pkgdir));
+        return dg;
+    }
+
+    msgn(3, "%s: using dependency graph", pkgdir_idstr_s(pkgdir));
+    dg->nodes = n_calloc(dg->npkgs, sizeof(*dg->nodes));
+    return dg;
+}
+
+struct reader {
+    const unsigned char *p;
+    const unsigned char *end;
+    int                 error;
+};
+
+static unsigned get_varint(struct reader *r)
+{
+    unsigned v = 0;
+    int shift = 0;
+
+    while (r->p < r->end && shift < 32) {
+        unsigned char c = *r->p++;
+
+        v |= (unsigned)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return v;
+
+        shift += 7;
+    }
+
+    r->error = 1;
+    return 0;
+}
+
+/* RET: edges or NULL; nos - upper bound of their numbers, 0 if not stored */
+static struct pkgdir_dgedge *get_edges(struct reader *r, const struct pkgdir *pkgdir,
+                                       int *nedges, unsigned nos, int withflags)
+{
+    struct pkgdir_dgedge *edges;
+    unsigned i, n, to;
+
+    n = get_varint(r);
+    if (r->error || n > (unsigned)(r->end - r->p)) { /* at least byte per edge */
+        r->error = 1;
+        return NULL;
+    }
+
+    edges = n_calloc(n + 1, sizeof(*edges));
+    for (i=0; i < n && !r->error; i++) {
+        if (nos && (edges[i].no = get_varint(r)) >= nos)
+            r->error = 1;
+
+        if ((to = get_varint(r)) >= (unsigned)n_array_size(pkgdir->pkgs))
+            r->error = 1;
+        else
+            edges[i].pkg = n_array_nth(pkgdir->pkgs, to);
+
+        if (withflags)
+            edges[i].flags = get_varint(r);
+    }
+
+    *nedges = n;
+    return edges;
+}
+
+static void node_free(struct pkgdir_dgnode *node)
+{
+    free(node->reqs);
+    free(node->cnfls);
+    free(node->reqby);
+    free(node);
+}
+
+static struct pkgdir_dgnode *load_node(struct pkgdir_depgraph *dg,
+                                       const struct pkgdir *pkgdir,
+                                       int no, const struct pkg *pkg)
+{
+    struct pkgdir_dgnode *node = NULL;
+    struct reader r;
+    char key[TNDB_KEY_MAX + 1], *val = NULL;
+    unsigned nreqs, ncnfls;
+    int n, vlen, klen;
+
+    n = n_snprintf(key, sizeof(key), "%c%u", PREFIX_PKG, no);
+    if ((vlen = tndb_get_all(dg->db, key, n, (void**)&val)) <= 0)
+        return &nonode;
+
+    klen = pndir_make_pkgkey(key, sizeof(key), pkg);
+    if (klen >= vlen || memcmp(val, key, klen + 1) != 0) /* another package */
+        goto l_end;
+
+    r.p = (unsigned char *)val + klen + 1;
+    r.end = (unsigned char *)val + vlen;
+    r.error = 0;
+
+    nreqs = get_varint(&r);
+    ncnfls = get_varint(&r);
+
+    if (nreqs != (unsigned)(pkg->reqs ? n_array_size(pkg->reqs) : 0) ||
+        ncnfls != (unsigned)(pkg->cnfls ? n_array_size(pkg->cnfls) : 0))
+        goto l_end;
+
+    node = n_calloc(1, sizeof(*node));
+    node->complete = get_varint(&r);
+    node->reqs = get_edges(&r, pkgdir, &node->nreqs, nreqs, 0);
+    node->cnfls = get_edges(&r, pkgdir, &node->ncnfls, ncnfls, 1);
+    node->reqby = get_edges(&r, pkgdir, &node->nreqby, 0, 0);
+
+    if (r.error) {
+        logn(LOGERR, "%s: broken dependency graph", tndb_path(dg->db));
+        node_free(node);
+        node = NULL;
+    }
+
+l_end:
+    free(val);
+    return node ? node : &nonode;
+}
+
+const struct pkgdir_dgnode *pkgdir__depgraph_node(struct pkgdir *pkgdir,
+                                                  const struct pkg *pkg)
+{
+    struct pkgdir_depgraph *dg;
+    int no;
+
+    if ((dg = pkgdir->_depgraph) == NULL)
+        dg = pkgdir->_depgraph = depgraph_open(pkgdir);
+
+    if (dg->db == NULL)
+        return NULL;
+
+    if ((no = pkg_no(pkgdir, pkg)) < 0 || no >= dg->npkgs)
+        return NULL;
+
+    if (dg->nodes[no] == NULL)
+        dg->nodes[no] = load_node(dg, pkgdir, no, pkg);
+
+    return dg->nodes[no] == &nonode ? NULL : dg->nodes[no];
+}
+
+void pkgdir__depgraph_free(struct pkgdir_depgraph *dg)
+{
+    int i;
+
+    for (i=0; dg->nodes && i < dg->npkgs; i++)
+        if (dg->nodes[i] && dg->nodes[i] != &nonode)
+            node_free(dg->nodes[i]);
+
+    free(dg->nodes);
+
+    if (dg->db)
+        tndb_close(dg->db);
+
+    free(dg);
+}
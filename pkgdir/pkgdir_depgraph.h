@@ -0,0 +1,48 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifndef PKGDIR_DEPGRAPH_H
+#define PKGDIR_DEPGRAPH_H
+/*
+  Dependency graph: hashed tndb created by makeidx (-o depgraph) next to
+  the index, maps every package to packages of the same repository which
+  satisfy its requirements, are in conflict with it (or obsoleted by) and
+  require it, as resolved at index creation. Nodes are read on demand,
+  see pkgset_get_required_packages() and friends.
+*/
+
+struct pkg;
+struct pkgdir;
+struct pkgdir_depgraph;
+
+struct pkgdir_dgedge {
+    struct pkg  *pkg;           /* target package */
+    unsigned    no;             /* number of requirement or conflict */
+    unsigned    flags;          /* conflicts: REQPKG_CONFLICT | REQPKG_OBSOLETE */
+};
+
+struct pkgdir_dgnode {
+    int                  complete; /* all requirements resolved within pkgdir */
+    int                  nreqs;
+    int                  ncnfls;
+    int                  nreqby;
+    struct pkgdir_dgedge *reqs;    /* providers grouped by requirement,
+                                      in resolver's order */
+    struct pkgdir_dgedge *cnfls;
+    struct pkgdir_dgedge *reqby;   /* no is not used */
+};
+
+/* creates graph of pkgdir packages next to index of given type at idxpath */
+int pkgdir__depgraph_create(struct pkgdir *pkgdir, const char *type,
+                            const char *idxpath);
+
+/* RET: node of pkg, NULL if pkgdir has no (usable) graph or pkg is not in */
+const struct pkgdir_dgnode *pkgdir__depgraph_node(struct pkgdir *pkgdir,
+                                                  const struct pkg *pkg);
+
+void pkgdir__depgraph_free(struct pkgdir_depgraph *dg);
+
+#endif
@@ -0,0 +1,398 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <tndb/tndb.h>
+#include <trurl/nassert.h>
+#include <trurl/nstr.h>
+#include <trurl/nbuf.h>
+#include <trurl/nhash.h>
+#include <trurl/nmalloc.h>
+
+#include <vfile/vfile.h>
+
+#include "compiler.h"
+#include "i18n.h"
+#include "log.h"
+#include "pkgdir.h"
+#include "pkgdir_intern.h"
+#include "pkg.h"
+#include "capreq.h"
+#include "misc.h"
+#include "trace.h"
+#include "pkgdir_stubindex.h"
+#include "pkgdir_depmap.h"
+#include "pndir/pndir.h"        /* for pndir_make_pkgkey() */
+
+/*
+  Records (package number is its position in pkgdir->pkgs):
+   "@NAME"  => providers: package numbers as 32-bit big endian integers,
+               NAME is a package name, capability or a file required by
+               any package of the pkgdir
+   "#NO"    => package key (as in pndir) followed by its requirement names,
+               all '\0' terminated
+*/
+#define FORMAT_KEY      "_#format"
+#define FORMAT_VERSION  "1"
+#define NPKGS_KEY       "_#npkgs"
+
+#define PREFIX_CAP      '@'
+#define PREFIX_PKG      '#'
+
+static const char *depmap_basename = "depmap";
+
+static int depmap_path(char *path, int size, const struct pkgdir *pkgdir)
+{
+    return pkgdir__cachefile_path(path, size, pkgdir, depmap_basename, NULL);
+}
+
+static void add_provider(tn_hash *caph, const char *name, unsigned no)
+{
+    unsigned char b[4];
+    tn_buf *nbuf;
+
+    if ((nbuf = n_hash_get(caph, name)) == NULL) {
+        nbuf = n_buf_new(16);
+        n_hash_insert(caph, name, nbuf);
+
+    } else {                    /* pkg may provide the same cap twice */
+        const unsigned char *p = n_buf_ptr(nbuf);
+        int n = n_buf_size(nbuf);
+
+        if (((unsigned)p[n - 4] << 24 | p[n - 3] << 16 | p[n - 2] << 8 | p[n - 1]) == no)
+            return;
+    }
+
+    b[0] = no >> 24;
+    b[1] = no >> 16;
+    b[2] = no >> 8;
+    b[3] = no;
+    n_buf_write(nbuf, b, sizeof(b));
+}
+
+static void map_package(struct tndb *db, tn_hash *caph, tn_hash *fileh,
+                        tn_buf *nbuf, unsigned no, struct pkg *pkg)
+{
+    char key[TNDB_KEY_MAX + 1];
+    int i, n;
+
+    add_provider(caph, pkg->name, no);
+
+    for (i=0; pkg->caps && i < n_array_size(pkg->caps); i++) {
+        struct capreq *cap = n_array_nth(pkg->caps, i);
+        add_provider(caph, capreq_name(cap), no);
+    }
+
+    if (n_hash_size(fileh) > 0) {
+        struct pkgflist_it *it = pkg_get_flist_it(pkg);
+        const char *path;
+
+        while (it && (path = pkgflist_it_get(it, NULL))) {
+            if (n_hash_exists(fileh, path))
+                add_provider(caph, path, no);
+        }
+
+        if (it)
+            pkgflist_it_free(it);
+    }
+
+    n_buf_clean(nbuf);
+    n = pndir_make_pkgkey(key, sizeof(key), pkg);
+    n_buf_write(nbuf, key, n + 1);
+
+    for (i=0; pkg->reqs && i < n_array_size(pkg->reqs); i++) {
+        struct capreq *req = n_array_nth(pkg->reqs, i);
+
+        if (capreq_is_rpmlib(req))
+            continue;
+
+        n_buf_write(nbuf, capreq_name(req), strlen(capreq_name(req)) + 1);
+    }
+
+    n = n_snprintf(key, sizeof(key), "%c%u", PREFIX_PKG, no);
+    tndb_put(db, key, n, n_buf_ptr(nbuf), n_buf_size(nbuf));
+}
+
+static int depmap_create(const struct pkgdir *pkgdir, const char *path)
+{
+    struct vflock *lock;
+    struct tndb   *db;
+    tn_hash       *caph, *fileh;
+    tn_array      *names;
+    tn_buf        *nbuf;
+    char          *tmp, *dir, val[32];
+    int           i, j, n;
+
+    n_strdupap(path, &tmp);
+    dir = n_dirname(tmp);
+
+    if ((lock = vf_lock_mkdir(dir)) == NULL)
+        return 0;
+
+    if ((db = tndb_creat(path, 0, TNDB_SIGN_DIGEST)) == NULL) {
+        logn(LOGERR, "%s: open failed (%m)\n", path);
+        vf_lock_release(lock);
+        return 0;
+    }
+
+    msgn_i(2, 2, "Creating dependency map of %s...", pkgdir_idstr_s(pkgdir));
+
+    /* only files required within pkgdir are mapped, whole file
+       database would be far too big */
+    fileh = n_hash_new(1024, NULL);
+    for (i=0; i < n_array_size(pkgdir->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgdir->pkgs, i);
+
+        for (j=0; pkg->reqs && j < n_array_size(pkg->reqs); j++) {
+            struct capreq *req = n_array_nth(pkg->reqs, j);
+
+            if (capreq_is_file(req) && !n_hash_exists(fileh, capreq_name(req)))
+                n_hash_insert(fileh, capreq_name(req), NULL);
+        }
+    }
+
+    caph = n_hash_new(n_array_size(pkgdir->pkgs) * 8, (tn_fn_free)n_buf_free);
+    nbuf = n_buf_new(1024);
+
+    for (i=0; i < n_array_size(pkgdir->pkgs); i++)
+        map_package(db, caph, fileh, nbuf, i, n_array_nth(pkgdir->pkgs, i));
+
+    names = n_hash_keys(caph);
+    for (i=0; i < n_array_size(names); i++) {
+        const char *name = n_array_nth(names, i);
+        tn_buf *providers = n_hash_get(caph, name);
+        char key[TNDB_KEY_MAX + 1];
+
+        n = n_snprintf(key, sizeof(key), "%c%s", PREFIX_CAP, name);
+        if (n >= TNDB_KEY_MAX)  /* unmappable, solver will miss it */
+            continue;
+
+        tndb_put(db, key, n, n_buf_ptr(providers), n_buf_size(providers));
+    }
+
+    n = n_snprintf(val, sizeof(val), "%d", n_array_size(pkgdir->pkgs));
+    tndb_put(db, NPKGS_KEY, strlen(NPKGS_KEY), val, n);
+    tndb_put(db, FORMAT_KEY, strlen(FORMAT_KEY), FORMAT_VERSION,
+             strlen(FORMAT_VERSION));
+
+    n_array_free(names);
+    n_buf_free(nbuf);
+    n_hash_free(caph);
+    n_hash_free(fileh);
+
+    tndb_close(db);
+    poldek_util_set_mtime(path, pkgdir_mtime(pkgdir));
+    vf_lock_release(lock);
+
+    return 1;
+}
+
+void pkgdir__depmap_update(struct pkgdir *pkgdir)
+{
+    char path[PATH_MAX];
+
+    /* closure-loaded or empty (tndb cannot create empty files) */
+    if (pkgdir->_ld_keys || n_array_size(pkgdir->pkgs) == 0)
+        return;
+
+    depmap_path(path, sizeof(path), pkgdir);
+    if (poldek_util_mtime(path) == pkgdir_mtime(pkgdir))
+        return;
+
+    depmap_create(pkgdir, path);
+}
+
+struct depmap {
+    struct pkgdir *pkgdir;
+    struct tndb   *db;
+    unsigned      npkgs;
+    unsigned char *selected;     /* npkgs */
+    tn_hash       *keys;         /* selected packages */
+};
+
+static struct tndb *depmap_open(const struct pkgdir *pkgdir, unsigned *npkgs)
+{
+    struct tndb *db;
+    char path[PATH_MAX], val[32];
+    time_t mtime;
+
+    depmap_path(path, sizeof(path), pkgdir);
+
+    mtime = poldek_util_mtime(path);
+    if (mtime == 0 || mtime != pkgdir_mtime(pkgdir)) {
+        msgn(3, "%s: no or outdated dependency map", pkgdir_idstr_s(pkgdir));
+        return NULL;
+    }
+
+    if ((db = tndb_open(path)) == NULL)
+        return NULL;
+
+    if (!tndb_get_str(db, FORMAT_KEY, (unsigned char *)val, sizeof(val)) ||
+        n_str_ne(val, FORMAT_VERSION) ||
+        !tndb_get_str(db, NPKGS_KEY, (unsigned char *)val, sizeof(val)) ||
+        sscanf(val, "%u", npkgs) != 1) {
+        msgn(2, _("%s: outdated dependency map format"), path);
+        tndb_close(db);
+        return NULL;
+    }
+
+    return db;
+}
+
+static void enqueue(tn_array *queue, tn_hash *seen, const char *name)
+{
+    if (n_hash_exists(seen, name))
+        return;
+
+    n_hash_insert(seen, name, NULL);
+    n_array_push(queue, n_strdup(name));
+}
+
+static void select_package(struct depmap *dm, unsigned no,
+                           tn_array *queue, tn_hash *seen)
+{
+    char key[32], *val = NULL, *p;
+    int n, vlen;
+
+    n = n_snprintf(key, sizeof(key), "%c%u", PREFIX_PKG, no);
+    if ((vlen = tndb_get_all(dm->db, key, n, (void**)&val)) <= 0)
+        return;
+
+    if (val[vlen - 1] != '\0') {
+        logn(LOGERR, "%s: broken dependency map", tndb_path(dm->db));
+        free(val);
+        return;
+    }
+
+    if (!n_hash_exists(dm->keys, val))  /* package key comes first */
+        n_hash_insert(dm->keys, val, NULL);
+
+    for (p = val + strlen(val) + 1; p < val + vlen; p += strlen(p) + 1)
+        enqueue(queue, seen, p);
+
+    free(val);
+}
+
+/* RET: number of providers of name */
+static int resolve_name(struct depmap *dm, const char *name,
+                        tn_array *queue, tn_hash *seen)
+{
+    char key[TNDB_KEY_MAX + 1];
+    unsigned char *providers = NULL;
+    int i, n, vlen;
+
+    n = n_snprintf(key, sizeof(key), "%c%s", PREFIX_CAP, name);
+    if ((vlen = tndb_get_all(dm->db, key, n, (void**)&providers)) <= 0)
+        return 0;
+
+    for (i=0; i + 4 <= vlen; i += 4) {
+        unsigned no = (unsigned)providers[i] << 24 | providers[i + 1] << 16 |
+            providers[i + 2] << 8 | providers[i + 3];
+
+        if (no < dm->npkgs && !dm->selected[no]) {
+            dm->selected[no] = 1;
+            select_package(dm, no, queue, seen);
+        }
+    }
+
+    free(providers);
+    return vlen / 4;
+}
+
+int pkgdir__depmap_closure(tn_array *pkgdirs, const tn_array *names)
+{
+    struct depmap *dms;
+    tn_array      *queue;
+    tn_hash       *seen;
+    int           i, j, ndms, nselected = 0, rc = 0;
+
+    struct trace_span *span = trace_begin("pkgdir.closure");
+
+    ndms = n_array_size(pkgdirs);
+    dms = n_calloc(ndms, sizeof(*dms));
+    queue = n_array_new(256, free, NULL);
+    seen = n_hash_new(4096, NULL);
+
+    for (i=0; i < ndms; i++) {
+        struct pkgdir *pkgdir = n_array_nth(pkgdirs, i);
+
+        if ((pkgdir->mod->cap_flags & PKGDIR_CAP_LDKEYS) == 0) {
+            msgn(3, "%s: %s type cannot be loaded partially",
+                 pkgdir_idstr_s(pkgdir), pkgdir->type);
+            goto l_end;
+        }
+
+        if ((dms[i].db = depmap_open(pkgdir, &dms[i].npkgs)) == NULL)
+            goto l_end;
+
+        dms[i].pkgdir = pkgdir;
+        dms[i].selected = n_calloc(dms[i].npkgs + 1, 1);
+        dms[i].keys = n_hash_new(256, NULL);
+    }
+
+    for (i=0; i < n_array_size(names); i++) {
+        const char *name = n_array_nth(names, i);
+        int nproviders = 0;
+
+        if (n_hash_exists(seen, name))
+            continue;
+
+        n_hash_insert(seen, name, NULL);
+        for (j=0; j < ndms; j++)
+            nproviders += resolve_name(&dms[j], name, queue, seen);
+
+        if (nproviders == 0) {  /* let full load report it */
+            msgn(3, "%s: not found in dependency maps", name);
+            goto l_end;
+        }
+    }
+
+    /* unresolved requirements are left to the solver,
+       they are probably satisfied by installed packages */
+    while (n_array_size(queue) > 0) {
+        char *name = n_array_shift(queue);
+
+        for (j=0; j < ndms; j++)
+            resolve_name(&dms[j], name, queue, seen);
+        free(name);
+    }
+
+    for (i=0; i < ndms; i++) {
+        nselected += n_hash_size(dms[i].keys);
+        dms[i].pkgdir->_ld_keys = dms[i].keys;
+        dms[i].keys = NULL;
+    }
+
+    msgn(2, _("%d packages in dependency closure"), nselected);
+    rc = 1;
+
+l_end:
+    for (i=0; i < ndms; i++) {
+        if (dms[i].db)
+            tndb_close(dms[i].db);
+        n_cfree(&dms[i].selected);
+        if (dms[i].keys)
+            n_hash_free(dms[i].keys);
+    }
+
+    free(dms);
+    n_array_free(queue);
+    n_hash_free(seen);
+
+    trace_count(span, "packages", nselected);
+    trace_end(span);
+
+    return rc;
+}
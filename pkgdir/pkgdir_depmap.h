@@ -0,0 +1,28 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifndef PKGDIR_DEPMAP_H
+#define PKGDIR_DEPMAP_H
+/*
+  Dependency map: hashed tndb kept in cache dir next to stub index,
+  maps capability names, package names and required files to package
+  keys and package keys to their requirements. It lets loader restore
+  only packages reachable from requested ones (see pkgset_load_closure()).
+*/
+
+#include <trurl/narray.h>
+
+struct pkgdir;
+
+/* (re)create depmap of loaded pkgdir if outdated */
+void pkgdir__depmap_update(struct pkgdir *pkgdir);
+
+/* sets pkgdir->_ld_keys of every (opened, not loaded) pkgdir to keys of
+   packages reachable from names; RET: 0 if any of depmaps is missing or
+   outdated or any of names is unknown, pkgdirs are untouched then */
+int pkgdir__depmap_closure(tn_array *pkgdirs, const tn_array *names);
+
+#endif
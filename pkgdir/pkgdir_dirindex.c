@@ -55,15 +55,134 @@
 
 #define PREFIXLEN 2
 
+/*
+  Format version, stored after package_no entries. Version 2 keeps
+  { path => package_no[] } as LEB128 varints of package_no deltas (lists
+  are ascending), version 1 (unversioned) had colon separated decimals.
+*/
+#define FORMAT_KEY      "_#format"
+#define FORMAT_VERSION  "2"
+
 const char *pkgdir_dirindex_basename = "dirindex";
 
 struct pkgdir_dirindex {
     struct tndb *db;
     tn_alloc *na;
-    tn_hash  *idmap;             /* { package_no => pkg } pairs */
+    struct pkg **idmap;          /* package_no => pkg */
+    unsigned  nidmap;
     tn_hash  *keymap;            /* { package_key => package_no } */
 };
 
+/* path's package_no[] being built */
+struct posting {
+    uint32_t  n;
+    uint32_t  last;
+    uint32_t  len;
+    uint32_t  size;
+    uint8_t   *buf;
+};
+
+static void posting_free(struct posting *po)
+{
+    free(po->buf);
+    free(po);
+}
+
+static void posting_add(struct posting *po, uint32_t no)
+{
+    uint32_t delta = no;
+
+    if (po->n > 0) {
+        if (no == po->last)     /* already here */
+            return;
+
+        n_assert(no > po->last);
+        delta = no - po->last;
+    }
+
+    if (po->len + 5 > po->size) {
+        po->size = po->size ? po->size * 2 : 16;
+        po->buf = n_realloc(po->buf, po->size);
+    }
+
+    do {
+        uint8_t b = delta & 0x7f;
+
+        delta >>= 7;
+        po->buf[po->len++] = b | (delta ? 0x80 : 0);
+    } while (delta);
+
+    po->last = no;
+    po->n++;
+}
+
+/* iterator over path's package_no[], allocates for very long lists only */
+struct posting_it {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t      no;
+    uint32_t      n;
+    uint8_t       *buf;
+    uint8_t       sbuf[4096];
+};
+
+static int posting_it_init(const struct pkgdir_dirindex *dirindex,
+                           struct posting_it *it, const char *path)
+{
+    off_t    voff = 0;
+    size_t   vlen = 0;
+    uint8_t  *data;
+
+    it->buf = NULL;
+    it->p = it->end = NULL;
+    it->no = it->n = 0;
+
+    if (*path == '/' && path[1] != '\0')
+        path++;
+
+    if (!tndb_get_voff(dirindex->db, path, strlen(path), &voff, &vlen))
+        return 0;
+
+    data = it->sbuf;
+    if (vlen > sizeof(it->sbuf))
+        data = it->buf = n_malloc(vlen);
+
+    if (vlen > 0 && tndb_read(dirindex->db, voff, data, vlen) != (int)vlen) {
+        logn(LOGERR, _("%s: %s: read error"), tndb_path(dirindex->db), path);
+        n_cfree(&it->buf);
+        return 0;
+    }
+
+    it->p = data;
+    it->end = data + vlen;
+    return 1;
+}
+
+static int posting_it_get(struct posting_it *it, uint32_t *no)
+{
+    uint32_t delta = 0;
+    int      shift = 0;
+    uint8_t  b;
+
+    do {
+        if (it->p == it->end || shift > 28) /* EOF or garbage */
+            return 0;
+
+        b = *it->p++;
+        delta |= (uint32_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    it->no = it->n++ ? it->no + delta : delta;
+    *no = it->no;
+    return 1;
+}
+
+static void posting_it_destroy(struct posting_it *it)
+{
+    n_cfree(&it->buf);
+}
+
 const char *pkgdir__dirindex_path(struct pkgdir_dirindex *dirindex) {
     return tndb_path(dirindex->db);
 }
@@ -134,22 +253,19 @@ void store_package_no(uint32_t package_no, struct tndb *db, const struct pkg *pk
 static
 void add_to_path_index(tn_hash *path_index, const char *path, uint32_t package_no)
 {
-    char val[512];
-    int vlen, klen = 0;
+    int klen = 0;
     unsigned khash = 0;
-    tn_array *keys;
+    struct posting *po;
 
     if (strlen(path) > 255)
 	return;
 
-    if ((keys = n_hash_get_ex(path_index, path, &klen, &khash)) == NULL) {
-        keys = n_array_new(16, free, (tn_fn_cmp)strcmp);
-        n_hash_insert_ex(path_index, path, klen, khash, keys);
+    if ((po = n_hash_get_ex(path_index, path, &klen, &khash)) == NULL) {
+        po = n_calloc(1, sizeof(*po));
+        n_hash_insert_ex(path_index, path, klen, khash, po);
     }
 
-    vlen = package_no_key(val, sizeof(val), package_no, 0);
-    //printf("add %s: %s\n", path, val);
-    n_array_push(keys, n_strdupl(val, vlen));
+    posting_add(po, package_no);
 }
 
 
@@ -314,7 +430,7 @@ static int dirindex_create(const struct pkgdir *pkgdir, const char *path,
     }
 
     na = n_alloc_new(4, TN_ALLOC_OBSTACK);
-    path_index = n_hash_new_na(na, n_array_size(pkgdir->pkgs) * 16, (tn_fn_free)n_array_free);
+    path_index = n_hash_new_na(na, n_array_size(pkgdir->pkgs) * 16, (tn_fn_free)posting_free);
     nbuf = n_buf_new(1024 * 16);
 
     tn_array *pkgs = pkgdir->_unsorted_pkgs;
@@ -327,6 +443,9 @@ static int dirindex_create(const struct pkgdir *pkgdir, const char *path,
         store_package_no(i, db, pkg);
         DBGF(" store pkgno %d %s\n", i, pkg_id(pkg));
     }
+    /* after package_no entries, see load_keymap() */
+    tndb_put(db, FORMAT_KEY, strlen(FORMAT_KEY), FORMAT_VERSION,
+             strlen(FORMAT_VERSION));
 
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg *pkg = n_array_nth(pkgs, i);
@@ -343,18 +462,11 @@ static int dirindex_create(const struct pkgdir *pkgdir, const char *path,
 
     for (i=0; i < n_array_size(directories); i++) {
         const char *dir_path = n_array_nth(directories, i);
-        tn_array *ids = n_hash_get(path_index, dir_path);
-        int j;
-
-        n_buf_clean(nbuf);
-        for (j = 0; j < n_array_size(ids); j++) {
-    	    n_buf_printf(nbuf, "%s%s", (char *)n_array_nth(ids, j),
-    				       j < n_array_size(ids) - 1 ? ":" : "");
-        }
+        struct posting *po = n_hash_get(path_index, dir_path);
 
-        DBGF("  dir %s %s\n", dir_path, (char*)n_buf_ptr(nbuf));
+        DBGF("  dir %s %u packages\n", dir_path, po->n);
 
-        tndb_put(db, dir_path, strlen(dir_path), n_buf_ptr(nbuf), n_buf_size(nbuf));
+        tndb_put(db, dir_path, strlen(dir_path), po->buf, po->len);
     }
 
     n_array_free(directories);
@@ -441,7 +553,7 @@ int pkgdir__dirindex_make_path(char *path, int size, const struct pkgdir *pkgdir
 }
 
 /* load { packages_key => package_no } into hash */
-static tn_hash *load_keymap(struct tndb *db, int npackages)
+static tn_hash *load_keymap(struct tndb *db, int npackages, unsigned *nids)
 {
     struct tndb_it  it;
     char            key[TNDB_KEY_MAX + 1] = {0}, *val = NULL;
@@ -479,6 +591,9 @@ static tn_hash *load_keymap(struct tndb *db, int npackages)
         memcpy(id, key + PREFIXLEN, klen - PREFIXLEN); /* skipping prefix */
         id[klen - PREFIXLEN] = '\0';
 
+        if ((unsigned)atoi(id) >= *nids)
+            *nids = atoi(id) + 1;
+
         DBGF("%s => %s\n", key, val);
 
         /* replace duplicates as rpm allows to install multiple instances of GPG keys */
@@ -568,6 +683,7 @@ void verify_dirindex(struct pkgdir *pkgdir, struct pkgdir_dirindex *dirindex)
             tn_array *pkgs = NULL;
             pkgs = do_dirindex_get(dirindex, pkgs, dir);
             n_assert(pkgs);
+            n_array_free(pkgs);
             tl++;
         }
 
@@ -578,10 +694,11 @@ void verify_dirindex(struct pkgdir *pkgdir, struct pkgdir_dirindex *dirindex)
 
 static
 struct tndb *open_index_database(const struct pkgdir *pkgdir, const char *path,
-                                 tn_hash **keymap)
+                                 tn_hash **keymap, unsigned *nids)
 {
     struct tndb     *db;
     tn_hash         *kmap = NULL;
+    char            version[32];
 
     n_assert(n_array_size(pkgdir->pkgs)); /* XXX: tndb w/o */
 
@@ -599,7 +716,14 @@ struct tndb *open_index_database(const struct pkgdir *pkgdir, const char *path,
 
     MEMINF("opened");
 
-    if ((kmap = load_keymap(db, n_array_size(pkgdir->pkgs))) == NULL)
+    if (!tndb_get_str(db, FORMAT_KEY, (unsigned char *)version, sizeof(version)) ||
+        n_str_ne(version, FORMAT_VERSION)) {
+        msgn(2, _("%s: outdated directory index format"), path);
+        goto l_error_end;
+    }
+
+    *nids = 0;
+    if ((kmap = load_keymap(db, n_array_size(pkgdir->pkgs), nids)) == NULL)
         goto l_error_end;
 
     MEMINF("keymap");
@@ -664,13 +788,26 @@ static int update_pkgdir_pkg(struct pkg *pkg, struct tndb *db,
 
 #define UPDATE_IFNEEDED (1 << 0)
 
+static void free_idmap(struct pkg **idmap, unsigned nids)
+{
+    unsigned i;
+
+    for (i=0; i < nids; i++)
+        if (idmap[i])
+            pkg_free(idmap[i]);
+
+    free(idmap);
+}
+
 static
 struct pkgdir_dirindex *load_dirindex(const struct pkgdir *pkgdir,
                                       const char *path, unsigned flags)
 {
     struct tndb     *db;
     tn_alloc        *na = NULL;
-    tn_hash         *idmap = NULL, *keymap = NULL;
+    tn_hash         *keymap = NULL;
+    struct pkg      **idmap = NULL;
+    unsigned        nids = 0;
     int             rc = 0, index_outdated = 0;
     int             i;
     struct pkgdir_dirindex *dirindex = NULL;
@@ -678,13 +815,13 @@ struct pkgdir_dirindex *load_dirindex(const struct pkgdir *pkgdir,
     msgn_i(2, 2, "Loading directory index of %s...", pkgdir_idstr_s(pkgdir));
     MEMINF("start");
 
-    if ((db = open_index_database(pkgdir, path, &keymap)) == NULL)
+    if ((db = open_index_database(pkgdir, path, &keymap, &nids)) == NULL)
         return NULL;
 
     rc = 0;
 
     na = n_alloc_new(4, TN_ALLOC_OBSTACK);
-    idmap = n_hash_new_na(na, n_array_size(pkgdir->pkgs), (tn_fn_free)pkg_free);
+    idmap = n_calloc(nids + 1, sizeof(*idmap));
 
     for (i=0; i < n_array_size(pkgdir->pkgs); i++) {
         struct pkg   *pkg = n_array_nth(pkgdir->pkgs, i);
@@ -697,7 +834,12 @@ struct pkgdir_dirindex *load_dirindex(const struct pkgdir *pkgdir,
 
         /* { package_no => package } map */
         if (pkg_no) {
-            n_hash_replace(idmap, pkg_no, pkg_link(pkg));
+            unsigned no = atoi(pkg_no);
+
+            n_assert(no < nids);
+            if (idmap[no])
+                pkg_free(idmap[no]);
+            idmap[no] = pkg_link(pkg);
 
         } else if (flags & UPDATE_IFNEEDED) {
             msgn_i(3, 4, "%s: missing package", pkg_id(pkg));
@@ -721,6 +863,7 @@ l_end:
         dirindex->db = db;
         dirindex->na = na;
         dirindex->idmap = idmap;
+        dirindex->nidmap = nids;
         dirindex->keymap = NULL;
 
         n_assert(keymap);
@@ -738,7 +881,7 @@ l_end:
         tndb_close(db);
 
         if (idmap)
-            n_hash_free(idmap);
+            free_idmap(idmap, nids);
 
         if (na)
             n_alloc_free(na);
@@ -832,7 +975,7 @@ struct pkgdir_dirindex *pkgdir__dirindex_open(struct pkgdir *pkgdir, unsigned fl
 void pkgdir__dirindex_close(struct pkgdir_dirindex *dirindex)
 {
     tndb_close(dirindex->db);
-    n_hash_free(dirindex->idmap);
+    free_idmap(dirindex->idmap, dirindex->nidmap);
     if (dirindex->keymap)
         n_hash_free(dirindex->keymap);
 
@@ -928,53 +1071,26 @@ tn_array *pkgdir_dirindex_get_provided(const struct pkgdir *pkgdir,
 static tn_array *do_dirindex_get(const struct pkgdir_dirindex *dirindex,
                                  tn_array *pkgs, const char *path)
 {
-    const char    **tl, **tl_save;
-    char          val[8192];
-    int           n, found, pkgs_passsed = 1;
+    struct posting_it it;
+    uint32_t          no;
 
-    if (*path == '/' && path[1] != '\0')
-        path++;
+    if (!posting_it_init(dirindex, &it, path))
+        return NULL;
 
-    if (!tndb_get_str(dirindex->db, path, (unsigned char *)val, sizeof(val)))
-        return 0;
+    while (posting_it_get(&it, &no)) {
+        struct pkg *p;
 
-    tl = tl_save = n_str_tokl_n(val, ":", &n);
-    DBGF("%s: FOUND %d (pkgs=%p)\n", path, n, pkgs ? pkgs : NULL);
+        if (no >= dirindex->nidmap || (p = dirindex->idmap[no]) == NULL)
+            continue;           /* patched pkgdir by diff without new packages */
 
-    if (n) {
-        if (pkgs == NULL) {
+        if (pkgs == NULL)
             pkgs = pkgs_array_new(4);
-            pkgs_passsed = 0;
-        }
-
-        while (*tl) {
-            const char *no = *tl;
-            struct pkg *p;
-
-            tl++;
 
-            if (*no == '\0')
-                continue;
-
-            DBGF("no %s\n", no);
-
-            if ((p = n_hash_get(dirindex->idmap, no)) == NULL)
-                continue;
-
-            n_array_push(pkgs, pkg_link(p));
-        }
-        n_str_tokl_free(tl_save);
-        tl_save = NULL;
-    }
-    n_assert(tl_save == NULL);
-
-    found = n_array_size(pkgs);
-
-    if (found == 0) { /* patched pkgdir by diff without new packages */
-        if (!pkgs_passsed)
-            n_array_cfree(&pkgs);
+        n_array_push(pkgs, pkg_link(p));
     }
+    posting_it_destroy(&it);
 
+    DBGF("%s: FOUND %d\n", path, pkgs ? n_array_size(pkgs) : 0);
     return pkgs;
 }
 
@@ -991,48 +1107,26 @@ int pkgdir_dirindex_pkg_has_path(const struct pkgdir *pkgdir,
                                  const struct pkg *pkg, const char *path)
 {
     const struct pkgdir_dirindex *dirindex = pkgdir->dirindex;
-    const char    **tl, **tl_save;
-    char          val[8192];
-    int           n, found;
+    struct posting_it it;
+    uint32_t          no;
+    int               found = 0;
 
     if (dirindex == NULL)
         return 0;
 
     DBGF("%s %s\n", pkg_id(pkg), path);
 
-    if (*path == '/' && path[1] != '\0')
-        path++;
-
-    if (!tndb_get_str(dirindex->db, path, (unsigned char *)val, sizeof(val)))
+    if (!posting_it_init(dirindex, &it, path))
         return 0;
 
-    tl = tl_save = n_str_tokl_n(val, ":", &n);
-    DBGF("%s: FOUND %d\n", path, n);
-
-    if (n) {
-        while (*tl) {
-            const char *no = *tl;
-            struct pkg *p;
-
-            tl++;
-
-            if (*no == '\0')
-                continue;
-
-            DBGF("no %s\n", no);
-
-            if ((p = n_hash_get(dirindex->idmap, no)) == NULL)
-                continue;
-
-            if (p == pkg) {
-                found = 1;
-                break;
-            }
+    while (posting_it_get(&it, &no)) {
+        if (no < dirindex->nidmap && dirindex->idmap[no] == pkg) {
+            found = 1;
+            break;
         }
-        n_str_tokl_free(tl_save);
-        tl_save = NULL;
     }
-    n_assert(tl_save == NULL);
+    posting_it_destroy(&it);
 
     return found;
 }
+
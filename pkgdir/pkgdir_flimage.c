@@ -0,0 +1,491 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <trurl/nassert.h>
+#include <trurl/narray.h>
+#include <trurl/nstr.h>
+#include <trurl/nmalloc.h>
+#include <trurl/ntuple.h>
+
+#include <vfile/vfile.h>
+
+#include "compiler.h"
+#include "i18n.h"
+#include "log.h"
+#include "pkgdir.h"
+#include "pkgdir_intern.h"
+#include "pkg.h"
+#include "pkgfl.h"
+#include "misc.h"
+#include "trace.h"
+#include "pkgdir_stubindex.h"
+#include "pkgdir_flimage.h"
+#include "pndir/pndir.h"        /* for pndir_make_pkgkey() */
+
+/*
+  Layout (host byte order, image is not meant to be portable):
+   header
+   packages, each one 8 bytes aligned:
+     uint32 keylen, uint32 ndirs, key '\0' (4 bytes aligned)
+     ndirs times:
+       uint32 nfiles, uint32 dnlen, dirname '\0' (4 bytes aligned)
+       nfiles flfile records, FLFILE_SIZE() each
+   index: uint64 offsets of packages, sorted by package key
+*/
+#define FLIMAGE_MAGIC    "poldekfl"
+#define FLIMAGE_VERSION  1
+#define FLIMAGE_BOM      0x01020304
+
+struct flimage_hdr {
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  bom;              /* FLIMAGE_BOM as written */
+    uint32_t  flfile_size;      /* sizeof(struct flfile) */
+    uint32_t  npkgs;
+    uint64_t  index_offs;
+    uint64_t  size;             /* whole image */
+};
+
+struct pkgdir_flimage {
+    dev_t           dev;
+    ino_t           ino;
+    const char      *addr;
+    size_t          size;
+    const uint64_t  *index;
+    unsigned        npkgs;
+};
+
+#define ALIGN(v, a) (((v) + (a) - 1) & ~(uint64_t)((a) - 1))
+
+static const char *flimage_basename = "flimage";
+
+/* mapped images, never unmapped */
+static tn_array *images = NULL;
+static pthread_mutex_t images_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int flimage_path(char *path, int size, const struct pkgdir *pkgdir)
+{
+    return pkgdir__cachefile_path(path, size, pkgdir, flimage_basename, NULL);
+}
+
+struct writer {
+    FILE      *stream;
+    uint64_t  offs;
+    int       error;
+};
+
+static void put(struct writer *w, const void *ptr, size_t size)
+{
+    if (w->error)
+        return;
+
+    if (fwrite(ptr, size, 1, w->stream) != 1)
+        w->error = errno ? errno : EIO;
+
+    w->offs += size;
+}
+
+static void put_uint32(struct writer *w, uint32_t v)
+{
+    put(w, &v, sizeof(v));
+}
+
+static void put_align(struct writer *w, int align)
+{
+    static const char zeros[8] = { 0 };
+    uint64_t offs = ALIGN(w->offs, align);
+
+    if (offs > w->offs)
+        put(w, zeros, offs - w->offs);
+}
+
+/* string with '\0', padded to 4 bytes */
+static void put_str(struct writer *w, const char *s, int len)
+{
+    put(w, s, len);
+    put(w, "", 1);
+    put_align(w, 4);
+}
+
+static void put_flfile(struct writer *w, const struct flfile *file)
+{
+    char buf[FLFILE_SIZE(UINT8_MAX, UINT8_MAX)];
+    struct flfile *f = (struct flfile *)buf;
+    const char *linkto;
+    int bnl, slen;
+
+    bnl = strlen(file->basename);
+    linkto = file->basename + bnl + 1;
+    slen = strlen(linkto);
+    n_assert(bnl <= UINT8_MAX && slen <= UINT8_MAX);
+
+    memset(buf, 0, FLFILE_SIZE(bnl, slen));
+    f->size = file->size;
+    f->mode = file->mode;
+    memcpy(f->basename, file->basename, bnl);
+    memcpy(f->basename + bnl + 1, linkto, slen);
+
+    put(w, buf, FLFILE_SIZE(bnl, slen));
+}
+
+struct flimage_pkg {
+    uint64_t  offs;
+    char      key[0];
+};
+
+static int flimage_pkg_cmp(const struct flimage_pkg *p1,
+                           const struct flimage_pkg *p2)
+{
+    return strcmp(p1->key, p2->key);
+}
+
+static void put_package(struct writer *w, tn_array *index, struct pkg *pkg)
+{
+    struct flimage_pkg *ipkg;
+    char key[512];
+    int i, j, n;
+
+    n = pndir_make_pkgkey(key, sizeof(key), pkg);
+
+    ipkg = n_malloc(sizeof(*ipkg) + n + 1);
+    memcpy(ipkg->key, key, n + 1);
+    put_align(w, 8);
+    ipkg->offs = w->offs;
+    n_array_push(index, ipkg);
+
+    put_uint32(w, n);
+    put_uint32(w, n_tuple_size(pkg->fl));
+    put_str(w, key, n);
+
+    for (i=0; i < n_tuple_size(pkg->fl); i++) {
+        struct pkgfl_ent *flent = n_tuple_nth(pkg->fl, i);
+
+        put_uint32(w, flent->items);
+        put_uint32(w, strlen(flent->dirname));
+        put_str(w, flent->dirname, strlen(flent->dirname));
+
+        for (j=0; j < flent->items; j++)
+            put_flfile(w, flent->files[j]);
+    }
+}
+
+static int flimage_create(const struct pkgdir *pkgdir, const char *path)
+{
+    struct flimage_hdr hdr;
+    struct writer w;
+    struct vflock *lock;
+    tn_array *index;
+    char *tmp, *dir, tmppath[PATH_MAX];
+    int i;
+
+    n_strdupap(path, &tmp);
+    dir = n_dirname(tmp);
+
+    if ((lock = vf_lock_mkdir(dir)) == NULL)
+        return 0;
+
+    /* written aside and renamed, processes still using previous image
+       keep their mapping */
+    n_snprintf(tmppath, sizeof(tmppath), "%s.%d", path, (int)getpid());
+    if ((w.stream = fopen(tmppath, "w")) == NULL) {
+        logn(LOGERR, "%s: open failed (%m)", tmppath);
+        vf_lock_release(lock);
+        return 0;
+    }
+
+    msgn_i(2, 2, "Creating file list image of %s...", pkgdir_idstr_s(pkgdir));
+
+    w.offs = 0;
+    w.error = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    put(&w, &hdr, sizeof(hdr)); /* place for header */
+
+    index = n_array_new(n_array_size(pkgdir->pkgs), free,
+                        (tn_fn_cmp)flimage_pkg_cmp);
+
+    for (i=0; i < n_array_size(pkgdir->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgdir->pkgs, i);
+
+        if (pkg->fl && pkg_has_ldallfiles(pkg))
+            put_package(&w, index, pkg);
+    }
+
+    n_array_sort(index);
+    put_align(&w, 8);
+
+    memcpy(hdr.magic, FLIMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.version = FLIMAGE_VERSION;
+    hdr.bom = FLIMAGE_BOM;
+    hdr.flfile_size = sizeof(struct flfile);
+    hdr.npkgs = n_array_size(index);
+    hdr.index_offs = w.offs;
+
+    for (i=0; i < n_array_size(index); i++) {
+        struct flimage_pkg *ipkg = n_array_nth(index, i);
+        put(&w, &ipkg->offs, sizeof(ipkg->offs));
+    }
+    hdr.size = w.offs;
+
+    if (w.error == 0 && fseek(w.stream, 0, SEEK_SET) == 0)
+        put(&w, &hdr, sizeof(hdr));
+
+    if (fclose(w.stream) != 0 && w.error == 0)
+        w.error = errno;
+
+    n_array_free(index);
+
+    if (w.error == 0 && rename(tmppath, path) != 0)
+        w.error = errno;
+
+    if (w.error) {
+        logn(LOGERR, "%s: %s", path, strerror(w.error));
+        unlink(tmppath);
+
+    } else {
+        poldek_util_set_mtime(path, pkgdir_mtime(pkgdir));
+    }
+
+    vf_lock_release(lock);
+    return w.error == 0;
+}
+
+void pkgdir__flimage_update(struct pkgdir *pkgdir)
+{
+    char path[PATH_MAX];
+    int i;
+
+    /* closure-loaded or just mapped */
+    if (pkgdir->_ld_keys || pkgdir->_flimage || n_array_size(pkgdir->pkgs) == 0)
+        return;
+
+    for (i=0; i < n_array_size(pkgdir->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgdir->pkgs, i);
+
+        if (!pkg_has_ldallfiles(pkg)) /* not full file lists loaded */
+            return;
+    }
+
+    flimage_path(path, sizeof(path), pkgdir);
+    if (poldek_util_mtime(path) == pkgdir_mtime(pkgdir))
+        return;
+
+    flimage_create(pkgdir, path);
+}
+
+static struct pkgdir_flimage *flimage_map(const char *path, const struct stat *st)
+{
+    struct pkgdir_flimage *im;
+    const struct flimage_hdr *hdr;
+    void *addr;
+    int fd;
+
+    if (st->st_size < (off_t)sizeof(*hdr))
+        return NULL;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        logn(LOGERR, "%s: open failed (%m)", path);
+        return NULL;
+    }
+
+    addr = mmap(NULL, st->st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        logn(LOGERR, "%s: mmap failed (%m)", path);
+        return NULL;
+    }
+
+    hdr = addr;
+    if (memcmp(hdr->magic, FLIMAGE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != FLIMAGE_VERSION || hdr->bom != FLIMAGE_BOM ||
+        hdr->flfile_size != sizeof(struct flfile) ||
+        hdr->size != (uint64_t)st->st_size ||
+        hdr->index_offs + hdr->npkgs * sizeof(uint64_t) > hdr->size) {
+        msgn(2, _("%s: outdated or broken file list image"), path);
+        munmap(addr, st->st_size);
+        return NULL;
+    }
+
+    im = n_malloc(sizeof(*im));
+    im->dev = st->st_dev;
+    im->ino = st->st_ino;
+    im->addr = addr;
+    im->size = st->st_size;
+    im->index = (const uint64_t *)(im->addr + hdr->index_offs);
+    im->npkgs = hdr->npkgs;
+
+    return im;
+}
+
+const struct pkgdir_flimage *pkgdir__flimage_open(struct pkgdir *pkgdir)
+{
+    struct pkgdir_flimage *im = NULL;
+    char path[PATH_MAX];
+    struct stat st;
+    int i;
+
+    flimage_path(path, sizeof(path), pkgdir);
+
+    if (stat(path, &st) != 0 || st.st_mtime != pkgdir_mtime(pkgdir)) {
+        msgn(3, "%s: no or outdated file list image", pkgdir_idstr_s(pkgdir));
+        return NULL;
+    }
+
+    pthread_mutex_lock(&images_lock);
+
+    if (images == NULL)
+        images = n_array_new(4, NULL, NULL);
+
+    for (i=0; i < n_array_size(images); i++) {
+        struct pkgdir_flimage *m = n_array_nth(images, i);
+
+        if (m->dev == st.st_dev && m->ino == st.st_ino) {
+            im = m;
+            break;
+        }
+    }
+
+    if (im == NULL && (im = flimage_map(path, &st)))
+        n_array_push(images, im);
+
+    pthread_mutex_unlock(&images_lock);
+
+    return im;
+}
+
+static const char *flimage_lookup(const struct pkgdir_flimage *im,
+                                  const char *key)
+{
+    int l = 0, r = im->npkgs - 1;
+
+    while (l <= r) {
+        int i = (l + r) / 2, cmprc;
+        const char *rec = im->addr + im->index[i];
+
+        if (im->index[i] + 8 >= im->size)
+            return NULL;
+
+        if ((cmprc = strcmp(key, rec + 8)) == 0)
+            return rec;
+
+        if (cmprc < 0)
+            r = i - 1;
+        else
+            l = i + 1;
+    }
+
+    return NULL;
+}
+
+static tn_tuple *flimage_restore_fl(tn_alloc *na, const struct pkgdir_flimage *im,
+                                    const char *rec)
+{
+    const char *p, *end = im->addr + im->size;
+    uint32_t keylen, ndirs, i, j;
+    tn_tuple *fl;
+
+    memcpy(&keylen, rec, sizeof(keylen));
+    memcpy(&ndirs, rec + 4, sizeof(ndirs));
+    p = rec + 8 + ALIGN(keylen + 1, 4);
+
+    fl = n_tuple_new(na, ndirs, NULL);
+
+    for (i=0; i < ndirs; i++) {
+        struct pkgfl_ent *flent;
+        uint32_t nfiles, dnlen;
+
+        if (p + 8 > end)
+            goto l_broken;
+
+        memcpy(&nfiles, p, sizeof(nfiles));
+        memcpy(&dnlen, p + 4, sizeof(dnlen));
+        p += 8;
+
+        flent = na->na_malloc(na, sizeof(*flent) + nfiles * sizeof(struct flfile*));
+        flent->dirname = (char *)p;
+        flent->items = nfiles;
+        p += ALIGN(dnlen + 1, 4);
+
+        for (j=0; j < nfiles; j++) {
+            const struct flfile *file = (const struct flfile *)p;
+            int bnl, slen;
+
+            if (p + sizeof(*file) > end)
+                goto l_broken;
+
+            bnl = strlen(file->basename);
+            slen = strlen(file->basename + bnl + 1);
+            flent->files[j] = (struct flfile *)file;
+            p += FLFILE_SIZE(bnl, slen);
+        }
+
+        if (p > end)
+            goto l_broken;
+
+        n_tuple_set_nth(fl, i, flent);
+    }
+
+    return fl;
+
+l_broken:
+    return NULL;
+}
+
+int pkgdir__flimage_attach(struct pkgdir *pkgdir)
+{
+    const struct pkgdir_flimage *im = pkgdir->_flimage;
+    int i, nmissing = 0;
+
+    struct trace_span *span = trace_begin("pkgdir.flimage");
+
+    n_assert(im);
+    for (i=0; i < n_array_size(pkgdir->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgdir->pkgs, i);
+        const char *rec;
+        tn_tuple *fl = NULL;
+        char key[512];
+
+        pndir_make_pkgkey(key, sizeof(key), pkg);
+
+        if (pkg->na && (rec = flimage_lookup(im, key)))
+            fl = flimage_restore_fl(pkg->na, im, rec);
+
+        if (fl == NULL) {       /* will be loaded on demand */
+            msgn(3, "%s: not found in file list image", pkg_id(pkg));
+            nmissing++;
+            continue;
+        }
+
+        if (pkg->fl)            /* depdirs' files */
+            n_tuple_free(pkg->na, pkg->fl);
+
+        pkg->fl = fl;
+        pkg_set_ldallfiles(pkg);
+    }
+
+    trace_count(span, "packages", n_array_size(pkgdir->pkgs) - nmissing);
+    trace_end(span);
+
+    return nmissing;
+}
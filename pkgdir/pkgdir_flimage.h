@@ -0,0 +1,34 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifndef PKGDIR_FLIMAGE_H
+#define PKGDIR_FLIMAGE_H
+/*
+  File list image: file lists of all packages of pkgdir laid out as they
+  are in memory (packed flfile records, see pkgfl.h), kept in cache dir
+  next to stub index. Image is mapped read-only, so concurrent processes
+  loading the same source with full file lists share its pages instead of
+  decoding private copies; per process are only pkgfl_ent headers.
+
+  Mapping is kept until process exit, packages (which may outlive their
+  pkgdir) point into it.
+*/
+
+struct pkgdir;
+struct pkgdir_flimage;
+
+/* (re)create image of loaded pkgdir if outdated */
+void pkgdir__flimage_update(struct pkgdir *pkgdir);
+
+/* RET: mapped image of (opened, not loaded) pkgdir or NULL if missing
+   or outdated */
+const struct pkgdir_flimage *pkgdir__flimage_open(struct pkgdir *pkgdir);
+
+/* sets file lists of loaded packages from pkgdir->_flimage;
+   RET: number of packages without file list in the image */
+int pkgdir__flimage_attach(struct pkgdir *pkgdir);
+
+#endif
@@ -21,6 +21,7 @@ int pkgdirmodule_init(void);
 
 extern const char *poldek_conf_PKGDIR_DEFAULT_TYPE;
 extern const char *poldek_conf_PKGDIR_DEFAULT_COMPR;
+extern int poldek_conf_PKGDIR_PARALLEL_UPDATES;
 
 #include <trurl/nbuf.h>
 
@@ -64,6 +65,7 @@ time_t pkgdir_mtime(const struct pkgdir *pkgdir);
 #define PKGDIR_CAP_INTERNALTYPE  (1 << 8) /* do not show it outside  */
 #define PKGDIR_CAP_NOSAVAFTUP    (1 << 9) /* needn't saving after update() */
 #define PKGDIR_CAP_HANDLEIGNORE  (1 << 10) /* handles ign_patterns internally */
+#define PKGDIR_CAP_LDKEYS        (1 << 11) /* loads only pkgdir->_ld_keys if set */
 
 
 /*  module methods */
@@ -48,11 +48,12 @@
 #include "pkgfl.h"
 #include "misc.h"
 #include "pndir/pndir.h"        /* for pndir_make_pkgkey() */
-//#include "pkgdir_stubindex.h"
+#include "pkgdir_stubindex.h"
 
 const char *pkgdir_stubindex_basename = "stubindex";
 
-static int stubindex_path(char *path, int size, const struct pkgdir *pkgdir)
+int pkgdir__cachefile_path(char *path, int size, const struct pkgdir *pkgdir,
+                           const char *basename, const char *suffix)
 {
     char tmp[PATH_MAX];
     char *ofpath;
@@ -86,8 +87,8 @@ static int stubindex_path(char *path, int size, const struct pkgdir *pkgdir)
     DBGF("cache path = %s\n", path);
 
     n_assert(n > 0);
-    n += n_snprintf(&path[n], size - n, "/%s.%s.zst", pkgdir_stubindex_basename,
-                    pkgdir->type);
+    n += n_snprintf(&path[n], size - n, "/%s.%s%s", basename, pkgdir->type,
+                    suffix ? suffix : "");
     DBGF("result = %s\n", path);
     n_assert(n > 0);
 
@@ -219,7 +220,8 @@ void pkgdir__stubindex_update(struct pkgdir *pkgdir)
     time_t idx_mtime, mtime;
     char path[1024];
 
-    stubindex_path(path, sizeof(path), pkgdir);
+    pkgdir__cachefile_path(path, sizeof(path), pkgdir,
+                           pkgdir_stubindex_basename, ".zst");
     DBGF("%s\n", path);
 
     idx_mtime = pkgdir_mtime(pkgdir);
@@ -24,4 +24,8 @@ struct pkgdir;
 
 void pkgdir__stubindex_update(struct pkgdir *pkgdir);
 
+/* path of pkgdir's auxiliary file in cache dir: DIR/BASENAME.TYPE[SUFFIX] */
+int pkgdir__cachefile_path(char *path, int size, const struct pkgdir *pkgdir,
+                           const char *basename, const char *suffix);
+
 #endif
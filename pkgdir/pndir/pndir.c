@@ -73,7 +73,7 @@ int posthook_diff(struct pkgdir *pd1, struct pkgdir* pd2, struct pkgdir *diff);
 struct pkgdir_module pkgdir_module_pndir = {
     NULL,
     PKGDIR_CAP_UPDATEABLE_INC | PKGDIR_CAP_UPDATEABLE |
-    PKGDIR_CAP_HANDLEIGNORE,
+    PKGDIR_CAP_HANDLEIGNORE | PKGDIR_CAP_LDKEYS,
     "pndir",
     NULL,
     "Native poldek's index format",
@@ -723,6 +723,9 @@ int do_load(struct pkgdir *pkgdir, unsigned ldflags)
             goto l_continue_loop;
         }
 
+        if (pkgdir->_ld_keys && !n_hash_exists(pkgdir->_ld_keys, key))
+            goto l_continue_loop; /* out of dependency closure */
+
         if (ign_patterns) {
             char buf[512];
             int i;
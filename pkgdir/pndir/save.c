@@ -716,6 +716,14 @@ int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
         klen = pndir_make_pkgkey(key, sizeof(key), pkg);
         n_array_push(keys, n_strdupl(key, klen));
 
+        pkgu = NULL;
+        if (save_descr)
+            pkgu = pkg_xuinf(pkg, langstosave);
+
+        /* let "ls -u --sec" skip changelog parsing */
+        if (pkgu && !pkg_has_sectime(pkg))
+            pkg_set_sectime(pkg, pkguinf_changelog_security_fix_time(pkgu));
+
         n_buf_clean(nbuf);
         if (pkg_store(pkg, nbuf, exclpath, pkgdir->depdirs, st_flags))
             tndb_put(db, key, klen, n_buf_ptr(nbuf), n_buf_size(nbuf));
@@ -723,10 +731,7 @@ int pndir_m_create(struct pkgdir *pkgdir, const char *pathname, unsigned flags)
         if (i % 1000 == 0)
             MEMINF("%d packages", i);
 
-        if (!save_descr)
-            continue;
-
-        if ((pkgu = pkg_xuinf(pkg, langstosave))) {
+        if (pkgu) {
             int v;
 
             v = pndir_save_pkginfo(i, pkgu, langstosave_h, db_dscr_h, key, klen,
@@ -19,6 +19,9 @@
 #include <sys/param.h>          /* for PATH_MAX */
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 
 #include <trurl/nmalloc.h>
@@ -48,6 +51,7 @@ extern const char *pkgdir_stubindex_basename;
 const char source_TYPE_GROUP[] = "group";
 const char *poldek_conf_PKGDIR_DEFAULT_TYPE = "pndir";
 const char *poldek_conf_PKGDIR_DEFAULT_COMPR = COMPR_GZ;
+int poldek_conf_PKGDIR_PARALLEL_UPDATES = 4;
 
 struct subopt {
     char      *name;
@@ -922,20 +926,183 @@ void source_printf(const struct source *src) {
     source_printf_w(src, 12);
 }
 
+/*
+  Sources are refreshed by up to poldek_conf_PKGDIR_PARALLEL_UPDATES
+  child processes at once. Each child updates one source, holding its
+  cache dir lock (vf_lock_mkdir() in pkgdir_update()) on its own, so a
+  slow or broken mirror does not stall the others; vfile's internal
+  client is not thread-safe (SIGALRM timeouts, connection pool), hence
+  processes instead of threads.
+*/
+struct update_job {
+    struct source *src;
+    pid_t         pid;
+    int           rc;
+};
+
+static int update_job_start(struct update_job *job, unsigned flags)
+{
+    pid_t pid;
+
+    if (job->src->type == NULL)  /* keep it in parent too */
+        source_set_type(job->src, poldek_conf_PKGDIR_DEFAULT_TYPE);
+
+    fflush(NULL);               /* don't let children repeat buffered output */
+
+    if ((pid = fork()) < 0) {
+        logn(LOGERR, "fork: %m");
+        return 0;
+    }
+
+    if (pid == 0) {
+        int rc;
+
+        /* interleaved progress bars would be unreadable */
+        vfile_configure(VFILE_CONF_PROGRESS_NONE, 1);
+
+        rc = source_update(job->src, flags);
+        fflush(NULL);
+        _exit(rc ? 0 : 1);
+    }
+
+    job->pid = pid;
+    return 1;
+}
+
+static struct update_job *update_job_wait(struct update_job *jobs, int njobs)
+{
+    int i, st;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &st, 0)) < 0) {
+        if (errno != EINTR)     /* interrupted (^C) => wait again */
+            return NULL;
+    }
+
+    for (i=0; i < njobs; i++) {
+        struct update_job *job = &jobs[i];
+
+        if (job->pid == pid) {
+            job->pid = 0;
+            job->rc = WIFEXITED(st) && WEXITSTATUS(st) == 0;
+            return job;
+        }
+    }
+
+    return update_job_wait(jobs, njobs); /* not ours */
+}
+
+/* stops and reaps still running jobs, they are failed then */
+static void update_jobs_kill(struct update_job *jobs, int njobs)
+{
+    int i, st;
+
+    for (i=0; i < njobs; i++)
+        if (jobs[i].pid > 0)
+            kill(jobs[i].pid, SIGTERM);
+
+    for (i=0; i < njobs; i++) {
+        if (jobs[i].pid <= 0)
+            continue;
+
+        while (waitpid(jobs[i].pid, &st, 0) < 0 && errno == EINTR)
+            ;
+
+        jobs[i].pid = 0;
+        jobs[i].rc = 0;
+    }
+}
+
+static int update_parallel(tn_array *sources, unsigned flags, int nparallel)
+{
+    struct update_job *jobs;
+    int i, njobs, nrunning = 0, ndone = 0, nerr = 0;
+
+    njobs = n_array_size(sources);
+    jobs = n_calloc(njobs, sizeof(*jobs));
+
+    msgn(1, _("Updating %d sources (%d at once)..."), njobs, nparallel);
+
+    i = 0;
+    while (ndone < njobs) {
+        struct update_job *job;
+
+        while (i < njobs && nrunning < nparallel) {
+            job = &jobs[i++];
+            job->src = n_array_nth(sources, i - 1);
+
+            if (update_job_start(job, flags)) {
+                nrunning++;
+
+            } else {            /* no fork, do it here */
+                job->rc = source_update(job->src, flags);
+                ndone++;
+            }
+        }
+
+        if (nrunning == 0)
+            continue;
+
+        if ((job = update_job_wait(jobs, i)) == NULL) {
+            logn(LOGERR, "waitpid: %m");
+            update_jobs_kill(jobs, i);
+            break;
+        }
+
+        nrunning--;
+        ndone++;
+        msgn(1, _("[%d/%d] %s: %s"), ndone, njobs, source_idstr(job->src),
+             job->rc ? _("done") : _("failed"));
+    }
+
+    /* waitpid() failure leaves killed jobs as failed */
+    for (i=0; i < njobs; i++) {
+        if (jobs[i].src && !jobs[i].rc) {
+            if (nerr == 0)
+                logn(LOGERR, _("Update failed for:"));
+            logn(LOGERR, "  %s", source_idstr(jobs[i].src));
+            nerr++;
+        }
+    }
+
+    if (nerr)
+        logn(LOGERR, _("%d of %d sources not updated"), nerr, njobs);
+
+    free(jobs);
+    return nerr == 0;
+}
+
 int sources_update(tn_array *sources, unsigned flags)
 {
-    int i, nerr = 0;
+    tn_array *todo;
+    int i, nerr = 0, nparallel;
 
+    todo = n_array_new(n_array_size(sources), NULL, NULL);
     for (i=0; i < n_array_size(sources); i++) {
         struct source *src = n_array_nth(sources, i);
 
-        if (src->flags & PKGSOURCE_NOAUTOUP)
-            continue;
+        if ((src->flags & PKGSOURCE_NOAUTOUP) == 0)
+            n_array_push(todo, src);
+    }
+
+    nparallel = poldek_conf_PKGDIR_PARALLEL_UPDATES;
+    if (nparallel > n_array_size(todo))
+        nparallel = n_array_size(todo);
+
+    if (nparallel > 1) {
+        int rc = update_parallel(todo, flags, nparallel);
+        n_array_free(todo);
+        return rc;
+    }
+
+    for (i=0; i < n_array_size(todo); i++) {
+        struct source *src = n_array_nth(todo, i);
 
         if (!source_update(src, flags))
             nerr++;
     }
 
+    n_array_free(todo);
     return nerr == 0;
 }
 
@@ -42,6 +42,7 @@
 #include "pkgdir/pkgdir.h"
 #include "misc.h"
 #include "pm/pm.h"
+#include "trace.h"
 
 
 unsigned pkg_get_verify_signflags(struct pkg *pkg)
@@ -111,14 +112,65 @@ void packages_fetch_summary(struct pm_ctx *pmctx, const tn_array *pkgs,
     msg(1, "_\n");
 }
 
+/* adds pkg to be downloaded to its URL group */
+static void enqueue_pkg(tn_hash *urls_h, tn_hash *pkgs_h, tn_hash *labels_h,
+                        tn_array *urls_arr, const tn_array *pkgs,
+                        struct pkg *pkg)
+{
+    char      *pkgpath = pkg->pkgdir->path;
+    char      path[PATH_MAX + 128];
+    tn_array  *urls, *packages;
+
+    if ((urls = n_hash_get(urls_h, pkgpath)) == NULL) {
+        urls = n_array_new(n_array_size(pkgs), free, NULL);
+        n_hash_insert(urls_h, pkgpath, urls);
+
+        packages = n_array_new(n_array_size(pkgs), NULL, NULL);
+        n_hash_insert(pkgs_h, pkgpath, packages);
+
+        n_array_push(urls_arr, pkgpath);
+        n_hash_insert(labels_h, pkgpath, pkg->pkgdir->name);
+    }
+
+    packages = n_hash_get(pkgs_h, pkgpath);
+
+    n_snprintf(path, sizeof(path), "%s/%s", pkgpath, pkg_filename_s(pkg));
+    n_array_push(urls, n_strdup(path));
+    n_array_push(packages, pkg);
+}
+
+/* verifies paths at once, RET: results, to be freed by caller */
+static int *verify_paths(struct pm_ctx *pmctx, const tn_array *paths,
+                         int *nerr)
+{
+    int i, *results;
+
+    results = n_malloc((n_array_size(paths) + 1) * sizeof(*results));
+    pm_verify_signatures(pmctx, paths, PKGVERIFY_MD, results);
+
+    if (nerr == NULL)
+        return results;
+
+    for (i = 0; i < n_array_size(paths); i++) {
+        if (!results[i]) {
+            logn(LOGERR, _("%s: MD5 signature verification failed"),
+                 n_basenam(n_array_nth(paths, i)));
+            (*nerr)++;
+        }
+    }
+
+    return results;
+}
+
 int packages_fetch(struct pm_ctx *pmctx,
                    tn_array *pkgs, const char *destdir, int is_destdir_custom)
 {
-    int       i, nerr, urltype, ncdroms;
-    tn_array  *urls = NULL, *packages = NULL;
-    tn_array  *urls_arr = NULL;
+    int       i, nerr, urltype, ncdroms, counter = 0, *results;
+    tn_array  *urls = NULL;
+    tn_array  *urls_arr = NULL, *local_paths, *cached_paths, *cached_pkgs;
     tn_hash   *urls_h, *pkgs_h = NULL;
     tn_hash   *pkgdir_labels_h = NULL;
+    struct trace_span *span = trace_begin("fetch");
 
     n_assert(destdir);
     urls_h = n_hash_new(21, (tn_fn_free)n_array_free);
@@ -129,15 +181,19 @@ int packages_fetch(struct pm_ctx *pmctx,
     int pkgs_count = n_array_size(pkgs);
     urls_arr = n_array_new(pkgs_count, NULL, (tn_fn_cmp)strcmp);
 
+    /* files already there, verified in batches below */
+    local_paths = n_array_new(16, free, NULL);
+    cached_paths = n_array_new(16, free, NULL);
+    cached_pkgs = n_array_new(16, NULL, NULL);
+
     // group by URL
     ncdroms = 0;
     nerr = 0;
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg  *pkg = n_array_nth(pkgs, i);
         char        *pkgpath = pkg->pkgdir->path;
-        char        path[PATH_MAX + 128], *s;
+        char        path[PATH_MAX + 128];
         const char  *pkg_basename;
-        int         len;
 
         if (sigint_reached())
             break;
@@ -156,11 +212,7 @@ int packages_fetch(struct pm_ctx *pmctx,
                 nerr++;
 
             } else {
-                if (!pm_verify_signature(pmctx, path, PKGVERIFY_MD)) {
-                    logn(LOGERR, _("%s: MD5 signature verification failed"),
-                         n_basenam(path));
-                    nerr++;
-                }
+                n_array_push(local_paths, n_strdup(path));
             }
             if (is_destdir_custom)
                 poldek_util_copy_file(path, destdir);
@@ -182,35 +234,36 @@ int packages_fetch(struct pm_ctx *pmctx,
         }
 
         if (access(path, R_OK) == 0) {
-            int pkg_ok;
-
-            pkg_ok = pm_verify_signature(pmctx, path, PKGVERIFY_MD);
-            if (pkg_ok) {         /* we got it  */
-		pkgs_count--;
-                continue;
-	    }
-            else
-                vf_unlink(path);
+            n_array_push(cached_paths, n_strdup(path));
+            n_array_push(cached_pkgs, pkg);
+            continue;
         }
 
-        if ((urls = n_hash_get(urls_h, pkgpath)) == NULL) {
-            urls = n_array_new(n_array_size(pkgs), NULL, NULL);
-            n_hash_insert(urls_h, pkgpath, urls);
+        enqueue_pkg(urls_h, pkgs_h, pkgdir_labels_h, urls_arr, pkgs, pkg);
+    }
 
-            packages = n_array_new(n_array_size(pkgs), NULL, NULL);
-            n_hash_insert(pkgs_h, pkgpath, packages);
+    if (sigint_reached())
+        goto l_end;
 
-            n_array_push(urls_arr, pkgpath);
-            n_hash_insert(pkgdir_labels_h, pkgpath, pkg->pkgdir->name);
-        }
+    if (n_array_size(local_paths)) {
+        results = verify_paths(pmctx, local_paths, &nerr);
+        free(results);
+    }
 
-        len = n_snprintf(path, sizeof(path), "%s/%s", pkgpath, pkg_basename);
+    if (n_array_size(cached_paths)) {
+        results = verify_paths(pmctx, cached_paths, NULL);
 
-        s = alloca(len + 1);
-        memcpy(s, path, len);
-        s[len] = '\0';
-        n_array_push(urls, s);
-        n_array_push(packages, pkg);
+        for (i=0; i < n_array_size(cached_paths); i++) {
+            if (results[i]) {   /* we got it  */
+                pkgs_count--;
+                continue;
+            }
+
+            vf_unlink(n_array_nth(cached_paths, i));
+            enqueue_pkg(urls_h, pkgs_h, pkgdir_labels_h, urls_arr, pkgs,
+                        n_array_nth(cached_pkgs, i));
+        }
+        free(results);
     }
 
     if (sigint_reached())
@@ -227,7 +280,6 @@ int packages_fetch(struct pm_ctx *pmctx,
     else if (ncdroms == 1)
         putenv("POLDEK_VFJUGGLE_CPMODE=link");
 
-    int counter = 0;
     for (i=0; i < n_array_size(urls_arr); i++) {
         char path[PATH_MAX];
         const char *real_destdir, *pkgdir_name;
@@ -237,7 +289,6 @@ int packages_fetch(struct pm_ctx *pmctx,
             break;
 
         urls = n_hash_get(urls_h, pkgpath);
-        packages = n_hash_get(pkgs_h, pkgpath);
         real_destdir = destdir;
         if (is_destdir_custom == 0) {
             char buf[1024];
@@ -251,19 +302,20 @@ int packages_fetch(struct pm_ctx *pmctx,
         if (!vf_fetcha(urls, real_destdir, 0, pkgdir_name, counter, pkgs_count)) {
             nerr++;
         } else {
+            tn_array *localpaths = n_array_new(n_array_size(urls), free, NULL);
+
             for (int j=0; j < n_array_size(urls); j++) {
                 char localpath[PATH_MAX];
                 n_snprintf(localpath, sizeof(localpath), "%s/%s", real_destdir,
                          n_basenam(n_array_nth(urls, j)));
 
-                if (!pm_verify_signature(pmctx, localpath, PKGVERIFY_MD)) {
-                    logn(LOGERR, _("%s: MD5 signature verification failed"),
-                         n_basenam(localpath));
-                    nerr++;
-                }
-
+                n_array_push(localpaths, n_strdup(localpath));
 		counter++;
             }
+
+            results = verify_paths(pmctx, localpaths, &nerr);
+            free(results);
+            n_array_free(localpaths);
         }
     }
 
@@ -271,10 +323,18 @@ int packages_fetch(struct pm_ctx *pmctx,
     if (sigint_reached())
         nerr++;
 
+    n_array_free(local_paths);
+    n_array_free(cached_paths);
+    n_array_free(cached_pkgs);
     n_array_free(urls_arr);
     n_hash_free(urls_h);
     n_hash_free(pkgs_h);
     n_hash_free(pkgdir_labels_h);
+
+    trace_count(span, "packages", n_array_size(pkgs));
+    trace_count(span, "downloaded", counter);
+    trace_end(span);
+
     return nerr == 0;
 }
 
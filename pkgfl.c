@@ -32,18 +32,14 @@
 #include "depdirs.h"
 #include "misc.h"
 
-struct flfile *flfile_new(tn_alloc *na, uint32_t size, uint16_t mode,
-                          const char *basename, int blen,
-                          const char *slinkto, int slen)
+static
+struct flfile *flfile_fill(void *ptr, uint32_t size, uint16_t mode,
+                           const char *basename, int blen,
+                           const char *slinkto, int slen)
 {
-    struct flfile *file;
+    struct flfile *file = ptr;
     char *p;
 
-    if (na)
-        file = na->na_malloc(na, sizeof(*file) + blen + 1 + slen + 1);
-    else
-        file = n_malloc(sizeof(*file) + blen + 1 + slen + 1);
-
     file->mode = mode;
     file->size = size;
 
@@ -59,6 +55,20 @@ struct flfile *flfile_new(tn_alloc *na, uint32_t size, uint16_t mode,
     return file;
 }
 
+struct flfile *flfile_new(tn_alloc *na, uint32_t size, uint16_t mode,
+                          const char *basename, int blen,
+                          const char *slinkto, int slen)
+{
+    void *ptr;
+
+    if (na)
+        ptr = na->na_malloc(na, sizeof(struct flfile) + blen + 1 + slen + 1);
+    else
+        ptr = n_malloc(sizeof(struct flfile) + blen + 1 + slen + 1);
+
+    return flfile_fill(ptr, size, mode, basename, blen, slinkto, slen);
+}
+
 
 struct flfile *flfile_clone(struct flfile *flfile)
 {
@@ -402,24 +412,119 @@ int pkgfl_store(tn_tuple *fl, tn_buf *nbuf,
     return bsize;
 }
 
+/*
+  Whole file list of a package is decoded into one block: pkgfl_ent
+  headers (with files[] pointers) followed by packed flfile records.
+  First pass over the buffer sizes the block, second one fills it, so
+  loading full file lists does not cost an allocation per file.
+*/
+struct pkgfl_blob {
+    char *ents;                 /* pkgfl_ent headers */
+    char *files;                /* flfile records */
+};
+
+/* RET: number of dirs; *entsize, *filesize - sizes of blob parts */
+static int pkgfl_restore_size(tn_buf_it *nbufi, tn_array *dirs, int include,
+                              unsigned default_loadir, size_t *entsize,
+                              size_t *filesize)
+{
+    uint32_t ndirs = 0, i, j;
+
+    *entsize = 0;
+    *filesize = 0;
+
+    if (!n_buf_it_get_int32(nbufi, &ndirs))
+        return -1;
+
+    for (i=0; i < ndirs; i++) {
+        char      *dn;
+        uint8_t   dnl = 0;
+        uint32_t  nfiles = 0;
+        int       loadir;
+
+        n_buf_it_get_int8(nbufi, &dnl);
+        dn = n_buf_it_get(nbufi, dnl);
+
+        loadir = default_loadir;
+        if (dirs && n_array_bsearch(dirs, dn))
+            loadir = include;
+
+        n_buf_it_get_int32(nbufi, &nfiles);
+
+        if (loadir)
+            *entsize += sizeof(struct pkgfl_ent) + nfiles * sizeof(struct flfile*);
+
+        for (j=0; j < nfiles; j++) {
+            uint8_t   bnl = 0, slen = 0;
+            uint16_t  mode = 0;
+            uint32_t  fsize = 0;
+
+            n_buf_it_get_int8(nbufi, &bnl);
+            n_buf_it_get(nbufi, bnl);
+            n_buf_it_get_int16(nbufi, &mode);
+            n_buf_it_get_int32(nbufi, &fsize);
+
+            if (S_ISLNK(mode)) {
+                n_buf_it_get_int8(nbufi, &slen);
+                n_buf_it_get(nbufi, slen);
+            }
+
+            if (loadir)
+                *filesize += FLFILE_SIZE(bnl, slen);
+        }
+    }
+
+    return ndirs;
+}
+
+static struct pkgfl_ent *pkgfl_blob_ent(tn_alloc *na, struct pkgfl_blob *blob,
+                                        char *dirname, int dirname_len,
+                                        int nfiles)
+{
+    struct pkgfl_ent *flent = (struct pkgfl_ent *)blob->ents;
+    const tn_str8 *ent;
+
+    blob->ents += sizeof(*flent) + nfiles * sizeof(struct flfile*);
+
+    dirname = prepare_dirname(dirname, &dirname_len);
+    n_assert(dirname_len < UINT8_MAX);
+    ent = na->na_alloc_str8(na, dirname, dirname_len);
+    flent->dirname = (char *)ent->str;
+    flent->items = 0;
+    return flent;
+}
+
 static int pkgfl_restore(tn_alloc *na, tn_tuple **fl,
                          tn_buf_it *nbufi, tn_array *dirs, int include)
 {
     struct pkgfl_ent **ents;
+    struct pkgfl_blob blob;
+    tn_buf_it sizei = *nbufi;
     uint32_t ndirs = 0, n;
     unsigned j, default_loadir;
+    size_t entsize = 0, filesize = 0;
 
     *fl = NULL;
     default_loadir = 1;
     if (dirs)
         default_loadir = include ? 0 : 1;
 
+    if (pkgfl_restore_size(&sizei, dirs, include, default_loadir,
+                           &entsize, &filesize) < 0)
+        return -1;
+
     if (!n_buf_it_get_int32(nbufi, &ndirs))
         return -1;
 
     ents = alloca(ndirs * sizeof(*ents));
     n = 0;
 
+    blob.ents = blob.files = NULL;
+    if (entsize > 0) {
+        blob.ents = na->na_malloc(na, entsize + filesize);
+        blob.files = blob.ents + entsize;
+    }
+
     while (ndirs--) {
         struct pkgfl_ent  *flent = NULL;
         char              *dn = NULL;
@@ -444,7 +549,7 @@ static int pkgfl_restore(tn_alloc *na, tn_tuple **fl,
         n_buf_it_get_int32(nbufi, &nfiles);
 
         if (loadir) {
-            flent = pkgfl_ent_new(na, dn, dnl, nfiles);
+            flent = pkgfl_blob_ent(na, &blob, dn, dnl, nfiles);
             ents[n++] = flent;
         }
 
@@ -468,7 +573,8 @@ static int pkgfl_restore(tn_alloc *na, tn_tuple **fl,
 
             if (loadir) {
                 struct flfile *file;
-                file = flfile_new(na, size, mode, bn, bnl, linkto, slen);
+                file = flfile_fill(blob.files, size, mode, bn, bnl, linkto, slen);
+                blob.files += FLFILE_SIZE(bnl, slen);
                 flent->files[flent->items++] = file;
             }
 
@@ -29,6 +29,11 @@ struct flfile {
     char      basename[0];
 };
 
+/* size of packed flfile record (basename and symlink target follow
+   the struct), rounded up to keep consecutive records aligned */
+#define FLFILE_SIZE(blen, slen) \
+    ((sizeof(struct flfile) + (blen) + 1 + (slen) + 1 + 3) & ~(size_t)3)
+
 EXPORT struct flfile *flfile_new(tn_alloc *na, uint32_t size, uint16_t mode,
                           const char *basename, int blen,
                           const char *slinkto, int slen);
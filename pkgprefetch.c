@@ -0,0 +1,387 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+
+#include "compiler.h"
+#include "pkg.h"
+#include "pkgcmp.h"
+#include "pkgu.h"
+#include "pkgprefetch.h"
+#include "thread.h"
+#include "trace.h"
+
+#define PF_BATCH   64              /* items read at once, in index order */
+#define PF_WINDOW  (4 * PF_BATCH)  /* decoded ahead of and kept behind caller */
+
+#define PFI_NEW    0
+#define PFI_BUSY   1               /* being read */
+#define PFI_READY  2
+#define PFI_GONE   3               /* evicted */
+
+struct pf_item {
+    const struct pkg *pkg;
+    struct pkguinf   *uinf;
+    struct pkgflist  *flist;
+    int              state;
+};
+
+struct pkg_prefetch {
+    unsigned         what;
+    struct pf_item   *items;    /* in caller's order */
+    struct pf_item   **byptr;   /* sorted by pkg address */
+    int              nitems;
+    int              next;      /* first item not taken by reader yet */
+    int              pos;       /* caller's position (last asked item + 1) */
+    int              evicted;   /* items before it are freed */
+    int              stop;
+    int              threaded;
+#ifdef ENABLE_THREADS
+    pthread_t        tid;
+    pthread_mutex_t  mutex;     /* items' state and positions above */
+    pthread_cond_t   cond;
+    pthread_mutex_t  io_mutex;  /* index (tndb) reads are not thread safe */
+#endif
+};
+
+/* the one being active */
+static struct pkg_prefetch *active = NULL;
+
+#ifdef ENABLE_THREADS
+# define pf_lock(pf)     ((pf)->threaded ? pthread_mutex_lock(&(pf)->mutex) : 0)
+# define pf_unlock(pf)   ((pf)->threaded ? pthread_mutex_unlock(&(pf)->mutex) : 0)
+# define pf_wait(pf)     ((pf)->threaded ? pthread_cond_wait(&(pf)->cond, &(pf)->mutex) : 0)
+# define pf_wakeup(pf)   ((pf)->threaded ? pthread_cond_broadcast(&(pf)->cond) : 0)
+#else
+# define pf_lock(pf)     ((void) 0)
+# define pf_unlock(pf)   ((void) 0)
+# define pf_wait(pf)     n_assert(0)
+# define pf_wakeup(pf)   ((void) 0)
+#endif
+
+void pkg_prefetch__io_lock(void)
+{
+#ifdef ENABLE_THREADS
+    if (active && active->threaded)
+        pthread_mutex_lock(&active->io_mutex);
+#endif
+}
+
+void pkg_prefetch__io_unlock(void)
+{
+#ifdef ENABLE_THREADS
+    if (active && active->threaded)
+        pthread_mutex_unlock(&active->io_mutex);
+#endif
+}
+
+static int item_cmp_addr(const void *a, const void *b)
+{
+    const struct pf_item *i1 = *(struct pf_item **)a;
+    const struct pf_item *i2 = *(struct pf_item **)b;
+
+    if (i1->pkg == i2->pkg)
+        return 0;
+
+    return i1->pkg < i2->pkg ? -1 : 1;
+}
+
+/* index order: packages of the same pkgdir by sequence (record) number */
+static int item_cmp_seqno(const void *a, const void *b)
+{
+    const struct pf_item *i1 = *(struct pf_item **)a;
+    const struct pf_item *i2 = *(struct pf_item **)b;
+
+    if (i1->pkg->pkgdir != i2->pkg->pkgdir)
+        return i1->pkg->pkgdir < i2->pkg->pkgdir ? -1 : 1;
+
+    return pkg_cmp_seqno(i1->pkg, i2->pkg);
+}
+
+static void item_load(struct pkg_prefetch *pf, struct pf_item *it)
+{
+    const struct pkg *pkg = it->pkg;
+
+    if ((pf->what & PKG_PREFETCH_UINF) && pkg->load_pkguinf &&
+        !pkg_has_ldpkguinf(pkg)) {
+        pkg_prefetch__io_lock();
+        it->uinf = pkg->load_pkguinf(NULL, pkg, pkg->pkgdir_data, NULL);
+        pkg_prefetch__io_unlock();
+    }
+
+    if (pf->what & PKG_PREFETCH_FLIST)
+        it->flist = pkg__load_flist(pkg);
+}
+
+/* item's objects are released by caller's thread only, reader just
+   creates them, so their refcounts are never touched concurrently */
+static void item_free(struct pf_item *it)
+{
+    if (it->uinf)
+        pkguinf_free(it->uinf);
+
+    if (it->flist)
+        pkgflist_free(it->flist);
+
+    it->uinf = NULL;
+    it->flist = NULL;
+    it->state = PFI_GONE;
+}
+
+/* reads not yet read items of batch starting at from; called and returns
+   with pf locked */
+static void load_batch(struct pkg_prefetch *pf, int from)
+{
+    struct pf_item *batch[PF_BATCH];
+    int i, n = 0, to;
+
+    to = from + PF_BATCH;
+    if (to > pf->nitems)
+        to = pf->nitems;
+
+    for (i = from; i < to; i++) {
+        struct pf_item *it = &pf->items[i];
+
+        if (it->state == PFI_NEW) {
+            it->state = PFI_BUSY;
+            batch[n++] = it;
+        }
+    }
+
+    if (to > pf->next)
+        pf->next = to;
+
+    if (n == 0)
+        return;
+
+    pf_unlock(pf);
+
+    qsort(batch, n, sizeof(*batch), item_cmp_seqno);
+    for (i = 0; i < n; i++)
+        item_load(pf, batch[i]);
+
+    pf_lock(pf);
+
+    for (i = 0; i < n; i++)
+        batch[i]->state = PFI_READY;
+    pf_wakeup(pf);
+}
+
+/* frees items left far behind caller's position */
+static void evict(struct pkg_prefetch *pf)
+{
+    int limit = pf->pos - PF_WINDOW;
+
+    for (; pf->evicted < limit; pf->evicted++) {
+        struct pf_item *it = &pf->items[pf->evicted];
+
+        if (it->state == PFI_BUSY) /* reader's one, freed at the end */
+            continue;
+
+        item_free(it);
+    }
+}
+
+#ifdef ENABLE_THREADS
+static void *reader(void *arg)
+{
+    struct pkg_prefetch *pf = arg;
+    struct trace_span *span = trace_begin("pkg.prefetch");
+    int nbatches = 0;
+
+    pf_lock(pf);
+    while (!pf->stop) {
+        if (pf->next < pf->pos)   /* caller jumped ahead */
+            pf->next = pf->pos;
+
+        if (pf->next >= pf->nitems)
+            break;
+
+        if (pf->next >= pf->pos + PF_WINDOW) {
+            pf_wait(pf);
+            continue;
+        }
+
+        load_batch(pf, pf->next);
+        nbatches++;
+    }
+    pf_unlock(pf);
+
+    trace_count(span, "batches", nbatches);
+    trace_end(span);
+    return NULL;
+}
+#endif
+
+struct pkg_prefetch *pkg_prefetch_begin(const tn_array *pkgs, unsigned what)
+{
+    struct pkg_prefetch *pf;
+    int i, n = 0;
+
+    if (active || what == 0 || pkgs == NULL || n_array_size(pkgs) < 2)
+        return NULL;
+
+    pf = n_calloc(1, sizeof(*pf));
+    pf->what = what;
+    pf->items = n_calloc(n_array_size(pkgs), sizeof(*pf->items));
+
+    for (i = 0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+
+        /* nothing to read from index */
+        if (pkg->load_pkguinf == NULL && pkg->load_nodep_fl == NULL)
+            continue;
+
+        pf->items[n++].pkg = pkg;
+    }
+
+    if (n < 2) {
+        free(pf->items);
+        free(pf);
+        return NULL;
+    }
+
+    pf->nitems = n;
+    pf->byptr = n_malloc(n * sizeof(*pf->byptr));
+    for (i = 0; i < n; i++)
+        pf->byptr[i] = &pf->items[i];
+
+    qsort(pf->byptr, n, sizeof(*pf->byptr), item_cmp_addr);
+
+    active = pf;
+
+#ifdef ENABLE_THREADS
+    /* no nesting, a worker of poldek_run_workers() has its own loop */
+    if (n > PF_BATCH && poldek_enabled_threads() && !poldek_threading_is_on()) {
+        pthread_mutex_init(&pf->mutex, NULL);
+        pthread_mutex_init(&pf->io_mutex, NULL);
+        pthread_cond_init(&pf->cond, NULL);
+
+        pf->threaded = 1;
+        poldek_threading_toggle(true);
+
+        if (pthread_create(&pf->tid, NULL, reader, pf) != 0) {
+            poldek_threading_toggle(false);
+            pf->threaded = 0;
+            pthread_cond_destroy(&pf->cond);
+            pthread_mutex_destroy(&pf->io_mutex);
+            pthread_mutex_destroy(&pf->mutex);
+        }
+    }
+#endif
+
+    return pf;
+}
+
+void pkg_prefetch_end(struct pkg_prefetch *pf)
+{
+    int i;
+
+    if (pf == NULL)
+        return;
+
+    n_assert(pf == active);
+
+#ifdef ENABLE_THREADS
+    if (pf->threaded) {
+        pf_lock(pf);
+        pf->stop = 1;
+        pf_wakeup(pf);
+        pf_unlock(pf);
+
+        pthread_join(pf->tid, NULL);
+        poldek_threading_toggle(false);
+
+        pthread_cond_destroy(&pf->cond);
+        pthread_mutex_destroy(&pf->io_mutex);
+        pthread_mutex_destroy(&pf->mutex);
+        pf->threaded = 0;
+    }
+#endif
+
+    active = NULL;
+
+    for (i = 0; i < pf->nitems; i++)
+        item_free(&pf->items[i]);
+
+    free(pf->byptr);
+    free(pf->items);
+    free(pf);
+}
+
+/* RET: ready item of pkg or NULL; called with pf locked */
+static struct pf_item *item_get(struct pkg_prefetch *pf, const struct pkg *pkg)
+{
+    struct pf_item key, *keyp = &key, **itp, *it;
+    int k;
+
+    key.pkg = pkg;
+    itp = bsearch(&keyp, pf->byptr, pf->nitems, sizeof(*pf->byptr),
+                  item_cmp_addr);
+    if (itp == NULL)
+        return NULL;
+
+    it = *itp;
+    k = it - pf->items;
+
+    if (it->state == PFI_NEW)   /* not reached by reader yet */
+        load_batch(pf, k);
+
+    while (it->state == PFI_BUSY)
+        pf_wait(pf);
+
+    if (k + 1 > pf->pos) {
+        pf->pos = k + 1;
+        evict(pf);
+        pf_wakeup(pf);
+    }
+
+    return it->state == PFI_READY ? it : NULL;
+}
+
+int pkg_prefetch__uinf(const struct pkg *pkg, struct pkguinf **pkgu)
+{
+    struct pkg_prefetch *pf = active;
+    struct pf_item *it;
+
+    if (pf == NULL || (pf->what & PKG_PREFETCH_UINF) == 0)
+        return 0;
+
+    pf_lock(pf);
+    if ((it = item_get(pf, pkg)))
+        *pkgu = it->uinf ? pkguinf_link(it->uinf) : NULL;
+    pf_unlock(pf);
+
+    return it != NULL;
+}
+
+int pkg_prefetch__flist(const struct pkg *pkg, struct pkgflist **flist)
+{
+    struct pkg_prefetch *pf = active;
+    struct pf_item *it;
+    int rc = 0;
+
+    if (pf == NULL || (pf->what & PKG_PREFETCH_FLIST) == 0)
+        return 0;
+
+    pf_lock(pf);
+    if ((it = item_get(pf, pkg)) && it->flist) { /* given away, once */
+        *flist = it->flist;
+        it->flist = NULL;
+        rc = 1;
+    }
+    pf_unlock(pf);
+
+    return rc;
+}
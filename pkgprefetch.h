@@ -0,0 +1,44 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifndef POLDEK_PKGPREFETCH_H
+#define POLDEK_PKGPREFETCH_H
+
+#include <trurl/narray.h>
+
+struct pkg;
+struct pkguinf;
+struct pkgflist;
+struct pkg_prefetch;
+
+#define PKG_PREFETCH_UINF   (1 << 0)  /* pkg_uinf() */
+#define PKG_PREFETCH_FLIST  (1 << 1)  /* pkg_get_flist() */
+
+/*
+  Reads packages' descriptions and/or file lists from their indexes ahead
+  of the caller: batches of pkgs (taken in pkgs order, i.e. order the
+  caller will ask for them) are read in index order on a background
+  thread. Until pkg_prefetch_end() pkg_uinf() and pkg_get_flist() of these
+  packages are served from it; decoded objects are kept in a bounded
+  window around caller's position.
+
+  RET: NULL if there is nothing to prefetch or another prefetch is active
+*/
+struct pkg_prefetch *pkg_prefetch_begin(const tn_array *pkgs, unsigned what);
+void pkg_prefetch_end(struct pkg_prefetch *pf);
+
+/* internal, used by pkg.c; RET: non-zero if pkg is handled by prefetch */
+int pkg_prefetch__uinf(const struct pkg *pkg, struct pkguinf **pkgu);
+int pkg_prefetch__flist(const struct pkg *pkg, struct pkgflist **flist);
+
+/* serializes index reads while prefetch is active */
+void pkg_prefetch__io_lock(void);
+void pkg_prefetch__io_unlock(void);
+
+/* pkg.c: pkg_get_flist() without prefetch */
+struct pkgflist *pkg__load_flist(const struct pkg *pkg);
+
+#endif
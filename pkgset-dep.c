@@ -29,6 +29,9 @@
 #include "capreqidx.h"
 #include "pkg.h"
 #include "pkgset.h"
+#include "trace.h"
+#include "pkgdir/pkgdir.h"
+#include "pkgdir/pkgdir_depgraph.h"
 
 void *pkg_na_malloc(const struct pkg *pkg, size_t size);
 
@@ -212,8 +215,10 @@ int process_reqs(int indent, tn_array *reqpkgs, struct pkgset *ps, const struct
         khash = n_hash_compute_hash(cache, key, klen);
         if (n_hash_hexists(cache, streq, klen, khash)) {
             matches = n_hash_hget(cache, streq, klen, khash);
+            trace_count(NULL, "req.cache.hits", 1);
 
         } else {
+            trace_count(NULL, "req.cache.misses", 1);
             int found = pkgset_find_match_packages(ps, pkg, req, &matches, strict);
             if (found && matches == NULL)
                 matches = pkgs_array_new(2);
@@ -256,6 +261,84 @@ int process_reqs(int indent, tn_array *reqpkgs, struct pkgset *ps, const struct
     return nerrors;
 }
 
+/* ps->_depgraph */
+#define DEPGRAPH_UNKNOWN   0
+#define DEPGRAPH_USABLE    1
+#define DEPGRAPH_UNUSABLE  2
+
+static int in_pkgset(struct pkgset *ps, const struct pkg *pkg)
+{
+    return n_array_bsearch(ps->pkgs, pkg) == pkg;
+}
+
+/*
+  Graph saved with index (see pkgdir_depgraph.h) holds edges within its
+  pkgdir only, so it is used when ps consists of pkgdir's packages alone;
+  its edges are filtered to packages still in ps, what gives the same
+  result as resolving. RET: node of pkg or NULL
+*/
+static const struct pkgdir_dgnode *depgraph_node(struct pkgset *ps,
+                                                 const struct pkg *pkg)
+{
+    struct pkgdir *pkgdir;
+
+    if (ps->_depgraph == DEPGRAPH_UNKNOWN) {
+        ps->_depgraph = DEPGRAPH_UNUSABLE;
+
+        if (n_array_size(ps->pkgdirs) == 1) {
+            pkgdir = n_array_nth(ps->pkgdirs, 0);
+            ps->_depgraph = DEPGRAPH_USABLE;
+
+            for (int i=0; i < n_array_size(ps->pkgs); i++) {
+                struct pkg *p = n_array_nth(ps->pkgs, i);
+                if (p->pkgdir != pkgdir) {
+                    ps->_depgraph = DEPGRAPH_UNUSABLE;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (ps->_depgraph != DEPGRAPH_USABLE)
+        return NULL;
+
+    pkgdir = n_array_nth(ps->pkgdirs, 0);
+    if (pkg->pkgdir != pkgdir || !in_pkgset(ps, pkg))
+        return NULL;
+
+    return pkgdir__depgraph_node(pkgdir, pkg);
+}
+
+static tn_array *depgraph_required(struct pkgset *ps, const struct pkg *pkg,
+                                   const struct pkgdir_dgnode *node)
+{
+    tn_array *reqpkgs, *matches;
+    int i = 0;
+
+    reqpkgs = reqpkgs_array_new(n_array_size(pkg->reqs)/2+2);
+    matches = n_array_new(4, NULL, NULL);
+
+    while (i < node->nreqs) {  /* edges are grouped by requirement */
+        unsigned no = node->reqs[i].no;
+
+        n_array_clean(matches);
+        for (; i < node->nreqs && node->reqs[i].no == no; i++) {
+            if (in_pkgset(ps, node->reqs[i].pkg))
+                n_array_push(matches, node->reqs[i].pkg);
+        }
+
+        if (n_array_size(matches) > 0)
+            process_req(reqpkgs, n_array_nth(pkg->reqs, no), matches);
+    }
+
+    n_array_free(matches);
+
+    if (n_array_size(reqpkgs) == 0)
+        n_array_cfree(&reqpkgs);
+
+    return reqpkgs;
+}
+
 tn_array *pkgset_get_required_packages_x(int indent, struct pkgset *ps,
                                          const struct pkg *pkg, tn_hash **unreqh)
 {
@@ -300,7 +383,14 @@ tn_array *pkgset_get_required_packages(int indent, struct pkgset *ps,
             return n_ref(reqpkgs);
     }
 
-    reqpkgs = pkgset_get_required_packages_x(indent, ps, pkg, NULL);
+    const struct pkgdir_dgnode *node = depgraph_node(ps, pkg);
+    if (node && node->complete) {
+        trace_count(NULL, "depgraph.hits", 1);
+        reqpkgs = depgraph_required(ps, pkg, node);
+
+    } else {
+        reqpkgs = pkgset_get_required_packages_x(indent, ps, pkg, NULL);
+    }
 
     if (reqpkgs)
         n_hash_insert(ps->_reqpkgs_cache, pkg_id(pkg), n_ref(reqpkgs));
@@ -381,6 +471,25 @@ tn_array *pkgset_get_conflicted_packages(int indent, struct pkgset *ps, const st
     }
 
     tn_array *re = NULL;
+    const struct pkgdir_dgnode *node;
+
+    if ((node = depgraph_node(ps, pkg))) {
+        for (int i=0; i < node->ncnfls; i++) {
+            const struct pkgdir_dgedge *e = &node->cnfls[i];
+
+            if (!in_pkgset(ps, e->pkg))
+                continue;
+
+            if (re == NULL)
+                re = reqpkgs_array_new(4);
+
+            n_array_push(re, reqpkg_new(e->pkg, n_array_nth(pkg->cnfls, e->no),
+                                        e->flags, 0));
+        }
+
+        return re;
+    }
+
     for (int i=0; i < n_array_size(pkg->cnfls); i++) {
         struct capreq *cnfl = n_array_nth(pkg->cnfls, i);
         //if (capreq_is_obsl(cnfl)) // XXX
@@ -454,6 +563,23 @@ tn_array *pkgset_get_requiredby_packages(int indent, struct pkgset *ps,
                                          const struct pkg *pkg)
 {
     tn_array *re = NULL;
+    const struct pkgdir_dgnode *node;
+
+    if ((node = depgraph_node(ps, pkg))) {
+        for (int i=0; i < node->nreqby; i++) {
+            struct pkg *rpkg = node->reqby[i].pkg;
+
+            if (!in_pkgset(ps, rpkg))
+                continue;
+
+            if (re == NULL)
+                re = pkgs_array_new(4);
+
+            n_array_push(re, pkg_link(rpkg));
+        }
+
+        return re;
+    }
 
     pkg_add_selfcap((struct pkg*)pkg); /* XXX */
     for (int i=0; i < n_array_size(pkg->caps); i++) {
@@ -25,11 +25,13 @@
 #include "pkgset.h"
 #include "pkgdir/pkgdir.h"
 #include "pkgdir/pkgdir_intern.h"
+#include "pkgdir/pkgdir_depmap.h"
 #include "log.h"
 #include "misc.h"
 #include "i18n.h"
 #include "depdirs.h"
 #include "thread.h"
+#include "trace.h"
 
 static int load_pkgdirs_seq(const tn_array *pkgdirs, const tn_array *depdirs, int ldflags)
 {
@@ -158,11 +160,17 @@ static int load_pkgdirs(const tn_array *pkgdirs, const tn_array *depdirs, int ld
 #endif
 
 int pkgset_load(struct pkgset *ps, int ldflags, tn_array *sources)
+{
+    return pkgset_load_closure(ps, ldflags, sources, NULL);
+}
+
+int pkgset_load_closure(struct pkgset *ps, int ldflags, tn_array *sources,
+                        const tn_array *names)
 {
     int i, j;
     unsigned openflags = 0;
 
-    tt_start;
+    struct trace_span *span = trace_begin("ps.load");
     n_array_sort_ex(sources, (tn_fn_cmp)source_cmp_pri);
 
     if (ldflags & PKGDIR_LD_ALLDESC)
@@ -211,6 +219,14 @@ int pkgset_load(struct pkgset *ps, int ldflags, tn_array *sources)
     n_array_uniq(ps->depdirs);
     n_array_freeze(ps->depdirs);
 
+    if (names) {
+        /* maps are built from full loads, so next run could use them */
+        ldflags |= PKGDIR_LD_UPDATE_DEPMAP;
+
+        if (!pkgdir__depmap_closure(ps->pkgdirs, names))
+            msgn(2, _("Dependency maps are not usable, loading all packages"));
+    }
+
     load_pkgdirs(ps->pkgdirs, ps->depdirs, ldflags);
 
     /* merge pkgdirs packages into ps->pkgs */
@@ -235,7 +251,8 @@ int pkgset_load(struct pkgset *ps, int ldflags, tn_array *sources)
                          "%d packages read", n), n);
     }
 
-    tt_stop("ps.load");
+    trace_count(span, "packages", n_array_size(ps->pkgs));
+    trace_end(span);
 
     return n_array_size(ps->pkgs);
 }
@@ -262,6 +279,8 @@ int pkgset_add_pkgdir(struct pkgset *ps, struct pkgdir *pkgdir)
     }
     */
     n_array_push(ps->pkgdirs, pkgdir);
+    pkgset__reset_lookup_misses(ps); /* new dirindex */
+    ps->_depgraph = 0;
 
     return 1;
 }
@@ -15,6 +15,7 @@
 #endif
 
 #include <limits.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
@@ -27,225 +28,265 @@
 #include "compiler.h"
 #include "i18n.h"
 #include "log.h"
-#define POLDEK_PKG_DAG_COLOURS 1  /* for pkg_*color */
 #include "pkg.h"
 #include "pkgset.h"
 #include "misc.h"
+#include "trace.h"
 
 /*
  * Ordering: sort packages topologically
+ *
+ * Dependency graph of ordered packages is built once, as compact adjacency
+ * lists (CSR): edges of node i are edges[offs[i] .. offs[i + 1]), each one
+ * carrying flags of its requirement (REQPKG_PREREQ*). Both passes walk
+ * the graph with an explicit stack, so neither recursion depth nor
+ * re-resolving of requirements depends on a number of packages.
  */
-struct visit_install_order_s {
-    struct pkgset *ps;
-    tn_array *ordered_pkgs;
-    tn_array *stack;
-    int nerrors;
-    int verbose_level;
-};
-
+#define NODE_WHITE 0
+#define NODE_GRAY  1
+#define NODE_BLACK 2
 
-static
-int visit_install_order(struct visit_install_order_s *vs, struct pkg *pkg,
-                        unsigned reqpkg_flag, int deep)
-{
-    int i, last_stack_i = -1;
-    int verb = vs->verbose_level;
+struct order_edge {
+    int      to;
+    unsigned flags;
+};
 
-    deep += 2;
+struct order_graph {
+    int               nnodes;
+    struct pkg        **nodes;
+    int               *offs;        /* nnodes + 1 */
+    struct order_edge *edges;
+    int               nedges;
+};
 
-    pkg_set_color(pkg, PKG_COLOR_GRAY);
+struct order_frame {
+    int node;
+    int edge;                       /* next edge to visit */
+};
 
-    tn_array *reqpkgs = pkgset_get_required_packages(deep, vs->ps, pkg);
+struct pkg_node {
+    const struct pkg *pkg;
+    int              node;
+};
 
-    if (reqpkgs == NULL || n_array_size(reqpkgs) == 0) {
-        msg(verb, "_\n");
-        msg_i(verb, deep, "_ visit %s  (NO REQS)", pkg->name);
-        goto l_end;
-    }
+static int pkg_node_cmp(const void *a, const void *b)
+{
+    uintptr_t pa = (uintptr_t)((const struct pkg_node*)a)->pkg;
+    uintptr_t pb = (uintptr_t)((const struct pkg_node*)b)->pkg;
 
-    n_array_push(vs->stack, pkg);
-    last_stack_i = n_array_size(vs->stack) - 1;
+    return pa < pb ? -1 : (pa > pb ? 1 : 0);
+}
 
-    msg(verb, "_\n");
-    msg_i(verb, deep, "_ visit %s -> (", pkg->name);
-    for (i=0; i < n_array_size(reqpkgs); i++) {
-        struct reqpkg *rp = n_array_nth(reqpkgs, i);
+/* RET: node of pkg or -1 if it is not in our pool */
+static int pkg_node_lookup(const struct pkg_node *map, int n,
+                           const struct pkg *pkg)
+{
+    struct pkg_node key = { pkg, -1 }, *ent;
 
-        msg(verb, "_%s%s, ", (rp->flags & reqpkg_flag) ? "*" : "",
-            rp->pkg->name);
+    ent = bsearch(&key, map, n, sizeof(*map), pkg_node_cmp);
+    return ent ? ent->node : -1;
+}
 
-        if (rp->flags & REQPKG_MULTI) {
-            int n = 0;
-            while (rp->adds[n]) {
-                msg(verb, "_%s%s, ",
-                    (rp->adds[n]->flags & reqpkg_flag) ? "*" : "",
-                    rp->adds[n]->pkg->name);
-                n++;
+static struct order_graph *order_graph_new(struct pkgset *ps,
+                                           const tn_array *pkgs)
+{
+    struct order_graph *g;
+    struct pkg_node *map;
+    tn_array **reqpkgs;
+    int i, j, n, nedges = 0;
+
+    n = n_array_size(pkgs);
+
+    g = n_calloc(1, sizeof(*g));
+    g->nnodes = n;
+    g->nodes = n_malloc(n * sizeof(*g->nodes));
+    g->offs = n_malloc((n + 1) * sizeof(*g->offs));
+
+    map = n_malloc(n * sizeof(*map));
+    reqpkgs = n_malloc(n * sizeof(*reqpkgs));
+
+    for (i=0; i < n; i++) {
+        g->nodes[i] = n_array_nth(pkgs, i);
+        map[i].pkg = g->nodes[i];
+        map[i].node = i;
+
+        reqpkgs[i] = pkgset_get_required_packages(0, ps, g->nodes[i]);
+        for (j=0; reqpkgs[i] && j < n_array_size(reqpkgs[i]); j++) {
+            struct reqpkg *rp = n_array_nth(reqpkgs[i], j);
+
+            nedges++;
+            if (rp->flags & REQPKG_MULTI) {
+                int k = 0;
+                while (rp->adds[k++])
+                    nedges++;
             }
         }
     }
-    msg(verb, "_) {");
-
-    for (i=0; i < n_array_size(reqpkgs); i++) {
-        struct reqpkg *rpkg, *rp;
-        int np = 0;
 
-        rpkg = rp = n_array_nth(reqpkgs, i);
+    qsort(map, n, sizeof(*map), pkg_node_cmp);
+    g->edges = n_malloc((nedges ? nedges : 1) * sizeof(*g->edges));
 
-        while (rp != NULL) {
-            if (pkg_is_color(rp->pkg, PKG_ALL_COLORS) == 0) { // skip, it is not in our pool
-                (void)0;
+    for (i=0; i < n; i++) {
+        g->offs[i] = g->nedges;
 
-            } else if (pkg_is_color(rp->pkg, PKG_COLOR_WHITE)) {
-                if (rp->flags & reqpkg_flag)
-                    pkg_set_prereqed(rp->pkg);
-                else
-                    pkg_clr_prereqed(rp->pkg);
+        for (j=0; reqpkgs[i] && j < n_array_size(reqpkgs[i]); j++) {
+            struct reqpkg *rpkg, *rp;
+            int np = 0;
 
-                if (reqpkg_flag == 0 || (rp->flags & reqpkg_flag))
-                    visit_install_order(vs, rp->pkg, reqpkg_flag, deep);
+            rpkg = rp = n_array_nth(reqpkgs[i], j);
 
-            } else if (pkg_is_color(rp->pkg, PKG_COLOR_BLACK)) {
-                msg(verb, "_\n");
-                msg_i(verb, deep, "_   visited %s", rp->pkg->name);
+            while (rp != NULL) {
+                int to = pkg_node_lookup(map, n, rp->pkg);
 
-            } else if (pkg_is_color(rp->pkg, PKG_COLOR_GRAY)) { /* cycle  */
-                int is_loop = 0;
+                if (to >= 0) { /* skip ones not in our pool */
+                    g->edges[g->nedges].to = to;
+                    g->edges[g->nedges].flags = rp->flags;
+                    g->nedges++;
+                }
 
-                if (rp->flags & reqpkg_flag) {
-                    int j, nn = 0, nprereqs = 0;
+                if (rpkg->flags & REQPKG_MULTI)
+                    rp = rpkg->adds[np++];
+                else
+                    rp = NULL;
+            }
+        }
 
-                    for (j=n_array_size(vs->stack)-1; j >= 0; j--) {
-                        struct pkg *p = n_array_nth(vs->stack, j);
+        n_array_cfree(&reqpkgs[i]);
+    }
+    g->offs[n] = g->nedges;
 
-                        if (p == rp->pkg)
-                            break;
+    free(reqpkgs);
+    free(map);
 
-                        nn++;
-                        if (!pkg_is_prereqed(p))
-                            break;
+    return g;
+}
 
-                        nprereqs++;
-                    }
+static void order_graph_free(struct order_graph *g)
+{
+    free(g->nodes);
+    free(g->offs);
+    free(g->edges);
+    free(g);
+}
 
-                    if (nn > 0 && nn == nprereqs)
-                        is_loop = 1;
-                }
+static void report_loop(const struct order_graph *g,
+                        const struct order_frame *stack, int sp,
+                        int to, int verb)
+{
+    struct pkg *pkg = g->nodes[stack[sp - 1].node];
+    char *error;
+    int i, size, ne = 0;
+
+    if (verb > 2) {
+        msgn_i(verb, sp * 2, "  cycle   %s -> %s", pkg->name,
+               g->nodes[to]->name);
+        return;
+    }
 
-                if (is_loop) {
-                    vs->nerrors++;
+    size = sp * 128 + 128;
+    error = alloca(size);
 
-                    if (verb > 2) {
-                        msg(verb, "\n");
-                        msg_i(verb, deep, "   cycle   %s -> %s", pkg->name,
-                              rp->pkg->name);
+    ne += n_snprintf(error, size, _("Requires(pre) loop: "));
+    ne += n_snprintf(&error[ne], size - ne, "%s", g->nodes[to]->name);
+    for (i = sp - 1; i >= 0; i--)
+        ne += n_snprintf(&error[ne], size - ne, " <- %s",
+                         g->nodes[stack[i].node]->name);
 
-                    } else {
-                        char *error;
-                        int size, ne = 0;
-
-                        size = n_array_size(vs->stack) * 128;
-                        error = alloca(size);
-
-                        ne += n_snprintf(error, size, _("Requires(pre) loop: "));
-                        ne += n_snprintf(&error[ne], size - ne, "%s", rp->pkg->name);
-                        for (int ii=n_array_size(vs->stack)-1; ii >= 0; ii--) {
-                            struct pkg *p = n_array_nth(vs->stack, ii);
-                            ne += n_snprintf(&error[ne], size - ne, " <- %s", p->name);
-                        }
-                        log(LOGERR, "%s\n", error);
-                    }
+    log(LOGERR, "%s\n", error);
+}
 
-                } else {
-                    msg(verb, "\n");
-                    msg_i(verb, deep, "   fakecycle   %s -> %s", pkg->name,
-                          rp->pkg->name);
-                }
+/*
+  Depth-first walk from roots (in given order), nodes are appended to
+  ordered in postorder, i.e. after their requirements. With reqpkg_flag
+  set only such edges are followed and reaching a node being visited by
+  one of them is a loop, unless it is a requirement of itself.
 
-            } else {
-                n_assert(0);
+  RET: number of detected loops
+*/
+static int order_pass(const struct order_graph *g, const int *roots,
+                      int *ordered, unsigned reqpkg_flag, int verb)
+{
+    struct order_frame *stack;
+    unsigned char *color;
+    int i, sp, nordered = 0, nerrors = 0;
+
+    color = n_calloc(g->nnodes, sizeof(*color));
+    stack = n_malloc(g->nnodes * sizeof(*stack));
+
+    for (i=0; i < g->nnodes; i++) {
+        int root = roots[i];
+
+        if (color[root] != NODE_WHITE)
+            continue;
+
+        color[root] = NODE_GRAY;
+        stack[0].node = root;
+        stack[0].edge = g->offs[root];
+        sp = 1;
+        msgn_i(verb, sp * 2, "visit %s", g->nodes[root]->name);
+
+        while (sp > 0) {
+            struct order_frame *fr = &stack[sp - 1];
+            const struct order_edge *e;
+
+            if (fr->edge == g->offs[fr->node + 1]) { /* requirements done */
+                color[fr->node] = NODE_BLACK;
+                ordered[nordered++] = fr->node;
+                msgn(verb, "push %s", pkg_snprintf_s(g->nodes[fr->node]));
+                sp--;
+                continue;
             }
 
-            if (rpkg->flags & REQPKG_MULTI)
-                rp = rpkg->adds[np++];
-            else
-                rp = NULL;
-        }
-    }
-
-    msg(verb, "\n");
-    msg_i(verb, deep, "_ } ");
-    msg(verb, "_%s",  pkg->name);
-    for (i=n_array_size(vs->stack)-2; i >= 0; i--) {
-        struct pkg *p = n_array_nth(vs->stack, i);
-        if (p != pkg)
-            msg(verb, "_ <- %s", p->name);
-    }
-    msg(verb, "_\n");
+            e = &g->edges[fr->edge++];
 
- l_end:
-    pkg_set_color(pkg, PKG_COLOR_BLACK);
-    pkg_clr_prereqed(pkg);
-    msgn(verb, "push %s", pkg_snprintf_s(pkg));
-    n_array_push(vs->ordered_pkgs, pkg_link(pkg));
-
-    n_array_cfree(&reqpkgs);
+            switch (color[e->to]) {
+                case NODE_WHITE:
+                    if (reqpkg_flag == 0 || (e->flags & reqpkg_flag)) {
+                        color[e->to] = NODE_GRAY;
+                        stack[sp].node = e->to;
+                        stack[sp].edge = g->offs[e->to];
+                        sp++;
+                        msgn_i(verb, sp * 2, "visit %s", g->nodes[e->to]->name);
+                    }
+                    break;
 
-    if (last_stack_i != -1)
-        for (i=last_stack_i; i < n_array_size(vs->stack); i++) {
-            pkg = n_array_pop(vs->stack);
-            pkg_clr_prereqed(pkg);
-        }
+                case NODE_BLACK:
+                    msgn_i(verb, sp * 2, "  visited %s", g->nodes[e->to]->name);
+                    break;
 
-    return 0;
-}
+                case NODE_GRAY: /* cycle */
+                    if ((e->flags & reqpkg_flag) && e->to != fr->node) {
+                        nerrors++;
+                        report_loop(g, stack, sp, e->to, verb);
 
-static void mapfn_clean_pkg_color(struct pkg *pkg)
-{
-    pkg_set_color(pkg, PKG_COLOR_WHITE);
-    pkg_clr_prereqed(pkg);
-}
+                    } else {
+                        msgn_i(verb, sp * 2, "  fakecycle %s -> %s",
+                               g->nodes[fr->node]->name, g->nodes[e->to]->name);
+                    }
+                    break;
 
-static int do_order(struct pkgset *ps, const tn_array *pkgs, tn_array **ordered_pkgs,
-                    unsigned reqpkg_flag, int verbose_level)
-{
-    struct pkg *pkg;
-    struct visit_install_order_s vs;
-    int i;
-
-    vs.ps = ps;
-    vs.ordered_pkgs = n_array_new(n_array_size(pkgs), (tn_fn_free)pkg_free, NULL);
-    vs.nerrors = 0;
-    vs.stack = n_array_new(128, NULL, NULL);
-    vs.verbose_level = verbose_level;
-
-    n_array_map(pkgs, (tn_fn_map1)mapfn_clean_pkg_color);
-
-    for (i=0; i<n_array_size(pkgs); i++) {
-        pkg = n_array_nth(pkgs, i);
-        if (pkg_is_color(pkg, PKG_COLOR_WHITE)) {
-            visit_install_order(&vs, pkg, reqpkg_flag, reqpkg_flag ? 1 : 0);
-            n_array_clean(vs.stack);
+                default:
+                    n_assert(0);
+            }
         }
     }
 
-    n_assert(n_array_size(vs.ordered_pkgs) == n_array_size(pkgs));
+    n_assert(nordered == g->nnodes);
 
-    n_assert(*ordered_pkgs == NULL);
-    n_array_free(vs.stack);
-    *ordered_pkgs = vs.ordered_pkgs;
-    return vs.nerrors;
-}
+    free(stack);
+    free(color);
 
+    return nerrors;
+}
 
 /* RET: number of detected loops  */
 static int do_packages_order(struct pkgset *ps, const tn_array *pkgs,
                              tn_array **ordered_pkgs, int ordertype,
                              int verbose_level)
 {
-    tn_array *preordered = NULL;
+    struct order_graph *g;
     unsigned reqpkg_flag = 0;
-    int nloops;
+    int i, nloops, *roots, *preordered, *ordered;
 
     n_assert(n_array_ctl_get_cmpfn(pkgs) == (tn_fn_cmp)pkg_cmp_name_evr_rev);
     n_assert(n_array_size(pkgs) > 0);
@@ -255,9 +296,19 @@ static int do_packages_order(struct pkgset *ps, const tn_array *pkgs,
        by pkg_cmp_pri_name_evr_rev() */
     n_array_isort_ex(inpkgs, (tn_fn_cmp)pkg_cmp_pri_name_evr_rev);
 
+    g = order_graph_new(ps, inpkgs);
+    trace_count(NULL, "edges", g->nedges);
+
+    roots = n_malloc(g->nnodes * sizeof(*roots));
+    preordered = n_malloc(g->nnodes * sizeof(*preordered));
+    ordered = n_malloc(g->nnodes * sizeof(*ordered));
+
+    for (i=0; i < g->nnodes; i++)
+        roots[i] = i;
+
     /* Preordering packages using Requires: */
     msgn(verbose_level + 2, "Preordering packages...");
-    do_order(ps, inpkgs, &preordered, 0, verbose_level + 2);
+    order_pass(g, roots, preordered, 0, verbose_level + 2);
 
     switch (ordertype) {
         case PKGORDER_INSTALL:
@@ -272,10 +323,16 @@ static int do_packages_order(struct pkgset *ps, const tn_array *pkgs,
             n_assert(0);
     }
     msgn(verbose_level + 2, "Ordering packages...");
-    *ordered_pkgs = NULL;
-    nloops = do_order(ps, preordered, ordered_pkgs, reqpkg_flag, verbose_level + 1);
+    nloops = order_pass(g, preordered, ordered, reqpkg_flag, verbose_level + 1);
+
+    *ordered_pkgs = n_array_new(g->nnodes, (tn_fn_free)pkg_free, NULL);
+    for (i=0; i < g->nnodes; i++)
+        n_array_push(*ordered_pkgs, pkg_link(g->nodes[ordered[i]]));
 
-    n_array_free(preordered);
+    free(roots);
+    free(preordered);
+    free(ordered);
+    order_graph_free(g);
     n_array_free(inpkgs);
 
     return nloops;
@@ -283,7 +340,16 @@ static int do_packages_order(struct pkgset *ps, const tn_array *pkgs,
 
 int pkgset_order_ex(struct pkgset *ps, const tn_array *pkgs, tn_array **ordered, int ordertype, int verbose_level)
 {
-    return do_packages_order(ps, pkgs, ordered, ordertype, verbose_level);
+    struct trace_span *span = trace_begin("ps.order");
+    int nloops;
+
+    nloops = do_packages_order(ps, pkgs, ordered, ordertype, verbose_level);
+
+    trace_count(span, "packages", n_array_size(pkgs));
+    trace_count(span, "loops", nloops);
+    trace_end(span);
+
+    return nloops;
 }
 
 int pkgset_order(struct pkgset *ps, const tn_array *pkgs, tn_array **ordered, int ordertype) {
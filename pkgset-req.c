@@ -30,6 +30,8 @@
 #include "pkgmisc.h"
 #include "capreq.h"
 #include "fileindex.h"
+#include "bloom.h"
+#include "thread.h"
 
 extern int poldek_conf_MULTILIB;
 extern void *pkg_na_malloc(struct pkg *pkg, size_t size);
@@ -40,6 +42,64 @@ static int psreq_lookup(struct pkgset *ps, const struct capreq *req,
                         struct pkg ***suspkgs, struct pkg **pkgsbuf, int *npkgs);
 
 
+#ifdef ENABLE_THREADS
+static pthread_mutex_t lookup_misses_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void pkgset__reset_lookup_misses(struct pkgset *ps)
+{
+    mutex_lock(&lookup_misses_mutex);
+    if (ps->_lookup_misses)
+        n_hash_clean(ps->_lookup_misses);
+    mutex_unlock(&lookup_misses_mutex);
+}
+
+static int lookup_missed(struct pkgset *ps, const char *reqname)
+{
+    int missed = 0;
+
+    mutex_lock(&lookup_misses_mutex);
+    if (ps->_lookup_misses)
+        missed = n_hash_exists(ps->_lookup_misses, reqname);
+    mutex_unlock(&lookup_misses_mutex);
+
+    return missed;
+}
+
+static void lookup_remember_miss(struct pkgset *ps, const char *reqname)
+{
+    mutex_lock(&lookup_misses_mutex);
+    if (ps->_lookup_misses == NULL) {
+        ps->_lookup_misses = n_hash_new(1024, NULL);
+        n_hash_ctl(ps->_lookup_misses, TN_HASH_REHASH);
+    }
+
+    if (!n_hash_exists(ps->_lookup_misses, reqname))
+        n_hash_insert(ps->_lookup_misses, reqname, NULL);
+    mutex_unlock(&lookup_misses_mutex);
+}
+
+/* RET: 0 if surely no package provides name */
+static inline int cap_maybe(const struct pkgset *ps, const char *name, int len)
+{
+    return ps->_lookup_bloom == NULL || bloom_maybe(ps->_lookup_bloom, name, len);
+}
+
+/* RET: 0 if surely no package has path */
+static int file_maybe(const struct pkgset *ps, const char *path)
+{
+    const char *basename;
+
+    if (ps->_lookup_bloom == NULL || (basename = strrchr(path, '/')) == NULL)
+        return 1;
+
+    basename++;
+    if (*basename == '\0')      /* dir/, let the index judge */
+        return 1;
+
+    return bloom_maybe(ps->_lookup_bloom, basename, strlen(basename));
+}
+
 static void isort_pkgs(struct pkg *pkgs[], size_t size)
 {
     register size_t i, j;
@@ -84,13 +144,15 @@ static void isort_pkgs(struct pkg *pkgs[], size_t size)
   - otherwise suspkgs is pointed to array of "suspect" packages,
     Suspected packages are sorted descending by name and EVR.
 
+  Names surely not in indexes (per lookup filter) or not provided by any
+  package already are passed to PM straight away.
 */
 static int psreq_lookup(struct pkgset *ps, const struct capreq *req,
                         struct pkg ***suspkgs, struct pkg **pkgsbuf, int *npkgs)
 {
-    const struct capreq_idx_ent *ent;
+    const struct capreq_idx_ent *ent = NULL;
     const char *reqname;
-    int matched, pkgsbuf_size;
+    int matched, pkgsbuf_size, missed;
 
     reqname = capreq_name(req);
     pkgsbuf_size = *npkgs;
@@ -98,13 +160,22 @@ static int psreq_lookup(struct pkgset *ps, const struct capreq *req,
     matched = 0;
 
     pkgset__index_caps(ps);
-    if ((ent = capreq_idx_lookup(&ps->cap_idx, reqname, capreq_name_len(req)))) {
+    missed = lookup_missed(ps, reqname);
+
+    if (missed) {
+        ;                       /* known miss, PM only */
+
+    } else if (cap_maybe(ps, reqname, capreq_name_len(req)) &&
+               (ent = capreq_idx_lookup(&ps->cap_idx, reqname, capreq_name_len(req)))) {
         *suspkgs = (struct pkg **)ent->pkgs;
         *npkgs = ent->items;
         matched = 1;
 
     } else if (capreq_is_file(req)) {
-        int n = file_index_lookup(ps->file_idx, reqname, 0, pkgsbuf, pkgsbuf_size);
+        int n = 0;
+
+        if (file_maybe(ps, reqname))
+            n = file_index_lookup(ps->file_idx, reqname, 0, pkgsbuf, pkgsbuf_size);
 
         n_assert(n >= 0);
         if (n) {
@@ -143,6 +214,9 @@ static int psreq_lookup(struct pkgset *ps, const struct capreq *req,
         }
     }
 
+    if (!missed && !matched && ent == NULL)
+        lookup_remember_miss(ps, reqname);
+
     /* disabled - well tested
       if (strncmp("rpmlib", capreq_name(req), 6) == 0 && !capreq_is_rpmlib(req))
          n_assert(0);
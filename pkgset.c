@@ -36,10 +36,12 @@
 #include "pkgmisc.h"
 #include "pkgset.h"
 #include "misc.h"
+#include "bloom.h"
 #include "poldek_term.h"
 #include "pm/pm.h"
 #include "pkgdir/pkgdir.h"
 #include "fileindex.h"
+#include "trace.h"
 
 #ifdef HAVE_CONFIG_H
 # include "config.h"
@@ -92,6 +94,12 @@ void pkgset_free(struct pkgset *ps)
         ps->_reqpkgs_cache = NULL;
     }
 
+    if (ps->_lookup_bloom)
+        bloom_free(ps->_lookup_bloom);
+
+    if (ps->_lookup_misses)
+        n_hash_free(ps->_lookup_misses);
+
     n_array_cfree(&ps->pkgs);
     n_array_cfree(&ps->depdirs);
     n_array_cfree(&ps->pkgdirs);
@@ -125,7 +133,8 @@ static void add_self_cap(struct pkgset *ps)
     n_array_map(ps->pkgs, package_add_self_cap);
 }
 
-static int pkgfl2fidx(const struct pkg *pkg, struct file_index *fidx)
+static int pkgfl2fidx(const struct pkg *pkg, struct file_index *fidx,
+                      struct bloom *bf)
 {
     int i, j;
 
@@ -138,8 +147,12 @@ static int pkgfl2fidx(const struct pkg *pkg, struct file_index *fidx)
 
         fidx_dir = file_index_add_dirname(fidx, flent->dirname);
         for (j=0; j < flent->items; j++) {
+            const char *basename = flent->files[j]->basename;
+
             file_index_add_basename(fidx, fidx_dir,
                                     flent->files[j], (struct pkg*)pkg);
+            if (bf)
+                bloom_add(bf, basename, strlen(basename));
         }
         // XXX not needed (probably)
         //if (setup)
@@ -154,12 +167,36 @@ static int index_package_caps(struct pkgset *ps, const struct pkg *pkg)
         for (int i=0; i < n_array_size(pkg->caps); i++) {
             struct capreq *cap = n_array_nth(pkg->caps, i);
             capreq_idx_add(&ps->cap_idx, capreq_name(cap), capreq_name_len(cap), pkg);
+            if (ps->_lookup_bloom)
+                bloom_add(ps->_lookup_bloom, capreq_name(cap), capreq_name_len(cap));
         }
 
-    pkgfl2fidx(pkg, ps->file_idx);
+    pkgfl2fidx(pkg, ps->file_idx, ps->_lookup_bloom);
     return 1;
 }
 
+/* number of keys to be put into lookup filter */
+static size_t count_lookup_keys(const struct pkgset *ps)
+{
+    size_t n = 0;
+    int i, j;
+
+    for (i=0; i < n_array_size(ps->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(ps->pkgs, i);
+
+        if (pkg->caps)
+            n += n_array_size(pkg->caps);
+
+        if (pkg->fl)
+            for (j=0; j < n_tuple_size(pkg->fl); j++) {
+                struct pkgfl_ent *flent = n_tuple_nth(pkg->fl, j);
+                n += flent->items;
+            }
+    }
+
+    return n;
+}
+
 
 static int index_package_reqs(struct pkgset *ps, const struct pkg *pkg)
 {
@@ -188,7 +225,7 @@ int pkgset__index_caps(struct pkgset *ps)
     if (ps->cap_idx.na != NULL)
         return 1;
 
-    tt_start;
+    struct trace_span *span = trace_begin("ps.index.caps");
     add_self_cap(ps);
     n_array_map(ps->pkgs, (tn_fn_map1)sort_pkg_caps);
 
@@ -197,11 +234,15 @@ int pkgset__index_caps(struct pkgset *ps)
     n_assert(ps->file_idx == NULL);
     ps->file_idx = file_index_new(512);
 
+    n_assert(ps->_lookup_bloom == NULL);
+    ps->_lookup_bloom = bloom_new(count_lookup_keys(ps));
+
     for (int i=0; i < n_array_size(ps->pkgs); i++) {
         struct pkg *pkg = n_array_nth(ps->pkgs, i);
         index_package_caps(ps, pkg);
     }
-    tt_stop("ps.index.caps");
+    trace_count(span, "packages", n_array_size(ps->pkgs));
+    trace_end(span);
 
 #if ENABLE_TRACE
     extern void capreq_idx_stats(const char *prefix, struct capreq_idx *idx);
@@ -216,7 +257,7 @@ int pkgset__index_reqs(struct pkgset *ps)
     if (ps->req_idx.na != NULL)
         return 1;
 
-    tt_start;
+    struct trace_span *span = trace_begin("ps.index.reqs");
     capreq_idx_init(&ps->req_idx,  CAPREQ_IDX_REQ, 8 * n_array_size(ps->pkgs));
     capreq_idx_init(&ps->obs_idx,  CAPREQ_IDX_REQ, n_array_size(ps->pkgs)/5 + 4);
     capreq_idx_init(&ps->cnfl_idx, CAPREQ_IDX_REQ, n_array_size(ps->pkgs)/5 + 4);
@@ -224,7 +265,8 @@ int pkgset__index_reqs(struct pkgset *ps)
         struct pkg *pkg = n_array_nth(ps->pkgs, i);
         index_package_reqs(ps, pkg);
     }
-    tt_stop("ps.index.reqs");
+    trace_count(span, "packages", n_array_size(ps->pkgs));
+    trace_end(span);
     return 1;
 }
 
@@ -238,6 +280,9 @@ int pkgset_add_package(struct pkgset *ps, struct pkg *pkg)
     if (ps->cap_idx.na != NULL) /* already indexed caps */
         index_package_caps(ps, pkg);
 
+    pkgset__reset_lookup_misses(ps);
+    ps->_depgraph = 0;
+
     if (ps->req_idx.na != NULL) /* already indexed reqs */
         index_package_reqs(ps, pkg);
 
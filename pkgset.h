@@ -21,6 +21,7 @@
 
 struct file_index;
 struct pkgdir;
+struct bloom;
 
 struct pkgset {
     tn_array           *pkgs;           /*  pkg* []    */
@@ -37,6 +38,11 @@ struct pkgset {
 
     tn_hash            *_req_cache;
     tn_hash            *_reqpkgs_cache;
+
+    struct bloom       *_lookup_bloom;  /* cap names and file basenames */
+    tn_hash            *_lookup_misses; /* reqs not provided by any pkg */
+    int                _depgraph;       /* pkgdir's graph usability,
+                                           see pkgset-dep.c */
 };
 
 struct pm_ctx;
@@ -44,10 +50,15 @@ struct pkgset *pkgset_new(struct pm_ctx *ctx);
 void pkgset_free(struct pkgset *ps);
 
 int pkgset_load(struct pkgset *ps, int ldflags, tn_array *sources);
+/* loads only packages reachable from names if dependency maps allow */
+int pkgset_load_closure(struct pkgset *ps, int ldflags, tn_array *sources,
+                        const tn_array *names);
 int pkgset_add_pkgdir(struct pkgset *ps, struct pkgdir *pkgdir);
 
 int pkgset__index_caps(struct pkgset *ps);
 int pkgset__index_reqs(struct pkgset *ps);
+/* forgets remembered lookup misses, to be called when ps gets new pkgs */
+void pkgset__reset_lookup_misses(struct pkgset *ps);
 
 
 // pkgset-req.c
@@ -498,6 +498,13 @@ static tn_array *get_parsed_changelog(struct pkguinf *inf, time_t since)
     return entries;
 }
 
+static int changelog_ent_is_security_fix(const struct changelog_ent *ent)
+{
+    const char *m = ent->message;
+
+    return strstr(m, "CVE-20") || strstr(m, "CVE-19") || strcasestr(m, "security");
+}
+
 int pkguinf_changelog_with_security_fixes(struct pkguinf *inf, time_t since)
 {
     tn_array *entries;
@@ -509,9 +516,8 @@ int pkguinf_changelog_with_security_fixes(struct pkguinf *inf, time_t since)
 
     for (i=0; i < n_array_size(entries); i++) {
         struct changelog_ent *ent = n_array_nth(entries, i);
-        const char *m = ent->message;
 
-        if (strstr(m, "CVE-20") || strstr(m, "CVE-19") || strcasestr(m, "security")) {
+        if (changelog_ent_is_security_fix(ent)) {
             yes = 1;
             break;
         }
@@ -520,6 +526,25 @@ int pkguinf_changelog_with_security_fixes(struct pkguinf *inf, time_t since)
     return yes;
 }
 
+time_t pkguinf_changelog_security_fix_time(struct pkguinf *inf)
+{
+    tn_array *entries;
+    time_t ts = 0;
+    int i;
+
+    if ((entries = get_parsed_changelog(inf, 0)) == NULL)
+        return 0;
+
+    for (i=0; i < n_array_size(entries); i++) {
+        struct changelog_ent *ent = n_array_nth(entries, i);
+
+        if (ent->ts > ts && changelog_ent_is_security_fix(ent))
+            ts = ent->ts;
+    }
+    n_array_free(entries);
+    return ts;
+}
+
 const char *pkguinf_get_changelog(struct pkguinf *inf, time_t since)
 {
     tn_array *entries;
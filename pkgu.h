@@ -45,6 +45,8 @@ EXPORT int pkguinf_set(struct pkguinf *pkgu, int tag, const char *val,
 
 EXPORT const char *pkguinf_get_changelog(struct pkguinf *inf, time_t since);
 EXPORT int pkguinf_changelog_with_security_fixes(struct pkguinf *inf, time_t since);
+/* RET: time of the latest changelog entry with security fix or 0 */
+EXPORT time_t pkguinf_changelog_security_fix_time(struct pkguinf *inf);
 
 EXPORT tn_array *pkguinf_langs(struct pkguinf *pkgu);
 
@@ -90,6 +90,11 @@ struct pm_module {
                                    const char *dbpath, unsigned pkgdir_ldflags,
                                    tn_hash *kw);
     int (*machine_score)(void *modh, int tag, const char *val);
+
+    /* verifies files at once, results[i] is set to result of i-th path;
+       RET: number of successfully verified ones */
+    int (*pkg_verify_signs)(void *modh, const tn_array *paths, unsigned flags,
+                            int *results);
 };
 
 int pm_module_register(const struct pm_module *mod);
@@ -85,6 +85,8 @@ struct pkgdb *pkgdb_open(struct pm_ctx *ctx, const char *rootdir,
     return NULL;
 }
 
+static unsigned last_generation = 0;
+
 int pkgdb_reopen(struct pkgdb *db, mode_t mode)
 {
     if (db->_opened)
@@ -102,6 +104,7 @@ int pkgdb_reopen(struct pkgdb *db, mode_t mode)
 
     db->_opened = 1;
     db->mode = mode;
+    db->_generation = __sync_add_and_fetch(&last_generation, 1);
 
     return 1;
 }
@@ -123,6 +126,7 @@ void pkgdb_close(struct pkgdb *db)
         n_assert(db->_ctx->mod->dbclose);
         db->_ctx->mod->dbclose(db->dbh);
         db->_opened = 0;
+        db->_generation = 0;
     }
 }
 
@@ -325,8 +329,10 @@ int pkgdb_install(struct pkgdb *db, const char *path,
                   const struct poldek_ts *ts)
 {
     n_assert(db->dbh);
-    if (db->_ctx->mod->dbinstall)
+    if (db->_ctx->mod->dbinstall) {
+        db->_generation = __sync_add_and_fetch(&last_generation, 1);
         return db->_ctx->mod->dbinstall(db, path, ts);
+    }
     logn(LOGERR, "%s: dbinstall is not supported", db->_ctx->mod->name);
     return 0;
 }
@@ -367,8 +373,9 @@ int pkgdb_search(struct pkgdb *db, tn_array **dbpkgs,
         /* check for dups as rpmdbIterator returns package twice for double conflicts like
            foo > 1
            foo < 1
+           (not needed while walking through all records)
          */
-        if (dbpkg_array_has(*dbpkgs, dbrec->recno))
+        if (tag != PMTAG_RECNO && dbpkg_array_has(*dbpkgs, dbrec->recno))
             continue;
 
         if ((pkg = load_pkg(NULL, db, dbrec, ldflags))) {
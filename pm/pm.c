@@ -26,6 +26,7 @@
 #include "pm.h"
 #include "mod.h"
 #include "log.h"
+#include "trace.h"
 
 struct pm_ctx *pm_new(const char *name)
 {
@@ -63,12 +64,15 @@ const char *pm_get_name(struct pm_ctx *ctx)
 int pm_pminstall(struct pkgdb *db, const tn_array *pkgs,
                  const tn_array *pkgs_toremove, struct poldek_ts *ts)
 {
+    struct trace_span *span;
     int i, rc;
     char path[PATH_MAX];
 
-
+    span = trace_begin_l("pm.install", pm_get_name(db->_ctx));
     rc = db->_ctx->mod->pm_install(db, pkgs, pkgs_toremove, ts);
-    
+    trace_count(span, "packages", n_array_size(pkgs));
+    trace_end(span);
+
     if (!rc || ts->getop(ts, POLDEK_OP_RPMTEST) ||
         ts->getop(ts, POLDEK_OP_KEEP_DOWNLOADS))
         return rc;
@@ -92,7 +96,14 @@ int pm_pminstall(struct pkgdb *db, const tn_array *pkgs,
 
 int pm_pmuninstall(struct pkgdb *db, const tn_array *pkgs, struct poldek_ts *ts)
 {
-    return db->_ctx->mod->pm_uninstall(db, pkgs, ts);
+    struct trace_span *span = trace_begin_l("pm.uninstall", pm_get_name(db->_ctx));
+    int rc;
+
+    rc = db->_ctx->mod->pm_uninstall(db, pkgs, ts);
+    trace_count(span, "packages", n_array_size(pkgs));
+    trace_end(span);
+
+    return rc;
 }
 
 int pm_verify_signature(struct pm_ctx *ctx, const char *path, unsigned flags)
@@ -102,6 +113,34 @@ int pm_verify_signature(struct pm_ctx *ctx, const char *path, unsigned flags)
     return 1;
 }
 
+int pm_verify_signatures(struct pm_ctx *ctx, const tn_array *paths,
+                         unsigned flags, int *results)
+{
+    struct trace_span *span;
+    int i, nok = 0;
+
+    if (n_array_size(paths) == 0)
+        return 0;
+
+    span = trace_begin_l("pm.verify", pm_get_name(ctx));
+
+    if (ctx->mod->pkg_verify_signs) {
+        nok = ctx->mod->pkg_verify_signs(ctx->modh, paths, flags, results);
+
+    } else {
+        for (i = 0; i < n_array_size(paths); i++) {
+            results[i] = pm_verify_signature(ctx, n_array_nth(paths, i), flags);
+            if (results[i])
+                nok++;
+        }
+    }
+
+    trace_count(span, "files", n_array_size(paths));
+    trace_end(span);
+
+    return nok;
+}
+
 time_t pm_dbmtime(struct pm_ctx *ctx, const char *path) 
 {
     if (ctx->mod->dbmtime)
@@ -51,6 +51,10 @@ EXPORT int pm_pminstall(struct pkgdb *db, const tn_array *pkgs,
 EXPORT int pm_pmuninstall(struct pkgdb *db, const tn_array *pkgs, struct poldek_ts *ts);
 
 EXPORT int pm_verify_signature(struct pm_ctx *ctx, const char *path, unsigned flags);
+/* verifies paths (in parallel if module can), results[i] is non-zero if
+   i-th one is fine; RET: number of successfully verified files */
+EXPORT int pm_verify_signatures(struct pm_ctx *ctx, const tn_array *paths,
+                                unsigned flags, int *results);
 
 struct pm_dbrec;
 typedef int (*pkgdb_filter_fn) (struct pkgdb *db,
@@ -70,6 +74,9 @@ struct pkgdb {
     void            *_filter_arg;
 
     struct pm_ctx *_ctx;
+
+    unsigned _generation;     /* changes on every (re)open and install,
+                                 0 if closed */
 };
 
 EXPORT struct pkgdb *pkgdb_open(struct pm_ctx *ctx, const char *rootdir,
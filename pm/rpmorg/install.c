@@ -17,6 +17,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -75,13 +76,21 @@ static void progress(const unsigned long amount, const unsigned long total)
     }
 }
 
-static void *install_cb(const void *h __attribute__((unused)),
+/* state of batch transaction's notifications */
+struct install_cb_state {
+    int  ninstalled;
+    int  ntotal;
+    int  progress;              /* show progress bar? */
+};
+
+static void *install_cb(const void *h,
                         const enum rpmCallbackType_e op,
                         const rpm_loff_t amount,
                         const rpm_loff_t total,
                         const void *pkgpath,
-                        void *data __attribute__((unused)))
+                        void *data)
 {
+    struct install_cb_state *st = data;
     void *r = NULL;
     static FD_t fd = NULL;
 
@@ -117,11 +126,32 @@ static void *install_cb(const void *h __attribute__((unused)),
             break;
 
         case RPMCALLBACK_INST_START:
+            if (st) {
+                char *nevra = h ? headerGetAsString((Header)h, RPMTAG_NEVRA) : NULL;
+
+                st->ninstalled++;
+                msgn(1, _("[%d/%d] Installing %s..."), st->ninstalled, st->ntotal,
+                     nevra ? nevra : n_basenam(pkgpath));
+                free(nevra);
+
+                if (!st->progress)
+                    break;
+            }
             progress(amount, total);
             break;
 
         case RPMCALLBACK_INST_PROGRESS:
-            progress(amount, total);
+            if (st == NULL || st->progress)
+                progress(amount, total);
+            break;
+
+        case RPMCALLBACK_UNINST_START:
+            if (st && h) {
+                char *nevra = headerGetAsString((Header)h, RPMTAG_NEVRA);
+
+                msgn(1, _("Removing %s..."), nevra);
+                free(nevra);
+            }
             break;
 
         default:
@@ -294,3 +324,146 @@ int pm_rpm_install_package(struct pkgdb *db, const char *path,
     return do_dbinstall(db->dbh, db->rootdir, path,
                         filterflags, transflags, instflags);
 }
+
+/* RET: number of problems */
+static int add_erase_elements(rpmts rts, const tn_array *pkgs)
+{
+    int i, nerr = 0;
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+        rpmdbMatchIterator mi;
+        unsigned int recno = pkg->recno;
+        Header h;
+
+        mi = rpmtsInitIterator(rts, RPMDBI_PACKAGES, &recno, sizeof(recno));
+        if ((h = rpmdbNextIterator(mi)) == NULL) {
+            logn(LOGERR, _("%s: not found in database"), pkg_id(pkg));
+            nerr++;
+
+        } else if (rpmtsAddEraseElement(rts, h, recno) != 0) {
+            logn(LOGERR, "%s: rpmtsAddEraseElement() failed", pkg_id(pkg));
+            nerr++;
+        }
+
+        rpmdbFreeIterator(mi);
+    }
+
+    return nerr;
+}
+
+/*
+  Installs pkgs (hdrs[i] is pkgs[i] header read from paths[i]) and, if
+  upgrading, removes pkgs_toremove in single in-process rpm transaction
+*/
+int pm_rpm_run_transaction(struct pkgdb *db, const tn_array *pkgs,
+                           Header *hdrs, char *const *paths,
+                           const tn_array *pkgs_toremove,
+                           struct poldek_ts *ts)
+{
+    struct install_cb_state st;
+    unsigned filterflags = 0, transflags = 0;
+    rpmts rts = NULL;
+    rpmps probs = NULL;
+    int i, rc, upgrade, nerr = 0;
+
+    (void)db;
+
+    upgrade = poldek_ts_issetf(ts, POLDEK_TS_UPGRADE | POLDEK_TS_REINSTALL |
+                               POLDEK_TS_DOWNGRADE);
+
+    if (ts->getop(ts, POLDEK_OP_RPMTEST))
+        transflags |= RPMTRANS_FLAG_TEST;
+
+    if (ts->getop(ts, POLDEK_OP_JUSTDB))
+        transflags |= RPMTRANS_FLAG_JUSTDB;
+
+    if (ts->getop(ts, POLDEK_OP_FORCE) || poldek_ts_issetf(ts, POLDEK_TS_REINSTALL))
+        filterflags |= RPMPROB_FILTER_REPLACEPKG |
+            RPMPROB_FILTER_REPLACEOLDFILES |
+            RPMPROB_FILTER_REPLACENEWFILES;
+
+    if (ts->getop(ts, POLDEK_OP_FORCE) || poldek_ts_issetf(ts, POLDEK_TS_DOWNGRADE))
+        filterflags |= RPMPROB_FILTER_OLDPACKAGE;
+
+    rts = rpmtsCreate();
+    rpmtsSetRootDir(rts, ts->rootdir ? ts->rootdir : "/");
+    if (rpmtsOpenDB(rts, (transflags & RPMTRANS_FLAG_TEST) ? O_RDONLY : O_RDWR) != 0) {
+        logn(LOGERR, _("could not open rpm database"));
+        rc = -1;
+        goto l_end;
+    }
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        /* headers are already read, rpm does not parse them again */
+        rc = rpmtsAddInstallElement(rts, hdrs[i], paths[i], upgrade, NULL);
+        if (rc == 0)
+            continue;
+
+        if (rc == 1)
+            logn(LOGERR, _("%s: rpm read error"), n_basenam(paths[i]));
+        else if (rc == 2)
+            logn(LOGERR, _("%s requires a newer version of RPM"), n_basenam(paths[i]));
+        else
+            logn(LOGERR, "%s: rpmtsAddInstallElement() failed", n_basenam(paths[i]));
+        nerr++;
+    }
+
+    /* multiple instances are upgraded by separate uninstall, see install3 */
+    if (upgrade && pkgs_toremove)
+        nerr += add_erase_elements(rts, pkgs_toremove);
+
+    if (nerr) {
+        rc = -1;
+        goto l_end;
+    }
+
+    if (!ts->getop(ts, POLDEK_OP_NODEPS)) {
+        if (rpmtsCheck(rts) != 0) {
+            logn(LOGERR, "rpmtsCheck() failed");
+            rc = -1;
+            goto l_end;
+        }
+
+        probs = rpmtsProblems(rts);
+        if (rpmpsNumProblems(probs) > 0) {
+            logn(LOGERR, _("failed dependencies:"));
+            rpmpsPrint(stderr, probs);
+            rc = -1;
+            goto l_end;
+        }
+        probs = rpmpsFree(probs);
+    }
+
+    if (rpmtsOrder(rts) != 0) {
+        logn(LOGERR, "rpmtsOrder() failed");
+        rc = -1;
+        goto l_end;
+    }
+
+    memset(&st, 0, sizeof(st));
+    st.ntotal = n_array_size(pkgs);
+    st.progress = poldek_VERBOSE > 0 && !ts->getop(ts, POLDEK_OP_PROGRESS_NONE);
+
+    rpmtsSetFlags(rts, transflags);
+    rpmtsSetNotifyCallback(rts, install_cb, &st);
+    rc = rpmtsRun(rts, NULL, (rpmprobFilterFlags) filterflags);
+
+    if (rc > 0) {
+        probs = rpmtsProblems(rts);
+        logn(LOGERR, _("installation failed:"));
+        rpmpsPrint(stderr, probs); /* XXX: rpm logging API... */
+
+    } else if (rc < 0) {
+        logn(LOGERR, _("installation failed (retcode=%d)"), rc);
+    }
+
+ l_end:
+    if (probs)
+        rpmpsFree(probs);
+
+    rpmtsCloseDB(rts);
+    rpmtsFree(rts);
+
+    return rc == 0;
+}
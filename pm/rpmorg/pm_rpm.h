@@ -41,6 +41,7 @@
 #include "pm/pm.h"
 
 #define PM_RPM_CMDSETUP_DONE (1 << 0)
+#define PM_RPM_INPROCESS     (1 << 1) /* run transactions in-process */
 struct pm_rpm {
     unsigned flags;
     char *rpm;
@@ -71,6 +72,8 @@ int pm_rpm_packages_uninstall(struct pkgdb *db, const tn_array *pkgs,
 #include <rpm/rpmcli.h>
 
 int pm_rpm_verify_signature(void *pm_rpm, const char *path, unsigned flags);
+int pm_rpm_verify_signatures(void *pm_rpm, const tn_array *paths,
+                             unsigned flags, int *results);
 
 struct rpmorg_db {
     rpmts ts;
@@ -86,6 +89,10 @@ void pm_rpm_closedb(struct rpmorg_db *db);
 int pm_rpm_db_it_init(struct pkgdb_it *it, int tag, const char *arg);
 int pm_rpm_install_package(struct pkgdb *db, const char *path,
                            const struct poldek_ts *ts);
+int pm_rpm_run_transaction(struct pkgdb *db, const tn_array *pkgs,
+                           Header *hdrs, char *const *paths,
+                           const tn_array *pkgs_toremove,
+                           struct poldek_ts *ts);
 
 int pm_rpm_vercmp(const char *one, const char *two);
 
@@ -99,6 +99,7 @@ void *pm_rpm_init(void)
     memset(pm_rpm, 0, sizeof(*pm_rpm));
     pm_rpm->rpm = NULL;
     pm_rpm->sudo = NULL;
+    pm_rpm->flags = PM_RPM_INPROCESS;
 
     char *path = rpmGetPath("%{_dbpath}", NULL);
     if (path && *path == '%') {
@@ -131,6 +132,11 @@ int pm_rpm_configure(void *pm_rpm, const char *key, void *val)
             pm->rpm = n_strdup(val);
         DBGF("%s %s\n", key, (char *)val);
 
+    } else if (n_str_eq(key, "inprocess")) {
+        pm->flags &= ~PM_RPM_INPROCESS;
+        if (val && *(int*)val)
+            pm->flags |= PM_RPM_INPROCESS;
+
     } else if (n_str_eq(key, "sudocmd")) {
         n_cfree(&pm->sudo);
         if (val)
@@ -250,15 +250,12 @@ void pm_rpm_setup_commands(struct pm_rpm *pm)
 }
 
 /* colors equal? there are repository types without color info, so catch them */
-static int colors_eq(const struct pkg *pkg, const char *path)
+static int colors_eq(const struct pkg *pkg, Header h, const char *path)
 {
-    Header h;
     int color = -1;
 
-    if (pm_rpmhdr_loadfile(path, &h)) {
+    if (h)
         color = headerGetNumber(h, RPMTAG_HEADERCOLOR);
-        headerFree(h);
-    }
 
     if (color > 0 && (unsigned)color == pkg->color)
         return 1;
@@ -278,6 +275,72 @@ static int colors_eq(const struct pkg *pkg, const char *path)
 }
 
 
+/* verifies packages at paths[i] grouped by their verification flags;
+   RET: number of failures */
+static int verify_signatures(void *pm, const tn_array *pkgs, char *const *paths)
+{
+    unsigned *flags;
+    int i, j, nerr = 0;
+
+    flags = n_malloc((n_array_size(pkgs) + 1) * sizeof(*flags));
+    for (i=0; i < n_array_size(pkgs); i++)
+        flags[i] = pkg_get_verify_signflags(n_array_nth(pkgs, i));
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        tn_array *vpaths, *vpkgs;
+        unsigned vrfyflags = flags[i];
+        int *results;
+
+        if (vrfyflags == 0)     /* not to be verified or done already */
+            continue;
+
+        vpaths = n_array_new(16, NULL, NULL);
+        vpkgs = n_array_new(16, NULL, NULL);
+
+        for (j=i; j < n_array_size(pkgs); j++) {
+            if (flags[j] == vrfyflags) {
+                n_array_push(vpaths, paths[j]);
+                n_array_push(vpkgs, n_array_nth(pkgs, j));
+                flags[j] = 0;
+            }
+        }
+
+        results = n_malloc(n_array_size(vpaths) * sizeof(*results));
+        pm_rpm_verify_signatures(pm, vpaths, vrfyflags, results);
+
+        for (j=0; j < n_array_size(vpaths); j++) {
+            if (!results[j]) {
+                logn(LOGERR, _("%s: signature verification failed"),
+                     pkg_snprintf_s(n_array_nth(vpkgs, j)));
+                nerr++;
+            }
+        }
+
+        free(results);
+        n_array_free(vpaths);
+        n_array_free(vpkgs);
+    }
+
+    free(flags);
+    return nerr;
+}
+
+/* transaction could be run by us instead of rpm binary? */
+static int can_run_inprocess(struct pm_rpm *pm, struct poldek_ts *ts)
+{
+    if ((pm->flags & PM_RPM_INPROCESS) == 0)
+        return 0;
+
+    if (ts->rpmopts && n_array_size(ts->rpmopts)) /* rpm's options */
+        return 0;
+
+    /* sudo is needed or rpm should complain itself */
+    if (getuid() != 0 && !ts->getop(ts, POLDEK_OP_RPMTEST))
+        return 0;
+
+    return 1;
+}
+
 int pm_rpm_packages_install(struct pkgdb *db, const tn_array *pkgs,
                             const tn_array *pkgs_toremove,
                             struct poldek_ts *ts)
@@ -285,10 +348,9 @@ int pm_rpm_packages_install(struct pkgdb *db, const tn_array *pkgs,
     struct pm_rpm *pm = db->_ctx->modh;
     char **argv;
     char *cmd;
+    Header *hdrs = NULL;
     int i, nargs, nopts = 0, ec, nsignerr = 0, ncolorerr = 0;
-    int nverbose = poldek_VERBOSE;
-
-    pkgs_toremove = pkgs_toremove;
+    int nverbose = poldek_VERBOSE, inprocess, rc = 0;
 
     pm_rpm_setup_commands(pm);
     if (pm->rpm == NULL) {
@@ -391,12 +453,16 @@ int pm_rpm_packages_install(struct pkgdb *db, const tn_array *pkgs,
             argv[nargs++] = n_array_nth(ts->rpmopts, i);
 
 
+    inprocess = can_run_inprocess(pm, ts);
+    if (inprocess)
+        hdrs = n_calloc(n_array_size(pkgs), sizeof(*hdrs));
+
     nsignerr = 0;
     nopts = nargs;
     for (i=0; i < n_array_size(pkgs); i++) {
         char path[PATH_MAX], *s, name[1024], *pkgpath;
-        unsigned vrfyflags;
         struct pkg *pkg;
+        Header h = NULL;
         int len;
 
         pkg = n_array_nth(pkgs, i);
@@ -414,23 +480,29 @@ int pm_rpm_packages_install(struct pkgdb *db, const tn_array *pkgs,
                              buf, n_basenam(name));
         }
 
-        if ((vrfyflags = pkg_get_verify_signflags(pkg))) {
-            if (!pm_rpm_verify_signature(pm, path, vrfyflags)) {
-                logn(LOGERR, _("%s: signature verification failed"),
-                     pkg_snprintf_s(pkg));
-                nsignerr++;
-            }
+        /* header is read once, for coloring check and transaction */
+        if ((inprocess || ts->getop(ts, POLDEK_OP_MULTILIB)) &&
+            !pm_rpmhdr_loadfile(path, &h) && inprocess) {
+            logn(LOGERR, _("%s: read header failed"), n_basenam(path));
+            goto l_err_end;
         }
 
-        if (ts->getop(ts, POLDEK_OP_MULTILIB) && !colors_eq(pkg, path))
+        if (ts->getop(ts, POLDEK_OP_MULTILIB) && !colors_eq(pkg, h, path))
             ncolorerr++;
 
+        if (inprocess)
+            hdrs[i] = h;
+        else if (h)
+            headerFree(h);
+
         s = alloca(len + 1);
         memcpy(s, path, len);
         s[len] = '\0';
         argv[nargs++] = s;
     }
 
+    /* all at once, in parallel */
+    nsignerr = verify_signatures(pm, pkgs, &argv[nopts]);
 
     if (!ts->getop(ts, POLDEK_OP_RPMTEST) && (nsignerr || ncolorerr)) {
         int can_ask = poldek_ts_is_interactive_on(ts);
@@ -454,6 +526,12 @@ int pm_rpm_packages_install(struct pkgdb *db, const tn_array *pkgs,
     n_assert(nargs > nopts);
     argv[nargs] = NULL;
 
+    if (inprocess) {
+        rc = pm_rpm_run_transaction(db, pkgs, hdrs, &argv[nopts],
+                                    pkgs_toremove, ts);
+        goto l_end;
+    }
+
     if (poldek_VERBOSE) {
         char buf[8192], *p;
         p = buf;
@@ -474,7 +552,17 @@ int pm_rpm_packages_install(struct pkgdb *db, const tn_array *pkgs,
     return ec == 0;
 
  l_err_end:
-    return 0;
+    rc = 0;
+
+ l_end:
+    if (hdrs) {
+        for (i=0; i < n_array_size(pkgs); i++)
+            if (hdrs[i])
+                headerFree(hdrs[i]);
+        free(hdrs);
+    }
+
+    return rc;
 }
 
 int pm_rpm_packages_uninstall(struct pkgdb *db, const tn_array *pkgs,
@@ -23,6 +23,7 @@
 #include <fcntl.h>
 
 #include <rpm/rpmlog.h>
+#include <rpm/rpmkeyring.h>
 
 #include <trurl/nassert.h>
 #include <trurl/narray.h>
@@ -37,6 +38,8 @@
 #include "capreq.h"
 #include "pkgmisc.h"
 #include "pm_rpm.h"
+#include "sigint/sigint.h"
+#include "thread.h"
 
 /* missing rpm prototypes */
 extern rpmRC rpmLeadRead(FD_t fd, char **emsg);
@@ -125,11 +128,12 @@ static int rpm_signatures(const char *path, unsigned *signature_flags, FD_t *fd)
     return 1;
 }
 
-static int do_verify_signature(const char *path, unsigned flags)
+/* ts is reused by batch verification, if NULL temporary one is created */
+static int do_verify_signature(rpmts ts, const char *path, unsigned flags)
 {
     unsigned                  presented_signs = 0;
     struct rpmQVKArguments_s  qva; /* poor RPM API... */
-    rpmts                     ts;
+    rpmts                     ownts = NULL;
     FD_t                      fdt = NULL;
     int                       rc;
 
@@ -172,7 +176,9 @@ static int do_verify_signature(const char *path, unsigned flags)
     fdt = Fopen(path, "r.ufdio");
 
     if (fdt != NULL && Ferror(fdt) == 0) {
-        ts = rpmtsCreate();
+        if (ts == NULL)
+            ts = ownts = rpmtsCreate();
+
         rpmtsSetVfyFlags(ts, vfyflags);
 	if ((flags & (PKGVERIFY_PGP | PKGVERIFY_GPG)) == 0) {
 	    int vfylevel = rpmtsVfyLevel(ts);
@@ -180,7 +186,8 @@ static int do_verify_signature(const char *path, unsigned flags)
 	    rpmtsSetVfyLevel(ts, vfylevel);
 	}
         rc = rpmVerifySignatures(&qva, ts, fdt, n_basenam(path));
-        rpmtsFree(ts);
+        if (ownts)
+            rpmtsFree(ownts);
 
         DBGF("rpmVerifySignatures[md=%d, sign=%d] %s %s\n",
              flags & PKGVERIFY_MD ? 1:0, flags & (PKGVERIFY_GPG | PKGVERIFY_PGP) ? 1:0,
@@ -194,15 +201,14 @@ static int do_verify_signature(const char *path, unsigned flags)
 }
 
 static
-int do_pm_rpm_verify_signature(void *pm_rpm, const char *path, unsigned flags)
+int do_pm_rpm_verify_signature(rpmts ts, const char *path, unsigned flags)
 {
-    (void)pm_rpm;
     if (access(path, R_OK) != 0) {
         logn(LOGERR, "%s: verify signature failed: %m", path);
         return 0;
     }
 
-    return do_verify_signature(path, flags);
+    return do_verify_signature(ts, path, flags);
 }
 
 extern int pm_rpm_verbose;
@@ -213,9 +219,88 @@ int pm_rpm_verify_signature(void *pm_rpm, const char *path, unsigned flags)
     pm_rpm_verbose = 1;
     v = poldek_set_verbose(pm_rpm_verbose);
 
-    rc = do_pm_rpm_verify_signature(pm_rpm, path, flags);
+    (void)pm_rpm;
+    rc = do_pm_rpm_verify_signature(NULL, path, flags);
 
     pm_rpm_verbose = rv;
     poldek_set_verbose(v);
     return rc;
 }
+
+struct verify_job {
+    const tn_array  *paths;
+    unsigned        flags;
+    int             *results;
+    int             next;        /* next path to take */
+    int             interrupted;
+};
+
+#ifdef ENABLE_THREADS
+static pthread_mutex_t keyring_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void verify_worker(void *data, int worker_no, int nworkers)
+{
+    struct verify_job *job = data;
+    int n = n_array_size(job->paths);
+    rpmts ts;
+
+    (void)worker_no;
+    (void)nworkers;
+
+    /* own ts and keyring per worker */
+    ts = rpmtsCreate();
+    if (job->flags & (PKGVERIFY_GPG | PKGVERIFY_PGP)) {
+        mutex_lock(&keyring_mutex); /* keys are read from rpmdb */
+        rpmKeyringFree(rpmtsGetKeyring(ts, 1));
+        mutex_unlock(&keyring_mutex);
+    }
+
+    while (!__atomic_load_n(&job->interrupted, __ATOMIC_RELAXED)) {
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+
+        if (i >= n)
+            break;
+
+        job->results[i] = do_pm_rpm_verify_signature(ts, n_array_nth(job->paths, i),
+                                                     job->flags);
+        if (sigint_reached()) {
+            __atomic_store_n(&job->interrupted, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    rpmtsFree(ts);
+}
+
+int pm_rpm_verify_signatures(void *pm_rpm, const tn_array *paths,
+                             unsigned flags, int *results)
+{
+    struct verify_job job;
+    int v, rv = pm_rpm_verbose, i, nok = 0;
+
+    (void)pm_rpm;
+
+    memset(&job, 0, sizeof(job));
+    job.paths = paths;
+    job.flags = flags;
+    job.results = results;
+
+    for (i = 0; i < n_array_size(paths); i++)
+        results[i] = 0;         /* not verified if interrupted */
+
+    pm_rpm_verbose = 1;
+    v = poldek_set_verbose(pm_rpm_verbose);
+
+    poldek_run_workers(poldek_nworkers(n_array_size(paths), 4),
+                       verify_worker, &job);
+
+    pm_rpm_verbose = rv;
+    poldek_set_verbose(v);
+
+    for (i = 0; i < n_array_size(paths); i++)
+        if (results[i])
+            nok++;
+
+    return nok;
+}
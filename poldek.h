@@ -61,6 +61,7 @@ EXPORT struct poldek_ctx *poldek_link(struct poldek_ctx *ctx);
 #define POLDEK_CONF_CHOOSEEQUIV_CB     25
 #define POLDEK_CONF_CHOOSESUGGESTS_CB  26
 #define POLDEK_CONF_VFILEPROGRESS      27
+#define POLDEK_CONF_TRACEFILE          28
 
 EXPORT int poldek_configure(struct poldek_ctx *ctx, int param, ...);
 
@@ -74,6 +75,12 @@ EXPORT int poldek_setup(struct poldek_ctx *ctx);
 
 EXPORT int poldek_load_sources(struct poldek_ctx *ctx);
 
+/* reload available packages if any of loaded indexes has been changed
+   since load (i.e. updated by another poldek process); returns 1 if
+   packages were reloaded, 0 if it is not needed and -1 on error */
+#define POLDEK_RELOAD_FORCE (1 << 0)
+EXPORT int poldek_reload_sources(struct poldek_ctx *ctx, unsigned flags);
+
 EXPORT tn_array *poldek_load_stubs(struct poldek_ctx *ctx);
 
 /* need to be called manually if POLDEK_CONF_LAZY_DEPPROCESS is set */
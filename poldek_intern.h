@@ -13,6 +13,7 @@
 #ifndef POLDEK_INTERNAL_H
 #define POLDEK_INTERNAL_H
 
+#include <time.h>
 #include <trurl/narray.h>
 #include <trurl/nhash.h>
 
@@ -36,6 +37,7 @@ struct poldek_ctx {
     struct poldek_ts *ts;       /* main, internal ts */
 
     struct pkgset    *ps;
+    time_t           _ps_mtime;    /* the newest index mtime at ps load */
     struct pm_ctx    *pmctx;       /* package manager context */
     int              _rpm_tscolor; /* rpm transaction color */
     int              _depsolver;
@@ -98,6 +100,9 @@ int poldek__choose_suggests(const struct poldek_ts *ts,
                             tn_array *choices, int hint);
 
 void poldek__setup_default_ask_callbacks(struct poldek_ctx *ctx);
-int poldek__load_sources_internal(struct poldek_ctx *ctx);
+int poldek__load_sources_internal(struct poldek_ctx *ctx, const tn_array *names);
+int poldek__load_sources_closure(struct poldek_ctx *ctx, const tn_array *names);
+time_t poldek__pkgdirs_mtime(const tn_array *pkgdirs);
+int poldek__pkgdirs_partial(const tn_array *pkgdirs);
 
 #endif
@@ -250,6 +250,8 @@ static int poldek_ts_init(struct poldek_ts *ts, struct poldek_ctx *ctx)
     }
     ts->_na = n_alloc_new(4, TN_ALLOC_OBSTACK);
     ts->db = NULL;
+    ts->_dbsnap = NULL;
+    ts->_dbsnap_free = NULL;
 
     if (ctx) {  /* copy configuration from ctx's ts */
         cp_str(&ts->rootdir, ctx->ts->rootdir);
@@ -303,6 +305,10 @@ static void poldek_ts_destroy(struct poldek_ts *ts)
 
     ts->db = NULL;
 
+    if (ts->_dbsnap && ts->_dbsnap_free)
+        ts->_dbsnap_free(ts->_dbsnap);
+    ts->_dbsnap = NULL;
+
     if (ts->aps)
         arg_packages_free(ts->aps);
 
@@ -854,6 +860,25 @@ static int load_sources(struct poldek_ctx *ctx)
     return poldek_load_sources(ctx);
 }
 
+/* with load_closure only packages reachable from arguments are loaded,
+   if arguments are plain names */
+static int load_sources_closure(struct poldek_ts *ts)
+{
+    tn_array *names = NULL;
+    int rc;
+
+    if (ts->getop(ts, POLDEK_OP_LDCLOSURE))
+        names = arg_packages__get_names(ts->aps);
+
+    if (names == NULL)
+        return load_sources(ts->ctx);
+
+    rc = poldek__load_sources_closure(ts->ctx, names);
+    n_array_free(names);
+
+    return rc;
+}
+
 static int ts_run_install_dist(struct poldek_ts *ts)
 {
     if (!load_sources(ts->ctx)) {
@@ -906,7 +931,7 @@ static int ts_run_install(struct poldek_ts *ts)
     if (poldek_ts_issetf_all(ts, POLDEK_TS_INSTALLDIST))
         return ts_run_install_dist(ts);
 
-    if (!load_sources(ts->ctx)) {
+    if (!load_sources_closure(ts)) {
         return 0;
     }
 
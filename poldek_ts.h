@@ -107,6 +107,11 @@ enum poldek_ts_opt {
 
     POLDEK_OP_PROGRESS_NONE,  /* --noprogress */
 
+    /* new ones go here, not to renumber ones above */
+    POLDEK_OP_LDCLOSURE,         /* load_closure = yes */
+    POLDEK_OP_SPECULATE,         /* speculative choices = yes */
+    POLDEK_OP_LDFLIMAGE,         /* shared file lists = yes */
+
     POLDEK_OP___MAXOP,
 };
 
@@ -117,6 +122,7 @@ struct source;
 struct arg_packages;
 struct pkgmark_set;
 struct pkg;
+struct i3_dbsnap;
 
 #ifndef SWIG
 struct poldek_ts {
@@ -162,6 +168,9 @@ struct poldek_ts {
                                     by ts->setop(POLDEK_OP_GREEDY, v)
                                   */
 
+    /* internal ones, appended to keep offsets of fields above */
+    struct i3_dbsnap   *_dbsnap;   /* installed packages, see install3/dbsnap.c */
+    void               (*_dbsnap_free)(struct i3_dbsnap *); /* set by its owner */
 };
 #endif
 EXPORT struct poldek_ts *poldek_ts_new(struct poldek_ctx *ctx, unsigned flags);
@@ -14,6 +14,7 @@
 #include "cli/poclidek.h"
 #include "log.h"
 #include "vfile/vfile.h" /* for vf_progress */
+#include "pkgcols.h"
 
 static void PythonDoLog(void *data, int pri, const char *message);
 static int PythonConfirm(void *data, const struct poldek_ts *ts,
@@ -29,6 +30,7 @@ static int PythonChooseSuggests(void *data, const struct poldek_ts *ts,
                                 tn_array *choices, int hint);
 
 static struct vf_progress vfPyProgress;
+static PyTypeObject PkgColumn_Type;
 %}
 
 %include exception.i
@@ -270,6 +272,114 @@ static int PythonChooseSuggests(void *data, const struct poldek_ts *ts,
 
 %}
 
+%{
+/* read-only buffer of one pkgcols' column, keeps whole pkgcols alive */
+typedef struct {
+    PyObject_HEAD
+    PyObject             *owner;  /* capsule of struct pkgcols */
+    const struct pkgcol  *col;
+    Py_ssize_t           shape;
+} PkgColumn;
+
+static int PkgColumn_getbuffer(PyObject *obj, Py_buffer *view, int flags)
+{
+    PkgColumn *self = (PkgColumn *) obj;
+    const struct pkgcol *col = self->col;
+
+    if (PyBuffer_FillInfo(view, obj, (void *) col->data,
+                          col->nitems * col->itemsize, 1, flags) < 0)
+        return -1;
+
+    view->itemsize = col->itemsize;
+    if (flags & PyBUF_FORMAT)
+        view->format = (char *) col->format;
+
+    if (flags & PyBUF_ND) {
+        view->ndim = 1;
+        view->shape = &self->shape;
+    }
+
+    return 0;
+}
+
+static void PkgColumn_dealloc(PyObject *obj)
+{
+    Py_XDECREF(((PkgColumn *) obj)->owner);
+    PyObject_Del(obj);
+}
+
+static PyBufferProcs PkgColumn_as_buffer;
+
+static PyTypeObject PkgColumn_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "poldekmod.pkgcolumn",      /* tp_name */
+    sizeof(PkgColumn),          /* tp_basicsize */
+};
+
+static void pkgcols_capsule_free(PyObject *capsule)
+{
+    pkgcols_free(PyCapsule_GetPointer(capsule, "poldek.pkgcols"));
+}
+
+/*
+  Columns of pkgs' data (see pkgcols.h) as dict of name => object
+  supporting buffer protocol, i.e. memoryview(cols['size']) or
+  numpy.frombuffer() read them without copying.
+*/
+static PyObject *pkgs_columns(tn_array *pkgs)
+{
+    struct pkgcols *cols;
+    PyObject *capsule, *dict;
+    int i;
+
+    if (pkgs == NULL) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    cols = pkgcols_new(pkgs);
+    if ((capsule = PyCapsule_New(cols, "poldek.pkgcols", pkgcols_capsule_free)) == NULL) {
+        pkgcols_free(cols);
+        return NULL;
+    }
+
+    dict = PyDict_New();
+    for (i = 0; dict && i < pkgcols_size(cols); i++) {
+        const struct pkgcol *col = pkgcols_nth(cols, i);
+        PkgColumn *pycol;
+
+        if ((pycol = PyObject_New(PkgColumn, &PkgColumn_Type)) == NULL) {
+            Py_CLEAR(dict);
+            break;
+        }
+
+        Py_INCREF(capsule);
+        pycol->owner = capsule;
+        pycol->col = col;
+        pycol->shape = col->nitems;
+
+        PyDict_SetItemString(dict, col->name, (PyObject *) pycol);
+        Py_DECREF(pycol);
+    }
+
+    Py_DECREF(capsule);
+    return dict;
+}
+%}
+
+%init %{
+    PkgColumn_as_buffer.bf_getbuffer = PkgColumn_getbuffer;
+    PkgColumn_Type.tp_as_buffer = &PkgColumn_as_buffer;
+    PkgColumn_Type.tp_dealloc = PkgColumn_dealloc;
+    PkgColumn_Type.tp_flags = Py_TPFLAGS_DEFAULT;
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+    PkgColumn_Type.tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+#endif
+    PyType_Ready(&PkgColumn_Type);
+%}
+
+PyObject *pkgs_columns(tn_array *pkgs);
+
 %extend capreq {
     capreq(void *ptr) { return ptr; } /* conv constructor */
     capreq(const char *name, int32_t epoch,
@@ -426,6 +536,7 @@ static int PythonChooseSuggests(void *data, const struct poldek_ts *ts,
     }
     pkgdir(void *pkgdir) { return pkgdir; };
     tn_array *get_packages() { return self->pkgs; }
+    PyObject *columns() { return pkgs_columns(self->pkgs); }
 
     char *__str__() { // TODO: move it to C codebase
         char *id = NULL;
@@ -521,6 +632,15 @@ static int PythonChooseSuggests(void *data, const struct poldek_ts *ts,
     int configure(int param, unsigned val) { poldek_configure(self, param, val); }
     int configure(int param, char *val) { poldek_configure(self, param, val); }
 
+    PyObject *columns() {
+        tn_array *pkgs = poldek_get_avail_packages(self);
+        PyObject *cols = pkgs_columns(pkgs);
+
+        if (pkgs)
+            n_array_free(pkgs);
+        return cols;
+    }
+
     struct poldek_ts *ts_new(unsigned flags) { return poldek_ts_new(self, flags); }
     struct poldek_ts *ts_new() { return poldek_ts_new(self, 0); }
     int set_verbose(int v) { return poldek_set_verbose(v); }
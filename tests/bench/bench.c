@@ -0,0 +1,514 @@
+/*
+  Offline benchmark of poldek's core stages.
+
+  A synthetic pndir repository of given size is generated (once per size
+  and seed, reused afterwards), then the following stages are timed:
+  index loading, capability and requirement indexing, requirement
+  matching, install ordering, file conflict detection and install3
+  resolution of a set of "top" packages.
+
+  Results are printed to stdout as tab separated lines:
+    stage  packages  items  seconds  maxrss_kb
+  Lines starting with '#' are comments.
+
+  $ ./poldek-bench -n 50000
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <trurl/trurl.h>
+
+#include "i18n.h"
+#include "log.h"
+#include "poldek.h"
+#include "poldek_ts.h"
+#include "pkg.h"
+#include "pkgfl.h"
+#include "capreq.h"
+#include "pkgset.h"
+#include "fileindex.h"
+#include "pkgdir/pkgdir.h"
+#include "pkgdir/pkgdir_intern.h"
+#include "pkgdir/source.h"
+
+#define BENCH_IDXTYPE  "pndir"
+
+struct bench {
+    int          npkgs;
+    unsigned     seed;
+    int          ntop;          /* packages to install in i3 stage */
+    char         dir[PATH_MAX];
+    char         idxpath[PATH_MAX];
+};
+
+/* xorshift32; deterministic across platforms */
+static uint32_t rnd_state;
+
+static uint32_t rnd(void)
+{
+    uint32_t x = rnd_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rnd_state = x;
+}
+
+static double rnd_unit(void)
+{
+    return (double)rnd() / UINT32_MAX;
+}
+
+/* index of a dependency of package i; biased towards low indexes, so
+   there are few "base" packages required by almost everything */
+static int rnd_dep(int i)
+{
+    double u = rnd_unit();
+    return (int)(i * u * u * u);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long maxrss(void)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0;
+
+    return ru.ru_maxrss;
+}
+
+static void report(const char *stage, int npkgs, int items, double t0)
+{
+    printf("%s\t%d\t%d\t%.6f\t%ld\n", stage, npkgs, items, now() - t0, maxrss());
+    fflush(stdout);
+}
+
+/* synthetic package properties */
+#define has_lib(i)      ((i) % 3 == 0)
+#define has_bin(i)      ((i) % 2 == 0)
+#define has_vcap(i)     ((i) % 50 == 0)
+#define has_sharedf(i)  ((i) % 100 == 7)
+
+static int nvcaps(int npkgs)
+{
+    return npkgs / 500 + 1;
+}
+
+static void add_capreq(tn_array *arr, tn_alloc *na, const char *name,
+                       const char *ver, int32_t relflags, int32_t flags)
+{
+    struct capreq *cr;
+
+    if (capreq_arr_find(arr, name) >= 0)
+        return;
+
+    if ((cr = capreq_new(na, name, 0, ver, ver ? "1" : NULL, relflags, flags)))
+        n_array_push(arr, cr);
+}
+
+static struct pkgfl_ent *add_dir(tn_alloc *na, struct pkgfl_ent **ents,
+                                 int *nents, const char *dirname, int nfiles)
+{
+    char buf[PATH_MAX];
+    int n;
+
+    n = n_snprintf(buf, sizeof(buf), "%s", dirname);
+    ents[*nents] = pkgfl_ent_new(na, buf, n, nfiles);
+    return ents[(*nents)++];
+}
+
+static void add_file(tn_alloc *na, struct pkgfl_ent *ent, const char *basename,
+                     uint32_t size, uint16_t mode)
+{
+    ent->files[ent->items++] = flfile_new(na, size, mode, basename,
+                                          strlen(basename), NULL, 0);
+}
+
+static void gen_filelist(tn_alloc *na, struct pkg *pkg, int i, int npkgs)
+{
+    struct pkgfl_ent *ents[8], *ent;
+    char name[PATH_MAX];
+    int nents = 0, nfiles, j;
+    tn_tuple *fl;
+
+    n_snprintf(name, sizeof(name), "usr/share/%s", pkg->name);
+    nfiles = 3 + rnd() % 28;
+    ent = add_dir(na, ents, &nents, name, nfiles);
+    for (j=0; j < nfiles; j++) {
+        n_snprintf(name, sizeof(name), "file%d", j);
+        add_file(na, ent, name, rnd() % 65536, S_IFREG | 0644);
+    }
+
+    ent = add_dir(na, ents, &nents, "usr/share", 1);
+    add_file(na, ent, pkg->name, 0, S_IFDIR | 0755);
+
+    if (has_bin(i)) {
+        ent = add_dir(na, ents, &nents, "usr/bin", 1);
+        add_file(na, ent, pkg->name, rnd() % 262144, S_IFREG | 0755);
+    }
+
+    if (has_lib(i)) {
+        n_snprintf(name, sizeof(name), "lib%s.so.1", pkg->name);
+        ent = add_dir(na, ents, &nents, "usr/lib", 1);
+        add_file(na, ent, name, rnd() % 1048576, S_IFREG | 0755);
+    }
+
+    if (has_sharedf(i)) {       /* a few packages per conflicted path */
+        n_snprintf(name, sizeof(name), "shared%d.conf",
+                   (i / 100) % (npkgs / 400 + 1));
+        ent = add_dir(na, ents, &nents, "etc/bench", 1);
+        add_file(na, ent, name, i, S_IFREG | 0644);
+    }
+
+    fl = n_tuple_new(na, nents, NULL);
+    for (j=0; j < nents; j++) {
+        qsort(&ents[j]->files, ents[j]->items, sizeof(struct flfile*),
+              (int (*)(const void *, const void *))flfile_cmp_qsort);
+        n_tuple_set_nth(fl, j, ents[j]);
+    }
+    n_tuple_sort_ex(fl, (tn_fn_cmp)pkgfl_ent_cmp);
+    pkg->fl = fl;
+}
+
+static struct pkg *gen_package(tn_alloc *na, int i, int npkgs)
+{
+    char name[64], cap[128], ver[16];
+    struct pkg *pkg;
+    int j, nreqs;
+
+    n_snprintf(name, sizeof(name), "pkg%06d", i);
+    n_snprintf(ver, sizeof(ver), "1.%d", i % 10);
+
+    pkg = pkg_new_ext(na, name, 0, ver, "1", "x86_64", "linux",
+                      NULL, NULL, 1024 + rnd() % 1048576, 4096 + rnd() % 4194304,
+                      1700000000 + i);
+
+    pkg->caps = capreq_arr_new(4);
+    if (has_lib(i)) {
+        n_snprintf(cap, sizeof(cap), "lib%s.so.1()(64bit)", name);
+        add_capreq(pkg->caps, na, cap, NULL, 0, 0);
+    }
+
+    if (has_vcap(i)) {
+        n_snprintf(cap, sizeof(cap), "vcap%d", (i / 50) % nvcaps(npkgs));
+        add_capreq(pkg->caps, na, cap, NULL, 0, 0);
+    }
+
+    pkg->reqs = capreq_arr_new(8);
+    add_capreq(pkg->reqs, na, "rpmlib(PayloadFilesHavePrefix)", "4.0",
+               REL_EQ | REL_LT, CAPREQ_RPMLIB);
+
+    nreqs = i > 0 ? rnd() % 8 : 0;
+    for (j=0; j < nreqs; j++) {
+        int dep = rnd_dep(i), kind = rnd() % 10;
+
+        if (rnd() % 100 < 2)   /* backward edge, makes loops */
+            dep = i + 1 + rnd() % 16;
+
+        if (dep >= npkgs || dep == i)
+            continue;
+
+        if (kind < 5 && has_lib(dep)) {
+            n_snprintf(cap, sizeof(cap), "libpkg%06d.so.1()(64bit)", dep);
+            add_capreq(pkg->reqs, na, cap, NULL, 0, 0);
+
+        } else if (kind == 8 && has_bin(dep)) {
+            n_snprintf(cap, sizeof(cap), "/usr/bin/pkg%06d", dep);
+            add_capreq(pkg->reqs, na, cap, NULL, 0, 0);
+
+        } else if (kind == 9) {
+            n_snprintf(cap, sizeof(cap), "vcap%d", rnd() % nvcaps(npkgs));
+            add_capreq(pkg->reqs, na, cap, NULL, 0, 0);
+
+        } else {
+            n_snprintf(cap, sizeof(cap), "pkg%06d", dep);
+            add_capreq(pkg->reqs, na, cap, "1.0", REL_EQ | REL_GT, 0);
+        }
+    }
+
+    if (rnd() % 100 == 0 && i + 1 < npkgs) {
+        pkg->cnfls = capreq_arr_new(2);
+        n_snprintf(cap, sizeof(cap), "pkg%06d", i + 1);
+        add_capreq(pkg->cnfls, na, cap, "1.0", REL_LT, 0);
+    }
+
+    if (rnd() % 200 == 0) {
+        if (pkg->cnfls == NULL)
+            pkg->cnfls = capreq_arr_new(2);
+        n_snprintf(cap, sizeof(cap), "old%s", name);
+        add_capreq(pkg->cnfls, na, cap, NULL, 0, CAPREQ_OBCNFL);
+    }
+
+    n_array_sort(pkg->caps);
+    n_array_sort(pkg->reqs);
+    if (pkg->cnfls)
+        n_array_sort(pkg->cnfls);
+
+    gen_filelist(na, pkg, i, npkgs);
+    return pkg;
+}
+
+static int generate(struct bench *b)
+{
+    struct pkgdir *pkgdir;
+    int i, rc;
+
+    rnd_state = b->seed ? b->seed : 1;
+
+    pkgdir = pkgdir_malloc();
+    pkgdir->type = "synthetic";  /* just reference, saved as BENCH_IDXTYPE */
+    pkgdir->name = n_strdup("synthetic");
+    pkgdir->path = n_strdup(b->dir);
+    pkgdir->idxpath = n_strdup(b->idxpath);
+    pkgdir->pkgs = pkgs_array_new(b->npkgs);
+    pkgdir->avlangs_h = pkgdir__avlangs_new();
+    pkgdir->flags = PKGDIR_UNIQED;
+    pkgdir->ts = time(NULL);
+
+    for (i=0; i < b->npkgs; i++) {
+        struct pkg *pkg = gen_package(pkgdir->na, i, b->npkgs);
+        pkg->pkgdir = pkgdir;
+        n_array_push(pkgdir->pkgs, pkg);
+    }
+
+    n_array_sort(pkgdir->pkgs);
+    pkgdir__setup_depdirs(pkgdir);
+
+    rc = pkgdir_save_as(pkgdir, BENCH_IDXTYPE, b->idxpath,
+                        PKGDIR_CREAT_NOPATCH | PKGDIR_CREAT_NODESC |
+                        PKGDIR_CREAT_NOUNIQ);
+    pkgdir_free(pkgdir);
+    return rc;
+}
+
+static int bench_match(struct pkgset *ps, int *nunmatched)
+{
+    tn_array *matches = NULL;
+    int i, j, nreqs = 0;
+
+    *nunmatched = 0;
+    for (i=0; i < n_array_size(ps->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(ps->pkgs, i);
+
+        if (pkg->reqs == NULL)
+            continue;
+
+        for (j=0; j < n_array_size(pkg->reqs); j++) {
+            struct capreq *req = n_array_nth(pkg->reqs, j);
+
+            if (capreq_is_rpmlib(req))
+                continue;
+
+            if (!pkgset_find_match_packages(ps, pkg, req, &matches, false))
+                (*nunmatched)++;
+
+            if (matches)
+                n_array_clean(matches);
+            nreqs++;
+        }
+    }
+
+    n_array_cfree(&matches);
+    return nreqs;
+}
+
+static int bench_pkgset(struct bench *b)
+{
+    struct pkgdir *pkgdir;
+    struct pkgset *ps;
+    tn_array *ordered = NULL;
+    int n, nunmatched, verbose;
+    double t0;
+
+    t0 = now();
+    pkgdir = pkgdir_open(b->dir, NULL, BENCH_IDXTYPE, "synthetic");
+    if (pkgdir == NULL || !pkgdir_load(pkgdir, NULL, PKGDIR_LD_FULLFLIST)) {
+        logn(LOGERR, "%s: load failed", b->idxpath);
+        if (pkgdir)
+            pkgdir_free(pkgdir);
+        return 0;
+    }
+    n = n_array_size(pkgdir->pkgs);
+    report("pkgdir_load", n, n, t0);
+
+    ps = pkgset_new(NULL);
+    pkgset_add_pkgdir(ps, pkgdir);
+    n_array_sort(ps->pkgs);
+
+    t0 = now();
+    pkgset__index_caps(ps);
+    report("index_caps", n, n, t0);
+
+    t0 = now();
+    pkgset__index_reqs(ps);
+    report("index_reqs", n, n, t0);
+
+    t0 = now();
+    report("find_match_packages", n, bench_match(ps, &nunmatched), t0);
+    if (nunmatched)
+        printf("# %d requirements unmatched\n", nunmatched);
+
+    verbose = poldek_set_verbose(-1);
+
+    t0 = now();
+    pkgset_order(ps, ps->pkgs, &ordered, PKGORDER_INSTALL);
+    report("pkgset_order", n, ordered ? n_array_size(ordered) : 0, t0);
+    n_array_cfree(&ordered);
+
+    t0 = now();
+    report("file_conflicts", n,
+           file_index_report_conflicts(ps->file_idx, NULL), t0);
+
+    poldek_set_verbose(verbose);
+    pkgset_free(ps);
+    return 1;
+}
+
+/* install resolution of top (rarely required) packages against
+   an empty destination, test mode */
+static int bench_install(struct bench *b)
+{
+    struct poldek_ctx *ctx;
+    struct poldek_ts *ts;
+    char path[PATH_MAX], name[64];
+    int i, n, verbose, rc = 0;
+    double t0;
+
+    ctx = poldek_new(0);
+    poldek_load_config(ctx, NULL, NULL, POLDEK_LOADCONF_NOCONF);
+
+    n_snprintf(path, sizeof(path), "%s/cache", b->dir);
+    poldek_configure(ctx, POLDEK_CONF_CACHEDIR, path);
+
+    n_snprintf(path, sizeof(path), "%s/dest", b->dir);
+    mkdir(path, 0755);
+    poldek_configure(ctx, POLDEK_CONF_SOURCE,
+                     source_new("synthetic", BENCH_IDXTYPE, b->dir, NULL));
+    poldek_configure(ctx, POLDEK_CONF_DESTINATION,
+                     source_new_pathspec("dir", path, NULL));
+    poldek_configure(ctx, POLDEK_CONF_PM, "pset");
+
+    verbose = poldek_set_verbose(-1);
+    if (!poldek_setup(ctx) || !poldek_load_sources(ctx))
+        goto l_end;
+
+    ts = poldek_ts_new(ctx, 0);
+    poldek_ts_set_type(ts, POLDEK_TS_TYPE_INSTALL, "install");
+    poldek_ts_setop(ts, POLDEK_OP_TEST, 1);
+
+    n = b->ntop < b->npkgs ? b->ntop : b->npkgs;
+    for (i=0; i < n; i++) {
+        n_snprintf(name, sizeof(name), "pkg%06d", b->npkgs - 1 - i);
+        poldek_ts_add_pkgmask(ts, name);
+    }
+
+    t0 = now();
+    rc = poldek_ts_run(ts, 0);
+    report("i3_install", b->npkgs, n, t0);
+    if (!rc)
+        printf("# install resolution failed\n");
+
+    poldek_ts_free(ts);
+
+l_end:
+    poldek_set_verbose(verbose);
+    poldek_free(ctx);
+    return rc;
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [-n PACKAGES] [-s SEED] [-t TOP] [-d DIR]\n"
+           "  -n  number of packages in synthetic repository (10000)\n"
+           "  -s  random seed (1)\n"
+           "  -t  number of packages to install in i3 stage (50)\n"
+           "  -d  working directory ($TMPDIR/poldek-bench-PACKAGES-SEED)\n",
+           argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench b;
+    const char *tmpdir;
+    struct stat st;
+    int c;
+
+    memset(&b, 0, sizeof(b));
+    b.npkgs = 10000;
+    b.seed = 1;
+    b.ntop = 50;
+
+    while ((c = getopt(argc, argv, "n:s:t:d:h")) != -1) {
+        switch (c) {
+            case 'n': b.npkgs = atoi(optarg); break;
+            case 's': b.seed = strtoul(optarg, NULL, 10); break;
+            case 't': b.ntop = atoi(optarg); break;
+            case 'd': n_snprintf(b.dir, sizeof(b.dir), "%s", optarg); break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
+    if (b.npkgs < 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (*b.dir == '\0') {
+        if ((tmpdir = getenv("TMPDIR")) == NULL)
+            tmpdir = "/tmp";
+        n_snprintf(b.dir, sizeof(b.dir), "%s/poldek-bench-%d-%u", tmpdir,
+                   b.npkgs, b.seed);
+    }
+
+    if (mkdir(b.dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %m\n", b.dir);
+        exit(EXIT_FAILURE);
+    }
+
+    poldeklib_init();
+    poldek_set_verbose(0);
+
+    pkgdir__make_idxpath(b.idxpath, sizeof(b.idxpath), b.dir, BENCH_IDXTYPE,
+                         pkgdir_type_default_compr(BENCH_IDXTYPE));
+
+    printf("# poldek %s, %s\n", VERSION, b.idxpath);
+    printf("# stage\tpackages\titems\tseconds\tmaxrss_kb\n");
+
+    if (stat(b.idxpath, &st) != 0) {
+        double t0 = now();
+
+        if (!generate(&b)) {
+            fprintf(stderr, "%s: repository generation failed\n", b.dir);
+            exit(EXIT_FAILURE);
+        }
+        report("generate", b.npkgs, b.npkgs, t0);
+    }
+
+    if (!bench_pkgset(&b) || !bench_install(&b))
+        exit(EXIT_FAILURE);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+#include "test.h"
+#include "satsolver.h"
+
+START_TEST (test_empty) {
+    struct i3sat *s = i3sat_new();
+
+    expect_int(i3sat_nvars(s), 0);
+    expect_int(i3sat_solve(s, NULL, NULL, 0), 1);
+
+    i3sat_free(s);
+}
+END_TEST
+
+START_TEST (test_solve) {
+    struct i3sat *s = i3sat_new();
+    int a = i3sat_add_var(s), b = i3sat_add_var(s);
+    int c1[] = { a, b }, c2[] = { -a };
+
+    i3sat_add_clause(s, c1, 2);
+    i3sat_add_clause(s, c2, 1);
+
+    expect_int(i3sat_solve(s, NULL, NULL, 0), 1);
+    expect_int(i3sat_value(s, a), -1);
+    expect_int(i3sat_value(s, b), 1);
+
+    i3sat_free(s);
+}
+END_TEST
+
+NTEST_RUNNER("sat solver", test_empty, test_solve);
@@ -79,7 +79,30 @@ END_TEST
 
 
 
+START_TEST(test_shared_capreq) {
+    tn_alloc *na1 = n_alloc_new(4, TN_ALLOC_OBSTACK);
+    tn_alloc *na2 = n_alloc_new(4, TN_ALLOC_OBSTACK);
+    struct capreq *cr1, *cr2;
+    tn_array *arr;
+
+    cr1 = new_capreq(na1, "baz", 10, "1", "1");
+    cr2 = new_capreq(na2, "baz", 10, "1", "1");
+    fail_ifnot(cr1 == cr2, "equal capreqs are not shared");
+
+    cr2 = capreq_new(na2, "baz", 10, "1", "1", REL_EQ, CAPREQ_PREREQ);
+    fail_if(cr1 == cr2, "capreqs of different flags are shared");
+
+    /* store must not touch shared instance */
+    arr = capreq_arr_new(2);
+    n_array_push(arr, cr1);
+    do_test_capreq_store(na2, arr);
+    expect_int(capreq_epoch(cr1), 10);
+    n_array_free(arr);
+}
+END_TEST
+
 NTEST_RUNNER("store",
              test_cap,
-             test_long_capname
+             test_long_capname,
+             test_shared_capreq
     );
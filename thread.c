@@ -3,12 +3,17 @@
 #endif
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #if HAVE_LIBPTHREAD
 #include <pthread.h>
 #endif
 
 #include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+
+#include "thread.h"
 
 static bool poldek_USE_THREADS = true;
 static bool poldek_THREADING = false;
@@ -35,3 +40,95 @@ void poldek_disable_threads() {
 bool poldek_enabled_threads() {
     return poldek_USE_THREADS;
 }
+
+#define MAX_WORKERS 16
+
+int poldek_nworkers(int nitems, int min_per_worker) {
+#ifndef ENABLE_THREADS
+    (void)nitems;
+    (void)min_per_worker;
+    return 1;
+#else
+    long ncpu;
+    int n;
+
+    if (!poldek_USE_THREADS || poldek_threading_is_on()) /* no nesting */
+        return 1;
+
+    if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 2)
+        return 1;
+
+    if (min_per_worker < 1)
+        min_per_worker = 1;
+
+    n = nitems / min_per_worker;
+    if (n > ncpu)
+        n = ncpu;
+
+    if (n > MAX_WORKERS)
+        n = MAX_WORKERS;
+
+    return n > 1 ? n : 1;
+#endif
+}
+
+#ifdef ENABLE_THREADS
+struct worker {
+    pthread_t         tid;
+    int               no;
+    int               nworkers;
+    poldek_worker_fn  fn;
+    void              *data;
+};
+
+static void *worker_run(void *arg) {
+    struct worker *w = arg;
+
+    w->fn(w->data, w->no, w->nworkers);
+    return NULL;
+}
+#endif
+
+int poldek_run_workers(int nworkers, poldek_worker_fn fn, void *data) {
+#ifdef ENABLE_THREADS
+    struct worker *workers;
+    int i;
+
+    if (nworkers < 2 || !poldek_USE_THREADS) {
+        fn(data, 0, 1);
+        return 1;
+    }
+
+    workers = n_calloc(nworkers, sizeof(*workers));
+    poldek_threading_toggle(true);
+
+    for (i = 1; i < nworkers; i++) {
+        struct worker *w = &workers[i];
+
+        w->no = i;
+        w->nworkers = nworkers;
+        w->fn = fn;
+        w->data = data;
+
+        if (pthread_create(&w->tid, NULL, worker_run, w) != 0)
+            w->fn = NULL;       /* not started, run it below */
+    }
+
+    fn(data, 0, nworkers);
+
+    for (i = 1; i < nworkers; i++) {
+        if (workers[i].fn)
+            pthread_join(workers[i].tid, NULL);
+        else
+            fn(data, i, nworkers);
+    }
+
+    poldek_threading_toggle(false);
+    free(workers);
+    return nworkers;
+#else
+    (void)nworkers;
+    fn(data, 0, 1);
+    return 1;
+#endif
+}
@@ -6,15 +6,24 @@
 #endif
 
 #include <stdbool.h>
+#include "compiler.h"
 
-bool poldek_enabled_threads();
+EXPORT bool poldek_enabled_threads();
 void poldek_disable_threads();
 
+/* number of workers worth to run for nitems (at least min_per_worker each) */
+EXPORT int poldek_nworkers(int nitems, int min_per_worker);
+
+/* runs fn(data, worker_no, nworkers) on nworkers threads (caller's
+   thread is worker 0) and waits for all of them */
+typedef void (*poldek_worker_fn)(void *data, int worker_no, int nworkers);
+EXPORT int poldek_run_workers(int nworkers, poldek_worker_fn fn, void *data);
+
 #ifdef ENABLE_THREADS
 # include <pthread.h>
 
-void poldek_threading_toggle(bool value);
-bool poldek_threading_is_on();
+EXPORT void poldek_threading_toggle(bool value);
+EXPORT bool poldek_threading_is_on();
 
 # define mutex_lock(m) (poldek_threading_is_on() ? pthread_mutex_lock(m) : ((void) 0))
 # define mutex_unlock(m) (poldek_threading_is_on() ? pthread_mutex_unlock(m) : ((void) 0))
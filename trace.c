@@ -0,0 +1,324 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_MALLOPT
+# include <malloc.h>
+#endif
+
+#include <trurl/trurl.h>
+
+#include "compiler.h"
+#include "i18n.h"
+#include "log.h"
+#include "trace.h"
+
+#ifdef ENABLE_THREADS
+# include <pthread.h>
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+# define trace_mutex_lock()   pthread_mutex_lock(&trace_lock)
+# define trace_mutex_unlock() pthread_mutex_unlock(&trace_lock)
+#else
+# define trace_mutex_lock()   ((void) 0)
+# define trace_mutex_unlock() ((void) 0)
+#endif
+
+#define TRACE_MAX_COUNTERS 8
+
+struct trace_counter {
+    const char *name;
+    long       value;
+};
+
+struct trace_span {
+    struct trace_span    *parent;
+    const char           *name;
+    char                 *label;
+    double               start;    /* us since trace start */
+    long                 heap;     /* heap in use at start */
+    int                  ncounters;
+    struct trace_counter counters[TRACE_MAX_COUNTERS];
+};
+
+/* summary entry, per span path */
+struct trace_stat {
+    unsigned             calls;
+    double               total;
+    double               max;
+    long                 heap;
+    int                  ncounters;
+    struct trace_counter counters[TRACE_MAX_COUNTERS];
+};
+
+int poldek__tracing = 0;
+
+static struct {
+    FILE     *stream;
+    char     *path;
+    int      chrome;            /* Chrome trace or summary */
+    int      nevents;
+    double   t0;
+    tn_hash  *stats;
+} tr;
+
+static __thread struct trace_span *current = NULL;
+static __thread int thread_id = 0;
+static int last_thread_id = 0;
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static long heap_inuse(void)
+{
+#ifdef HAVE_MALLINFO2
+    struct mallinfo2 mi = mallinfo2();
+    return mi.arena - mi.fordblks + mi.hblkhd;
+#elif defined(HAVE_MALLOPT)
+    struct mallinfo mi = mallinfo();
+    return mi.arena - mi.fordblks + mi.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+static int get_thread_id(void)
+{
+    if (thread_id == 0)
+        thread_id = __sync_add_and_fetch(&last_thread_id, 1);
+
+    return thread_id;
+}
+
+int poldek_trace_open(const char *path)
+{
+    const char *ext;
+
+    if (tr.stream)
+        poldek_trace_close();
+
+    if ((tr.stream = fopen(path, "w")) == NULL) {
+        logn(LOGERR, "%s: %m", path);
+        return 0;
+    }
+
+    tr.path = n_strdup(path);
+    tr.chrome = (ext = strrchr(path, '.')) && n_str_eq(ext, ".json");
+    tr.nevents = 0;
+    tr.t0 = now_us();
+
+    if (tr.chrome)
+        fprintf(tr.stream, "{\"traceEvents\":[\n");
+    else
+        tr.stats = n_hash_new(64, free);
+
+    poldek__tracing = 1;
+    return 1;
+}
+
+static void add_counter(struct trace_counter *counters, int *ncounters,
+                        const char *name, long n)
+{
+    int i;
+
+    for (i=0; i < *ncounters; i++) {
+        if (counters[i].name == name || n_str_eq(counters[i].name, name)) {
+            counters[i].value += n;
+            return;
+        }
+    }
+
+    if (*ncounters < TRACE_MAX_COUNTERS) {
+        counters[*ncounters].name = name;
+        counters[*ncounters].value = n;
+        (*ncounters)++;
+    }
+}
+
+static void write_summary(void)
+{
+    tn_array *keys;
+    int i, j;
+
+    keys = n_hash_keys(tr.stats);
+    n_array_sort(keys);
+
+    fprintf(tr.stream, "# span\tcalls\ttotal_s\tmax_s\theap_kb\tcounters\n");
+    for (i=0; i < n_array_size(keys); i++) {
+        const char *key = n_array_nth(keys, i);
+        struct trace_stat *st = n_hash_get(tr.stats, key);
+
+        fprintf(tr.stream, "%s\t%u\t%.6f\t%.6f\t%ld\t", key, st->calls,
+                st->total / 1e6, st->max / 1e6, st->heap / 1024);
+
+        for (j=0; j < st->ncounters; j++)
+            fprintf(tr.stream, "%s%s=%ld", j ? "," : "",
+                    st->counters[j].name, st->counters[j].value);
+        fprintf(tr.stream, "\n");
+    }
+
+    n_array_free(keys);
+}
+
+void poldek_trace_close(void)
+{
+    if (tr.stream == NULL)
+        return;
+
+    poldek__tracing = 0;
+
+    trace_mutex_lock();
+    if (tr.chrome) {
+        fprintf(tr.stream, "\n]}\n");
+
+    } else {
+        write_summary();
+        n_hash_free(tr.stats);
+        tr.stats = NULL;
+    }
+
+    if (fclose(tr.stream) != 0)
+        logn(LOGERR, "%s: %m", tr.path);
+
+    tr.stream = NULL;
+    n_cfree(&tr.path);
+    trace_mutex_unlock();
+}
+
+struct trace_span *trace__begin(const char *name, const char *label)
+{
+    struct trace_span *span;
+
+    span = n_calloc(1, sizeof(*span));
+    span->name = name;
+    span->label = label ? n_strdup(label) : NULL;
+    span->heap = heap_inuse();
+    span->start = now_us() - tr.t0;
+
+    span->parent = current;
+    current = span;
+
+    return span;
+}
+
+void trace__count(struct trace_span *span, const char *counter, long n)
+{
+    if (span == NULL && (span = current) == NULL)
+        return;
+
+    add_counter(span->counters, &span->ncounters, counter, n);
+}
+
+static void json_puts(FILE *stream, const char *s)
+{
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(stream, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(stream, "\\u%04x", *s);
+        else
+            fputc(*s, stream);
+    }
+}
+
+static void write_event(const struct trace_span *span, double dur, long heap)
+{
+    int i;
+
+    fprintf(tr.stream, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+            "\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"heap_kb\":%ld",
+            tr.nevents++ ? ",\n" : "", span->name, span->start, dur,
+            (int)getpid(), get_thread_id(), heap / 1024);
+
+    if (span->label) {
+        fprintf(tr.stream, ",\"label\":\"");
+        json_puts(tr.stream, span->label);
+        fprintf(tr.stream, "\"");
+    }
+
+    for (i=0; i < span->ncounters; i++)
+        fprintf(tr.stream, ",\"%s\":%ld", span->counters[i].name,
+                span->counters[i].value);
+
+    fprintf(tr.stream, "}}");
+}
+
+static void update_stat(const struct trace_span *span, double dur, long heap)
+{
+    const struct trace_span *sp;
+    struct trace_stat *st;
+    char key[256];
+    int i, n = 0;
+
+    /* key is path of span names, root first */
+    for (sp = span; sp; sp = sp->parent)
+        n += strlen(sp->name) + 1;
+
+    if (n > (int)sizeof(key))
+        n = sizeof(key);
+
+    key[--n] = '\0';
+    for (sp = span; sp && n > 0; sp = sp->parent) {
+        int len = strlen(sp->name);
+
+        if (len > n)
+            break;
+
+        n -= len;
+        memcpy(&key[n], sp->name, len);
+        if (n > 0)
+            key[--n] = '/';
+    }
+
+    if ((st = n_hash_get(tr.stats, &key[n])) == NULL) {
+        st = n_calloc(1, sizeof(*st));
+        n_hash_insert(tr.stats, &key[n], st);
+    }
+
+    st->calls++;
+    st->total += dur;
+    st->heap += heap;
+    if (dur > st->max)
+        st->max = dur;
+
+    for (i=0; i < span->ncounters; i++)
+        add_counter(st->counters, &st->ncounters, span->counters[i].name,
+                    span->counters[i].value);
+}
+
+void trace__end(struct trace_span *span)
+{
+    double dur = now_us() - tr.t0 - span->start;
+    long heap = heap_inuse() - span->heap;
+
+    if (current == span)
+        current = span->parent;
+
+    trace_mutex_lock();
+    if (tr.stream) {            /* still open? */
+        if (tr.chrome)
+            write_event(span, dur, heap);
+        else
+            update_stat(span, dur, heap);
+    }
+    trace_mutex_unlock();
+
+    n_cfree(&span->label);
+    free(span);
+}
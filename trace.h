@@ -0,0 +1,49 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+*/
+
+#ifndef POLDEK_TRACE_H
+#define POLDEK_TRACE_H
+
+#include "compiler.h"
+
+/*
+  Lightweight spans for profiling on production hosts (--trace=FILE).
+
+  Spans nest per thread; each one records wall time, heap growth and
+  named counters. FILE ending with ".json" gets Chrome trace events
+  (loadable by chrome://tracing or ui.perfetto.dev), any other FILE
+  gets per span summary (calls, total/max time, counter sums).
+
+  Everything is a no-op unless tracing has been enabled.
+*/
+
+EXPORT int poldek_trace_open(const char *path);
+EXPORT void poldek_trace_close(void);
+
+struct trace_span;
+
+extern int poldek__tracing;
+
+struct trace_span *trace__begin(const char *name, const char *label);
+void trace__end(struct trace_span *span);
+void trace__count(struct trace_span *span, const char *counter, long n);
+
+/* name must be a string literal (or otherwise live forever),
+   label, if any, is copied */
+#define trace_begin(name) \
+    (poldek__tracing ? trace__begin(name, NULL) : NULL)
+
+#define trace_begin_l(name, label) \
+    (poldek__tracing ? trace__begin(name, label) : NULL)
+
+#define trace_end(span) \
+    do { if (span) trace__end(span); } while (0)
+
+/* NULL span means the innermost span of the calling thread */
+#define trace_count(span, counter, n) \
+    do { if (poldek__tracing) trace__count(span, counter, n); } while (0)
+
+#endif /* POLDEK_TRACE_H */